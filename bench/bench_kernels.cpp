@@ -0,0 +1,320 @@
+/*
+Benchmark of the tesseroid kernels in grav_tess.cpp.
+
+Compares every kernel with a reference implementation that evaluates the
+trigonometric functions of the nodes in the innermost loop and uses
+pow(l_sqr, 2.5), like the kernels did before the loops were restructured.
+
+Usage:
+
+    make bench
+    ./bench_kernels [LON_ORDER/LAT_ORDER/R_ORDER]
+
+Prints the time per kernel evaluation of both versions, the speedup and the
+largest relative difference between the results.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "../src/constants.h"
+#include "../src/geometry.h"
+#include "../src/glq.h"
+#include "../src/grav_tess.h"
+#include "../src/grav_tess_simd.h"
+#include "../src/grav_tess_fixed.h"
+
+
+/* Number of computation points used for each kernel */
+#define BENCH_POINTS 200
+
+/* Minimum time spent timing each kernel, in seconds */
+#define BENCH_MIN_TIME 0.2
+
+/* Components of the gravity gradient tensor */
+enum {GXX, GXY, GXZ, GYY, GYZ, GZZ};
+
+
+/* Reference implementation of any combination of tensor components */
+static void ref_tess_comps(TESSEROID tess, double lonp, double latp, double rp,
+    GLQ glq_lon, GLQ glq_lat, GLQ glq_r, const int *comps, int ncomps,
+    double *res)
+{
+    double d2r = PI/180., l_sqr, kphi, coslatp, coslatc, sinlatp, sinlatc,
+           coslon, sinlon, cospsi, rc, kappa, deltax, deltay, deltaz, w, g;
+    int i, j, k, c;
+
+    coslatp = cos(d2r*latp);
+    sinlatp = sin(d2r*latp);
+    for(c = 0; c < ncomps; c++)
+    {
+        res[c] = 0;
+    }
+    for(k = 0; k < glq_lon.order; k++)
+    {
+        for(j = 0; j < glq_lat.order; j++)
+        {
+            for(i = 0; i < glq_r.order; i++)
+            {
+                rc = glq_r.nodes[i];
+                sinlatc = sin(d2r*glq_lat.nodes[j]);
+                coslatc = cos(d2r*glq_lat.nodes[j]);
+                coslon = cos(d2r*(lonp - glq_lon.nodes[k]));
+                sinlon = sin(d2r*(glq_lon.nodes[k] - lonp));
+                cospsi = sinlatp*sinlatc + coslatp*coslatc*coslon;
+                l_sqr = rp*rp + rc*rc - 2*rp*rc*cospsi;
+                kphi = coslatp*sinlatc - sinlatp*coslatc*coslon;
+                kappa = rc*rc*coslatc;
+                deltax = rc*kphi;
+                deltay = rc*coslatc*sinlon;
+                deltaz = rc*cospsi - rp;
+                w = glq_lon.weights[k]*glq_lat.weights[j]*glq_r.weights[i];
+                for(c = 0; c < ncomps; c++)
+                {
+                    switch(comps[c])
+                    {
+                        case GXX: g = 3*deltax*deltax - l_sqr; break;
+                        case GXY: g = 3*deltax*deltay; break;
+                        case GXZ: g = 3*deltax*deltaz; break;
+                        case GYY: g = 3*deltay*deltay - l_sqr; break;
+                        case GYZ: g = 3*deltay*deltaz; break;
+                        default: g = 3*deltaz*deltaz - l_sqr; break;
+                    }
+                    res[c] += w*kappa*g/pow(l_sqr, 2.5);
+                }
+            }
+        }
+    }
+    for(c = 0; c < ncomps; c++)
+    {
+        res[c] *= SI2EOTVOS*G*tess.density*d2r*(tess.e - tess.w)*d2r*
+                  (tess.n - tess.s)*(tess.r2 - tess.r1)*0.125;
+    }
+}
+
+
+/* Node table of the benchmark tesseroid */
+static TESS_NODES *bench_nodes = NULL;
+
+/* Node table version of tess_ggt with the signature of the other kernels */
+static void bench_ggt_nodes(TESSEROID tess, double lonp, double latp,
+    double rp, GLQ glq_lon, GLQ glq_lat, GLQ glq_r, double *res)
+{
+    tess_fixed_nodes(&tess_ggt, bench_nodes->lon_order,
+                     bench_nodes->lat_order, bench_nodes->r_order)(
+        bench_nodes, 0, lonp, latp, rp, res);
+}
+
+
+/* A kernel under test, either a single or a multiple component one */
+typedef struct bench_kernel_struct
+{
+    const char *name;
+    double (*single)(TESSEROID, double, double, double, GLQ, GLQ, GLQ);
+    void (*multi)(TESSEROID, double, double, double, GLQ, GLQ, GLQ, double*);
+    int ncomps;
+    int comps[6];
+    int isa; /* use the version of the kernel for this instruction set */
+    int fixed; /* use the version specialized for the GLQ orders */
+} BENCH_KERNEL;
+
+
+static const BENCH_KERNEL kernels[] = {
+    {"tess_gxx", tess_gxx, NULL, 1, {GXX}, TESS_ISA_SCALAR},
+    {"tess_gxy", tess_gxy, NULL, 1, {GXY}, TESS_ISA_SCALAR},
+    {"tess_gxz", tess_gxz, NULL, 1, {GXZ}, TESS_ISA_SCALAR},
+    {"tess_gyy", tess_gyy, NULL, 1, {GYY}, TESS_ISA_SCALAR},
+    {"tess_gyz", tess_gyz, NULL, 1, {GYZ}, TESS_ISA_SCALAR},
+    {"tess_gzz", tess_gzz, NULL, 1, {GZZ}, TESS_ISA_SCALAR},
+    {"tess_gxz_gyz_gzz", NULL, tess_gxz_gyz_gzz, 3, {GXZ, GYZ, GZZ},
+     TESS_ISA_SCALAR},
+    {"tess_gxx_gxy_gxz", NULL, tess_gxx_gxy_gxz, 3, {GXX, GXY, GXZ},
+     TESS_ISA_SCALAR},
+    {"tess_gxy_gyy_gyz", NULL, tess_gxy_gyy_gyz, 3, {GXY, GYY, GYZ},
+     TESS_ISA_SCALAR},
+    {"tess_ggt", NULL, tess_ggt, 6, {GXX, GXY, GXZ, GYY, GYZ, GZZ},
+     TESS_ISA_SCALAR},
+    {"tess_gxz_gyz_gzz_avx2", NULL, tess_gxz_gyz_gzz, 3, {GXZ, GYZ, GZZ},
+     TESS_ISA_AVX2},
+    {"tess_ggt_avx2", NULL, tess_ggt, 6, {GXX, GXY, GXZ, GYY, GYZ, GZZ},
+     TESS_ISA_AVX2},
+    {"tess_gxz_gyz_gzz_avx512", NULL, tess_gxz_gyz_gzz, 3,
+     {GXZ, GYZ, GZZ}, TESS_ISA_AVX512},
+    {"tess_ggt_avx512", NULL, tess_ggt, 6,
+     {GXX, GXY, GXZ, GYY, GYZ, GZZ}, TESS_ISA_AVX512},
+    {"tess_ggt_nodes", NULL, bench_ggt_nodes, 6,
+     {GXX, GXY, GXZ, GYY, GYZ, GZZ}, TESS_ISA_SCALAR},
+    {"tess_gzz_fixed", tess_gzz, NULL, 1, {GZZ}, TESS_ISA_SCALAR, 1},
+    {"tess_gxz_gyz_gzz_fixed", NULL, tess_gxz_gyz_gzz, 3, {GXZ, GYZ, GZZ},
+     TESS_ISA_SCALAR, 1},
+    {"tess_ggt_fixed", NULL, tess_ggt, 6, {GXX, GXY, GXZ, GYY, GYZ, GZZ},
+     TESS_ISA_SCALAR, 1}
+};
+
+
+/* Wall clock time in seconds */
+static double wall_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+
+int main(int argc, char **argv)
+{
+    TESSEROID tess = {0};
+    TESS_MODEL *model;
+    GLQ *glq_lon, *glq_lat, *glq_r;
+    double lons[BENCH_POINTS], lats[BENCH_POINTS], rs[BENCH_POINTS];
+    double res[6], ref[6], sink = 0, start, t_new, t_ref, diff, maxdiff;
+    int lon_order = 2, lat_order = 2, r_order = 2, p, c, reps, nk;
+    const BENCH_KERNEL *kern;
+    BENCH_KERNEL chosen;
+
+    if(argc > 1 &&
+       sscanf(argv[1], "%d/%d/%d", &lon_order, &lat_order, &r_order) != 3)
+    {
+        fprintf(stderr, "Usage: %s [LON_ORDER/LAT_ORDER/R_ORDER]\n", argv[0]);
+        return 1;
+    }
+
+    tess.density = 1;
+    tess.w = 10;
+    tess.e = 11;
+    tess.s = 45;
+    tess.n = 46;
+    tess.r1 = MEAN_EARTH_RADIUS - 20000;
+    tess.r2 = MEAN_EARTH_RADIUS - 1000;
+    glq_lon = glq_new(lon_order, tess.w, tess.e);
+    glq_lat = glq_new(lat_order, tess.s, tess.n);
+    glq_r = glq_new(r_order, tess.r1, tess.r2);
+    if(glq_lon == NULL || glq_lat == NULL || glq_r == NULL)
+    {
+        fprintf(stderr, "failed to create GLQ structures\n");
+        return 1;
+    }
+    model = tess_model_from_array(&tess, 1);
+    bench_nodes = tess_nodes_new(model, 1, lon_order, lat_order, r_order);
+    if(bench_nodes == NULL)
+    {
+        fprintf(stderr, "failed to create the node table\n");
+        return 1;
+    }
+
+    /* Points around the tesseroid at satellite and at ground altitude */
+    srand(42);
+    for(p = 0; p < BENCH_POINTS; p++)
+    {
+        lons[p] = 5 + 11.0*rand()/RAND_MAX;
+        lats[p] = 40 + 11.0*rand()/RAND_MAX;
+        rs[p] = MEAN_EARTH_RADIUS + (p % 2 ? 400000 : 10000);
+    }
+
+    printf("# GLQ order: %d lon / %d lat / %d r\n", lon_order, lat_order,
+           r_order);
+    printf("# %-23s %12s %12s %8s %12s\n", "kernel", "ref ns/eval",
+           "new ns/eval", "speedup", "max rel diff");
+    for(nk = 0; nk < (int)(sizeof(kernels)/sizeof(kernels[0])); nk++)
+    {
+        kern = &kernels[nk];
+        if(kern->isa > tess_isa_detect())
+        {
+            printf("  %-23s not supported by this processor\n", kern->name);
+            continue;
+        }
+        if(kern->fixed)
+        {
+            if(!tess_fixed_supported(lon_order, lat_order, r_order))
+            {
+                printf("  %-23s not specialized for these orders\n",
+                       kern->name);
+                continue;
+            }
+            chosen = *kern;
+            if(chosen.single != NULL)
+                chosen.single = tess_fixed_single(chosen.single, lon_order,
+                                                  lat_order, r_order);
+            else
+                chosen.multi = tess_fixed_multi(chosen.multi, lon_order,
+                                                lat_order, r_order);
+            kern = &chosen;
+        }
+        else if(kern->isa != TESS_ISA_SCALAR)
+        {
+            chosen = *kern;
+            chosen.multi = tess_simd_kernel(chosen.multi, chosen.isa);
+            kern = &chosen;
+        }
+
+        /* Largest difference to the reference */
+        maxdiff = 0;
+        for(p = 0; p < BENCH_POINTS; p++)
+        {
+            ref_tess_comps(tess, lons[p], lats[p], rs[p], *glq_lon, *glq_lat,
+                           *glq_r, kern->comps, kern->ncomps, ref);
+            if(kern->single != NULL)
+                res[0] = kern->single(tess, lons[p], lats[p], rs[p], *glq_lon,
+                                      *glq_lat, *glq_r);
+            else
+                kern->multi(tess, lons[p], lats[p], rs[p], *glq_lon, *glq_lat,
+                            *glq_r, res);
+            for(c = 0; c < kern->ncomps; c++)
+            {
+                diff = fabs(res[c] - ref[c])/fabs(ref[c]);
+                if(diff > maxdiff)
+                    maxdiff = diff;
+            }
+        }
+
+        /* Time the reference */
+        reps = 0;
+        start = wall_time();
+        do
+        {
+            for(p = 0; p < BENCH_POINTS; p++)
+            {
+                ref_tess_comps(tess, lons[p], lats[p], rs[p], *glq_lon,
+                               *glq_lat, *glq_r, kern->comps, kern->ncomps,
+                               ref);
+                sink += ref[0];
+            }
+            reps++;
+        } while(wall_time() - start < BENCH_MIN_TIME);
+        t_ref = (wall_time() - start)/(reps*BENCH_POINTS);
+
+        /* Time the kernel */
+        reps = 0;
+        start = wall_time();
+        do
+        {
+            for(p = 0; p < BENCH_POINTS; p++)
+            {
+                if(kern->single != NULL)
+                    res[0] = kern->single(tess, lons[p], lats[p], rs[p],
+                                          *glq_lon, *glq_lat, *glq_r);
+                else
+                    kern->multi(tess, lons[p], lats[p], rs[p], *glq_lon,
+                                *glq_lat, *glq_r, res);
+                sink += res[0];
+            }
+            reps++;
+        } while(wall_time() - start < BENCH_MIN_TIME);
+        t_new = (wall_time() - start)/(reps*BENCH_POINTS);
+
+        printf("  %-23s %12.1f %12.1f %7.2fx %12.3g\n", kern->name,
+                   1e9*t_ref, 1e9*t_new, t_ref/t_new, maxdiff);
+    }
+    /* Keep the compiler from removing the timed calls */
+    if(sink == 0)
+        printf("# all results are zero\n");
+
+    glq_free(glq_lon);
+    glq_free(glq_lat);
+    glq_free(glq_r);
+    tess_nodes_free(bench_nodes);
+    tess_model_free(model);
+    return 0;
+}
@@ -0,0 +1,710 @@
+/*
+Microbenchmarks of the kernels, the drivers and the parsers.
+
+Times the building blocks of a run one by one, so that a change to any of
+them can be measured:
+
+    kernel/...   the kernels of grav_tess.cpp for several GLQ orders, in the
+                 versions the programs use (generic, specialized for the
+                 orders and SIMD)
+    adapt/...    calc_tess_model_adapt_triple with points at several
+                 distances from a tesseroid, from 1 km above it to satellite
+                 altitude. The closer the point, the more the tesseroid is
+                 divided.
+    glq/...      glq_set_limits
+    rotate/...   conv_vect_cblas_precalc and conv_vect_fast
+    parse/...    read_mag_tess_model on a model file and the parsing of the
+                 lines of computation points
+    format/...   formatting of the results
+
+Usage:
+
+    make bench
+    ./bench_suite [--save=FILE] [--compare=FILE] [--tolerance=X] [PATTERN]
+
+Prints the time per evaluation in ns of every benchmark whose name contains
+PATTERN. --save writes the times to FILE as a baseline. --compare prints
+them next to the times of a baseline and exits with 1 if a benchmark is
+slower than the baseline by more than the relative tolerance (default 0.25).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "../src/constants.h"
+#include "../src/geometry.h"
+#include "../src/glq.h"
+#include "../src/grav_tess.h"
+#include "../src/grav_tess_simd.h"
+#include "../src/grav_tess_fixed.h"
+#include "../src/linalg.h"
+#include "../src/logger.h"
+#include "../src/parsers.h"
+#include "../src/text_io.h"
+
+
+/* Number of computation points used for each kernel */
+#define BENCH_POINTS 200
+
+/* Minimum time spent timing each benchmark, in seconds */
+#define BENCH_MIN_TIME 0.2
+
+/* Number of tesseroids of the model file of the parsing benchmarks */
+#define BENCH_MODEL_SIZE 100000
+
+/* Number of lines of computation points of the parsing benchmarks */
+#define BENCH_LINES 100000
+
+/* Largest number of benchmarks */
+#define BENCH_MAX 128
+
+/* Largest length of the name of a benchmark */
+#define BENCH_NAME_SIZE 64
+
+
+/* Does n times the unit of work of a benchmark */
+typedef void (*BENCH_FUNC)(void *data, long n);
+
+
+/* Time per evaluation of the benchmarks that ran */
+typedef struct bench_results_struct
+{
+    int size;
+    char names[BENCH_MAX][BENCH_NAME_SIZE];
+    double ns[BENCH_MAX];
+} BENCH_RESULTS;
+
+
+/* Settings of the run */
+typedef struct bench_run_struct
+{
+    const char *pattern; /* only run the benchmarks with this in the name */
+    BENCH_RESULTS results;
+    const BENCH_RESULTS *baseline; /* NULL if not comparing */
+    double tolerance; /* relative slowdown allowed against the baseline */
+    int slower; /* number of benchmarks slower than the baseline */
+} BENCH_RUN;
+
+
+/* Keeps the compiler from removing the timed calls */
+static double sink = 0;
+
+
+/* Wall clock time in seconds */
+static double wall_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+
+/* Find a benchmark in results. Returns -1 if it is not there. */
+static int find_result(const BENCH_RESULTS *results, const char *name)
+{
+    int i;
+
+    for(i = 0; i < results->size; i++)
+    {
+        if(!strcmp(results->names[i], name))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/* Time a benchmark that does evals evaluations per unit of work and print
+   the time per evaluation. The number of units doubles until they take
+   BENCH_MIN_TIME. */
+static void bench(BENCH_RUN *run, const char *name, BENCH_FUNC func,
+    void *data, long evals)
+{
+    BENCH_RESULTS *results = &(run->results);
+    double start, elapsed, ns, base;
+    long n;
+    int b;
+
+    if(run->pattern != NULL && strstr(name, run->pattern) == NULL)
+    {
+        return;
+    }
+    /* Once to warm up the caches */
+    func(data, 1);
+    for(n = 1; ; n *= 2)
+    {
+        start = wall_time();
+        func(data, n);
+        elapsed = wall_time() - start;
+        if(elapsed >= BENCH_MIN_TIME)
+        {
+            break;
+        }
+    }
+    ns = 1e9*elapsed/((double)n*evals);
+    printf("  %-40s %12.1f", name, ns);
+    if(run->baseline != NULL)
+    {
+        b = find_result(run->baseline, name);
+        if(b < 0)
+        {
+            printf(" %12s", "new");
+        }
+        else
+        {
+            base = run->baseline->ns[b];
+            printf(" %12.1f %+7.1f%%", base, 100*(ns - base)/base);
+            if(ns > base*(1 + run->tolerance))
+            {
+                printf(" slower");
+                run->slower++;
+            }
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+    if(results->size < BENCH_MAX)
+    {
+        strncpy(results->names[results->size], name, BENCH_NAME_SIZE - 1);
+        results->names[results->size][BENCH_NAME_SIZE - 1] = '\0';
+        results->ns[results->size] = ns;
+        results->size++;
+    }
+}
+
+
+/* Read the times of a baseline. Returns 1 if it can't be read. */
+static int read_baseline(const char *fname, BENCH_RESULTS *results)
+{
+    FILE *file;
+    char line[256];
+
+    file = fopen(fname, "r");
+    if(file == NULL)
+    {
+        return 1;
+    }
+    results->size = 0;
+    while(fgets(line, sizeof(line), file) != NULL &&
+          results->size < BENCH_MAX)
+    {
+        if(line[0] == '#')
+        {
+            continue;
+        }
+        if(sscanf(line, "%63s %lf", results->names[results->size],
+                  &(results->ns[results->size])) == 2)
+        {
+            results->size++;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+
+/* Write the times as a baseline. Returns 1 if there was an error. */
+static int write_baseline(const char *fname, const BENCH_RESULTS *results)
+{
+    FILE *file;
+    int i;
+
+    file = fopen(fname, "w");
+    if(file == NULL)
+    {
+        return 1;
+    }
+    fprintf(file, "# bench_suite baseline: benchmark and ns per evaluation\n");
+    for(i = 0; i < results->size; i++)
+    {
+        fprintf(file, "%s %.6g\n", results->names[i], results->ns[i]);
+    }
+    return fclose(file) != 0;
+}
+
+
+/* A tesseroid, GLQ structures and computation points around it */
+typedef struct bench_tess_struct
+{
+    TESSEROID tess;
+    GLQ *glq_lon, *glq_lat, *glq_r;
+    double lons[BENCH_POINTS], lats[BENCH_POINTS], rs[BENCH_POINTS];
+    TESS_SINGLE_KERNEL single; /* kernel under test, single or multi */
+    TESS_MULTI_KERNEL multi;
+    double ratio; /* distance-size ratio of the adaptative driver */
+    TESS_ADAPT adapt;
+} BENCH_TESS;
+
+
+/* Make the tesseroid and GLQ structures of the given orders. The points are
+   around the tesseroid at satellite and at ground altitude. Returns 1 if
+   there was an error with allocation. */
+static int init_bench_tess(BENCH_TESS *b, int lon_order, int lat_order,
+    int r_order)
+{
+    int p;
+
+    memset(b, 0, sizeof(BENCH_TESS));
+    b->tess.density = 1;
+    b->tess.w = 10;
+    b->tess.e = 11;
+    b->tess.s = 45;
+    b->tess.n = 46;
+    b->tess.r1 = MEAN_EARTH_RADIUS - 20000;
+    b->tess.r2 = MEAN_EARTH_RADIUS - 1000;
+    b->glq_lon = glq_new(lon_order, b->tess.w, b->tess.e);
+    b->glq_lat = glq_new(lat_order, b->tess.s, b->tess.n);
+    b->glq_r = glq_new(r_order, b->tess.r1, b->tess.r2);
+    if(b->glq_lon == NULL || b->glq_lat == NULL || b->glq_r == NULL)
+    {
+        return 1;
+    }
+    srand(42);
+    for(p = 0; p < BENCH_POINTS; p++)
+    {
+        b->lons[p] = 5 + 11.0*rand()/RAND_MAX;
+        b->lats[p] = 40 + 11.0*rand()/RAND_MAX;
+        b->rs[p] = MEAN_EARTH_RADIUS + (p % 2 ? 400000 : 10000);
+    }
+    b->adapt.max_depth = TESS_ADAPT_DEFAULT_DEPTH;
+    return 0;
+}
+
+
+/* Free the GLQ structures of a benchmark tesseroid */
+static void free_bench_tess(BENCH_TESS *b)
+{
+    if(b->glq_lon != NULL)
+        glq_free(b->glq_lon);
+    if(b->glq_lat != NULL)
+        glq_free(b->glq_lat);
+    if(b->glq_r != NULL)
+        glq_free(b->glq_r);
+}
+
+
+/* Evaluate the kernel on all points n times */
+static void run_kernel(void *data, long n)
+{
+    BENCH_TESS *b = (BENCH_TESS *)data;
+    double res[6];
+    long i;
+    int p;
+
+    for(i = 0; i < n; i++)
+    {
+        for(p = 0; p < BENCH_POINTS; p++)
+        {
+            if(b->single != NULL)
+            {
+                res[0] = b->single(b->tess, b->lons[p], b->lats[p], b->rs[p],
+                                   *b->glq_lon, *b->glq_lat, *b->glq_r);
+            }
+            else
+            {
+                b->multi(b->tess, b->lons[p], b->lats[p], b->rs[p],
+                         *b->glq_lon, *b->glq_lat, *b->glq_r, res);
+            }
+            sink += res[0];
+        }
+    }
+}
+
+
+/* Calculate the tesseroid adaptatively at the first point n times */
+static void run_adapt(void *data, long n)
+{
+    BENCH_TESS *b = (BENCH_TESS *)data;
+    double res[3];
+    long i;
+
+    for(i = 0; i < n; i++)
+    {
+        calc_tess_model_adapt_triple(&(b->tess), 1, b->lons[0], b->lats[0],
+                                     b->rs[0], b->glq_lon, b->glq_lat,
+                                     b->glq_r, b->multi, b->ratio,
+                                     &(b->adapt), res);
+        sink += res[0];
+    }
+}
+
+
+/* Scale the nodes of the longitude to a new tesseroid n times */
+static void run_glq(void *data, long n)
+{
+    BENCH_TESS *b = (BENCH_TESS *)data;
+    long i;
+
+    for(i = 0; i < n; i++)
+    {
+        glq_set_limits(b->tess.w + 1e-9*(i & 7), b->tess.e, b->glq_lon);
+    }
+    sink += b->glq_lon->nodes[0];
+}
+
+
+/* Rotate a vector from a tesseroid to every point n times, with BLAS or in
+   closed form */
+typedef struct bench_rotate_struct
+{
+    double trig[BENCH_POINTS][4]; /* cos and sin of colatitude, longitude */
+    int fast;
+} BENCH_ROTATE;
+
+static void run_rotate(void *data, long n)
+{
+    BENCH_ROTATE *b = (BENCH_ROTATE *)data;
+    double vect[3] = {1, 2, 3}, res[3];
+    const double *t1 = b->trig[0], *t2;
+    long i;
+    int p;
+
+    for(i = 0; i < n; i++)
+    {
+        for(p = 0; p < BENCH_POINTS; p++)
+        {
+            t2 = b->trig[p];
+            if(b->fast)
+                conv_vect_fast(vect, t1[0], t1[1], t1[2], t1[3], t2[0], t2[1],
+                               t2[2], t2[3], res);
+            else
+                conv_vect_cblas_precalc(vect, t1[0], t1[1], t1[2], t1[3],
+                                        t2[0], t2[1], t2[2], t2[3], res);
+            sink += res[0];
+        }
+    }
+}
+
+
+/* Text of a model file and of a file of computation points */
+typedef struct bench_text_struct
+{
+    FILE *model; /* temporary model file */
+    char *lines; /* lines of computation points, one after the other */
+    int nlines;
+    double values[BENCH_LINES]; /* results to format */
+    int format;
+    char *out; /* room for the formatted results */
+} BENCH_TEXT;
+
+
+/* Read the model file n times */
+static void run_read_model(void *data, long n)
+{
+    BENCH_TEXT *b = (BENCH_TEXT *)data;
+    TESSEROID *model;
+    long i;
+    int size;
+
+    for(i = 0; i < n; i++)
+    {
+        rewind(b->model);
+        model = read_mag_tess_model(b->model, &size);
+        sink += size;
+        free(model);
+    }
+}
+
+
+/* Parse the lines of computation points n times, with text_parse_doubles
+   or with sscanf as the programs did before */
+static void run_parse_points(void *data, long n)
+{
+    BENCH_TEXT *b = (BENCH_TEXT *)data;
+    double coords[3];
+    const char *line;
+    long i;
+    int l;
+
+    for(i = 0; i < n; i++)
+    {
+        line = b->lines;
+        for(l = 0; l < b->nlines; l++)
+        {
+            text_parse_doubles(line, 3, coords);
+            sink += coords[2];
+            line += strlen(line) + 1;
+        }
+    }
+}
+
+static void run_sscanf_points(void *data, long n)
+{
+    BENCH_TEXT *b = (BENCH_TEXT *)data;
+    double coords[3];
+    const char *line;
+    long i;
+    int l;
+
+    for(i = 0; i < n; i++)
+    {
+        line = b->lines;
+        for(l = 0; l < b->nlines; l++)
+        {
+            sscanf(line, "%lf %lf %lf", &coords[0], &coords[1], &coords[2]);
+            sink += coords[2];
+            line += strlen(line) + 1;
+        }
+    }
+}
+
+
+/* Format the results n times, with text_format_double or with printf as
+   the programs did before */
+static void run_format(void *data, long n)
+{
+    BENCH_TEXT *b = (BENCH_TEXT *)data;
+    char *out;
+    long i;
+    int l;
+
+    for(i = 0; i < n; i++)
+    {
+        out = b->out;
+        for(l = 0; l < BENCH_LINES; l++)
+        {
+            out += text_format_double(out, b->values[l], b->format);
+        }
+        sink += out - b->out;
+    }
+}
+
+static void run_printf(void *data, long n)
+{
+    BENCH_TEXT *b = (BENCH_TEXT *)data;
+    char *out;
+    long i;
+    int l;
+
+    for(i = 0; i < n; i++)
+    {
+        out = b->out;
+        for(l = 0; l < BENCH_LINES; l++)
+        {
+            out += sprintf(out, "%.15g", b->values[l]);
+        }
+        sink += out - b->out;
+    }
+}
+
+
+/* Make the model file and the computation points of the parsing
+   benchmarks. Returns 1 if there was an error. */
+static int init_bench_text(BENCH_TEXT *b)
+{
+    char *line;
+    int i;
+
+    b->model = tmpfile();
+    b->lines = (char *)malloc(BENCH_LINES*64);
+    b->out = (char *)malloc(BENCH_LINES*TEXT_DOUBLE_SIZE);
+    if(b->model == NULL || b->lines == NULL || b->out == NULL)
+    {
+        return 1;
+    }
+    srand(7);
+    fprintf(b->model, "# W E S N TOP BOTTOM DENSITY SUSCEPT BX BY BZ\n");
+    for(i = 0; i < BENCH_MODEL_SIZE; i++)
+    {
+        fprintf(b->model, "%g %g %g %g %g %g %g %.4f %.3f %.3f %.3f\n",
+                -180 + 0.25*(i % 1440), -179.75 + 0.25*(i % 1440),
+                -90 + 0.25*(i/1440), -89.75 + 0.25*(i/1440), -1000.0,
+                -20000.0, 1.0, 0.05*rand()/RAND_MAX,
+                20000.0*rand()/RAND_MAX - 10000, 5000.0*rand()/RAND_MAX,
+                -40000.0 - 10000.0*rand()/RAND_MAX);
+    }
+    fflush(b->model);
+    line = b->lines;
+    for(i = 0; i < BENCH_LINES; i++)
+    {
+        /* Points of a grid as written by %.15g */
+        line += sprintf(line, "%.15g %.15g %.15g", -180 + 0.1*(i % 3600),
+                        -60 + 0.1*(i/3600), 400000.0) + 1;
+        b->values[i] = (2.0*rand()/RAND_MAX - 1)*pow(10, rand() % 6);
+    }
+    b->nlines = BENCH_LINES;
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    static const int orders[][3] = {{2, 2, 2}, {3, 3, 3}, {4, 4, 4},
+                                    {6, 6, 6}, {8, 8, 8}};
+    static const double heights[] = {1000, 10000, 100000, 400000};
+    static BENCH_RUN run;
+    static BENCH_RESULTS baseline;
+    static BENCH_TEXT text;
+    BENCH_TESS tess;
+    BENCH_ROTATE rotate;
+    const char *save = NULL, *compare = NULL;
+    char name[BENCH_NAME_SIZE];
+    int i, o, isa = tess_isa_detect(), lon, lat, r;
+
+    run.tolerance = 0.25;
+    for(i = 1; i < argc; i++)
+    {
+        if(!strncmp(argv[i], "--save=", 7))
+            save = argv[i] + 7;
+        else if(!strncmp(argv[i], "--compare=", 10))
+            compare = argv[i] + 10;
+        else if(!strncmp(argv[i], "--tolerance=", 12) &&
+                sscanf(argv[i] + 12, "%lf", &run.tolerance) == 1)
+            continue;
+        else if(argv[i][0] != '-' && run.pattern == NULL)
+            run.pattern = argv[i];
+        else
+        {
+            fprintf(stderr, "Usage: %s [--save=FILE] [--compare=FILE] [--tolerance=X] [PATTERN]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if(compare != NULL)
+    {
+        if(read_baseline(compare, &baseline))
+        {
+            fprintf(stderr, "failed to read baseline %s\n", compare);
+            return 1;
+        }
+        run.baseline = &baseline;
+    }
+    /* The parsers log bad lines only */
+    log_init(LOG_ERROR);
+
+    printf("# Instruction set of the kernels: %s\n", tess_isa_name(isa));
+    if(run.baseline != NULL)
+    {
+        printf("# %-40s %12s %12s %8s\n", "benchmark", "ns/eval", "baseline",
+               "change");
+    }
+    else
+    {
+        printf("# %-40s %12s\n", "benchmark", "ns/eval");
+    }
+
+    /* The kernels the programs use for each order */
+    for(o = 0; o < (int)(sizeof(orders)/sizeof(orders[0])); o++)
+    {
+        lon = orders[o][0];
+        lat = orders[o][1];
+        r = orders[o][2];
+        if(init_bench_tess(&tess, lon, lat, r))
+        {
+            fprintf(stderr, "failed to create GLQ structures\n");
+            return 1;
+        }
+        tess.single = &tess_gzz;
+        sprintf(name, "kernel/tess_gzz/%d-%d-%d", lon, lat, r);
+        bench(&run, name, run_kernel, &tess, BENCH_POINTS);
+        tess.single = NULL;
+        tess.multi = &tess_gxz_gyz_gzz;
+        sprintf(name, "kernel/tess_gxz_gyz_gzz/%d-%d-%d", lon, lat, r);
+        bench(&run, name, run_kernel, &tess, BENCH_POINTS);
+        tess.multi = &tess_ggt;
+        sprintf(name, "kernel/tess_ggt/%d-%d-%d", lon, lat, r);
+        bench(&run, name, run_kernel, &tess, BENCH_POINTS);
+        if(isa != TESS_ISA_SCALAR)
+        {
+            tess.multi = tess_simd_kernel(&tess_gxz_gyz_gzz, isa);
+            sprintf(name, "kernel/tess_gxz_gyz_gzz_%s/%d-%d-%d",
+                    tess_isa_name(isa), lon, lat, r);
+            bench(&run, name, run_kernel, &tess, BENCH_POINTS);
+            tess.multi = tess_simd_kernel(&tess_ggt, isa);
+            sprintf(name, "kernel/tess_ggt_%s/%d-%d-%d", tess_isa_name(isa),
+                    lon, lat, r);
+            bench(&run, name, run_kernel, &tess, BENCH_POINTS);
+        }
+        if(tess_fixed_supported(lon, lat, r))
+        {
+            tess.multi = tess_fixed_multi(&tess_gxz_gyz_gzz, lon, lat, r);
+            sprintf(name, "kernel/tess_gxz_gyz_gzz_fixed/%d-%d-%d", lon, lat,
+                    r);
+            bench(&run, name, run_kernel, &tess, BENCH_POINTS);
+            tess.multi = tess_fixed_multi(&tess_ggt, lon, lat, r);
+            sprintf(name, "kernel/tess_ggt_fixed/%d-%d-%d", lon, lat, r);
+            bench(&run, name, run_kernel, &tess, BENCH_POINTS);
+        }
+        sprintf(name, "glq/glq_set_limits/%d", lon);
+        bench(&run, name, run_glq, &tess, 1);
+        free_bench_tess(&tess);
+    }
+
+    /* The adaptative driver of tessbz above the center of the tesseroid.
+       Times are per tesseroid-point pair, with all pieces of the division. */
+    if(init_bench_tess(&tess, 2, 2, 2))
+    {
+        fprintf(stderr, "failed to create GLQ structures\n");
+        return 1;
+    }
+    tess.multi = &tess_gxz_gyz_gzz;
+    tess.ratio = TESSEROID_GXX_SIZE_RATIO;
+    if(TESSEROID_GXY_SIZE_RATIO > tess.ratio)
+        tess.ratio = TESSEROID_GXY_SIZE_RATIO;
+    if(TESSEROID_GXZ_SIZE_RATIO > tess.ratio)
+        tess.ratio = TESSEROID_GXZ_SIZE_RATIO;
+    for(i = 0; i < (int)(sizeof(heights)/sizeof(heights[0])); i++)
+    {
+        tess.lons[0] = 10.5;
+        tess.lats[0] = 45.5;
+        tess.rs[0] = MEAN_EARTH_RADIUS + heights[i];
+        sprintf(name, "adapt/tess_gxz_gyz_gzz/%gkm", heights[i]/1000);
+        bench(&run, name, run_adapt, &tess, 1);
+    }
+    free_bench_tess(&tess);
+
+    /* Rotation of the magnetization to the frame of the points */
+    for(i = 0; i < BENCH_POINTS; i++)
+    {
+        rotate.trig[i][0] = cos(PI/2 - DEG2RAD*(40 + 0.05*i));
+        rotate.trig[i][1] = sin(PI/2 - DEG2RAD*(40 + 0.05*i));
+        rotate.trig[i][2] = cos(DEG2RAD*(5 + 0.05*i));
+        rotate.trig[i][3] = sin(DEG2RAD*(5 + 0.05*i));
+    }
+    rotate.fast = 0;
+    bench(&run, "rotate/conv_vect_cblas_precalc", run_rotate, &rotate,
+          BENCH_POINTS);
+    rotate.fast = 1;
+    bench(&run, "rotate/conv_vect_fast", run_rotate, &rotate, BENCH_POINTS);
+
+    /* Parsing and formatting, per line or number */
+    if(init_bench_text(&text))
+    {
+        fprintf(stderr, "failed to make the files of the parsing benchmarks\n");
+        return 1;
+    }
+    bench(&run, "parse/read_mag_tess_model", run_read_model, &text,
+          BENCH_MODEL_SIZE);
+    bench(&run, "parse/text_parse_doubles", run_parse_points, &text,
+          BENCH_LINES);
+    bench(&run, "parse/sscanf", run_sscanf_points, &text, BENCH_LINES);
+    text.format = TEXT_FORMAT_SHORTEST;
+    bench(&run, "format/text_format_double/shortest", run_format, &text,
+          BENCH_LINES);
+    text.format = TEXT_FORMAT_COMPAT;
+    bench(&run, "format/text_format_double/compat", run_format, &text,
+          BENCH_LINES);
+    bench(&run, "format/sprintf", run_printf, &text, BENCH_LINES);
+    fclose(text.model);
+    free(text.lines);
+    free(text.out);
+
+    if(sink == 0)
+        printf("# all results are zero\n");
+    if(save != NULL && write_baseline(save, &(run.results)))
+    {
+        fprintf(stderr, "failed to write baseline %s\n", save);
+        return 1;
+    }
+    if(run.slower > 0)
+    {
+        printf("# %d benchmark(s) slower than the baseline by more than %g%%\n",
+               run.slower, 100*run.tolerance);
+        return 1;
+    }
+    return 0;
+}
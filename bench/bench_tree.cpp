@@ -0,0 +1,211 @@
+/*
+Benchmark and accuracy check of the tree evaluation in mag_tree.cpp.
+
+Makes a synthetic model of several layers of tesseroids with varying
+magnetization and calculates the magnetic field on grids of points at two
+heights, once by direct summation with calc_mag_model and once with the tree
+for several opening angles.
+
+Usage:
+
+    make bench
+    ./bench_tree [CELL_SIZE_IN_DEGREES]
+
+Prints the time of both versions, the speedup and the largest difference
+between the results relative to the largest field. Exits with 1 if the
+smallest opening angle is less accurate than BENCH_TREE_TOL.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "../src/constants.h"
+#include "../src/geometry.h"
+#include "../src/glq.h"
+#include "../src/grav_tess.h"
+#include "../src/mag_tess.h"
+#include "../src/mag_tree.h"
+
+
+/* Size of the region covered by the model, in degrees */
+#define BENCH_TREE_REGION 30.
+/* Number of layers of the model */
+#define BENCH_TREE_LAYERS 3
+/* Number of computation points along each side of the grids */
+#define BENCH_TREE_POINTS 12
+/* Largest relative error allowed for the smallest opening angle */
+#define BENCH_TREE_TOL 1e-3
+
+
+/* Make a model of layers of cells of size degrees, with a magnetization that
+   changes from cell to cell */
+static TESS_MODEL * bench_tree_model(double size)
+{
+    TESSEROID *tess;
+    TESS_MODEL *model;
+    int nside = (int)(BENCH_TREE_REGION/size + 0.5), ntess, i, j, k, t = 0;
+
+    ntess = nside*nside*BENCH_TREE_LAYERS;
+    tess = (TESSEROID *)malloc(ntess*sizeof(TESSEROID));
+    if(tess == NULL)
+    {
+        return NULL;
+    }
+    for(k = 0; k < BENCH_TREE_LAYERS; k++)
+    {
+        for(j = 0; j < nside; j++)
+        {
+            for(i = 0; i < nside; i++, t++)
+            {
+                tess[t].w = -0.5*BENCH_TREE_REGION + i*size;
+                tess[t].e = tess[t].w + size;
+                tess[t].s = -0.5*BENCH_TREE_REGION + j*size;
+                tess[t].n = tess[t].s + size;
+                tess[t].r2 = MEAN_EARTH_RADIUS - 10000.*k;
+                tess[t].r1 = tess[t].r2 - 10000.;
+                tess[t].density = 1;
+                tess[t].suscept = 0.01 + 0.005*sin(0.7*i + 1.3*j + k);
+                tess[t].Bx = 20000 + 5000*cos(0.3*j);
+                tess[t].By = 1000*sin(0.2*i);
+                tess[t].Bz = -40000 + 3000*sin(0.5*(i + j));
+                tess[t].cos_a1 = cos(PI/2.0 - DEG2RAD*0.5*(tess[t].s + tess[t].n));
+                tess[t].sin_a1 = sin(PI/2.0 - DEG2RAD*0.5*(tess[t].s + tess[t].n));
+                tess[t].cos_b1 = cos(DEG2RAD*0.5*(tess[t].w + tess[t].e));
+                tess[t].sin_b1 = sin(DEG2RAD*0.5*(tess[t].w + tess[t].e));
+            }
+        }
+    }
+    model = tess_model_from_array(tess, ntess);
+    free(tess);
+    return model;
+}
+
+
+static double wall_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+
+/* Calculate the field on the grid of points at a height, directly if tree is
+   NULL. res receives 3 values per point. Returns the time taken. */
+static double bench_tree_grid(const TESS_MODEL *model, const MAG_TREE *tree,
+    const MAG_CALC *calc, double height, GLQ *glq_lon, GLQ *glq_lat,
+    GLQ *glq_r, MAG_STATS *stats, double *res)
+{
+    MAG_POINT point;
+    double start, step = BENCH_TREE_REGION/BENCH_TREE_POINTS, lon, lat;
+    int i, j, p = 0;
+
+    mag_point_init(&point);
+    start = wall_time();
+    for(j = 0; j < BENCH_TREE_POINTS; j++)
+    {
+        lat = -0.5*BENCH_TREE_REGION + (j + 0.5)*step;
+        for(i = 0; i < BENCH_TREE_POINTS; i++, p++)
+        {
+            lon = -0.5*BENCH_TREE_REGION + (i + 0.5)*step;
+            mag_point_set(&point, lon, lat, height);
+            res[3*p] = res[3*p + 1] = res[3*p + 2] = 0;
+            if(tree == NULL)
+                calc_mag_model(model, 0, model->size, calc, &point, glq_lon,
+                               glq_lat, glq_r, stats, &res[3*p]);
+            else
+                calc_mag_tree(tree, model, calc, &point, glq_lon, glq_lat,
+                              glq_r, stats, &res[3*p]);
+        }
+    }
+    return wall_time() - start;
+}
+
+
+int main(int argc, char **argv)
+{
+    const double heights[] = {10000, 400000}, thetas[] = {0.2, 0.35, 0.5};
+    TESS_MODEL *model;
+    MAG_TREE *tree;
+    MAG_CALC calc = {0};
+    MAG_STATS stats = {{0, 0}, 0, 0, 0, 0, 0};
+    GLQ *glq_lon, *glq_lat, *glq_r;
+    double size = 0.25, *direct, *approx, t_direct, t_tree, bmax, err;
+    int npoints = BENCH_TREE_POINTS*BENCH_TREE_POINTS, h, th, i, status = 0;
+
+    if(argc > 1 && (sscanf(argv[1], "%lf", &size) != 1 || size <= 0))
+    {
+        fprintf(stderr, "Usage: %s [CELL_SIZE_IN_DEGREES]\n", argv[0]);
+        return 1;
+    }
+    model = bench_tree_model(size);
+    glq_lon = glq_new(2, -1, 1);
+    glq_lat = glq_new(2, -1, 1);
+    glq_r = glq_new(2, -1, 1);
+    direct = (double *)malloc(3*npoints*sizeof(double));
+    approx = (double *)malloc(3*npoints*sizeof(double));
+    if(model == NULL || glq_lon == NULL || glq_lat == NULL || glq_r == NULL ||
+       direct == NULL || approx == NULL)
+    {
+        fprintf(stderr, "Error allocating memory\n");
+        return 1;
+    }
+    /* Not adaptative, so the direct sum does the same work for every
+       tesseroid as the near field of the tree */
+    calc.vector = 1;
+    calc.field_block = &tess_ggt_block;
+    /* The tree reorders the model, so build one before the direct sums to
+       compare them in the same order */
+    tree = mag_tree_new(model, thetas[0]);
+    if(tree == NULL)
+    {
+        fprintf(stderr, "Error allocating memory\n");
+        return 1;
+    }
+    printf("Model: %d tesseroids, tree of %d nodes and %d levels\n",
+           model->size, tree->nnodes, tree->depth);
+    printf("%9s %6s %11s %11s %8s %11s %10s\n", "height", "theta",
+           "direct (s)", "tree (s)", "speedup", "rel. error", "nodes/pt");
+    for(h = 0; h < 2; h++)
+    {
+        t_direct = bench_tree_grid(model, NULL, &calc, heights[h], glq_lon,
+                                   glq_lat, glq_r, NULL, direct);
+        bmax = 0;
+        for(i = 0; i < 3*npoints; i++)
+        {
+            if(fabs(direct[i]) > bmax)
+                bmax = fabs(direct[i]);
+        }
+        for(th = 0; th < 3; th++)
+        {
+            tree->theta = thetas[th];
+            stats.tree_nodes = 0;
+            t_tree = bench_tree_grid(model, tree, &calc, heights[h], glq_lon,
+                                     glq_lat, glq_r, &stats, approx);
+            err = 0;
+            for(i = 0; i < 3*npoints; i++)
+            {
+                if(fabs(direct[i] - approx[i]) > err)
+                    err = fabs(direct[i] - approx[i]);
+            }
+            err /= bmax;
+            printf("%9g %6g %11.4g %11.4g %8.3g %11.3g %10.4g\n", heights[h],
+                   thetas[th], t_direct, t_tree, t_direct/t_tree, err,
+                   (double)stats.tree_nodes/npoints);
+            if(th == 0 && err > BENCH_TREE_TOL)
+            {
+                printf("FAILED: error larger than %g\n", BENCH_TREE_TOL);
+                status = 1;
+            }
+        }
+    }
+    mag_tree_free(tree);
+    tess_model_free(model);
+    glq_free(glq_lon);
+    glq_free(glq_lat);
+    glq_free(glq_r);
+    free(direct);
+    free(approx);
+    return status;
+}
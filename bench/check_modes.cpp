@@ -0,0 +1,152 @@
+/*
+Regression check of the non-adaptative calculation.
+
+The non-adaptative calculation rotates the magnetization of each tesseroid
+with the trigonometric functions of its center that read_mag_tess_model
+caches. Until they were fixed, these had the longitude and latitude swapped,
+and non-adaptative results disagreed with adaptative ones by up to 15%.
+
+Writes a model with tesseroids away from the equator and the prime meridian
+to a file, reads it with read_mag_tess_model and calculates the magnetic
+field without division on points far from it. The reference is the
+adaptative calculation of the same tesseroids, with the trigonometric
+functions computed here from their borders. Far from the model the
+tesseroids are not divided, so both must agree to rounding.
+
+Usage:
+
+    make check
+
+Prints the largest difference relative to the largest field and exits with
+1 if it is larger than CHECK_MODES_TOL.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../src/constants.h"
+#include "../src/geometry.h"
+#include "../src/glq.h"
+#include "../src/grav_tess.h"
+#include "../src/logger.h"
+#include "../src/mag_tess.h"
+#include "../src/parsers.h"
+
+
+/* Number of tesseroids of the model */
+#define CHECK_MODES_TESS 12
+/* Number of computation points */
+#define CHECK_MODES_POINTS 24
+/* Largest difference allowed, relative to the largest field */
+#define CHECK_MODES_TOL 1e-9
+
+
+/* Write a model of CHECK_MODES_TESS tesseroids of 1 degree to a file,
+   with their centers at different longitudes and latitudes */
+static void check_modes_model(FILE *file)
+{
+    double w, s;
+    int t;
+
+    for(t = 0; t < CHECK_MODES_TESS; t++)
+    {
+        w = -170 + 29*t;
+        s = -70 + 12*t;
+        fprintf(file, "%g %g %g %g %g %g 1 %g %g %g %g\n", w, w + 1, s, s + 1,
+                -1000., -11000. - 500*t, 0.01 + 0.002*t, 20000 - 1000.*t,
+                3000 + 500.*t, -40000 + 1500.*t);
+    }
+}
+
+
+int main(void)
+{
+    TESSEROID *array;
+    TESS_MODEL *model, *ref;
+    MAG_CALC calc = {0};
+    MAG_STATS stats = {{0, 0}, 0, 0, 0, 0, 0};
+    MAG_POINT point;
+    GLQ *glq_lon, *glq_lat, *glq_r;
+    FILE *file;
+    double res[3], expect[3], lon, lat, err = 0, bmax = 0;
+    int size, t, p, c;
+
+    log_init(LOG_WARNING);
+    file = tmpfile();
+    if(file == NULL)
+    {
+        fprintf(stderr, "Error creating a temporary model file\n");
+        return 1;
+    }
+    check_modes_model(file);
+    rewind(file);
+    array = read_mag_tess_model(file, &size);
+    fclose(file);
+    if(array == NULL || size != CHECK_MODES_TESS)
+    {
+        fprintf(stderr, "Error reading the model\n");
+        return 1;
+    }
+    model = tess_model_from_array(array, size);
+    for(t = 0; t < size; t++)
+    {
+        array[t].cos_a1 = cos(PI/2.0 - DEG2RAD*0.5*(array[t].s + array[t].n));
+        array[t].sin_a1 = sin(PI/2.0 - DEG2RAD*0.5*(array[t].s + array[t].n));
+        array[t].cos_b1 = cos(DEG2RAD*0.5*(array[t].w + array[t].e));
+        array[t].sin_b1 = sin(DEG2RAD*0.5*(array[t].w + array[t].e));
+    }
+    ref = tess_model_from_array(array, size);
+    free(array);
+    glq_lon = glq_new(4, -1, 1);
+    glq_lat = glq_new(4, -1, 1);
+    glq_r = glq_new(4, -1, 1);
+    if(model == NULL || ref == NULL || glq_lon == NULL || glq_lat == NULL ||
+       glq_r == NULL)
+    {
+        fprintf(stderr, "Error allocating memory\n");
+        return 1;
+    }
+    calc.vector = 1;
+    calc.ratio_max = 1;
+    calc.field_block = &tess_ggt_block;
+    stats.adapt.max_depth = TESS_ADAPT_MAX_DEPTH;
+    mag_point_init(&point);
+    /* Points 400 km above the tesseroids and around them */
+    for(p = 0; p < CHECK_MODES_POINTS; p++)
+    {
+        t = p % CHECK_MODES_TESS;
+        lon = -170 + 29*t + 0.5 + (p < CHECK_MODES_TESS ? 0 : 2);
+        lat = -70 + 12*t + 0.5 - (p < CHECK_MODES_TESS ? 0 : 1.5);
+        mag_point_set(&point, lon, lat, 400000);
+        res[0] = res[1] = res[2] = 0;
+        expect[0] = expect[1] = expect[2] = 0;
+        calc.adaptative = 0;
+        calc_mag_model(model, 0, size, &calc, &point, glq_lon, glq_lat, glq_r,
+                       NULL, res);
+        calc.adaptative = 1;
+        calc_mag_model(ref, 0, size, &calc, &point, glq_lon, glq_lat, glq_r,
+                       &stats, expect);
+        for(c = 0; c < 3; c++)
+        {
+            if(fabs(expect[c]) > bmax)
+                bmax = fabs(expect[c]);
+            if(fabs(res[c] - expect[c]) > err)
+                err = fabs(res[c] - expect[c]);
+        }
+    }
+    err /= bmax;
+    printf("Non-adaptative vs adaptative on %d far points: rel. error %.3g, %ld division(s)\n",
+           CHECK_MODES_POINTS, err, stats.adapt.splits[0]);
+    tess_model_free(model);
+    tess_model_free(ref);
+    glq_free(glq_lon);
+    glq_free(glq_lat);
+    glq_free(glq_r);
+    if(err > CHECK_MODES_TOL || stats.adapt.splits[0] != 0)
+    {
+        printf("FAILED: error larger than %g or tesseroids divided\n",
+               CHECK_MODES_TOL);
+        return 1;
+    }
+    return 0;
+}
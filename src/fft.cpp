@@ -0,0 +1,82 @@
+/*
+Radix-2 fast Fourier transform.
+*/
+
+
+#include <math.h>
+#include "constants.h"
+#include "fft.h"
+
+
+/* Smallest power of 2 that is >= n */
+int fft_size(int n)
+{
+    int size = 1;
+
+    while(size < n)
+    {
+        size *= 2;
+    }
+    return size;
+}
+
+
+/* Twiddle factors of an FFT of size n */
+void fft_twiddles(int n, double *tw)
+{
+    int k;
+
+    for(k = 0; k < n/2; k++)
+    {
+        tw[2*k] = cos(2*PI*k/n);
+        tw[2*k + 1] = -sin(2*PI*k/n);
+    }
+}
+
+
+/* In place iterative FFT: bit reversal permutation followed by the
+   butterflies of each stage */
+void fft(double *data, int n, int sign, const double *tw)
+{
+    double re, im, wr, wi, tr, ti;
+    int i, j, bit, half, step, start, k;
+
+    for(i = 1, j = 0; i < n; i++)
+    {
+        for(bit = n >> 1; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j |= bit;
+        if(i < j)
+        {
+            re = data[2*i];
+            im = data[2*i + 1];
+            data[2*i] = data[2*j];
+            data[2*i + 1] = data[2*j + 1];
+            data[2*j] = re;
+            data[2*j + 1] = im;
+        }
+    }
+    for(half = 1; half < n; half *= 2)
+    {
+        /* The twiddles of this stage are every step-th of the table */
+        step = n/(2*half);
+        for(start = 0; start < n; start += 2*half)
+        {
+            for(k = 0; k < half; k++)
+            {
+                wr = tw[2*k*step];
+                wi = -sign*tw[2*k*step + 1];
+                i = start + k;
+                j = i + half;
+                tr = wr*data[2*j] - wi*data[2*j + 1];
+                ti = wr*data[2*j + 1] + wi*data[2*j];
+                data[2*j] = data[2*i] - tr;
+                data[2*j + 1] = data[2*i + 1] - ti;
+                data[2*i] += tr;
+                data[2*i + 1] += ti;
+            }
+        }
+    }
+}
@@ -0,0 +1,46 @@
+/*
+Radix-2 fast Fourier transform, used for the longitude convolutions of
+mag_fft.cpp.
+
+Complex numbers are stored interleaved: data[2*k] is the real part and
+data[2*k + 1] the imaginary part of element k. The sizes must be powers of 2;
+linear convolutions pad their inputs with zeros up to fft_size(length).
+
+Example
+-------
+
+    int n = fft_size(na + nb - 1);
+    double *tw = (double *)malloc(n*sizeof(double));
+
+    fft_twiddles(n, tw);
+    fft(a, n, -1, tw);
+    fft(b, n, -1, tw);
+    ... multiply a by b element by element ...
+    fft(a, n, 1, tw);
+    ... divide a by n ...
+*/
+
+#ifndef _TESSEROIDS_FFT_H_
+#define _TESSEROIDS_FFT_H_
+
+
+/** Smallest power of 2 that is >= n */
+int fft_size(int n);
+
+
+/** Fill tw with the n/2 complex twiddle factors exp(-2*pi*i*k/n) of an FFT of
+size n. tw must have room for n doubles. */
+void fft_twiddles(int n, double *tw);
+
+
+/** In place FFT of n complex numbers.
+
+@param data n complex numbers, interleaved
+@param n size, a power of 2
+@param sign -1 for the forward transform, 1 for the inverse one. The inverse
+            is not divided by n.
+@param tw twiddle factors made by fft_twiddles for size n
+*/
+void fft(double *data, int n, int sign, const double *tw);
+
+#endif
@@ -46,3 +46,213 @@ void split_tess(TESSEROID tess, TESSEROID *split)
         }
     }
 }
+
+
+/* Number of columns of a TESS_MODEL */
+#define TESS_MODEL_COLUMNS 20
+
+
+/* Fill columns with the addresses of the column pointers of a model */
+static void tess_model_columns(TESS_MODEL *model, double **columns[])
+{
+    columns[0] = &(model->w);
+    columns[1] = &(model->e);
+    columns[2] = &(model->s);
+    columns[3] = &(model->n);
+    columns[4] = &(model->r1);
+    columns[5] = &(model->r2);
+    columns[6] = &(model->mx);
+    columns[7] = &(model->my);
+    columns[8] = &(model->mz);
+    columns[9] = &(model->cos_a1);
+    columns[10] = &(model->sin_a1);
+    columns[11] = &(model->cos_b1);
+    columns[12] = &(model->sin_b1);
+    columns[13] = &(model->mass);
+    columns[14] = &(model->rc);
+    columns[15] = &(model->cos_latc);
+    columns[16] = &(model->sin_latc);
+    columns[17] = &(model->cos_lonc);
+    columns[18] = &(model->sin_lonc);
+    columns[19] = &(model->dim);
+}
+
+
+/* Allocate the memory block of a model for size tesseroids and point the
+   columns into it. Returns 1 if there was an error with allocation. */
+static int tess_model_alloc(TESS_MODEL *model, int size)
+{
+    double **columns[TESS_MODEL_COLUMNS];
+    size_t stride;
+    int i;
+
+    /* Round the columns up to 8 doubles to keep all of them aligned */
+    stride = ((size_t)size + 7)/8*8;
+    if(posix_memalign((void **)&(model->data), 64,
+                      TESS_MODEL_COLUMNS*stride*sizeof(double)) != 0)
+    {
+        return 1;
+    }
+    model->size = size;
+    tess_model_columns(model, columns);
+    for(i = 0; i < TESS_MODEL_COLUMNS; i++)
+    {
+        *columns[i] = model->data + i*stride;
+    }
+    return 0;
+}
+
+
+/* Allocate a structure of arrays model for size tesseroids. Returns NULL if
+   there was an error with allocation. */
+TESS_MODEL * tess_model_new(int size)
+{
+    TESS_MODEL *model;
+
+    model = (TESS_MODEL *)malloc(sizeof(TESS_MODEL));
+    if(model == NULL)
+    {
+        return NULL;
+    }
+    if(tess_model_alloc(model, size) != 0)
+    {
+        free(model);
+        return NULL;
+    }
+    return model;
+}
+
+
+/* Reorder the tesseroids of a model so that tesseroid i is the old tesseroid
+   perm[i]. Returns 1 if there was an error with allocation, in which case
+   the model is not changed. */
+int tess_model_permute(TESS_MODEL *model, const int *perm)
+{
+    TESS_MODEL old = *model;
+    double **columns[TESS_MODEL_COLUMNS], **old_columns[TESS_MODEL_COLUMNS],
+           *to, *from;
+    int i, c;
+
+    if(tess_model_alloc(model, old.size) != 0)
+    {
+        *model = old;
+        return 1;
+    }
+    tess_model_columns(model, columns);
+    tess_model_columns(&old, old_columns);
+    for(c = 0; c < TESS_MODEL_COLUMNS; c++)
+    {
+        to = *columns[c];
+        from = *old_columns[c];
+        for(i = 0; i < model->size; i++)
+        {
+            to[i] = from[perm[i]];
+        }
+    }
+    free(old.data);
+    return 0;
+}
+
+
+/* Free the memory of a structure of arrays model */
+void tess_model_free(TESS_MODEL *model)
+{
+    free(model->data);
+    free(model);
+}
+
+
+/* Calculate the volume, center of mass and size of tesseroid i of a
+   structure of arrays model from its borders. The center of mass is the
+   integral of the position vector over the tesseroid divided by the volume,
+   so it lies slightly below the middle radius. */
+static void tess_model_set_center(TESS_MODEL *model, int i)
+{
+    double d2r = PI/180., w = d2r*model->w[i], e = d2r*model->e[i],
+           s = d2r*model->s[i], n = d2r*model->n[i], r1 = model->r1[i],
+           r2 = model->r2[i], vol, moment, x, y, z, rxy, size;
+
+    vol = (r2*r2*r2 - r1*r1*r1)/3.*(sin(n) - sin(s))*(e - w);
+    /* Integral of r*r^2 dr times the integrals over the longitude and
+       latitude of the unit vector times cos(lat) */
+    moment = 0.25*(r2*r2*r2*r2 - r1*r1*r1*r1);
+    x = moment*(0.5*(n - s) + 0.25*(sin(2*n) - sin(2*s)))*(sin(e) - sin(w));
+    y = moment*(0.5*(n - s) + 0.25*(sin(2*n) - sin(2*s)))*(cos(w) - cos(e));
+    z = moment*0.5*(sin(n)*sin(n) - sin(s)*sin(s))*(e - w);
+    rxy = sqrt(x*x + y*y);
+    model->mass[i] = vol;
+    if(vol > 0 && rxy > 0)
+    {
+        model->rc[i] = sqrt(x*x + y*y + z*z)/vol;
+        model->cos_latc[i] = rxy/sqrt(rxy*rxy + z*z);
+        model->sin_latc[i] = z/sqrt(rxy*rxy + z*z);
+        model->cos_lonc[i] = x/rxy;
+        model->sin_lonc[i] = y/rxy;
+    }
+    else
+    {
+        model->rc[i] = 0.5*(r1 + r2);
+        model->cos_latc[i] = cos(0.5*(s + n));
+        model->sin_latc[i] = sin(0.5*(s + n));
+        model->cos_lonc[i] = cos(0.5*(w + e));
+        model->sin_lonc[i] = sin(0.5*(w + e));
+    }
+    size = MEAN_EARTH_RADIUS*(e - w);
+    if(MEAN_EARTH_RADIUS*(n - s) > size)
+        size = MEAN_EARTH_RADIUS*(n - s);
+    if(r2 - r1 > size)
+        size = r2 - r1;
+    model->dim[i] = size;
+}
+
+
+/* Make a structure of arrays model from an array of tesseroids read with
+   read_mag_tess_model. The magnetization is calculated once here instead of
+   for every computation point. */
+TESS_MODEL * tess_model_from_array(const TESSEROID *model, int size)
+{
+    TESS_MODEL *soa;
+    double B_to_H, factor;
+    int i;
+
+    soa = tess_model_new(size);
+    if(soa == NULL)
+    {
+        return NULL;
+    }
+    /* The kernels multiply by G*density and give Eotvos */
+    factor = M_0*EOTVOS2SI/(G*4*PI);
+    for(i = 0; i < size; i++)
+    {
+        soa->w[i] = model[i].w;
+        soa->e[i] = model[i].e;
+        soa->s[i] = model[i].s;
+        soa->n[i] = model[i].n;
+        soa->r1[i] = model[i].r1;
+        soa->r2[i] = model[i].r2;
+        B_to_H = model[i].suscept/(M_0);
+        soa->mx[i] = model[i].Bx*B_to_H*factor;
+        soa->my[i] = model[i].By*B_to_H*factor;
+        soa->mz[i] = model[i].Bz*B_to_H*factor;
+        soa->cos_a1[i] = model[i].cos_a1;
+        soa->sin_a1[i] = model[i].sin_a1;
+        soa->cos_b1[i] = model[i].cos_b1;
+        soa->sin_b1[i] = model[i].sin_b1;
+        tess_model_set_center(soa, i);
+    }
+    return soa;
+}
+
+
+/* Copy the borders of tesseroid i of a structure of arrays model into a
+   TESSEROID of unit density, as needed by the kernels */
+void tess_model_get(const TESS_MODEL *model, int i, TESSEROID *tess)
+{
+    tess->density = 1;
+    tess->w = model->w[i];
+    tess->e = model->e[i];
+    tess->s = model->s[i];
+    tess->n = model->n[i];
+    tess->r1 = model->r1[i];
+    tess->r2 = model->r2[i];
+}
@@ -32,6 +32,43 @@ typedef struct tess_struct {
 } TESSEROID;
 
 
+/* Store a magnetic tesseroid model as a structure of arrays. Each column is
+   aligned to 64 bytes, so loops over the tesseroids only read the columns
+   they need. */
+typedef struct tess_model_struct
+{
+    int size; /* number of tesseroids */
+    double *w; /* western longitude borders in degrees */
+    double *e; /* eastern longitude borders in degrees */
+    double *s; /* southern latitude borders in degrees */
+    double *n; /* northern latitude borders in degrees */
+    double *r1; /* smallest radius borders in SI units */
+    double *r2; /* largest radius borders in SI units */
+    double *mx; /* magnetization in the system of the tesseroid, multiplied */
+    double *my; /* by the factor that turns the gravity gradients of a */
+    double *mz; /* tesseroid of unit density into the magnetic field in nT */
+    double *cos_a1; /* cached trigonometric functions of the colatitude (a) */
+    double *sin_a1; /* and longitude (b) of the center of the tesseroid */
+    double *cos_b1;
+    double *sin_b1;
+    double *mass; /* volume, the mass of the tesseroid of unit density */
+    double *rc; /* radius, */
+    double *cos_latc; /* and trigonometric functions of the latitude */
+    double *sin_latc;
+    double *cos_lonc; /* and longitude of the center of mass */
+    double *sin_lonc;
+    double *dim; /* largest dimension in SI units, measured as in the
+                     adaptative division */
+    double *data; /* memory block holding all columns */
+} TESS_MODEL;
+
+
 void split_tess(TESSEROID tess, TESSEROID *split);
 
+TESS_MODEL * tess_model_new(int size);
+void tess_model_free(TESS_MODEL *model);
+int tess_model_permute(TESS_MODEL *model, const int *perm);
+TESS_MODEL * tess_model_from_array(const TESSEROID *model, int size);
+void tess_model_get(const TESS_MODEL *model, int i, TESSEROID *tess);
+
 #endif
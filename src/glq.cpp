@@ -16,6 +16,12 @@ GLQ * glq_new(int order, double lower, double upper)
     GLQ *glq;
     int rc;
 
+    if(order > GLQ_MAX_ORDER)
+    {
+        log_error("invalid GLQ order %d. Should be <= %d.", order,
+                  GLQ_MAX_ORDER);
+        return NULL;
+    }
     glq = (GLQ *)malloc(sizeof(GLQ));
     if(glq == NULL)
     {
@@ -61,6 +61,12 @@ Max error allowed for the root-finder algorithm */
 const double GLQ_MAXERROR = 0.000000000000001;
 
 
+/** \var GLQ_MAX_ORDER
+Max order of the quadrature. The tesseroid kernels keep the trigonometric
+functions of the nodes in arrays of this size. */
+const int GLQ_MAX_ORDER = 128;
+
+
 /** Store the nodes and weights needed for a GLQ integration */
 typedef struct glq_struct
 {
@@ -83,7 +89,7 @@ Prints error and warning messages using the logging.h module.
 @param upper upper integration limit
 
 @return GLQ data structure with the nodes and weights calculated. NULL if there
-    was an error with allocation.
+    was an error with allocation or if order > GLQ_MAX_ORDER.
 */
 GLQ * glq_new(int order, double lower, double upper);
 
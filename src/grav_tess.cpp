@@ -13,6 +13,7 @@ Karlsruhe, Germany.
 */
 
 
+#include <stdlib.h>
 #include <math.h>
 #include "logger.h"
 #include "geometry.h"
@@ -88,103 +89,430 @@ void calc_tess_model_triple(TESSEROID *model, int size, double lonp, double latp
 
 
 
-/* Adaptatively calculate the field of a tesseroid model at a given point */
-double calc_tess_model_adapt(TESSEROID *model, int size, double lonp, double latp, double rp, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r, double (*field)(TESSEROID, double, double, double, GLQ, GLQ, GLQ), double ratio)
+/* Borders of a tesseroid being divided by the adaptative drivers and the
+   number of times it was divided */
+typedef struct tess_box_struct
 {
-    double res, dist, lont, latt, rt, d2r = PI/180.;
-    int tess;
-    TESSEROID split[8];
+    double w, e, s, n, r1, r2;
+    int depth;
+} TESS_BOX;
+
+
+/* Evaluate a leaf of the adaptative division with either a single or a
+   multiple component kernel and add the result to res */
+static void calc_tess_leaf(const TESS_BOX *leaf, double density, double lonp,
+    double latp, double rp, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r,
+    double (*field)(TESSEROID, double, double, double, GLQ, GLQ, GLQ),
+    void (*field_multi)(TESSEROID, double, double, double, GLQ, GLQ, GLQ, double*),
+    int ncomps, double *res)
+{
+    TESSEROID tess;
+    double ri[6];
+    int c;
+
+    tess.density = density;
+    tess.w = leaf->w;
+    tess.e = leaf->e;
+    tess.s = leaf->s;
+    tess.n = leaf->n;
+    tess.r1 = leaf->r1;
+    tess.r2 = leaf->r2;
+    glq_set_limits(tess.w, tess.e, glq_lon);
+    glq_set_limits(tess.s, tess.n, glq_lat);
+    glq_set_limits(tess.r1, tess.r2, glq_r);
+    if(field != NULL)
+    {
+        res[0] += field(tess, lonp, latp, rp, *glq_lon, *glq_lat, *glq_r);
+    }
+    else
+    {
+        field_multi(tess, lonp, latp, rp, *glq_lon, *glq_lat, *glq_r, ri);
+        for(c = 0; c < ncomps; c++)
+        {
+            res[c] += ri[c];
+        }
+    }
+}
 
-    res = 0;
+
+/* Evaluate the leaves of the adaptative division gathered in a block with one
+   call of a block kernel and add the full tensor of each to res, in order */
+static void calc_tess_block_leaves(const TESS_BLOCK *block, double lonp,
+    double latp, double rp, const GLQ *glq_lon, const GLQ *glq_lat,
+    const GLQ *glq_r, TESS_BLOCK_KERNEL field_block, double *res)
+{
+    double g[6*TESS_BLOCK_SIZE];
+    int l, c;
+
+    field_block(block, lonp, latp, rp, glq_lon, glq_lat, glq_r, g);
+    for(l = 0; l < block->size; l++)
+    {
+        for(c = 0; c < 6; c++)
+        {
+            res[c] += g[c*TESS_BLOCK_SIZE + l];
+        }
+    }
+}
+
+
+/* Tell if the adaptative drivers divide a tesseroid */
+int tess_adapt_split(double w, double e, double s, double n, double r1,
+    double r2, double lonp, double latp, double rp, double sinlatp,
+    double coslatp, double ratio)
+{
+    double d2r = PI/180., lont = 0.5*(w + e), latt = 0.5*(s + n), dist;
+
+    /* Would get stuck dividing if dist = 0 and get wrong results if inside
+       the tesseroid */
+    if(lonp >= w && lonp <= e && latp >= s && latp <= n && rp >= r1 &&
+       rp <= r2)
+    {
+        return 0;
+    }
+    dist = sqrt(rp*rp + r2*r2 - 2*rp*r2*(sinlatp*sin(d2r*latt) +
+                coslatp*cos(d2r*latt)*cos(d2r*(lonp - lont))));
+    return dist < ratio*MEAN_EARTH_RADIUS*d2r*(e - w) ||
+           dist < ratio*MEAN_EARTH_RADIUS*d2r*(n - s) ||
+           dist < ratio*(r2 - r1);
+}
+
+
+/* Adaptatively calculate ncomps components of the gravity gradient tensor of
+   the tesseroid root with field, with field_multi if field is NULL, or all
+   six with field_block if both are NULL, and add them to res.
+
+   Tesseroids that are too close to the point for the ratio are divided in 8
+   until they are far enough or have been divided adapt->max_depth times.
+   The division uses an explicit stack of boxes instead of recursion. The
+   children are taken in the order of split_tess, so the leaves are summed in
+   the same order as the old recursive drivers. With a block kernel, the
+   leaves are gathered in a block and calculated TESS_BLOCK_SIZE at a time. */
+static void calc_tess_adapt_box(const TESS_BOX *root, int index,
+    double density, double lonp, double latp, double rp, double sinlatp,
+    double coslatp, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r,
+    double (*field)(TESSEROID, double, double, double, GLQ, GLQ, GLQ),
+    void (*field_multi)(TESSEROID, double, double, double, GLQ, GLQ, GLQ, double*),
+    TESS_BLOCK_KERNEL field_block, int ncomps, double ratio,
+    TESS_ADAPT *adapt, double *res)
+{
+    TESS_BOX stack[8 + 7*TESS_ADAPT_MAX_DEPTH], box, *child;
+    TESS_BLOCK block;
+    double dlon, dlat, dr, ws[2], ss[2], r1s[2];
+    int top, i, j, k, max_depth = TESS_ADAPT_DEFAULT_DEPTH;
+
+    if(adapt != NULL)
+    {
+        max_depth = adapt->max_depth;
+    }
+    stack[0] = *root;
+    stack[0].depth = 0;
+    top = 1;
+    block.size = 0;
+    while(top > 0)
+    {
+        box = stack[--top];
+        /* Still do the calculation if the point is inside the tesseroid but
+           warn user that it's probably wrong */
+        if(lonp >= box.w && lonp <= box.e && latp >= box.s &&
+           latp <= box.n && rp >= box.r1 && rp <= box.r2)
+        {
+            log_warning("Point (%g %g %g) is on top of tesseroid %d: %g %g %g %g %g %g %g. Can't guarantee accuracy.",
+                        lonp, latp, rp - MEAN_EARTH_RADIUS, index, box.w,
+                        box.e, box.s, box.n, box.r2 - MEAN_EARTH_RADIUS,
+                        box.r1 - MEAN_EARTH_RADIUS, density);
+        }
+        /* Check if the computation point is at an acceptable distance.
+           If not split the tesseroid using the given ratio */
+        else if(tess_adapt_split(box.w, box.e, box.s, box.n, box.r1, box.r2,
+                                 lonp, latp, rp, sinlatp, coslatp, ratio))
+        {
+            if(box.depth < max_depth)
+            {
+                log_debug("Splitting tesseroid %d (%g %g %g %g %g %g %g) at point (%g %g %g) using ratio %g",
+                          index, box.w, box.e, box.s, box.n,
+                          box.r2 - MEAN_EARTH_RADIUS,
+                          box.r1 - MEAN_EARTH_RADIUS, density,
+                          lonp, latp, rp - MEAN_EARTH_RADIUS, ratio);
+                if(adapt != NULL)
+                {
+                    adapt->splits[box.depth]++;
+                }
+                /* Same division as split_tess. The children are pushed
+                   last to first so the first one is taken next. */
+                dlon = 0.5*(box.e - box.w);
+                dlat = 0.5*(box.n - box.s);
+                dr = 0.5*(box.r2 - box.r1);
+                ws[0] = box.w;
+                ws[1] = box.w + dlon;
+                ss[0] = box.s;
+                ss[1] = box.s + dlat;
+                r1s[0] = box.r1;
+                r1s[1] = box.r1 + dr;
+                for(k = 1; k >= 0; k--)
+                {
+                    for(j = 1; j >= 0; j--)
+                    {
+                        for(i = 1; i >= 0; i--)
+                        {
+                            child = &stack[top++];
+                            child->w = ws[i];
+                            child->e = ws[i] + dlon;
+                            child->s = ss[j];
+                            child->n = ss[j] + dlat;
+                            child->r1 = r1s[k];
+                            child->r2 = r1s[k] + dr;
+                            child->depth = box.depth + 1;
+                        }
+                    }
+                }
+                continue;
+            }
+            if(adapt != NULL)
+            {
+                adapt->depth_hits++;
+            }
+        }
+        if(adapt != NULL)
+        {
+            adapt->leaves++;
+        }
+        if(field_block == NULL)
+        {
+            calc_tess_leaf(&box, density, lonp, latp, rp, glq_lon, glq_lat,
+                           glq_r, field, field_multi, ncomps, res);
+            continue;
+        }
+        block.w[block.size] = box.w;
+        block.e[block.size] = box.e;
+        block.s[block.size] = box.s;
+        block.n[block.size] = box.n;
+        block.r1[block.size] = box.r1;
+        block.r2[block.size] = box.r2;
+        block.size++;
+        if(block.size == TESS_BLOCK_SIZE)
+        {
+            calc_tess_block_leaves(&block, lonp, latp, rp, glq_lon, glq_lat,
+                                   glq_r, field_block, res);
+            block.size = 0;
+        }
+    }
+    if(block.size > 0)
+    {
+        calc_tess_block_leaves(&block, lonp, latp, rp, glq_lon, glq_lat,
+                               glq_r, field_block, res);
+    }
+}
+
+
+/* Adaptatively calculate ncomps components of the gravity gradient tensor of
+   a tesseroid model with field, or with field_multi if field is NULL */
+static void calc_tess_model_adapt_iter(TESSEROID *model, int size, double lonp,
+    double latp, double rp, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r,
+    double (*field)(TESSEROID, double, double, double, GLQ, GLQ, GLQ),
+    void (*field_multi)(TESSEROID, double, double, double, GLQ, GLQ, GLQ, double*),
+    int ncomps, double ratio, TESS_ADAPT *adapt, double *res)
+{
+    TESS_BOX root;
+    double d2r = PI/180., sinlatp, coslatp;
+    int tess, c;
+
+    sinlatp = sin(d2r*latp);
+    coslatp = cos(d2r*latp);
+    for(c = 0; c < ncomps; c++)
+    {
+        res[c] = 0;
+    }
     for(tess = 0; tess < size; tess++)
     {
-        rt = model[tess].r2;
-        lont = 0.5*(model[tess].w + model[tess].e);
-        latt = 0.5*(model[tess].s + model[tess].n);
-        dist = sqrt(rp*rp + rt*rt - 2*rp*rt*(sin(d2r*latp)*sin(d2r*latt) +
-                    cos(d2r*latp)*cos(d2r*latt)*cos(d2r*(lonp - lont))));
+        root.w = model[tess].w;
+        root.e = model[tess].e;
+        root.s = model[tess].s;
+        root.n = model[tess].n;
+        root.r1 = model[tess].r1;
+        root.r2 = model[tess].r2;
+        calc_tess_adapt_box(&root, tess, model[tess].density, lonp, latp, rp,
+                            sinlatp, coslatp, glq_lon, glq_lat, glq_r, field,
+                            field_multi, NULL, ncomps, ratio, adapt, res);
+    }
+}
+
+
+/* Adaptatively calculate the full gravity gradient tensor of a tesseroid of
+   unit density with a block kernel */
+void calc_tess_adapt_block(double w, double e, double s, double n, double r1,
+    double r2, int index, double lonp, double latp, double rp, GLQ *glq_lon,
+    GLQ *glq_lat, GLQ *glq_r, TESS_BLOCK_KERNEL field_block, double ratio,
+    TESS_ADAPT *adapt, double *res)
+{
+    TESS_BOX root;
+    double d2r = PI/180.;
+    int c;
+
+    root.w = w;
+    root.e = e;
+    root.s = s;
+    root.n = n;
+    root.r1 = r1;
+    root.r2 = r2;
+    for(c = 0; c < 6; c++)
+    {
+        res[c] = 0;
+    }
+    calc_tess_adapt_box(&root, index, 1, lonp, latp, rp, sin(d2r*latp),
+                        cos(d2r*latp), glq_lon, glq_lat, glq_r, NULL, NULL,
+                        field_block, 6, ratio, adapt, res);
+}
+
+
+/* Adaptatively calculate the field of a tesseroid model at a given point. */
+double calc_tess_model_adapt(TESSEROID *model, int size, double lonp, double latp, double rp, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r, double (*field)(TESSEROID, double, double, double, GLQ, GLQ, GLQ), double ratio)
+{
+    double res;
+
+    calc_tess_model_adapt_iter(model, size, lonp, latp, rp, glq_lon, glq_lat,
+                               glq_r, field, NULL, 1, ratio, NULL, &res);
+    return res;
+}
+
 
-        /* Would get stuck in infinite loop if dist = 0 and get wrong results if
-           inside de tesseroid. Still do the calculation but warn user that it's
-           probably wrong. */
+
+/* Calculates the full gravity gradient tensor of a tesseroid model at a given
+   point. field_ggt is tess_ggt or one of its SIMD versions. res receives gxx,
+   gxy, gxz, gyy, gyz and gzz. */
+void calc_tess_model_ggt(TESSEROID *model, int size, double lonp, double latp, double rp, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r, void (*field_ggt)(TESSEROID, double, double, double, GLQ, GLQ, GLQ, double*), double *res)
+{
+    double ri[6];
+    int tess, c;
+
+    for(c = 0; c < 6; c++)
+    {
+        res[c] = 0;
+    }
+    for(tess = 0; tess < size; tess++)
+    {
         if(lonp >= model[tess].w && lonp <= model[tess].e &&
            latp >= model[tess].s && latp <= model[tess].n &&
            rp >= model[tess].r1 && rp <= model[tess].r2)
         {
-            log_warning("Point (%g %g %g) is on top of tesseroid %d: %g %g %g %g %g %g %g. Can't guarantee accuracy.",
+            log_warning("Point (%g %g %g) is on tesseroid %d: %g %g %g %g %g %g %g. Can't guarantee accuracy.",
                         lonp, latp, rp - MEAN_EARTH_RADIUS, tess,
                         model[tess].w, model[tess].e, model[tess].s,
                         model[tess].n, model[tess].r2 - MEAN_EARTH_RADIUS,
                         model[tess].r1 - MEAN_EARTH_RADIUS,
                         model[tess].density);
-            glq_set_limits(model[tess].w, model[tess].e, glq_lon);
-            glq_set_limits(model[tess].s, model[tess].n, glq_lat);
-            glq_set_limits(model[tess].r1, model[tess].r2, glq_r);
-            res += field(model[tess], lonp, latp, rp, *glq_lon, *glq_lat,
-                         *glq_r);
-        }
-        /* Check if the computation point is at an acceptable distance. If not
-           split the tesseroid using the given ratio */
-        else if(
-            dist < ratio*MEAN_EARTH_RADIUS*d2r*(model[tess].e - model[tess].w) ||
-            dist < ratio*MEAN_EARTH_RADIUS*d2r*(model[tess].n - model[tess].s) ||
-            dist < ratio*(model[tess].r2 - model[tess].r1))
-        {
-            log_debug("Splitting tesseroid %d (%g %g %g %g %g %g %g) at point (%g %g %g) using ratio %g",
-                      tess, model[tess].w, model[tess].e, model[tess].s,
-                      model[tess].n, model[tess].r2 - MEAN_EARTH_RADIUS,
-                      model[tess].r1 - MEAN_EARTH_RADIUS, model[tess].density,
-                      lonp, latp, rp - MEAN_EARTH_RADIUS, ratio);
-            /* Do it recursively until ratio*size is smaller than distance */
-            split_tess(model[tess], split);
-            res += calc_tess_model_adapt(split, 8, lonp, latp, rp, glq_lon,
-                                         glq_lat, glq_r, field, ratio);
-        }
-        else
-        {
-            glq_set_limits(model[tess].w, model[tess].e, glq_lon);
-            glq_set_limits(model[tess].s, model[tess].n, glq_lat);
-            glq_set_limits(model[tess].r1, model[tess].r2, glq_r);
-            res += field(model[tess], lonp, latp, rp, *glq_lon, *glq_lat,
-                         *glq_r);
+        }
+        glq_set_limits(model[tess].w, model[tess].e, glq_lon);
+        glq_set_limits(model[tess].s, model[tess].n, glq_lat);
+        glq_set_limits(model[tess].r1, model[tess].r2, glq_r);
+        field_ggt(model[tess], lonp, latp, rp, *glq_lon, *glq_lat, *glq_r, ri);
+
+        for(c = 0; c < 6; c++)
+        {
+            res[c] += ri[c];
         }
     }
-    return res;
 }
 
+
+/* Adaptatively calculate three components of the gravity gradient tensor of a
+   tesseroid model with one division of the tesseroids. ratio should be the
+   largest of the ratios of the components. */
+void calc_tess_model_adapt_triple(TESSEROID *model, int size, double lonp, double latp, double rp, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r, void (*field_triple)(TESSEROID, double, double, double, GLQ, GLQ, GLQ, double*), double ratio, TESS_ADAPT *adapt, double *res)
+{
+    calc_tess_model_adapt_iter(model, size, lonp, latp, rp, glq_lon, glq_lat,
+                               glq_r, NULL, field_triple, 3, ratio, adapt,
+                               res);
+}
+
+
+/* Adaptatively calculate the full gravity gradient tensor of a tesseroid model
+   at a given point. All six components share the same division of the
+   tesseroids, so ratio should be the largest of the ratios of the
+   components. */
+void calc_tess_model_adapt_ggt(TESSEROID *model, int size, double lonp, double latp, double rp, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r, void (*field_ggt)(TESSEROID, double, double, double, GLQ, GLQ, GLQ, double*), double ratio, TESS_ADAPT *adapt, double *res)
+{
+    calc_tess_model_adapt_iter(model, size, lonp, latp, rp, glq_lon, glq_lat,
+                               glq_r, NULL, field_ggt, 6, ratio, adapt, res);
+}
+
+/* Fill coslon and sinlon with cos(lonp - lon) and sin(lon - lonp) of the
+   longitude nodes. The kernels call this once instead of in the innermost
+   loop. */
+static void lon_nodes_trig(double lonp, const GLQ *glq_lon, double *coslon,
+                           double *sinlon)
+{
+    double d2r = PI/180.;
+    int k;
+
+    for(k = 0; k < glq_lon->order; k++)
+    {
+        coslon[k] = cos(d2r*(lonp - glq_lon->nodes[k]));
+        sinlon[k] = sin(d2r*(glq_lon->nodes[k] - lonp));
+    }
+}
+
+
+/* Fill coslatc and sinlatc with the cossine and sine of the latitude nodes */
+static void lat_nodes_trig(const GLQ *glq_lat, double *coslatc, double *sinlatc)
+{
+    double d2r = PI/180.;
+    int j;
+
+    for(j = 0; j < glq_lat->order; j++)
+    {
+        coslatc[j] = cos(d2r*glq_lat->nodes[j]);
+        sinlatc[j] = sin(d2r*glq_lat->nodes[j]);
+    }
+}
+
+
+/* Calculate 1/l^5 from l^2. Cheaper than pow(l_sqr, -2.5). */
+static inline double inv_dist5(double l_sqr)
+{
+    double l = sqrt(l_sqr);
+
+    return 1./(l_sqr*l_sqr*l);
+}
+
+
 /* Calculates gxx caused by a tesseroid. */
 double tess_gxx(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon,
                 GLQ glq_lat, GLQ glq_r)
 {
-    double d2r = PI/180., l_sqr, kphi, coslatp, coslatc, sinlatp, sinlatc,
-           coslon, rc, kappa, res;
+    double d2r = PI/180., l_sqr, coslatp, sinlatp, cospsi, kphi, rc, kappa,
+           wlonlat, weight, deltax, res,
+           coslon[GLQ_MAX_ORDER], sinlon[GLQ_MAX_ORDER],
+           coslatc[GLQ_MAX_ORDER], sinlatc[GLQ_MAX_ORDER];
     register int i, j, k;
 
     coslatp = cos(d2r*latp);
     sinlatp = sin(d2r*latp);
 
+    lon_nodes_trig(lonp, &glq_lon, coslon, sinlon);
+    lat_nodes_trig(&glq_lat, coslatc, sinlatc);
+
     res = 0;
 
     for(k = 0; k < glq_lon.order; k++)
     {
         for(j = 0; j < glq_lat.order; j++)
         {
+            wlonlat = glq_lon.weights[k]*glq_lat.weights[j];
+            cospsi = sinlatp*sinlatc[j] + coslatp*coslatc[j]*coslon[k];
+            kphi = coslatp*sinlatc[j] - sinlatp*coslatc[j]*coslon[k];
+
             for(i = 0; i < glq_r.order; i++)
             {
                 rc = glq_r.nodes[i];
-                sinlatc = sin(d2r*glq_lat.nodes[j]);
-                coslatc = cos(d2r*glq_lat.nodes[j]);
-                coslon = cos(d2r*(lonp - glq_lon.nodes[k]));
 
-                l_sqr = rp*rp + rc*rc - 2*rp*rc*(sinlatp*sinlatc +
-                                                 coslatp*coslatc*coslon);
+                l_sqr = rp*rp + rc*rc - 2*rp*rc*cospsi;
+                kappa = rc*rc*coslatc[j];
 
-                kphi = coslatp*sinlatc - sinlatp*coslatc*coslon;
+                deltax = rc*kphi;
 
-                kappa = rc*rc*coslatc;
+                weight = wlonlat*glq_r.weights[i]*kappa*inv_dist5(l_sqr);
 
-                res += glq_lon.weights[k]*glq_lat.weights[j]*glq_r.weights[i]*
-                       kappa*(3*rc*kphi*rc*kphi - l_sqr)/pow(l_sqr, 2.5);
+                res += weight*(3*deltax*deltax - l_sqr);
             }
         }
     }
@@ -200,40 +528,42 @@ double tess_gxx(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon
 double tess_gxy(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon,
                 GLQ glq_lat, GLQ glq_r)
 {
-    double d2r = PI/180., l_sqr, kphi, coslatp, coslatc, sinlatp, sinlatc,
-           coslon, sinlon, rc, kappa, deltax, deltay, res;
+    double d2r = PI/180., l_sqr, coslatp, sinlatp, cospsi, kphi, coslat_sinlon,
+           rc, kappa, wlonlat, weight, deltax, deltay, res,
+           coslon[GLQ_MAX_ORDER], sinlon[GLQ_MAX_ORDER],
+           coslatc[GLQ_MAX_ORDER], sinlatc[GLQ_MAX_ORDER];
     register int i, j, k;
 
     coslatp = cos(d2r*latp);
     sinlatp = sin(d2r*latp);
 
+    lon_nodes_trig(lonp, &glq_lon, coslon, sinlon);
+    lat_nodes_trig(&glq_lat, coslatc, sinlatc);
+
     res = 0;
 
     for(k = 0; k < glq_lon.order; k++)
     {
         for(j = 0; j < glq_lat.order; j++)
         {
+            wlonlat = glq_lon.weights[k]*glq_lat.weights[j];
+            cospsi = sinlatp*sinlatc[j] + coslatp*coslatc[j]*coslon[k];
+            kphi = coslatp*sinlatc[j] - sinlatp*coslatc[j]*coslon[k];
+            coslat_sinlon = coslatc[j]*sinlon[k];
+
             for(i = 0; i < glq_r.order; i++)
             {
                 rc = glq_r.nodes[i];
-                sinlatc = sin(d2r*glq_lat.nodes[j]);
-                coslatc = cos(d2r*glq_lat.nodes[j]);
-                coslon = cos(d2r*(lonp - glq_lon.nodes[k]));
-                sinlon = sin(d2r*(glq_lon.nodes[k] - lonp));
 
-                l_sqr = rp*rp + rc*rc - 2*rp*rc*(sinlatp*sinlatc +
-                                                 coslatp*coslatc*coslon);
-
-                kphi = coslatp*sinlatc - sinlatp*coslatc*coslon;
-
-                kappa = rc*rc*coslatc;
+                l_sqr = rp*rp + rc*rc - 2*rp*rc*cospsi;
+                kappa = rc*rc*coslatc[j];
 
                 deltax = rc*kphi;
+                deltay = rc*coslat_sinlon;
 
-                deltay = rc*coslatc*sinlon;
+                weight = wlonlat*glq_r.weights[i]*kappa*inv_dist5(l_sqr);
 
-                res += glq_lon.weights[k]*glq_lat.weights[j]*glq_r.weights[i]*
-                       kappa*(3*deltax*deltay)/pow(l_sqr, 2.5);
+                res += weight*(3*deltax*deltay);
             }
         }
     }
@@ -249,40 +579,41 @@ double tess_gxy(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon
 double tess_gxz(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon,
                 GLQ glq_lat, GLQ glq_r)
 {
-    double d2r = PI/180., l_sqr, kphi, coslatp, coslatc, sinlatp, sinlatc,
-           coslon, cospsi, rc, kappa, deltax, deltaz, res;
+    double d2r = PI/180., l_sqr, coslatp, sinlatp, cospsi, kphi, rc, kappa,
+           wlonlat, weight, deltax, deltaz, res,
+           coslon[GLQ_MAX_ORDER], sinlon[GLQ_MAX_ORDER],
+           coslatc[GLQ_MAX_ORDER], sinlatc[GLQ_MAX_ORDER];
     register int i, j, k;
 
     coslatp = cos(d2r*latp);
     sinlatp = sin(d2r*latp);
 
+    lon_nodes_trig(lonp, &glq_lon, coslon, sinlon);
+    lat_nodes_trig(&glq_lat, coslatc, sinlatc);
+
     res = 0;
 
     for(k = 0; k < glq_lon.order; k++)
     {
         for(j = 0; j < glq_lat.order; j++)
         {
+            wlonlat = glq_lon.weights[k]*glq_lat.weights[j];
+            cospsi = sinlatp*sinlatc[j] + coslatp*coslatc[j]*coslon[k];
+            kphi = coslatp*sinlatc[j] - sinlatp*coslatc[j]*coslon[k];
+
             for(i = 0; i < glq_r.order; i++)
             {
                 rc = glq_r.nodes[i];
-                sinlatc = sin(d2r*glq_lat.nodes[j]);
-                coslatc = cos(d2r*glq_lat.nodes[j]);
-                coslon = cos(d2r*(lonp - glq_lon.nodes[k]));
-
-                cospsi = sinlatp*sinlatc + coslatp*coslatc*coslon;
 
                 l_sqr = rp*rp + rc*rc - 2*rp*rc*cospsi;
-
-                kphi = coslatp*sinlatc - sinlatp*coslatc*coslon;
-
-                kappa = rc*rc*coslatc;
+                kappa = rc*rc*coslatc[j];
 
                 deltax = rc*kphi;
-
                 deltaz = rc*cospsi - rp;
 
-                res += glq_lon.weights[k]*glq_lat.weights[j]*glq_r.weights[i]*
-                       kappa*(3*deltax*deltaz)/pow(l_sqr, 2.5);
+                weight = wlonlat*glq_r.weights[i]*kappa*inv_dist5(l_sqr);
+
+                res += weight*(3*deltax*deltaz);
             }
         }
     }
@@ -298,36 +629,40 @@ double tess_gxz(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon
 double tess_gyy(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon,
                 GLQ glq_lat, GLQ glq_r)
 {
-    double d2r = PI/180., l_sqr, coslatp, coslatc, sinlatp, sinlatc,
-           coslon, sinlon, rc, kappa, deltay, res;
+    double d2r = PI/180., l_sqr, coslatp, sinlatp, cospsi, coslat_sinlon, rc,
+           kappa, wlonlat, weight, deltay, res,
+           coslon[GLQ_MAX_ORDER], sinlon[GLQ_MAX_ORDER],
+           coslatc[GLQ_MAX_ORDER], sinlatc[GLQ_MAX_ORDER];
     register int i, j, k;
 
     coslatp = cos(d2r*latp);
     sinlatp = sin(d2r*latp);
 
+    lon_nodes_trig(lonp, &glq_lon, coslon, sinlon);
+    lat_nodes_trig(&glq_lat, coslatc, sinlatc);
+
     res = 0;
 
     for(k = 0; k < glq_lon.order; k++)
     {
         for(j = 0; j < glq_lat.order; j++)
         {
+            wlonlat = glq_lon.weights[k]*glq_lat.weights[j];
+            cospsi = sinlatp*sinlatc[j] + coslatp*coslatc[j]*coslon[k];
+            coslat_sinlon = coslatc[j]*sinlon[k];
+
             for(i = 0; i < glq_r.order; i++)
             {
                 rc = glq_r.nodes[i];
-                sinlatc = sin(d2r*glq_lat.nodes[j]);
-                coslatc = cos(d2r*glq_lat.nodes[j]);
-                coslon = cos(d2r*(lonp - glq_lon.nodes[k]));
-                sinlon = sin(d2r*(glq_lon.nodes[k] - lonp));
 
-                l_sqr = rp*rp + rc*rc - 2*rp*rc*(sinlatp*sinlatc +
-                                                 coslatp*coslatc*coslon);
+                l_sqr = rp*rp + rc*rc - 2*rp*rc*cospsi;
+                kappa = rc*rc*coslatc[j];
 
-                kappa = rc*rc*coslatc;
+                deltay = rc*coslat_sinlon;
 
-                deltay = rc*coslatc*sinlon;
+                weight = wlonlat*glq_r.weights[i]*kappa*inv_dist5(l_sqr);
 
-                res += glq_lon.weights[k]*glq_lat.weights[j]*glq_r.weights[i]*
-                       kappa*(3*deltay*deltay - l_sqr)/pow(l_sqr, 2.5);
+                res += weight*(3*deltay*deltay - l_sqr);
             }
         }
     }
@@ -343,39 +678,41 @@ double tess_gyy(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon
 double tess_gyz(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon,
                 GLQ glq_lat, GLQ glq_r)
 {
-    double d2r = PI/180., l_sqr, coslatp, coslatc, sinlatp, sinlatc,
-           coslon, sinlon, cospsi, rc, kappa, deltay, deltaz, res;
+    double d2r = PI/180., l_sqr, coslatp, sinlatp, cospsi, coslat_sinlon, rc,
+           kappa, wlonlat, weight, deltay, deltaz, res,
+           coslon[GLQ_MAX_ORDER], sinlon[GLQ_MAX_ORDER],
+           coslatc[GLQ_MAX_ORDER], sinlatc[GLQ_MAX_ORDER];
     register int i, j, k;
 
     coslatp = cos(d2r*latp);
     sinlatp = sin(d2r*latp);
 
+    lon_nodes_trig(lonp, &glq_lon, coslon, sinlon);
+    lat_nodes_trig(&glq_lat, coslatc, sinlatc);
+
     res = 0;
 
     for(k = 0; k < glq_lon.order; k++)
     {
         for(j = 0; j < glq_lat.order; j++)
         {
+            wlonlat = glq_lon.weights[k]*glq_lat.weights[j];
+            cospsi = sinlatp*sinlatc[j] + coslatp*coslatc[j]*coslon[k];
+            coslat_sinlon = coslatc[j]*sinlon[k];
+
             for(i = 0; i < glq_r.order; i++)
             {
                 rc = glq_r.nodes[i];
-                sinlatc = sin(d2r*glq_lat.nodes[j]);
-                coslatc = cos(d2r*glq_lat.nodes[j]);
-                coslon = cos(d2r*(lonp - glq_lon.nodes[k]));
-                sinlon = sin(d2r*(glq_lon.nodes[k] - lonp));
-
-                cospsi = sinlatp*sinlatc + coslatp*coslatc*coslon;
 
                 l_sqr = rp*rp + rc*rc - 2*rp*rc*cospsi;
+                kappa = rc*rc*coslatc[j];
 
-                kappa = rc*rc*coslatc;
-
-                deltay = rc*coslatc*sinlon;
-
+                deltay = rc*coslat_sinlon;
                 deltaz = rc*cospsi - rp;
 
-                res += glq_lon.weights[k]*glq_lat.weights[j]*glq_r.weights[i]*
-                       kappa*(3*deltay*deltaz)/pow(l_sqr, 2.5);
+                weight = wlonlat*glq_r.weights[i]*kappa*inv_dist5(l_sqr);
+
+                res += weight*(3*deltay*deltaz);
             }
         }
     }
@@ -391,36 +728,39 @@ double tess_gyz(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon
 double tess_gzz(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon,
                 GLQ glq_lat, GLQ glq_r)
 {
-    double d2r = PI/180., l_sqr, coslatp, coslatc, sinlatp, sinlatc,
-           coslon, cospsi, rc, kappa, deltaz, res;
+    double d2r = PI/180., l_sqr, coslatp, sinlatp, cospsi, rc, kappa, wlonlat,
+           weight, deltaz, res,
+           coslon[GLQ_MAX_ORDER], sinlon[GLQ_MAX_ORDER],
+           coslatc[GLQ_MAX_ORDER], sinlatc[GLQ_MAX_ORDER];
     register int i, j, k;
 
     coslatp = cos(d2r*latp);
     sinlatp = sin(d2r*latp);
 
+    lon_nodes_trig(lonp, &glq_lon, coslon, sinlon);
+    lat_nodes_trig(&glq_lat, coslatc, sinlatc);
+
     res = 0;
 
     for(k = 0; k < glq_lon.order; k++)
     {
         for(j = 0; j < glq_lat.order; j++)
         {
+            wlonlat = glq_lon.weights[k]*glq_lat.weights[j];
+            cospsi = sinlatp*sinlatc[j] + coslatp*coslatc[j]*coslon[k];
+
             for(i = 0; i < glq_r.order; i++)
             {
                 rc = glq_r.nodes[i];
-                sinlatc = sin(d2r*glq_lat.nodes[j]);
-                coslatc = cos(d2r*glq_lat.nodes[j]);
-                coslon = cos(d2r*(lonp - glq_lon.nodes[k]));
-
-                cospsi = sinlatp*sinlatc + coslatp*coslatc*coslon;
 
                 l_sqr = rp*rp + rc*rc - 2*rp*rc*cospsi;
-
-                kappa = rc*rc*coslatc;
+                kappa = rc*rc*coslatc[j];
 
                 deltaz = rc*cospsi - rp;
 
-                res += glq_lon.weights[k]*glq_lat.weights[j]*glq_r.weights[i]*
-                       kappa*(3*deltaz*deltaz - l_sqr)/pow(l_sqr, 2.5);
+                weight = wlonlat*glq_r.weights[i]*kappa*inv_dist5(l_sqr);
+
+                res += weight*(3*deltaz*deltaz - l_sqr);
             }
         }
     }
@@ -431,18 +771,24 @@ double tess_gzz(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon
     return res;
 }
 
+
 /*Calculate three gravity gradient components simultaneously*/
 void tess_gxz_gyz_gzz(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon,
                 GLQ glq_lat, GLQ glq_r, double *res)
 {
-    double d2r = PI/180., l_sqr, coslatp, coslatc, sinlatp, sinlatc, sinlon,
-           coslon, cospsi, rc, kappa, deltaz, deltax, deltay, kphi,
-           res_gxz, res_gyz, res_gzz;
+    double d2r = PI/180., l_sqr, coslatp, sinlatp, cospsi, kphi, coslat_sinlon,
+           rc, kappa, wlonlat, weight, deltax, deltay, deltaz, res_gxz,
+           res_gyz, res_gzz,
+           coslon[GLQ_MAX_ORDER], sinlon[GLQ_MAX_ORDER],
+           coslatc[GLQ_MAX_ORDER], sinlatc[GLQ_MAX_ORDER];
     register int i, j, k;
 
     coslatp = cos(d2r*latp);
     sinlatp = sin(d2r*latp);
 
+    lon_nodes_trig(lonp, &glq_lon, coslon, sinlon);
+    lat_nodes_trig(&glq_lat, coslatc, sinlatc);
+
     res_gxz = 0;
     res_gyz = 0;
     res_gzz = 0;
@@ -451,31 +797,27 @@ void tess_gxz_gyz_gzz(TESSEROID tess, double lonp, double latp, double rp, GLQ g
     {
         for(j = 0; j < glq_lat.order; j++)
         {
+            wlonlat = glq_lon.weights[k]*glq_lat.weights[j];
+            cospsi = sinlatp*sinlatc[j] + coslatp*coslatc[j]*coslon[k];
+            kphi = coslatp*sinlatc[j] - sinlatp*coslatc[j]*coslon[k];
+            coslat_sinlon = coslatc[j]*sinlon[k];
+
             for(i = 0; i < glq_r.order; i++)
             {
                 rc = glq_r.nodes[i];
-                sinlatc = sin(d2r*glq_lat.nodes[j]);
-                coslatc = cos(d2r*glq_lat.nodes[j]);
-                coslon = cos(d2r*(lonp - glq_lon.nodes[k]));
-                sinlon = sin(d2r*(glq_lon.nodes[k] - lonp));
-                cospsi = sinlatp*sinlatc + coslatp*coslatc*coslon;
 
                 l_sqr = rp*rp + rc*rc - 2*rp*rc*cospsi;
-                kphi = coslatp*sinlatc - sinlatp*coslatc*coslon;
-                kappa = rc*rc*coslatc;
+                kappa = rc*rc*coslatc[j];
 
                 deltax = rc*kphi;
-                deltay = rc*coslatc*sinlon;
+                deltay = rc*coslat_sinlon;
                 deltaz = rc*cospsi - rp;
 
-                res_gxz += glq_lon.weights[k]*glq_lat.weights[j]*glq_r.weights[i]*
-                       kappa*(3*deltax*deltaz)/pow(l_sqr, 2.5);
+                weight = wlonlat*glq_r.weights[i]*kappa*inv_dist5(l_sqr);
 
-                res_gyz += glq_lon.weights[k]*glq_lat.weights[j]*glq_r.weights[i]*
-                              kappa*(3*deltay*deltaz)/pow(l_sqr, 2.5);
-
-                res_gzz += glq_lon.weights[k]*glq_lat.weights[j]*glq_r.weights[i]*
-                       kappa*(3*deltaz*deltaz - l_sqr)/pow(l_sqr, 2.5);
+                res_gxz += weight*(3*deltax*deltaz);
+                res_gyz += weight*(3*deltay*deltaz);
+                res_gzz += weight*(3*deltaz*deltaz - l_sqr);
             }
         }
     }
@@ -496,17 +838,23 @@ void tess_gxz_gyz_gzz(TESSEROID tess, double lonp, double latp, double rp, GLQ g
     return;
 }
 
+
 void tess_gxx_gxy_gxz(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon,
                 GLQ glq_lat, GLQ glq_r, double *res)
 {
-    double d2r = PI/180., l_sqr, coslatp, coslatc, sinlatp, sinlatc, sinlon,
-           coslon, cospsi, rc, kappa, deltaz, deltax, deltay, kphi,
-           res_gxx, res_gxy, res_gxz;
+    double d2r = PI/180., l_sqr, coslatp, sinlatp, cospsi, kphi, coslat_sinlon,
+           rc, kappa, wlonlat, weight, deltax, deltay, deltaz, res_gxx,
+           res_gxy, res_gxz,
+           coslon[GLQ_MAX_ORDER], sinlon[GLQ_MAX_ORDER],
+           coslatc[GLQ_MAX_ORDER], sinlatc[GLQ_MAX_ORDER];
     register int i, j, k;
 
     coslatp = cos(d2r*latp);
     sinlatp = sin(d2r*latp);
 
+    lon_nodes_trig(lonp, &glq_lon, coslon, sinlon);
+    lat_nodes_trig(&glq_lat, coslatc, sinlatc);
+
     res_gxx = 0;
     res_gxy = 0;
     res_gxz = 0;
@@ -515,31 +863,27 @@ void tess_gxx_gxy_gxz(TESSEROID tess, double lonp, double latp, double rp, GLQ g
     {
         for(j = 0; j < glq_lat.order; j++)
         {
+            wlonlat = glq_lon.weights[k]*glq_lat.weights[j];
+            cospsi = sinlatp*sinlatc[j] + coslatp*coslatc[j]*coslon[k];
+            kphi = coslatp*sinlatc[j] - sinlatp*coslatc[j]*coslon[k];
+            coslat_sinlon = coslatc[j]*sinlon[k];
+
             for(i = 0; i < glq_r.order; i++)
             {
                 rc = glq_r.nodes[i];
-                sinlatc = sin(d2r*glq_lat.nodes[j]);
-                coslatc = cos(d2r*glq_lat.nodes[j]);
-                coslon = cos(d2r*(lonp - glq_lon.nodes[k]));
-                sinlon = sin(d2r*(glq_lon.nodes[k] - lonp));
-                cospsi = sinlatp*sinlatc + coslatp*coslatc*coslon;
 
                 l_sqr = rp*rp + rc*rc - 2*rp*rc*cospsi;
-                kphi = coslatp*sinlatc - sinlatp*coslatc*coslon;
-                kappa = rc*rc*coslatc;
+                kappa = rc*rc*coslatc[j];
 
                 deltax = rc*kphi;
-                deltay = rc*coslatc*sinlon;
+                deltay = rc*coslat_sinlon;
                 deltaz = rc*cospsi - rp;
 
-                res_gxx += glq_lon.weights[k]*glq_lat.weights[j]*glq_r.weights[i]*
-                       kappa*(3*rc*kphi*rc*kphi - l_sqr)/pow(l_sqr, 2.5);
-
-                res_gxy += glq_lon.weights[k]*glq_lat.weights[j]*glq_r.weights[i]*
-                              kappa*(3*deltax*deltay)/pow(l_sqr, 2.5);
+                weight = wlonlat*glq_r.weights[i]*kappa*inv_dist5(l_sqr);
 
-                res_gxz += glq_lon.weights[k]*glq_lat.weights[j]*glq_r.weights[i]*
-                                     kappa*(3*deltax*deltaz)/pow(l_sqr, 2.5);
+                res_gxx += weight*(3*deltax*deltax - l_sqr);
+                res_gxy += weight*(3*deltax*deltay);
+                res_gxz += weight*(3*deltax*deltaz);
             }
         }
     }
@@ -551,7 +895,7 @@ void tess_gxx_gxy_gxz(TESSEROID tess, double lonp, double latp, double rp, GLQ g
            (tess.r2 - tess.r1)*0.125;
 
     res_gxz *= SI2EOTVOS*G*tess.density*d2r*(tess.e - tess.w)*d2r*(tess.n - tess.s)*
-                  (tess.r2 - tess.r1)*0.125;
+           (tess.r2 - tess.r1)*0.125;
 
     res[0] = res_gxx;
     res[1] = res_gxy;
@@ -561,18 +905,22 @@ void tess_gxx_gxy_gxz(TESSEROID tess, double lonp, double latp, double rp, GLQ g
 }
 
 
-
 void tess_gxy_gyy_gyz(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon,
                 GLQ glq_lat, GLQ glq_r, double *res)
 {
-    double d2r = PI/180., l_sqr, coslatp, coslatc, sinlatp, sinlatc, sinlon,
-           coslon, cospsi, rc, kappa, deltaz, deltax, deltay, kphi,
-           res_gxy, res_gyy, res_gyz;
+    double d2r = PI/180., l_sqr, coslatp, sinlatp, cospsi, kphi, coslat_sinlon,
+           rc, kappa, wlonlat, weight, deltax, deltay, deltaz, res_gxy,
+           res_gyy, res_gyz,
+           coslon[GLQ_MAX_ORDER], sinlon[GLQ_MAX_ORDER],
+           coslatc[GLQ_MAX_ORDER], sinlatc[GLQ_MAX_ORDER];
     register int i, j, k;
 
     coslatp = cos(d2r*latp);
     sinlatp = sin(d2r*latp);
 
+    lon_nodes_trig(lonp, &glq_lon, coslon, sinlon);
+    lat_nodes_trig(&glq_lat, coslatc, sinlatc);
+
     res_gxy = 0;
     res_gyy = 0;
     res_gyz = 0;
@@ -581,32 +929,27 @@ void tess_gxy_gyy_gyz(TESSEROID tess, double lonp, double latp, double rp, GLQ g
     {
         for(j = 0; j < glq_lat.order; j++)
         {
+            wlonlat = glq_lon.weights[k]*glq_lat.weights[j];
+            cospsi = sinlatp*sinlatc[j] + coslatp*coslatc[j]*coslon[k];
+            kphi = coslatp*sinlatc[j] - sinlatp*coslatc[j]*coslon[k];
+            coslat_sinlon = coslatc[j]*sinlon[k];
+
             for(i = 0; i < glq_r.order; i++)
             {
                 rc = glq_r.nodes[i];
-                sinlatc = sin(d2r*glq_lat.nodes[j]);
-                coslatc = cos(d2r*glq_lat.nodes[j]);
-                coslon = cos(d2r*(lonp - glq_lon.nodes[k]));
-                sinlon = sin(d2r*(glq_lon.nodes[k] - lonp));
-                cospsi = sinlatp*sinlatc + coslatp*coslatc*coslon;
 
                 l_sqr = rp*rp + rc*rc - 2*rp*rc*cospsi;
-                kphi = coslatp*sinlatc - sinlatp*coslatc*coslon;
-                kappa = rc*rc*coslatc;
+                kappa = rc*rc*coslatc[j];
 
                 deltax = rc*kphi;
-                deltay = rc*coslatc*sinlon;
+                deltay = rc*coslat_sinlon;
                 deltaz = rc*cospsi - rp;
 
-                res_gxy += glq_lon.weights[k]*glq_lat.weights[j]*glq_r.weights[i]*
-                              kappa*(3*deltax*deltay)/pow(l_sqr, 2.5);
-
-                res_gyy += glq_lon.weights[k]*glq_lat.weights[j]*glq_r.weights[i]*
-                              kappa*(3*deltay*deltay - l_sqr)/pow(l_sqr, 2.5);
-
-                res_gyz += glq_lon.weights[k]*glq_lat.weights[j]*glq_r.weights[i]*
-                              kappa*(3*deltay*deltaz)/pow(l_sqr, 2.5);
+                weight = wlonlat*glq_r.weights[i]*kappa*inv_dist5(l_sqr);
 
+                res_gxy += weight*(3*deltax*deltay);
+                res_gyy += weight*(3*deltay*deltay - l_sqr);
+                res_gyz += weight*(3*deltay*deltaz);
             }
         }
     }
@@ -615,10 +958,10 @@ void tess_gxy_gyy_gyz(TESSEROID tess, double lonp, double latp, double rp, GLQ g
            (tess.r2 - tess.r1)*0.125;
 
     res_gyy *= SI2EOTVOS*G*tess.density*d2r*(tess.e - tess.w)*d2r*(tess.n - tess.s)*
-                  (tess.r2 - tess.r1)*0.125;
+           (tess.r2 - tess.r1)*0.125;
 
     res_gyz *= SI2EOTVOS*G*tess.density*d2r*(tess.e - tess.w)*d2r*(tess.n - tess.s)*
-                  (tess.r2 - tess.r1)*0.125;
+           (tess.r2 - tess.r1)*0.125;
 
     res[0] = res_gxy;
     res[1] = res_gyy;
@@ -626,3 +969,341 @@ void tess_gxy_gyy_gyz(TESSEROID tess, double lonp, double latp, double rp, GLQ g
 
     return;
 }
+
+
+/* Calculate the six unique components of the gravity gradient tensor at once.
+   The expression of each component is the same as in the single component
+   functions. */
+void tess_ggt(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon,
+                GLQ glq_lat, GLQ glq_r, double *res)
+{
+    double d2r = PI/180., l_sqr, coslatp, sinlatp, cospsi, kphi, coslat_sinlon,
+           rc, kappa, wlonlat, weight, deltax, deltay, deltaz, res_gxx,
+           res_gxy, res_gxz, res_gyy, res_gyz, res_gzz, scale,
+           coslon[GLQ_MAX_ORDER], sinlon[GLQ_MAX_ORDER],
+           coslatc[GLQ_MAX_ORDER], sinlatc[GLQ_MAX_ORDER];
+    int i, j, k;
+
+    coslatp = cos(d2r*latp);
+    sinlatp = sin(d2r*latp);
+
+    lon_nodes_trig(lonp, &glq_lon, coslon, sinlon);
+    lat_nodes_trig(&glq_lat, coslatc, sinlatc);
+
+    res_gxx = 0;
+    res_gxy = 0;
+    res_gxz = 0;
+    res_gyy = 0;
+    res_gyz = 0;
+    res_gzz = 0;
+
+    for(k = 0; k < glq_lon.order; k++)
+    {
+        for(j = 0; j < glq_lat.order; j++)
+        {
+            wlonlat = glq_lon.weights[k]*glq_lat.weights[j];
+            cospsi = sinlatp*sinlatc[j] + coslatp*coslatc[j]*coslon[k];
+            kphi = coslatp*sinlatc[j] - sinlatp*coslatc[j]*coslon[k];
+            coslat_sinlon = coslatc[j]*sinlon[k];
+
+            for(i = 0; i < glq_r.order; i++)
+            {
+                rc = glq_r.nodes[i];
+
+                l_sqr = rp*rp + rc*rc - 2*rp*rc*cospsi;
+                kappa = rc*rc*coslatc[j];
+
+                deltax = rc*kphi;
+                deltay = rc*coslat_sinlon;
+                deltaz = rc*cospsi - rp;
+
+                weight = wlonlat*glq_r.weights[i]*kappa*inv_dist5(l_sqr);
+
+                res_gxx += weight*(3*deltax*deltax - l_sqr);
+                res_gxy += weight*(3*deltax*deltay);
+                res_gxz += weight*(3*deltax*deltaz);
+                res_gyy += weight*(3*deltay*deltay - l_sqr);
+                res_gyz += weight*(3*deltay*deltaz);
+                res_gzz += weight*(3*deltaz*deltaz - l_sqr);
+            }
+        }
+    }
+
+    scale = SI2EOTVOS*G*tess.density*d2r*(tess.e - tess.w)*d2r*(tess.n - tess.s)*
+           (tess.r2 - tess.r1)*0.125;
+
+    res[0] = res_gxx*scale;
+    res[1] = res_gxy*scale;
+    res[2] = res_gxz*scale;
+    res[3] = res_gyy*scale;
+    res[4] = res_gyz*scale;
+    res[5] = res_gzz*scale;
+
+    return;
+}
+
+
+/* Scale the quadrature nodes to the tesseroids of a block */
+void tess_block_nodes(const TESS_BLOCK *block, double lonp, const GLQ *glq_lon,
+    const GLQ *glq_lat, const GLQ *glq_r, TESS_BLOCK_NODES *nodes)
+{
+    double d2r = PI/180., plus, minus, lon, lat;
+    int i, j, k, l, last = block->size - 1;
+
+    for(l = 0; l < block->size; l++)
+    {
+        /* Same scaling as glq_set_limits */
+        plus = 0.5*(block->e[l] + block->w[l]);
+        minus = 0.5*(block->e[l] - block->w[l]);
+        for(k = 0; k < glq_lon->order; k++)
+        {
+            lon = minus*glq_lon->nodes_unscaled[k] + plus;
+            nodes->coslon[k][l] = cos(d2r*(lonp - lon));
+            nodes->sinlon[k][l] = sin(d2r*(lon - lonp));
+        }
+        plus = 0.5*(block->n[l] + block->s[l]);
+        minus = 0.5*(block->n[l] - block->s[l]);
+        for(j = 0; j < glq_lat->order; j++)
+        {
+            lat = minus*glq_lat->nodes_unscaled[j] + plus;
+            nodes->coslat[j][l] = cos(d2r*lat);
+            nodes->sinlat[j][l] = sin(d2r*lat);
+        }
+        plus = 0.5*(block->r2[l] + block->r1[l]);
+        minus = 0.5*(block->r2[l] - block->r1[l]);
+        for(i = 0; i < glq_r->order; i++)
+        {
+            nodes->r[i][l] = minus*glq_r->nodes_unscaled[i] + plus;
+        }
+        nodes->scale[l] = SI2EOTVOS*G*d2r*(block->e[l] - block->w[l])*d2r*
+                          (block->n[l] - block->s[l])*
+                          (block->r2[l] - block->r1[l])*0.125;
+    }
+    for(l = block->size; l < TESS_BLOCK_SIZE; l++)
+    {
+        for(k = 0; k < glq_lon->order; k++)
+        {
+            nodes->coslon[k][l] = nodes->coslon[k][last];
+            nodes->sinlon[k][l] = nodes->sinlon[k][last];
+        }
+        for(j = 0; j < glq_lat->order; j++)
+        {
+            nodes->coslat[j][l] = nodes->coslat[j][last];
+            nodes->sinlat[j][l] = nodes->sinlat[j][last];
+        }
+        for(i = 0; i < glq_r->order; i++)
+        {
+            nodes->r[i][l] = nodes->r[i][last];
+        }
+        nodes->scale[l] = nodes->scale[last];
+    }
+}
+
+
+/* Calculate the full gravity gradient tensor of the tesseroids of a block */
+void tess_ggt_block(const TESS_BLOCK *block, double lonp, double latp,
+    double rp, const GLQ *glq_lon, const GLQ *glq_lat, const GLQ *glq_r,
+    double *res)
+{
+    TESS_BLOCK_NODES nodes;
+    double d2r = PI/180., l_sqr, coslatp, sinlatp, rc, kappa, wlonlat, wlonlatr,
+           weight, deltax, deltay, deltaz, cospsi[TESS_BLOCK_SIZE],
+           kphi[TESS_BLOCK_SIZE], coslat_sinlon[TESS_BLOCK_SIZE],
+           sums[6][TESS_BLOCK_SIZE];
+    int i, j, k, l, c;
+
+    coslatp = cos(d2r*latp);
+    sinlatp = sin(d2r*latp);
+    tess_block_nodes(block, lonp, glq_lon, glq_lat, glq_r, &nodes);
+    for(c = 0; c < 6; c++)
+    {
+        for(l = 0; l < TESS_BLOCK_SIZE; l++)
+        {
+            sums[c][l] = 0;
+        }
+    }
+
+    /* The same operations as tess_ggt, with the tesseroids in the innermost
+       loop */
+    for(k = 0; k < glq_lon->order; k++)
+    {
+        for(j = 0; j < glq_lat->order; j++)
+        {
+            wlonlat = glq_lon->weights[k]*glq_lat->weights[j];
+            for(l = 0; l < TESS_BLOCK_SIZE; l++)
+            {
+                cospsi[l] = sinlatp*nodes.sinlat[j][l] +
+                            coslatp*nodes.coslat[j][l]*nodes.coslon[k][l];
+                kphi[l] = coslatp*nodes.sinlat[j][l] -
+                          sinlatp*nodes.coslat[j][l]*nodes.coslon[k][l];
+                coslat_sinlon[l] = nodes.coslat[j][l]*nodes.sinlon[k][l];
+            }
+            for(i = 0; i < glq_r->order; i++)
+            {
+                wlonlatr = wlonlat*glq_r->weights[i];
+                for(l = 0; l < TESS_BLOCK_SIZE; l++)
+                {
+                    rc = nodes.r[i][l];
+                    l_sqr = rp*rp + rc*rc - 2*rp*rc*cospsi[l];
+                    kappa = rc*rc*nodes.coslat[j][l];
+
+                    deltax = rc*kphi[l];
+                    deltay = rc*coslat_sinlon[l];
+                    deltaz = rc*cospsi[l] - rp;
+
+                    weight = wlonlatr*kappa*inv_dist5(l_sqr);
+
+                    sums[0][l] += weight*(3*deltax*deltax - l_sqr);
+                    sums[1][l] += weight*(3*deltax*deltay);
+                    sums[2][l] += weight*(3*deltax*deltaz);
+                    sums[3][l] += weight*(3*deltay*deltay - l_sqr);
+                    sums[4][l] += weight*(3*deltay*deltaz);
+                    sums[5][l] += weight*(3*deltaz*deltaz - l_sqr);
+                }
+            }
+        }
+    }
+
+    for(c = 0; c < 6; c++)
+    {
+        for(l = 0; l < TESS_BLOCK_SIZE; l++)
+        {
+            res[c*TESS_BLOCK_SIZE + l] = sums[c][l]*nodes.scale[l];
+        }
+    }
+}
+
+
+/* Calculate the gravity gradient tensor of tesseroid t as a point mass if the
+   point is far enough */
+int tess_model_ggt_far(const TESS_MODEL *model, int t, double ratio,
+    double rp, double sinlatp, double coslatp, double sinlonp, double coslonp,
+    double *res)
+{
+    double rc, coslatc, sinlatc, cosdlon, sindlon, cospsi, kphi, l_sqr,
+           deltax, deltay, deltaz, weight, dmin;
+
+    rc = model->rc[t];
+    coslatc = model->cos_latc[t];
+    sinlatc = model->sin_latc[t];
+    /* cos and sin of the longitude of the center minus the one of the point */
+    cosdlon = model->cos_lonc[t]*coslonp + model->sin_lonc[t]*sinlonp;
+    sindlon = model->sin_lonc[t]*coslonp - model->cos_lonc[t]*sinlonp;
+    cospsi = sinlatp*sinlatc + coslatp*coslatc*cosdlon;
+    l_sqr = rp*rp + rc*rc - 2*rp*rc*cospsi;
+    dmin = ratio*model->dim[t];
+    if(l_sqr < dmin*dmin)
+    {
+        return 0;
+    }
+    kphi = coslatp*sinlatc - sinlatp*coslatc*cosdlon;
+    deltax = rc*kphi;
+    deltay = rc*coslatc*sindlon;
+    deltaz = rc*cospsi - rp;
+    weight = SI2EOTVOS*G*model->mass[t]*inv_dist5(l_sqr);
+    res[0] = weight*(3*deltax*deltax - l_sqr);
+    res[1] = weight*(3*deltax*deltay);
+    res[2] = weight*(3*deltax*deltaz);
+    res[3] = weight*(3*deltay*deltay - l_sqr);
+    res[4] = weight*(3*deltay*deltaz);
+    res[5] = weight*(3*deltaz*deltaz - l_sqr);
+    return 1;
+}
+
+
+/* Number of bytes of the node table of size tesseroids */
+double tess_nodes_bytes(int size, int lon_order, int lat_order, int r_order)
+{
+    return (double)size*sizeof(double)*(lon_order + 2*lat_order + r_order +
+                                        lon_order*lat_order*r_order);
+}
+
+
+/* Make the node table of the first size tesseroids of a model */
+TESS_NODES * tess_nodes_new(const TESS_MODEL *model, int size, int lon_order,
+                            int lat_order, int r_order)
+{
+    TESS_NODES *nodes;
+    GLQ *glq_lon, *glq_lat, *glq_r;
+    double d2r = PI/180., scale, *lon, *coslat, *sinlat, *r, *w;
+    int t, i, j, k;
+
+    nodes = (TESS_NODES *)malloc(sizeof(TESS_NODES));
+    if(nodes == NULL)
+    {
+        return NULL;
+    }
+    nodes->size = size;
+    nodes->lon_order = lon_order;
+    nodes->lat_order = lat_order;
+    nodes->r_order = r_order;
+    nodes->stride = lon_order + 2*lat_order + r_order +
+                    lon_order*lat_order*r_order;
+    nodes->data = (double *)malloc((size_t)size*nodes->stride*sizeof(double));
+    glq_lon = glq_new(lon_order, -1, 1);
+    glq_lat = glq_new(lat_order, -1, 1);
+    glq_r = glq_new(r_order, -1, 1);
+    if(nodes->data == NULL || glq_lon == NULL || glq_lat == NULL ||
+       glq_r == NULL)
+    {
+        if(glq_lon != NULL)
+            glq_free(glq_lon);
+        if(glq_lat != NULL)
+            glq_free(glq_lat);
+        if(glq_r != NULL)
+            glq_free(glq_r);
+        free(nodes->data);
+        free(nodes);
+        return NULL;
+    }
+    for(t = 0; t < size; t++)
+    {
+        lon = nodes->data + (size_t)t*nodes->stride;
+        coslat = lon + lon_order;
+        sinlat = coslat + lat_order;
+        r = sinlat + lat_order;
+        w = r + r_order;
+        /* Same scaling as the drivers do before calling the kernels */
+        glq_set_limits(model->w[t], model->e[t], glq_lon);
+        glq_set_limits(model->s[t], model->n[t], glq_lat);
+        glq_set_limits(model->r1[t], model->r2[t], glq_r);
+        scale = SI2EOTVOS*G*d2r*(model->e[t] - model->w[t])*d2r*
+                (model->n[t] - model->s[t])*(model->r2[t] - model->r1[t])*0.125;
+        for(k = 0; k < lon_order; k++)
+        {
+            lon[k] = glq_lon->nodes[k];
+        }
+        for(j = 0; j < lat_order; j++)
+        {
+            coslat[j] = cos(d2r*glq_lat->nodes[j]);
+            sinlat[j] = sin(d2r*glq_lat->nodes[j]);
+        }
+        for(i = 0; i < r_order; i++)
+        {
+            r[i] = glq_r->nodes[i];
+        }
+        for(k = 0; k < lon_order; k++)
+        {
+            for(j = 0; j < lat_order; j++)
+            {
+                for(i = 0; i < r_order; i++)
+                {
+                    *w++ = glq_lon->weights[k]*glq_lat->weights[j]*
+                           glq_r->weights[i]*r[i]*r[i]*coslat[j]*scale;
+                }
+            }
+        }
+    }
+    glq_free(glq_lon);
+    glq_free(glq_lat);
+    glq_free(glq_r);
+    return nodes;
+}
+
+
+/* Free the memory of a node table */
+void tess_nodes_free(TESS_NODES *nodes)
+{
+    free(nodes->data);
+    free(nodes);
+}
@@ -74,10 +74,113 @@ Karlsruhe, Germany.
 /* Needed for definition of GLQ */
 #include "glq.h"
 
+/** Quadrature nodes of the tesseroids of a model, scaled once to the borders
+of each tesseroid. Each tesseroid takes stride doubles in data:
+
+    lon[lon_order]      longitude nodes in degrees
+    coslat[lat_order]   cossine of the latitude nodes
+    sinlat[lat_order]   sine of the latitude nodes
+    r[r_order]          radius nodes
+    w[lon_order*lat_order*r_order]
+
+w holds the products of the three weights, of r^2*cos(lat) and of the volume
+scale factor of a unit density tesseroid, ordered by lon, lat and r node.
+*/
+typedef struct tess_nodes_struct
+{
+    int size; /**< number of tesseroids in the table */
+    int lon_order, lat_order, r_order; /**< orders of the GLQ */
+    int stride; /**< number of doubles of each tesseroid */
+    double *data; /**< the table */
+} TESS_NODES;
+
+/* Largest number of times the adaptative drivers can divide a tesseroid */
+#define TESS_ADAPT_MAX_DEPTH 60
+/* Number of divisions allowed if no TESS_ADAPT is given */
+#define TESS_ADAPT_DEFAULT_DEPTH 30
+/* Number of tesseroids the block kernels calculate at once, the number of
+   doubles in an AVX-512 register */
+#define TESS_BLOCK_SIZE 8
+
+/** Borders of up to TESS_BLOCK_SIZE tesseroids of unit density, or pieces of
+tesseroids, stored by column for the block kernels */
+typedef struct tess_block_struct
+{
+    double w[TESS_BLOCK_SIZE] __attribute__((aligned(64)));
+    double e[TESS_BLOCK_SIZE] __attribute__((aligned(64)));
+    double s[TESS_BLOCK_SIZE] __attribute__((aligned(64)));
+    double n[TESS_BLOCK_SIZE] __attribute__((aligned(64)));
+    double r1[TESS_BLOCK_SIZE] __attribute__((aligned(64)));
+    double r2[TESS_BLOCK_SIZE] __attribute__((aligned(64)));
+    int size; /**< number of tesseroids in the block */
+} TESS_BLOCK;
+
+/** Quadrature nodes of the tesseroids of a block, scaled to their borders.
+Node k of tesseroid l is at [k][l], so a SIMD register holds the same node of
+all tesseroids. */
+typedef struct tess_block_nodes_struct
+{
+    /* cos(lonp - lon) and sin(lon - lonp) of the longitude nodes */
+    double coslon[GLQ_MAX_ORDER][TESS_BLOCK_SIZE] __attribute__((aligned(64)));
+    double sinlon[GLQ_MAX_ORDER][TESS_BLOCK_SIZE] __attribute__((aligned(64)));
+    /* cossine and sine of the latitude nodes */
+    double coslat[GLQ_MAX_ORDER][TESS_BLOCK_SIZE] __attribute__((aligned(64)));
+    double sinlat[GLQ_MAX_ORDER][TESS_BLOCK_SIZE] __attribute__((aligned(64)));
+    /* radius nodes */
+    double r[GLQ_MAX_ORDER][TESS_BLOCK_SIZE] __attribute__((aligned(64)));
+    /* volume scale factor of each tesseroid */
+    double scale[TESS_BLOCK_SIZE] __attribute__((aligned(64)));
+} TESS_BLOCK_NODES;
+
+/** Type of the block kernels. They calculate the six unique components of
+the gravity gradient tensor of every tesseroid of a block. res receives
+TESS_BLOCK_SIZE values of gxx, then as many of gxy, gxz, gyy, gyz and gzz; the
+values past the size of the block are to be ignored. Only the orders, the
+unscaled nodes and the weights of the GLQ structures are used, so their
+limits need not be set. */
+typedef void (*TESS_BLOCK_KERNEL)(const TESS_BLOCK *, double, double, double,
+                                  const GLQ *, const GLQ *, const GLQ *,
+                                  double *);
+
+/** Limit and statistics of the adaptative division. Each thread needs its
+own. */
+typedef struct tess_adapt_struct
+{
+    int max_depth; /**< number of times a tesseroid can be divided, from 0 to
+                        TESS_ADAPT_MAX_DEPTH */
+    long depth_hits; /**< number of times a tesseroid still too close to the
+                          point was not divided because of max_depth */
+    long splits[TESS_ADAPT_MAX_DEPTH]; /**< number of tesseroids divided at
+                                            each depth */
+    long leaves; /**< number of pieces calculated with the GLQ */
+} TESS_ADAPT;
+
 double calc_tess_model(TESSEROID *model, int size, double lonp, double latp, double rp, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r, double (*field)(TESSEROID, double, double, double, GLQ, GLQ, GLQ));
 void calc_tess_model_triple(TESSEROID *model, int size, double lonp, double latp, double rp, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r,
   void (*field_triple)(TESSEROID, double, double, double, GLQ, GLQ, GLQ, double*), double *res);
 double calc_tess_model_adapt(TESSEROID *model, int size, double lonp, double latp, double rp, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r, double (*field)(TESSEROID, double, double, double, GLQ, GLQ, GLQ), double ratio);
+void calc_tess_model_adapt_triple(TESSEROID *model, int size, double lonp, double latp, double rp, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r,
+  void (*field_triple)(TESSEROID, double, double, double, GLQ, GLQ, GLQ, double*), double ratio, TESS_ADAPT *adapt, double *res);
+void calc_tess_model_ggt(TESSEROID *model, int size, double lonp, double latp, double rp, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r,
+  void (*field_ggt)(TESSEROID, double, double, double, GLQ, GLQ, GLQ, double*), double *res);
+void calc_tess_model_adapt_ggt(TESSEROID *model, int size, double lonp, double latp, double rp, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r,
+  void (*field_ggt)(TESSEROID, double, double, double, GLQ, GLQ, GLQ, double*), double ratio, TESS_ADAPT *adapt, double *res);
+
+/* Tell if the adaptative drivers divide a tesseroid, that is, if the point is
+   closer to it than ratio times its size without being inside it. sinlatp and
+   coslatp are the sine and cossine of latp. */
+int tess_adapt_split(double w, double e, double s, double n, double r1,
+    double r2, double lonp, double latp, double rp, double sinlatp,
+    double coslatp, double ratio);
+
+/* Adaptatively calculate the full gravity gradient tensor of a tesseroid of
+   unit density given by its borders, as calc_tess_model_adapt_ggt. The leaves
+   of the division are calculated TESS_BLOCK_SIZE at a time with a block
+   kernel. index is the number of the tesseroid in the messages. */
+void calc_tess_adapt_block(double w, double e, double s, double n, double r1,
+    double r2, int index, double lonp, double latp, double rp, GLQ *glq_lon,
+    GLQ *glq_lat, GLQ *glq_r, TESS_BLOCK_KERNEL field_block, double ratio, TESS_ADAPT *adapt,
+    double *res);
 
 double tess_gxx(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon, GLQ glq_lat, GLQ glq_r);
 double tess_gxy(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon, GLQ glq_lat, GLQ glq_r);
@@ -90,4 +193,44 @@ void tess_gxz_gyz_gzz(TESSEROID tess, double lonp, double latp, double rp, GLQ g
 void tess_gxx_gxy_gxz(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon, GLQ glq_lat, GLQ glq_r, double *res);
 void tess_gxy_gyy_gyz(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon, GLQ glq_lat, GLQ glq_r, double *res);
 
+/* Number of bytes of the node table of size tesseroids */
+double tess_nodes_bytes(int size, int lon_order, int lat_order, int r_order);
+
+/* Make the node table of the first size tesseroids of a model. Returns NULL
+   if there was an error. */
+TESS_NODES * tess_nodes_new(const TESS_MODEL *model, int size, int lon_order,
+                            int lat_order, int r_order);
+void tess_nodes_free(TESS_NODES *nodes);
+
+/* Type of the kernels that use a node table, made by tess_fixed_nodes. They
+   calculate the gradients of the unit density tesseroid t of the table. */
+typedef void (*TESS_NODES_KERNEL)(const TESS_NODES *, int, double, double,
+                                  double, double*);
+
+/* Calculate the six unique components of the gravity gradient tensor at once.
+   res receives gxx, gxy, gxz, gyy, gyz and gzz in this order. */
+void tess_ggt(TESSEROID tess, double lonp, double latp, double rp, GLQ glq_lon, GLQ glq_lat, GLQ glq_r, double *res);
+
+/* Scale the quadrature nodes to the tesseroids of a block for the block
+   kernels. The lanes past the size of the block get the nodes of its last
+   tesseroid, so the kernels can calculate them without special cases. */
+void tess_block_nodes(const TESS_BLOCK *block, double lonp, const GLQ *glq_lon,
+    const GLQ *glq_lat, const GLQ *glq_r, TESS_BLOCK_NODES *nodes);
+
+/* Block version of tess_ggt for the tesseroids of a block, with the same
+   arithmetic for each of them. The scalar reference of the SIMD versions in
+   grav_tess_simd.h. */
+void tess_ggt_block(const TESS_BLOCK *block, double lonp, double latp,
+    double rp, const GLQ *glq_lon, const GLQ *glq_lat, const GLQ *glq_r,
+    double *res);
+
+/* Far field approximation of tess_ggt for the unit density tesseroid t of a
+   model: the tesseroid is taken as a point mass at its center of mass. This
+   is only done if the point is farther than ratio times the size of the
+   tesseroid from the center of mass. The latitude and longitude of the point
+   are given by their sine and cossine.
+   Returns 1 and fills res in the order of tess_ggt if the point was far
+   enough, 0 otherwise. */
+int tess_model_ggt_far(const TESS_MODEL *model, int t, double ratio, double rp, double sinlatp, double coslatp, double sinlonp, double coslonp, double *res);
+
 #endif
@@ -0,0 +1,379 @@
+/*
+Versions of the tesseroid kernels specialized at compile time for the most
+used GLQ orders.
+*/
+
+
+#include <math.h>
+#include "constants.h"
+#include "geometry.h"
+#include "glq.h"
+#include "grav_tess.h"
+#include "grav_tess_simd.h"
+#include "grav_tess_fixed.h"
+
+
+/* Components of the gravity gradient tensor */
+enum {GXX, GXY, GXZ, GYY, GYZ, GZZ};
+
+
+/* Weights of the Gauss-Legendre quadrature of order N. These are the values
+   calculated by glq_weights, digit by digit, so that the specialized kernels
+   give the same results as the generic ones. */
+template<int N> struct glq_fixed;
+
+template<> struct glq_fixed<2>
+{
+    static constexpr double weights[2] = {1.0000000000000002,
+                                          1.0000000000000002};
+};
+
+template<> struct glq_fixed<3>
+{
+    static constexpr double weights[3] = {0.55555555555555525,
+                                          0.88888888888888884,
+                                          0.55555555555555525};
+};
+
+template<> struct glq_fixed<4>
+{
+    static constexpr double weights[4] = {0.34785484513745374,
+                                          0.65214515486254609,
+                                          0.65214515486254609,
+                                          0.34785484513745374};
+};
+
+
+/* One component of the gravity gradient tensor at a node, without the
+   1/l^5 factor */
+template<int C>
+static inline double tensor_comp(double deltax, double deltay, double deltaz,
+                                 double l_sqr)
+{
+    if constexpr(C == GXX) return 3*deltax*deltax - l_sqr;
+    if constexpr(C == GXY) return 3*deltax*deltay;
+    if constexpr(C == GXZ) return 3*deltax*deltaz;
+    if constexpr(C == GYY) return 3*deltay*deltay - l_sqr;
+    if constexpr(C == GYZ) return 3*deltay*deltaz;
+    return 3*deltaz*deltaz - l_sqr;
+}
+
+
+/* Calculate components C... of the gravity gradient tensor with NLON x NLAT x
+   NR nodes. Same algorithm as the generic kernels in grav_tess.cpp. */
+template<int NLON, int NLAT, int NR, int... C>
+static inline void tess_fixed_comps(const TESSEROID &tess, double lonp,
+    double latp, double rp, const GLQ &glq_lon, const GLQ &glq_lat,
+    const GLQ &glq_r, double *res)
+{
+    constexpr int ncomps = sizeof...(C);
+    const double *wlon = glq_fixed<NLON>::weights,
+                 *wlat = glq_fixed<NLAT>::weights,
+                 *wr = glq_fixed<NR>::weights;
+    double d2r = PI/180., l_sqr, coslatp, sinlatp, cospsi, kphi, coslat_sinlon,
+           rc, kappa, wlonlat, weight, deltax, deltay, deltaz, scale,
+           coslon[NLON], sinlon[NLON], coslatc[NLAT], sinlatc[NLAT],
+           acc[ncomps];
+    int i, j, k, c;
+
+    coslatp = cos(d2r*latp);
+    sinlatp = sin(d2r*latp);
+
+    #pragma GCC unroll 16
+    for(k = 0; k < NLON; k++)
+    {
+        coslon[k] = cos(d2r*(lonp - glq_lon.nodes[k]));
+        sinlon[k] = sin(d2r*(glq_lon.nodes[k] - lonp));
+    }
+    #pragma GCC unroll 16
+    for(j = 0; j < NLAT; j++)
+    {
+        coslatc[j] = cos(d2r*glq_lat.nodes[j]);
+        sinlatc[j] = sin(d2r*glq_lat.nodes[j]);
+    }
+
+    for(c = 0; c < ncomps; c++)
+    {
+        acc[c] = 0;
+    }
+
+    #pragma GCC unroll 16
+    for(k = 0; k < NLON; k++)
+    {
+        #pragma GCC unroll 16
+        for(j = 0; j < NLAT; j++)
+        {
+            wlonlat = wlon[k]*wlat[j];
+            cospsi = sinlatp*sinlatc[j] + coslatp*coslatc[j]*coslon[k];
+            kphi = coslatp*sinlatc[j] - sinlatp*coslatc[j]*coslon[k];
+            coslat_sinlon = coslatc[j]*sinlon[k];
+
+            #pragma GCC unroll 16
+            for(i = 0; i < NR; i++)
+            {
+                rc = glq_r.nodes[i];
+
+                l_sqr = rp*rp + rc*rc - 2*rp*rc*cospsi;
+                kappa = rc*rc*coslatc[j];
+
+                deltax = rc*kphi;
+                deltay = rc*coslat_sinlon;
+                deltaz = rc*cospsi - rp;
+
+                weight = wlonlat*wr[i]*kappa*(1./(l_sqr*l_sqr*sqrt(l_sqr)));
+
+                c = 0;
+                ((acc[c++] += weight*tensor_comp<C>(deltax, deltay, deltaz,
+                                                    l_sqr)), ...);
+            }
+        }
+    }
+
+    scale = SI2EOTVOS*G*tess.density*d2r*(tess.e - tess.w)*d2r*
+            (tess.n - tess.s)*(tess.r2 - tess.r1)*0.125;
+    for(c = 0; c < ncomps; c++)
+    {
+        res[c] = acc[c]*scale;
+    }
+}
+
+
+/* Specialized single component kernel, with the signature of tess_gzz */
+template<int NLON, int NLAT, int NR, int C>
+static double tess_fixed_single_kernel(TESSEROID tess, double lonp,
+    double latp, double rp, GLQ glq_lon, GLQ glq_lat, GLQ glq_r)
+{
+    double res;
+
+    tess_fixed_comps<NLON, NLAT, NR, C>(tess, lonp, latp, rp, glq_lon,
+                                        glq_lat, glq_r, &res);
+    return res;
+}
+
+
+/* Specialized multiple component kernel, with the signature of tess_ggt */
+template<int NLON, int NLAT, int NR, int... C>
+static void tess_fixed_multi_kernel(TESSEROID tess, double lonp, double latp,
+    double rp, GLQ glq_lon, GLQ glq_lat, GLQ glq_r, double *res)
+{
+    tess_fixed_comps<NLON, NLAT, NR, C...>(tess, lonp, latp, rp, glq_lon,
+                                           glq_lat, glq_r, res);
+}
+
+
+/* Calculate components C... of the gravity gradient tensor of tesseroid t of
+   a node table. Same algorithm as tess_fixed_comps, without the per tesseroid
+   setup. An order of 0 means that it is taken from the table at runtime. */
+template<int NLON, int NLAT, int NR, int... C>
+static void tess_fixed_nodes_kernel(const TESS_NODES *nodes, int t,
+    double lonp, double latp, double rp, double *res)
+{
+    constexpr int ncomps = sizeof...(C);
+    const int nlon = NLON ? NLON : nodes->lon_order,
+              nlat = NLAT ? NLAT : nodes->lat_order,
+              nr = NR ? NR : nodes->r_order;
+    const double *lon, *coslatc, *sinlatc, *r, *w;
+    double d2r = PI/180., l_sqr, coslatp, sinlatp, cospsi, kphi, coslat_sinlon,
+           rc, weight, deltax, deltay, deltaz,
+           coslon[NLON ? NLON : GLQ_MAX_ORDER],
+           sinlon[NLON ? NLON : GLQ_MAX_ORDER], acc[ncomps];
+    int i, j, k, c;
+
+    lon = nodes->data + (size_t)t*nodes->stride;
+    coslatc = lon + nlon;
+    sinlatc = coslatc + nlat;
+    r = sinlatc + nlat;
+    w = r + nr;
+
+    coslatp = cos(d2r*latp);
+    sinlatp = sin(d2r*latp);
+
+    #pragma GCC unroll 16
+    for(k = 0; k < nlon; k++)
+    {
+        coslon[k] = cos(d2r*(lonp - lon[k]));
+        sinlon[k] = sin(d2r*(lon[k] - lonp));
+    }
+
+    for(c = 0; c < ncomps; c++)
+    {
+        acc[c] = 0;
+    }
+
+    #pragma GCC unroll 16
+    for(k = 0; k < nlon; k++)
+    {
+        #pragma GCC unroll 16
+        for(j = 0; j < nlat; j++)
+        {
+            cospsi = sinlatp*sinlatc[j] + coslatp*coslatc[j]*coslon[k];
+            kphi = coslatp*sinlatc[j] - sinlatp*coslatc[j]*coslon[k];
+            coslat_sinlon = coslatc[j]*sinlon[k];
+
+            #pragma GCC unroll 16
+            for(i = 0; i < nr; i++)
+            {
+                rc = r[i];
+
+                l_sqr = rp*rp + rc*rc - 2*rp*rc*cospsi;
+
+                deltax = rc*kphi;
+                deltay = rc*coslat_sinlon;
+                deltaz = rc*cospsi - rp;
+
+                weight = w[(k*nlat + j)*nr + i]*
+                         (1./(l_sqr*l_sqr*sqrt(l_sqr)));
+
+                c = 0;
+                ((acc[c++] += weight*tensor_comp<C>(deltax, deltay, deltaz,
+                                                    l_sqr)), ...);
+            }
+        }
+    }
+
+    for(c = 0; c < ncomps; c++)
+    {
+        res[c] = acc[c];
+    }
+}
+
+
+/* The generic kernels, in the order of the specialized ones in
+   TESS_FIXED_ORDERS */
+static const TESS_SINGLE_KERNEL generic_single[6] = {
+    tess_gxx, tess_gxy, tess_gxz, tess_gyy, tess_gyz, tess_gzz};
+static const TESS_MULTI_KERNEL generic_multi[4] = {
+    tess_gxz_gyz_gzz, tess_gxx_gxy_gxz, tess_gxy_gyy_gyz, tess_ggt};
+
+
+/* All kernels specialized for one combination of orders */
+typedef struct tess_fixed_orders_struct
+{
+    int lon_order, lat_order, r_order;
+    TESS_SINGLE_KERNEL single[6];
+    TESS_MULTI_KERNEL multi[4];
+    TESS_NODES_KERNEL nodes[4]; /* in the order of multi */
+} TESS_FIXED_ORDERS;
+
+#define TESS_FIXED_ORDERS_ENTRY(L, M, R) \
+    {L, M, R, \
+     {tess_fixed_single_kernel<L, M, R, GXX>, \
+      tess_fixed_single_kernel<L, M, R, GXY>, \
+      tess_fixed_single_kernel<L, M, R, GXZ>, \
+      tess_fixed_single_kernel<L, M, R, GYY>, \
+      tess_fixed_single_kernel<L, M, R, GYZ>, \
+      tess_fixed_single_kernel<L, M, R, GZZ>}, \
+     {tess_fixed_multi_kernel<L, M, R, GXZ, GYZ, GZZ>, \
+      tess_fixed_multi_kernel<L, M, R, GXX, GXY, GXZ>, \
+      tess_fixed_multi_kernel<L, M, R, GXY, GYY, GYZ>, \
+      tess_fixed_multi_kernel<L, M, R, GXX, GXY, GXZ, GYY, GYZ, GZZ>}, \
+     {tess_fixed_nodes_kernel<L, M, R, GXZ, GYZ, GZZ>, \
+      tess_fixed_nodes_kernel<L, M, R, GXX, GXY, GXZ>, \
+      tess_fixed_nodes_kernel<L, M, R, GXY, GYY, GYZ>, \
+      tess_fixed_nodes_kernel<L, M, R, GXX, GXY, GXZ, GYY, GYZ, GZZ>}}
+
+/* The node table kernels for any other order, in the order of multi */
+static const TESS_NODES_KERNEL any_orders_nodes[4] = {
+    tess_fixed_nodes_kernel<0, 0, 0, GXZ, GYZ, GZZ>,
+    tess_fixed_nodes_kernel<0, 0, 0, GXX, GXY, GXZ>,
+    tess_fixed_nodes_kernel<0, 0, 0, GXY, GYY, GYZ>,
+    tess_fixed_nodes_kernel<0, 0, 0, GXX, GXY, GXZ, GYY, GYZ, GZZ>};
+
+/* The combinations of orders with specialized kernels. 2/2/2 is the default
+   of the programs. */
+static const TESS_FIXED_ORDERS fixed_orders[] = {
+    TESS_FIXED_ORDERS_ENTRY(2, 2, 2),
+    TESS_FIXED_ORDERS_ENTRY(3, 3, 3),
+    TESS_FIXED_ORDERS_ENTRY(4, 4, 4)
+};
+
+
+/* Find the specialized kernels for a combination of orders */
+static const TESS_FIXED_ORDERS * find_fixed_orders(int lon_order,
+    int lat_order, int r_order)
+{
+    int n;
+
+    for(n = 0; n < (int)(sizeof(fixed_orders)/sizeof(fixed_orders[0])); n++)
+    {
+        if(fixed_orders[n].lon_order == lon_order &&
+           fixed_orders[n].lat_order == lat_order &&
+           fixed_orders[n].r_order == r_order)
+        {
+            return &fixed_orders[n];
+        }
+    }
+    return NULL;
+}
+
+
+/* Check if there are specialized kernels for a combination of GLQ orders */
+int tess_fixed_supported(int lon_order, int lat_order, int r_order)
+{
+    return find_fixed_orders(lon_order, lat_order, r_order) != NULL;
+}
+
+
+/* Get the specialized version of a single component kernel */
+TESS_SINGLE_KERNEL tess_fixed_single(TESS_SINGLE_KERNEL generic, int lon_order,
+                                     int lat_order, int r_order)
+{
+    const TESS_FIXED_ORDERS *orders;
+    int n;
+
+    orders = find_fixed_orders(lon_order, lat_order, r_order);
+    if(orders == NULL)
+    {
+        return generic;
+    }
+    for(n = 0; n < 6; n++)
+    {
+        if(generic == generic_single[n])
+        {
+            return orders->single[n];
+        }
+    }
+    return generic;
+}
+
+
+/* Get the specialized version of a multiple component kernel */
+TESS_MULTI_KERNEL tess_fixed_multi(TESS_MULTI_KERNEL generic, int lon_order,
+                                   int lat_order, int r_order)
+{
+    const TESS_FIXED_ORDERS *orders;
+    int n;
+
+    orders = find_fixed_orders(lon_order, lat_order, r_order);
+    if(orders == NULL)
+    {
+        return generic;
+    }
+    for(n = 0; n < 4; n++)
+    {
+        if(generic == generic_multi[n])
+        {
+            return orders->multi[n];
+        }
+    }
+    return generic;
+}
+
+
+/* Get the version of a multiple component kernel that uses a node table */
+TESS_NODES_KERNEL tess_fixed_nodes(TESS_MULTI_KERNEL generic, int lon_order,
+                                   int lat_order, int r_order)
+{
+    const TESS_FIXED_ORDERS *orders;
+    int n;
+
+    orders = find_fixed_orders(lon_order, lat_order, r_order);
+    for(n = 0; n < 4; n++)
+    {
+        if(generic == generic_multi[n])
+        {
+            return orders == NULL ? any_orders_nodes[n] : orders->nodes[n];
+        }
+    }
+    return NULL;
+}
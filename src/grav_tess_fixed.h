@@ -0,0 +1,91 @@
+/*
+Versions of the tesseroid kernels specialized at compile time for the most
+used GLQ orders.
+
+The loops over the quadrature nodes have a fixed number of iterations and are
+fully unrolled, and the weights are constants instead of being read from the
+GLQ structures. The weights are the ones calculated by glq_weights, so the
+results are the same as the generic kernels in grav_tess.h. Any other
+combination of orders uses the generic kernels.
+
+The kernels that use a node table (TESS_NODES) are only defined here, for the
+specialized orders and for any other order.
+
+Example
+-------
+
+    double (*field)(TESSEROID, double, double, double, GLQ, GLQ, GLQ);
+
+    field = tess_fixed_single(&tess_gzz, 2, 2, 2);
+*/
+
+#ifndef _TESSEROIDS_GRAV_TESS_FIXED_H_
+#define _TESSEROIDS_GRAV_TESS_FIXED_H_
+
+
+/* Needed for definition of TESSEROID */
+#include "geometry.h"
+/* Needed for definition of GLQ */
+#include "glq.h"
+/* Needed for definition of TESS_NODES_KERNEL */
+#include "grav_tess.h"
+/* Needed for definition of TESS_MULTI_KERNEL */
+#include "grav_tess_simd.h"
+
+
+/** Type of the kernels that calculate a single component */
+typedef double (*TESS_SINGLE_KERNEL)(TESSEROID, double, double, double, GLQ,
+                                     GLQ, GLQ);
+
+
+/** Check if there are specialized kernels for a combination of GLQ orders.
+
+@return 1 if there are, 0 if the generic kernels have to be used
+*/
+int tess_fixed_supported(int lon_order, int lat_order, int r_order);
+
+
+/** Get the specialized version of a single component kernel.
+
+@param generic one of tess_gxx, tess_gxy, tess_gxz, tess_gyy, tess_gyz or
+               tess_gzz
+@param lon_order order of the GLQ in longitude
+@param lat_order order of the GLQ in latitude
+@param r_order order of the GLQ in radius
+
+@return the specialized kernel, or generic itself if there is none
+*/
+TESS_SINGLE_KERNEL tess_fixed_single(TESS_SINGLE_KERNEL generic, int lon_order,
+                                     int lat_order, int r_order);
+
+
+/** Get the specialized version of a multiple component kernel.
+
+@param generic one of tess_gxz_gyz_gzz, tess_gxx_gxy_gxz, tess_gxy_gyy_gyz or
+               tess_ggt
+@param lon_order order of the GLQ in longitude
+@param lat_order order of the GLQ in latitude
+@param r_order order of the GLQ in radius
+
+@return the specialized kernel, or generic itself if there is none
+*/
+TESS_MULTI_KERNEL tess_fixed_multi(TESS_MULTI_KERNEL generic, int lon_order,
+                                   int lat_order, int r_order);
+
+/** Get the version of a multiple component kernel that uses a node table.
+
+The kernel is specialized for the orders if possible. Otherwise it reads the
+orders from the table.
+
+@param generic one of tess_gxz_gyz_gzz, tess_gxx_gxy_gxz, tess_gxy_gyy_gyz or
+               tess_ggt. The node table kernel gives the same components.
+@param lon_order order of the GLQ in longitude
+@param lat_order order of the GLQ in latitude
+@param r_order order of the GLQ in radius
+
+@return the kernel, or NULL if generic is not one of the above
+*/
+TESS_NODES_KERNEL tess_fixed_nodes(TESS_MULTI_KERNEL generic, int lon_order,
+                                   int lat_order, int r_order);
+
+#endif
@@ -0,0 +1,649 @@
+/*
+SIMD versions of the multiple component tesseroid kernels and the runtime
+selection of the instruction set.
+*/
+
+
+#include <string.h>
+#include <math.h>
+#include "constants.h"
+#include "geometry.h"
+#include "glq.h"
+#include "grav_tess.h"
+#include "grav_tess_simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define TESS_SIMD_X86
+	#include <immintrin.h>
+#endif
+
+
+/* Number of quadrature nodes gathered before they are evaluated. Must be a
+   multiple of 8, the width of an AVX-512 register. */
+#define TESS_SIMD_BATCH 64
+
+
+/* Values of a batch of nodes needed to evaluate the tensor components */
+typedef struct node_batch_struct
+{
+    double rc[TESS_SIMD_BATCH] __attribute__((aligned(64)));
+    double cospsi[TESS_SIMD_BATCH] __attribute__((aligned(64)));
+    double kphi[TESS_SIMD_BATCH] __attribute__((aligned(64)));
+    double coslat_sinlon[TESS_SIMD_BATCH] __attribute__((aligned(64)));
+    double coslatc[TESS_SIMD_BATCH] __attribute__((aligned(64)));
+    double weight[TESS_SIMD_BATCH] __attribute__((aligned(64)));
+} NODE_BATCH;
+
+
+/* Add the six tensor components of the n nodes of a batch to sums. n is a
+   multiple of 8. */
+typedef void (*BATCH_ACCUMULATOR)(const NODE_BATCH *, int, double, double *);
+
+
+/* Gather the nodes of a tesseroid in batches and accumulate the full tensor
+   with the given accumulator. res receives gxx, gxy, gxz, gyy, gyz, gzz. */
+static void tess_ggt_batched(TESSEROID tess, double lonp, double latp,
+    double rp, GLQ glq_lon, GLQ glq_lat, GLQ glq_r, double *res,
+    BATCH_ACCUMULATOR accumulate)
+{
+    double d2r = PI/180., coslatp, sinlatp, coslon, sinlon, cospsi, kphi,
+           coslat_sinlon, wlonlat, scale, sums[6] = {0},
+           coslatc[GLQ_MAX_ORDER], sinlatc[GLQ_MAX_ORDER];
+    NODE_BATCH batch;
+    int i, j, k, n = 0, c;
+
+    coslatp = cos(d2r*latp);
+    sinlatp = sin(d2r*latp);
+    for(j = 0; j < glq_lat.order; j++)
+    {
+        coslatc[j] = cos(d2r*glq_lat.nodes[j]);
+        sinlatc[j] = sin(d2r*glq_lat.nodes[j]);
+    }
+
+    for(k = 0; k < glq_lon.order; k++)
+    {
+        coslon = cos(d2r*(lonp - glq_lon.nodes[k]));
+        sinlon = sin(d2r*(glq_lon.nodes[k] - lonp));
+        for(j = 0; j < glq_lat.order; j++)
+        {
+            wlonlat = glq_lon.weights[k]*glq_lat.weights[j];
+            cospsi = sinlatp*sinlatc[j] + coslatp*coslatc[j]*coslon;
+            kphi = coslatp*sinlatc[j] - sinlatp*coslatc[j]*coslon;
+            coslat_sinlon = coslatc[j]*sinlon;
+            for(i = 0; i < glq_r.order; i++)
+            {
+                batch.rc[n] = glq_r.nodes[i];
+                batch.cospsi[n] = cospsi;
+                batch.kphi[n] = kphi;
+                batch.coslat_sinlon[n] = coslat_sinlon;
+                batch.coslatc[n] = coslatc[j];
+                batch.weight[n] = wlonlat*glq_r.weights[i];
+                n++;
+                if(n == TESS_SIMD_BATCH)
+                {
+                    accumulate(&batch, n, rp, sums);
+                    n = 0;
+                }
+            }
+        }
+    }
+    if(n > 0)
+    {
+        /* Pad with copies of the last node that have zero weight, so the
+           distances stay finite */
+        while(n % 8 != 0)
+        {
+            batch.rc[n] = batch.rc[n - 1];
+            batch.cospsi[n] = batch.cospsi[n - 1];
+            batch.kphi[n] = batch.kphi[n - 1];
+            batch.coslat_sinlon[n] = batch.coslat_sinlon[n - 1];
+            batch.coslatc[n] = batch.coslatc[n - 1];
+            batch.weight[n] = 0;
+            n++;
+        }
+        accumulate(&batch, n, rp, sums);
+    }
+
+    scale = SI2EOTVOS*G*tess.density*d2r*(tess.e - tess.w)*d2r*(tess.n - tess.s)*
+           (tess.r2 - tess.r1)*0.125;
+    for(c = 0; c < 6; c++)
+    {
+        res[c] = sums[c]*scale;
+    }
+}
+
+
+#ifdef TESS_SIMD_X86
+
+/* Sum the elements of an AVX register */
+__attribute__((target("avx2,fma")))
+static inline double hsum_avx2(__m256d v)
+{
+    __m128d lo = _mm256_castpd256_pd128(v), hi = _mm256_extractf128_pd(v, 1);
+
+    lo = _mm_add_pd(lo, hi);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+
+/* Accumulate a batch 4 nodes at a time */
+__attribute__((target("avx2,fma")))
+static void accumulate_avx2(const NODE_BATCH *batch, int n, double rp,
+                            double *sums)
+{
+    __m256d vrp = _mm256_set1_pd(rp), vrp_sqr = _mm256_set1_pd(rp*rp),
+            vtworp = _mm256_set1_pd(2*rp), vthree = _mm256_set1_pd(3),
+            gxx = _mm256_setzero_pd(), gxy = _mm256_setzero_pd(),
+            gxz = _mm256_setzero_pd(), gyy = _mm256_setzero_pd(),
+            gyz = _mm256_setzero_pd(), gzz = _mm256_setzero_pd(),
+            rc, cospsi, l_sqr, l, weight, dx, dy, dz, dx3, dy3, dz3;
+    int m;
+
+    for(m = 0; m < n; m += 4)
+    {
+        rc = _mm256_load_pd(&batch->rc[m]);
+        cospsi = _mm256_load_pd(&batch->cospsi[m]);
+
+        /* l_sqr = rp*rp + rc*rc - 2*rp*rc*cospsi. The terms of the distance
+           and of the tensor are rounded as in the scalar kernel, without
+           FMA, because they lose digits to cancellation near the
+           tesseroid. Only the sums over the nodes use FMA. */
+        l_sqr = _mm256_sub_pd(_mm256_add_pd(vrp_sqr, _mm256_mul_pd(rc, rc)),
+            _mm256_mul_pd(_mm256_mul_pd(vtworp, rc), cospsi));
+        l = _mm256_sqrt_pd(l_sqr);
+
+        /* weight*kappa/l^5 with kappa = rc*rc*coslatc */
+        weight = _mm256_mul_pd(_mm256_load_pd(&batch->weight[m]),
+                               _mm256_mul_pd(_mm256_mul_pd(rc, rc),
+                                   _mm256_load_pd(&batch->coslatc[m])));
+        weight = _mm256_div_pd(weight, _mm256_mul_pd(
+                     _mm256_mul_pd(l_sqr, l_sqr), l));
+
+        dx = _mm256_mul_pd(rc, _mm256_load_pd(&batch->kphi[m]));
+        dy = _mm256_mul_pd(rc, _mm256_load_pd(&batch->coslat_sinlon[m]));
+        dz = _mm256_sub_pd(_mm256_mul_pd(rc, cospsi), vrp);
+        dx3 = _mm256_mul_pd(vthree, dx);
+        dy3 = _mm256_mul_pd(vthree, dy);
+        dz3 = _mm256_mul_pd(vthree, dz);
+
+        gxx = _mm256_fmadd_pd(weight,
+            _mm256_sub_pd(_mm256_mul_pd(dx3, dx), l_sqr), gxx);
+        gxy = _mm256_fmadd_pd(weight, _mm256_mul_pd(dx3, dy), gxy);
+        gxz = _mm256_fmadd_pd(weight, _mm256_mul_pd(dx3, dz), gxz);
+        gyy = _mm256_fmadd_pd(weight,
+            _mm256_sub_pd(_mm256_mul_pd(dy3, dy), l_sqr), gyy);
+        gyz = _mm256_fmadd_pd(weight, _mm256_mul_pd(dy3, dz), gyz);
+        gzz = _mm256_fmadd_pd(weight,
+            _mm256_sub_pd(_mm256_mul_pd(dz3, dz), l_sqr), gzz);
+    }
+    sums[0] += hsum_avx2(gxx);
+    sums[1] += hsum_avx2(gxy);
+    sums[2] += hsum_avx2(gxz);
+    sums[3] += hsum_avx2(gyy);
+    sums[4] += hsum_avx2(gyz);
+    sums[5] += hsum_avx2(gzz);
+}
+
+
+/* Sum the elements of an AVX-512 register, in the order of
+   _mm512_reduce_add_pd. The zero-masked intrinsics don't read an undefined
+   register, which GCC warns about with -Wall. */
+__attribute__((target("avx512f")))
+static inline double hsum_avx512(__m512d v)
+{
+    __m256d h = _mm256_add_pd(_mm512_maskz_extractf64x4_pd(0xF, v, 1),
+                              _mm512_maskz_extractf64x4_pd(0xF, v, 0));
+    __m128d lo = _mm_add_pd(_mm256_extractf128_pd(h, 1),
+                            _mm256_castpd256_pd128(h));
+
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+
+/* Accumulate a batch 8 nodes at a time */
+__attribute__((target("avx512f")))
+static void accumulate_avx512(const NODE_BATCH *batch, int n, double rp,
+                              double *sums)
+{
+    __m512d vrp = _mm512_set1_pd(rp), vrp_sqr = _mm512_set1_pd(rp*rp),
+            vtworp = _mm512_set1_pd(2*rp), vthree = _mm512_set1_pd(3),
+            gxx = _mm512_setzero_pd(), gxy = _mm512_setzero_pd(),
+            gxz = _mm512_setzero_pd(), gyy = _mm512_setzero_pd(),
+            gyz = _mm512_setzero_pd(), gzz = _mm512_setzero_pd(),
+            rc, cospsi, l_sqr, l, weight, dx, dy, dz, dx3, dy3, dz3;
+    int m;
+
+    for(m = 0; m < n; m += 8)
+    {
+        rc = _mm512_load_pd(&batch->rc[m]);
+        cospsi = _mm512_load_pd(&batch->cospsi[m]);
+
+        l_sqr = _mm512_sub_pd(_mm512_add_pd(vrp_sqr, _mm512_mul_pd(rc, rc)),
+            _mm512_mul_pd(_mm512_mul_pd(vtworp, rc), cospsi));
+        l = _mm512_maskz_sqrt_pd(0xFF, l_sqr);
+
+        weight = _mm512_mul_pd(_mm512_load_pd(&batch->weight[m]),
+                               _mm512_mul_pd(_mm512_mul_pd(rc, rc),
+                                   _mm512_load_pd(&batch->coslatc[m])));
+        weight = _mm512_div_pd(weight, _mm512_mul_pd(
+                     _mm512_mul_pd(l_sqr, l_sqr), l));
+
+        dx = _mm512_mul_pd(rc, _mm512_load_pd(&batch->kphi[m]));
+        dy = _mm512_mul_pd(rc, _mm512_load_pd(&batch->coslat_sinlon[m]));
+        dz = _mm512_sub_pd(_mm512_mul_pd(rc, cospsi), vrp);
+        dx3 = _mm512_mul_pd(vthree, dx);
+        dy3 = _mm512_mul_pd(vthree, dy);
+        dz3 = _mm512_mul_pd(vthree, dz);
+
+        gxx = _mm512_fmadd_pd(weight,
+            _mm512_sub_pd(_mm512_mul_pd(dx3, dx), l_sqr), gxx);
+        gxy = _mm512_fmadd_pd(weight, _mm512_mul_pd(dx3, dy), gxy);
+        gxz = _mm512_fmadd_pd(weight, _mm512_mul_pd(dx3, dz), gxz);
+        gyy = _mm512_fmadd_pd(weight,
+            _mm512_sub_pd(_mm512_mul_pd(dy3, dy), l_sqr), gyy);
+        gyz = _mm512_fmadd_pd(weight, _mm512_mul_pd(dy3, dz), gyz);
+        gzz = _mm512_fmadd_pd(weight,
+            _mm512_sub_pd(_mm512_mul_pd(dz3, dz), l_sqr), gzz);
+    }
+    sums[0] += hsum_avx512(gxx);
+    sums[1] += hsum_avx512(gxy);
+    sums[2] += hsum_avx512(gxz);
+    sums[3] += hsum_avx512(gyy);
+    sums[4] += hsum_avx512(gyz);
+    sums[5] += hsum_avx512(gzz);
+}
+
+
+/* Calculate the full tensor of tesseroids h to h + 3 of a block, one in each
+   lane of an AVX register */
+__attribute__((target("avx2,fma")))
+static void ggt_block_avx2(const TESS_BLOCK_NODES *nodes, int h, double latp,
+    double rp, const GLQ *glq_lon, const GLQ *glq_lat, const GLQ *glq_r,
+    double *res)
+{
+    double d2r = PI/180.;
+    __m256d vrp = _mm256_set1_pd(rp), vrp_sqr = _mm256_set1_pd(rp*rp),
+            vtworp = _mm256_set1_pd(2*rp), vthree = _mm256_set1_pd(3),
+            vsinlatp = _mm256_set1_pd(sin(d2r*latp)),
+            vcoslatp = _mm256_set1_pd(cos(d2r*latp)),
+            gxx = _mm256_setzero_pd(), gxy = _mm256_setzero_pd(),
+            gxz = _mm256_setzero_pd(), gyy = _mm256_setzero_pd(),
+            gyz = _mm256_setzero_pd(), gzz = _mm256_setzero_pd(),
+            coslon, sinlon, coslat, sinlat, cospsi, kphi,
+            coslat_sinlon, rc, l_sqr, l, weight, dx, dy, dz, dx3, dy3, dz3,
+            scale;
+    double wlonlat;
+    int i, j, k;
+
+    for(k = 0; k < glq_lon->order; k++)
+    {
+        coslon = _mm256_load_pd(&nodes->coslon[k][h]);
+        sinlon = _mm256_load_pd(&nodes->sinlon[k][h]);
+        for(j = 0; j < glq_lat->order; j++)
+        {
+            wlonlat = glq_lon->weights[k]*glq_lat->weights[j];
+            coslat = _mm256_load_pd(&nodes->coslat[j][h]);
+            sinlat = _mm256_load_pd(&nodes->sinlat[j][h]);
+            /* The terms of the distance and of the tensor are rounded as
+               in the scalar kernel, without FMA, because they lose digits
+               to cancellation near the tesseroid. Only the sums over the
+               nodes use FMA. */
+            cospsi = _mm256_add_pd(_mm256_mul_pd(vsinlatp, sinlat),
+                _mm256_mul_pd(_mm256_mul_pd(vcoslatp, coslat), coslon));
+            kphi = _mm256_sub_pd(_mm256_mul_pd(vcoslatp, sinlat),
+                _mm256_mul_pd(_mm256_mul_pd(vsinlatp, coslat), coslon));
+            coslat_sinlon = _mm256_mul_pd(coslat, sinlon);
+            for(i = 0; i < glq_r->order; i++)
+            {
+                rc = _mm256_load_pd(&nodes->r[i][h]);
+
+                l_sqr = _mm256_sub_pd(
+                    _mm256_add_pd(vrp_sqr, _mm256_mul_pd(rc, rc)),
+                    _mm256_mul_pd(_mm256_mul_pd(vtworp, rc), cospsi));
+                l = _mm256_sqrt_pd(l_sqr);
+
+                weight = _mm256_mul_pd(
+                    _mm256_set1_pd(wlonlat*glq_r->weights[i]),
+                    _mm256_mul_pd(_mm256_mul_pd(rc, rc), coslat));
+                weight = _mm256_div_pd(weight, _mm256_mul_pd(
+                             _mm256_mul_pd(l_sqr, l_sqr), l));
+
+                dx = _mm256_mul_pd(rc, kphi);
+                dy = _mm256_mul_pd(rc, coslat_sinlon);
+                dz = _mm256_sub_pd(_mm256_mul_pd(rc, cospsi), vrp);
+                dx3 = _mm256_mul_pd(vthree, dx);
+                dy3 = _mm256_mul_pd(vthree, dy);
+                dz3 = _mm256_mul_pd(vthree, dz);
+
+                gxx = _mm256_fmadd_pd(weight,
+                    _mm256_sub_pd(_mm256_mul_pd(dx3, dx), l_sqr), gxx);
+                gxy = _mm256_fmadd_pd(weight, _mm256_mul_pd(dx3, dy), gxy);
+                gxz = _mm256_fmadd_pd(weight, _mm256_mul_pd(dx3, dz), gxz);
+                gyy = _mm256_fmadd_pd(weight,
+                    _mm256_sub_pd(_mm256_mul_pd(dy3, dy), l_sqr), gyy);
+                gyz = _mm256_fmadd_pd(weight, _mm256_mul_pd(dy3, dz), gyz);
+                gzz = _mm256_fmadd_pd(weight,
+                    _mm256_sub_pd(_mm256_mul_pd(dz3, dz), l_sqr), gzz);
+            }
+        }
+    }
+    scale = _mm256_load_pd(&nodes->scale[h]);
+    _mm256_storeu_pd(&res[h], _mm256_mul_pd(gxx, scale));
+    _mm256_storeu_pd(&res[TESS_BLOCK_SIZE + h], _mm256_mul_pd(gxy, scale));
+    _mm256_storeu_pd(&res[2*TESS_BLOCK_SIZE + h], _mm256_mul_pd(gxz, scale));
+    _mm256_storeu_pd(&res[3*TESS_BLOCK_SIZE + h], _mm256_mul_pd(gyy, scale));
+    _mm256_storeu_pd(&res[4*TESS_BLOCK_SIZE + h], _mm256_mul_pd(gyz, scale));
+    _mm256_storeu_pd(&res[5*TESS_BLOCK_SIZE + h], _mm256_mul_pd(gzz, scale));
+}
+
+
+/* Calculate the full tensor of the tesseroids of a block, one in each lane of
+   an AVX-512 register */
+__attribute__((target("avx512f")))
+static void ggt_block_avx512(const TESS_BLOCK_NODES *nodes, double latp,
+    double rp, const GLQ *glq_lon, const GLQ *glq_lat, const GLQ *glq_r,
+    double *res)
+{
+    double d2r = PI/180.;
+    __m512d vrp = _mm512_set1_pd(rp), vrp_sqr = _mm512_set1_pd(rp*rp),
+            vtworp = _mm512_set1_pd(2*rp), vthree = _mm512_set1_pd(3),
+            vsinlatp = _mm512_set1_pd(sin(d2r*latp)),
+            vcoslatp = _mm512_set1_pd(cos(d2r*latp)),
+            gxx = _mm512_setzero_pd(), gxy = _mm512_setzero_pd(),
+            gxz = _mm512_setzero_pd(), gyy = _mm512_setzero_pd(),
+            gyz = _mm512_setzero_pd(), gzz = _mm512_setzero_pd(),
+            coslon, sinlon, coslat, sinlat, cospsi, kphi,
+            coslat_sinlon, rc, l_sqr, l, weight, dx, dy, dz, dx3, dy3, dz3,
+            scale;
+    double wlonlat;
+    int i, j, k;
+
+    for(k = 0; k < glq_lon->order; k++)
+    {
+        coslon = _mm512_load_pd(nodes->coslon[k]);
+        sinlon = _mm512_load_pd(nodes->sinlon[k]);
+        for(j = 0; j < glq_lat->order; j++)
+        {
+            wlonlat = glq_lon->weights[k]*glq_lat->weights[j];
+            coslat = _mm512_load_pd(nodes->coslat[j]);
+            sinlat = _mm512_load_pd(nodes->sinlat[j]);
+            /* The terms of the distance and of the tensor are rounded as
+               in the scalar kernel, without FMA, because they lose digits
+               to cancellation near the tesseroid. Only the sums over the
+               nodes use FMA. */
+            cospsi = _mm512_add_pd(_mm512_mul_pd(vsinlatp, sinlat),
+                _mm512_mul_pd(_mm512_mul_pd(vcoslatp, coslat), coslon));
+            kphi = _mm512_sub_pd(_mm512_mul_pd(vcoslatp, sinlat),
+                _mm512_mul_pd(_mm512_mul_pd(vsinlatp, coslat), coslon));
+            coslat_sinlon = _mm512_mul_pd(coslat, sinlon);
+            for(i = 0; i < glq_r->order; i++)
+            {
+                rc = _mm512_load_pd(nodes->r[i]);
+
+                l_sqr = _mm512_sub_pd(
+                    _mm512_add_pd(vrp_sqr, _mm512_mul_pd(rc, rc)),
+                    _mm512_mul_pd(_mm512_mul_pd(vtworp, rc), cospsi));
+                l = _mm512_maskz_sqrt_pd(0xFF, l_sqr);
+
+                weight = _mm512_mul_pd(
+                    _mm512_set1_pd(wlonlat*glq_r->weights[i]),
+                    _mm512_mul_pd(_mm512_mul_pd(rc, rc), coslat));
+                weight = _mm512_div_pd(weight, _mm512_mul_pd(
+                             _mm512_mul_pd(l_sqr, l_sqr), l));
+
+                dx = _mm512_mul_pd(rc, kphi);
+                dy = _mm512_mul_pd(rc, coslat_sinlon);
+                dz = _mm512_sub_pd(_mm512_mul_pd(rc, cospsi), vrp);
+                dx3 = _mm512_mul_pd(vthree, dx);
+                dy3 = _mm512_mul_pd(vthree, dy);
+                dz3 = _mm512_mul_pd(vthree, dz);
+
+                gxx = _mm512_fmadd_pd(weight,
+                    _mm512_sub_pd(_mm512_mul_pd(dx3, dx), l_sqr), gxx);
+                gxy = _mm512_fmadd_pd(weight, _mm512_mul_pd(dx3, dy), gxy);
+                gxz = _mm512_fmadd_pd(weight, _mm512_mul_pd(dx3, dz), gxz);
+                gyy = _mm512_fmadd_pd(weight,
+                    _mm512_sub_pd(_mm512_mul_pd(dy3, dy), l_sqr), gyy);
+                gyz = _mm512_fmadd_pd(weight, _mm512_mul_pd(dy3, dz), gyz);
+                gzz = _mm512_fmadd_pd(weight,
+                    _mm512_sub_pd(_mm512_mul_pd(dz3, dz), l_sqr), gzz);
+            }
+        }
+    }
+    scale = _mm512_load_pd(nodes->scale);
+    _mm512_storeu_pd(res, _mm512_mul_pd(gxx, scale));
+    _mm512_storeu_pd(&res[TESS_BLOCK_SIZE], _mm512_mul_pd(gxy, scale));
+    _mm512_storeu_pd(&res[2*TESS_BLOCK_SIZE], _mm512_mul_pd(gxz, scale));
+    _mm512_storeu_pd(&res[3*TESS_BLOCK_SIZE], _mm512_mul_pd(gyy, scale));
+    _mm512_storeu_pd(&res[4*TESS_BLOCK_SIZE], _mm512_mul_pd(gyz, scale));
+    _mm512_storeu_pd(&res[5*TESS_BLOCK_SIZE], _mm512_mul_pd(gzz, scale));
+}
+
+#endif
+
+
+/* Find the best instruction set supported by the processor */
+int tess_isa_detect(void)
+{
+#ifdef TESS_SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+    {
+        return TESS_ISA_AVX512;
+    }
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return TESS_ISA_AVX2;
+    }
+#endif
+    return TESS_ISA_SCALAR;
+}
+
+
+/* Name of an instruction set */
+const char * tess_isa_name(int isa)
+{
+    switch(isa)
+    {
+        case TESS_ISA_AVX2:
+            return "avx2";
+        case TESS_ISA_AVX512:
+            return "avx512";
+        default:
+            return "scalar";
+    }
+}
+
+
+/* Parse the name of an instruction set */
+int tess_isa_parse(const char *name)
+{
+    if(!strcmp(name, "scalar"))
+        return TESS_ISA_SCALAR;
+    if(!strcmp(name, "avx2"))
+        return TESS_ISA_AVX2;
+    if(!strcmp(name, "avx512"))
+        return TESS_ISA_AVX512;
+    return -1;
+}
+
+
+/* Full tensor of a block with AVX2, as two halves of 4 tesseroids. Falls back
+   to the scalar kernel on other architectures. */
+static void tess_ggt_block_avx2(const TESS_BLOCK *block, double lonp,
+    double latp, double rp, const GLQ *glq_lon, const GLQ *glq_lat,
+    const GLQ *glq_r, double *res)
+{
+#ifdef TESS_SIMD_X86
+    TESS_BLOCK_NODES nodes;
+
+    tess_block_nodes(block, lonp, glq_lon, glq_lat, glq_r, &nodes);
+    ggt_block_avx2(&nodes, 0, latp, rp, glq_lon, glq_lat, glq_r, res);
+    if(block->size > 4)
+    {
+        ggt_block_avx2(&nodes, 4, latp, rp, glq_lon, glq_lat, glq_r, res);
+    }
+#else
+    tess_ggt_block(block, lonp, latp, rp, glq_lon, glq_lat, glq_r, res);
+#endif
+}
+
+
+/* Full tensor of a block with AVX-512. Falls back to the scalar kernel on
+   other architectures. */
+static void tess_ggt_block_avx512(const TESS_BLOCK *block, double lonp,
+    double latp, double rp, const GLQ *glq_lon, const GLQ *glq_lat,
+    const GLQ *glq_r, double *res)
+{
+#ifdef TESS_SIMD_X86
+    TESS_BLOCK_NODES nodes;
+
+    tess_block_nodes(block, lonp, glq_lon, glq_lat, glq_r, &nodes);
+    ggt_block_avx512(&nodes, latp, rp, glq_lon, glq_lat, glq_r, res);
+#else
+    tess_ggt_block(block, lonp, latp, rp, glq_lon, glq_lat, glq_r, res);
+#endif
+}
+
+
+/* Full tensor with AVX2. Falls back to the scalar kernel on other
+   architectures. */
+static void tess_ggt_avx2(TESSEROID tess, double lonp, double latp, double rp,
+    GLQ glq_lon, GLQ glq_lat, GLQ glq_r, double *res)
+{
+#ifdef TESS_SIMD_X86
+    tess_ggt_batched(tess, lonp, latp, rp, glq_lon, glq_lat, glq_r, res,
+                     &accumulate_avx2);
+#else
+    tess_ggt(tess, lonp, latp, rp, glq_lon, glq_lat, glq_r, res);
+#endif
+}
+
+
+/* Full tensor with AVX-512. Falls back to the scalar kernel on other
+   architectures. */
+static void tess_ggt_avx512(TESSEROID tess, double lonp, double latp,
+    double rp, GLQ glq_lon, GLQ glq_lat, GLQ glq_r, double *res)
+{
+#ifdef TESS_SIMD_X86
+    tess_ggt_batched(tess, lonp, latp, rp, glq_lon, glq_lat, glq_r, res,
+                     &accumulate_avx512);
+#else
+    tess_ggt(tess, lonp, latp, rp, glq_lon, glq_lat, glq_r, res);
+#endif
+}
+
+
+/* The three component kernels take their components from the full tensor.
+   The extra components cost a few multiplications per node, while the
+   distances are shared. */
+static void tess_gxz_gyz_gzz_avx2(TESSEROID tess, double lonp, double latp,
+    double rp, GLQ glq_lon, GLQ glq_lat, GLQ glq_r, double *res)
+{
+    double ggt[6];
+
+    tess_ggt_avx2(tess, lonp, latp, rp, glq_lon, glq_lat, glq_r, ggt);
+    res[0] = ggt[2];
+    res[1] = ggt[4];
+    res[2] = ggt[5];
+}
+
+
+static void tess_gxx_gxy_gxz_avx2(TESSEROID tess, double lonp, double latp,
+    double rp, GLQ glq_lon, GLQ glq_lat, GLQ glq_r, double *res)
+{
+    double ggt[6];
+
+    tess_ggt_avx2(tess, lonp, latp, rp, glq_lon, glq_lat, glq_r, ggt);
+    res[0] = ggt[0];
+    res[1] = ggt[1];
+    res[2] = ggt[2];
+}
+
+
+static void tess_gxy_gyy_gyz_avx2(TESSEROID tess, double lonp, double latp,
+    double rp, GLQ glq_lon, GLQ glq_lat, GLQ glq_r, double *res)
+{
+    double ggt[6];
+
+    tess_ggt_avx2(tess, lonp, latp, rp, glq_lon, glq_lat, glq_r, ggt);
+    res[0] = ggt[1];
+    res[1] = ggt[3];
+    res[2] = ggt[4];
+}
+
+
+static void tess_gxz_gyz_gzz_avx512(TESSEROID tess, double lonp, double latp,
+    double rp, GLQ glq_lon, GLQ glq_lat, GLQ glq_r, double *res)
+{
+    double ggt[6];
+
+    tess_ggt_avx512(tess, lonp, latp, rp, glq_lon, glq_lat, glq_r, ggt);
+    res[0] = ggt[2];
+    res[1] = ggt[4];
+    res[2] = ggt[5];
+}
+
+
+static void tess_gxx_gxy_gxz_avx512(TESSEROID tess, double lonp, double latp,
+    double rp, GLQ glq_lon, GLQ glq_lat, GLQ glq_r, double *res)
+{
+    double ggt[6];
+
+    tess_ggt_avx512(tess, lonp, latp, rp, glq_lon, glq_lat, glq_r, ggt);
+    res[0] = ggt[0];
+    res[1] = ggt[1];
+    res[2] = ggt[2];
+}
+
+
+static void tess_gxy_gyy_gyz_avx512(TESSEROID tess, double lonp, double latp,
+    double rp, GLQ glq_lon, GLQ glq_lat, GLQ glq_r, double *res)
+{
+    double ggt[6];
+
+    tess_ggt_avx512(tess, lonp, latp, rp, glq_lon, glq_lat, glq_r, ggt);
+    res[0] = ggt[1];
+    res[1] = ggt[3];
+    res[2] = ggt[4];
+}
+
+
+/* Get the version of a multiple component kernel for an instruction set */
+TESS_MULTI_KERNEL tess_simd_kernel(TESS_MULTI_KERNEL scalar, int isa)
+{
+    if(isa == TESS_ISA_AVX2)
+    {
+        if(scalar == &tess_ggt)
+            return &tess_ggt_avx2;
+        if(scalar == &tess_gxz_gyz_gzz)
+            return &tess_gxz_gyz_gzz_avx2;
+        if(scalar == &tess_gxx_gxy_gxz)
+            return &tess_gxx_gxy_gxz_avx2;
+        if(scalar == &tess_gxy_gyy_gyz)
+            return &tess_gxy_gyy_gyz_avx2;
+    }
+    if(isa == TESS_ISA_AVX512)
+    {
+        if(scalar == &tess_ggt)
+            return &tess_ggt_avx512;
+        if(scalar == &tess_gxz_gyz_gzz)
+            return &tess_gxz_gyz_gzz_avx512;
+        if(scalar == &tess_gxx_gxy_gxz)
+            return &tess_gxx_gxy_gxz_avx512;
+        if(scalar == &tess_gxy_gyy_gyz)
+            return &tess_gxy_gyy_gyz_avx512;
+    }
+    return scalar;
+}
+
+
+/* Get the version of the block kernel for an instruction set */
+TESS_BLOCK_KERNEL tess_simd_block_kernel(int isa)
+{
+    if(isa == TESS_ISA_AVX2)
+        return &tess_ggt_block_avx2;
+    if(isa == TESS_ISA_AVX512)
+        return &tess_ggt_block_avx512;
+    return &tess_ggt_block;
+}
@@ -0,0 +1,82 @@
+/*
+SIMD versions of the multiple component tesseroid kernels and the runtime
+selection of the instruction set.
+
+The scalar kernels in grav_tess.h are the reference. The SIMD kernels gather
+the quadrature nodes of a tesseroid in batches and evaluate the distances and
+the tensor components of several nodes at once with AVX2 or AVX-512. The
+results differ from the scalar kernels only by rounding.
+
+Example
+-------
+
+    int isa = tess_isa_detect();
+    void (*field_triple)(TESSEROID, double, double, double, GLQ, GLQ, GLQ,
+                         double*);
+
+    field_triple = tess_simd_kernel(&tess_gxz_gyz_gzz, isa);
+    log_info("Using %s kernels", tess_isa_name(isa));
+*/
+
+#ifndef _TESSEROIDS_GRAV_TESS_SIMD_H_
+#define _TESSEROIDS_GRAV_TESS_SIMD_H_
+
+
+/* Needed for definition of TESSEROID */
+#include "geometry.h"
+/* Needed for definition of GLQ */
+#include "glq.h"
+/* Needed for definition of TESS_BLOCK and TESS_BLOCK_KERNEL */
+#include "grav_tess.h"
+
+
+/* Instruction sets the kernels can use */
+#define TESS_ISA_SCALAR 0
+#define TESS_ISA_AVX2   1
+#define TESS_ISA_AVX512 2
+
+
+/** Type of the kernels that calculate several components at once */
+typedef void (*TESS_MULTI_KERNEL)(TESSEROID, double, double, double, GLQ, GLQ,
+                                  GLQ, double*);
+
+
+/** Find the best instruction set supported by the processor.
+
+@return one of TESS_ISA_SCALAR, TESS_ISA_AVX2 or TESS_ISA_AVX512
+*/
+int tess_isa_detect(void);
+
+
+/** Name of an instruction set, as used by option --isa */
+const char * tess_isa_name(int isa);
+
+
+/** Parse the name of an instruction set.
+
+@return the instruction set or -1 if the name is unknown
+*/
+int tess_isa_parse(const char *name);
+
+
+/** Get the version of a multiple component kernel for an instruction set.
+
+@param scalar one of tess_gxz_gyz_gzz, tess_gxx_gxy_gxz, tess_gxy_gyy_gyz or
+              tess_ggt
+@param isa instruction set. Must be supported by the processor.
+
+@return the SIMD version of the kernel, or scalar itself if there is none
+*/
+TESS_MULTI_KERNEL tess_simd_kernel(TESS_MULTI_KERNEL scalar, int isa);
+
+
+/** Get the version of the block kernel tess_ggt_block for an instruction
+set.
+
+@param isa instruction set. Must be supported by the processor.
+
+@return the SIMD version of the kernel, or tess_ggt_block for the scalar one
+*/
+TESS_BLOCK_KERNEL tess_simd_block_kernel(int isa);
+
+#endif
@@ -0,0 +1,271 @@
+/*
+Binary grid files: computation points and calculated grids as float64
+columns.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "logger.h"
+#include "grid_bin.h"
+
+
+/* Fill in the header of a binary grid */
+static void grid_bin_fill_header(char *header, int ncols, long long nrows)
+{
+    int32_t cols = ncols, reserved = 0;
+    int64_t rows = nrows;
+
+    memcpy(header, GRID_BIN_MAGIC, 8);
+    memcpy(header + 8, &cols, 4);
+    memcpy(header + 12, &reserved, 4);
+    memcpy(header + 16, &rows, 8);
+}
+
+
+/* Write the header of a binary grid at the current position of a file */
+int grid_bin_write_header(FILE *file, int ncols, long long nrows)
+{
+    char header[GRID_BIN_HEADER_SIZE];
+
+    grid_bin_fill_header(header, ncols, nrows);
+    if(fwrite(header, 1, GRID_BIN_HEADER_SIZE, file) != GRID_BIN_HEADER_SIZE)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+
+/* Fill in the number of rows of a binary grid and go back to the end */
+int grid_bin_set_rows(FILE *file, long long nrows)
+{
+    int64_t rows = nrows;
+
+    if(fflush(file) != 0 || fseek(file, 16, SEEK_SET) != 0)
+    {
+        return 1;
+    }
+    if(fwrite(&rows, 8, 1, file) != 1)
+    {
+        return 1;
+    }
+    if(fseek(file, 0, SEEK_END) != 0)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+
+/* Tell if a stream starts with a binary grid */
+int grid_bin_detect(FILE *file)
+{
+    int c;
+
+    c = getc(file);
+    if(c == EOF)
+    {
+        return 0;
+    }
+    ungetc(c, file);
+    return c == GRID_BIN_MAGIC[0];
+}
+
+
+/* Check a header and fill in the number of columns and rows. Returns 1 if
+   it is not the header of a binary grid. */
+static int grid_bin_parse_header(const char *header, GRID_BIN *grid)
+{
+    int32_t cols;
+    int64_t rows;
+
+    if(memcmp(header, GRID_BIN_MAGIC, 8) != 0)
+    {
+        log_error("not a binary grid (bad magic)");
+        return 1;
+    }
+    memcpy(&cols, header + 8, 4);
+    memcpy(&rows, header + 16, 8);
+    if(cols < 1 || rows < 0)
+    {
+        log_error("bad header of binary grid: %d column(s), %lld row(s)",
+                  (int)cols, (long long)rows);
+        return 1;
+    }
+    grid->ncols = cols;
+    grid->nrows = rows;
+    return 0;
+}
+
+
+/* Open a binary grid on a stream positioned at its beginning */
+GRID_BIN * grid_bin_open(FILE *file)
+{
+    GRID_BIN *grid;
+    struct stat st;
+    char header[GRID_BIN_HEADER_SIZE];
+    long long avail;
+    int fd = fileno(file);
+
+    grid = (GRID_BIN *)calloc(1, sizeof(GRID_BIN));
+    if(grid == NULL)
+    {
+        log_error("problem allocating memory for a binary grid");
+        return NULL;
+    }
+    if(fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+       st.st_size >= GRID_BIN_HEADER_SIZE && ftell(file) == 0)
+    {
+        grid->size = st.st_size;
+        grid->map = mmap(NULL, grid->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(grid->map == MAP_FAILED)
+        {
+            grid->map = NULL;
+        }
+    }
+    if(grid->map != NULL)
+    {
+        if(grid_bin_parse_header((const char *)grid->map, grid))
+        {
+            grid_bin_close(grid);
+            return NULL;
+        }
+        avail = (grid->size - GRID_BIN_HEADER_SIZE)/(8*grid->ncols);
+        if(grid->nrows > avail)
+        {
+            log_error("binary grid is truncated: %lld of %lld row(s)", avail,
+                      grid->nrows);
+            grid_bin_close(grid);
+            return NULL;
+        }
+        if(grid->nrows == 0)
+        {
+            grid->nrows = avail;
+        }
+        grid->data = (double *)((char *)grid->map + GRID_BIN_HEADER_SIZE);
+        madvise(grid->map, grid->size, MADV_SEQUENTIAL);
+        return grid;
+    }
+    /* Not a regular file, read the rows as they come */
+    if(fread(header, 1, GRID_BIN_HEADER_SIZE, file) != GRID_BIN_HEADER_SIZE)
+    {
+        log_error("binary grid is too short for its header");
+        grid_bin_close(grid);
+        return NULL;
+    }
+    if(grid_bin_parse_header(header, grid))
+    {
+        grid_bin_close(grid);
+        return NULL;
+    }
+    if(grid->nrows == 0)
+    {
+        grid->nrows = -1;
+    }
+    grid->file = file;
+    return grid;
+}
+
+
+/* Copy the next row of a grid open for reading into row */
+int grid_bin_read(GRID_BIN *grid, double *row)
+{
+    size_t nread;
+
+    if(grid->nrows >= 0 && grid->next >= grid->nrows)
+    {
+        return 0;
+    }
+    if(grid->data != NULL)
+    {
+        memcpy(row, &(grid->data[grid->next*grid->ncols]),
+               grid->ncols*sizeof(double));
+    }
+    else
+    {
+        nread = fread(row, sizeof(double), grid->ncols, grid->file);
+        if(nread != (size_t)grid->ncols)
+        {
+            if(nread != 0 || grid->nrows >= 0)
+            {
+                log_warning("binary grid ends in the middle of row %lld",
+                            grid->next + 1);
+            }
+            return 0;
+        }
+    }
+    grid->next++;
+    return 1;
+}
+
+
+/* Create a binary grid file of a known size and map it for writing */
+GRID_BIN * grid_bin_create(const char *fname, int ncols, long long nrows)
+{
+    GRID_BIN *grid;
+    int fd;
+
+    grid = (GRID_BIN *)calloc(1, sizeof(GRID_BIN));
+    if(grid == NULL)
+    {
+        log_error("problem allocating memory for a binary grid");
+        return NULL;
+    }
+    grid->ncols = ncols;
+    grid->nrows = nrows;
+    grid->writable = 1;
+    grid->size = GRID_BIN_HEADER_SIZE + (size_t)nrows*ncols*sizeof(double);
+    fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        log_error("unable to create binary grid %s", fname);
+        free(grid);
+        return NULL;
+    }
+    if(ftruncate(fd, grid->size) != 0)
+    {
+        log_error("unable to make room for %lld row(s) in %s", nrows, fname);
+        close(fd);
+        free(grid);
+        return NULL;
+    }
+    grid->map = mmap(NULL, grid->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fd, 0);
+    /* The mapping keeps the file open */
+    close(fd);
+    if(grid->map == MAP_FAILED)
+    {
+        log_error("unable to map binary grid %s", fname);
+        free(grid);
+        return NULL;
+    }
+    grid_bin_fill_header((char *)grid->map, ncols, nrows);
+    grid->data = (double *)((char *)grid->map + GRID_BIN_HEADER_SIZE);
+    return grid;
+}
+
+
+/* Unmap a grid and free its memory */
+void grid_bin_close(GRID_BIN *grid)
+{
+    if(grid == NULL)
+    {
+        return;
+    }
+    if(grid->map != NULL)
+    {
+        if(grid->writable)
+        {
+            msync(grid->map, grid->size, MS_SYNC);
+        }
+        munmap(grid->map, grid->size);
+    }
+    free(grid);
+}
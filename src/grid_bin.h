@@ -0,0 +1,124 @@
+/*
+Binary grid files: computation points and calculated grids as float64
+columns.
+
+A binary grid is a header of 24 bytes followed by the values, row by row:
+
+    offset  size  content
+    0       8     magic "TESSBIN1"
+    8       4     number of columns, int32
+    12      4     reserved, 0
+    16      8     number of rows, int64. 0 if the writer could not go back
+                  to fill it in: the rows then go to the end of the file.
+    24            rows of ncols float64
+
+All numbers are in the byte order of the machine that wrote the file (little
+endian on x86-64). The columns are the same as those of the text grids:
+longitude, latitude and height of the point, then the calculated values.
+
+Files are read and written through mmap when they are regular files. Pipes
+are read row by row.
+
+Example
+-------
+
+    GRID_BIN *in = grid_bin_open(stdin);
+    GRID_BIN *out = grid_bin_create("out.bin", in->ncols, in->nrows);
+    long long i = 0;
+
+    while(grid_bin_read(in, &(out->data[i*in->ncols])))
+        i++;
+    grid_bin_close(out);
+    grid_bin_close(in);
+
+    grid_bin_write_header(stdout, 6, 0);
+    fwrite(row, sizeof(double), 6, stdout);
+    grid_bin_set_rows(stdout, 1);
+*/
+
+#ifndef _TESSEROIDS_GRID_BIN_H_
+#define _TESSEROIDS_GRID_BIN_H_
+
+
+#include <stdio.h>
+
+
+/* Magic of the binary grids */
+#define GRID_BIN_MAGIC "TESSBIN1"
+/* Size of the header in bytes */
+#define GRID_BIN_HEADER_SIZE 24
+
+
+/** A binary grid open for reading or writing */
+typedef struct grid_bin_struct
+{
+    int ncols; /* number of columns */
+    long long nrows; /* number of rows, -1 if read from a pipe that has no
+                        count in its header */
+    double *data; /* the rows, NULL if read from a pipe */
+    long long next; /* index of the next row to read */
+    FILE *file; /* stream read row by row if not mapped */
+    void *map; /* mapped file, NULL if not mapped */
+    size_t size; /* size of the mapped file in bytes */
+    int writable; /* flag: created with grid_bin_create */
+} GRID_BIN;
+
+
+/** Tell if a stream starts with a binary grid, without reading from it.
+
+Text grids start with a number, a comment or a blank line, never with the
+first letter of the magic. */
+int grid_bin_detect(FILE *file);
+
+
+/** Open a binary grid on a stream positioned at its beginning.
+
+Regular files are mapped whole. Other streams are read row by row with
+grid_bin_read.
+
+@return the grid or NULL if the header is bad or the file can't be read
+        (the reason is logged)
+*/
+GRID_BIN * grid_bin_open(FILE *file);
+
+
+/** Copy the next row of a grid open for reading into row.
+
+@return 1 if a row was read, 0 at the end of the grid
+*/
+int grid_bin_read(GRID_BIN *grid, double *row);
+
+
+/** Create a binary grid file of a known size and map it for writing. The
+rows go in data and are written to the file by grid_bin_close.
+
+@return the grid or NULL if the file can't be created (the reason is logged)
+*/
+GRID_BIN * grid_bin_create(const char *fname, int ncols, long long nrows);
+
+
+/** Unmap a grid and free its memory. Does not close the stream given to
+grid_bin_open. */
+void grid_bin_close(GRID_BIN *grid);
+
+
+/** Write the header of a binary grid at the current position of a file.
+
+@param file the file
+@param ncols number of float64 columns
+@param nrows number of rows, 0 if not known yet
+
+@return 0 if all went well, 1 if the header could not be written
+*/
+int grid_bin_write_header(FILE *file, int ncols, long long nrows);
+
+
+/** Fill in the number of rows of a binary grid that starts at the beginning
+of a file, and go back to the end of the file.
+
+@return 0 if all went well, 1 if the file can't be rewound (a pipe). The
+        number of rows is left as it was in that case.
+*/
+int grid_bin_set_rows(FILE *file, long long nrows);
+
+#endif
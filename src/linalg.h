@@ -4,6 +4,24 @@
 void conv_vect_cblas(double *vect, double lon1, double lat1, double lon2, double lat2, double *res);
 void conv_vect_cblas_precalc(double *vect, double cos_a1, double sin_a1, double cos_b1, double sin_b1, double cos_a2, double sin_a2, double cos_b2, double sin_b2, double *res);
 
+/* Same as conv_vect_cblas_precalc, written out in closed form. a is the
+   colatitude and b the longitude of the tesseroid (1) and of the point (2).
+   Only the difference of the longitudes matters, so the rotation costs a few
+   products instead of two BLAS calls. */
+static inline void conv_vect_fast(const double *vect, double cos_a1, double sin_a1, double cos_b1, double sin_b1, double cos_a2, double sin_a2, double cos_b2, double sin_b2, double *res)
+{
+    double cos_db = cos_b1*cos_b2 + sin_b1*sin_b2,
+           sin_db = sin_b1*cos_b2 - cos_b1*sin_b2;
+
+    res[0] = (cos_a1*cos_a2*cos_db + sin_a1*sin_a2)*vect[0] +
+             cos_a2*sin_db*vect[1] +
+             (cos_a1*sin_a2 - sin_a1*cos_a2*cos_db)*vect[2];
+    res[1] = -cos_a1*sin_db*vect[0] + cos_db*vect[1] + sin_a1*sin_db*vect[2];
+    res[2] = (sin_a1*cos_a2 - cos_a1*sin_a2*cos_db)*vect[0] -
+             sin_a2*sin_db*vect[1] +
+             (sin_a1*sin_a2*cos_db + cos_a1*cos_a2)*vect[2];
+}
+
 void from_loc_sphr_to_cart(double* columnvect_xyzloc, double colatitude, double longitude, double* columnvect_res);
 void from_cart_to_loc_sphr(double* columnvect_xyzglob, double colatitude, double longitude, double* columnvect_res);
 void from_loc_sphr_to_loc_sphr(double* columnvect_xyzloc, double colatitude1, double longitude1, double colatitude2, double longitude2, double* columnvect_res);
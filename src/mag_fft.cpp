@@ -0,0 +1,388 @@
+/*
+Magnetic field of a regular tesseroid mesh on rows of a regular grid, by
+convolution in longitude.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "logger.h"
+#include "constants.h"
+#include "geometry.h"
+#include "glq.h"
+#include "fft.h"
+#include "mag_tess.h"
+#include "mag_fft.h"
+
+
+/* A tesseroid of the model while grouping them */
+typedef struct mag_fft_cell_struct
+{
+    double s, n, r1, r2;
+    int index; /* longitude index of the cell */
+    int t; /* index of the tesseroid in the model */
+} MAG_FFT_CELL;
+
+
+/* Order the tesseroids by group, then by longitude */
+static int mag_fft_cell_cmp(const void *a, const void *b)
+{
+    const MAG_FFT_CELL *ca = (const MAG_FFT_CELL *)a,
+                       *cb = (const MAG_FFT_CELL *)b;
+
+    if(ca->s != cb->s) return ca->s < cb->s ? -1 : 1;
+    if(ca->n != cb->n) return ca->n < cb->n ? -1 : 1;
+    if(ca->r1 != cb->r1) return ca->r1 < cb->r1 ? -1 : 1;
+    if(ca->r2 != cb->r2) return ca->r2 < cb->r2 ? -1 : 1;
+    return ca->index - cb->index;
+}
+
+
+/* Same group of tesseroids */
+#define MAG_FFT_SAME_GROUP(a, b) \
+    ((a).s == (b).s && (a).n == (b).n && (a).r1 == (b).r1 && (a).r2 == (b).r2)
+
+
+/* Check that a model is a regular mesh in longitude and group it */
+MAG_FFT_MESH * mag_fft_mesh_new(const TESS_MODEL *model)
+{
+    MAG_FFT_MESH *mesh;
+    MAG_FFT_CELL *cells;
+    MAG_FFT_GROUP *group;
+    TESSEROID *probes;
+    double dlon, lon0, pos, around;
+    int t, i, g, k, ndata, first;
+
+    if(model->size == 0)
+    {
+        log_warning("empty model, can't use the convolution in longitude");
+        return NULL;
+    }
+    lon0 = model->w[0];
+    dlon = model->e[0] - model->w[0];
+    if(dlon <= 0)
+    {
+        log_warning("tesseroid 1 has no width in longitude, can't use the "
+                    "convolution in longitude");
+        return NULL;
+    }
+    cells = (MAG_FFT_CELL *)malloc(model->size*sizeof(MAG_FFT_CELL));
+    if(cells == NULL)
+    {
+        log_error("problem allocating memory for the convolution mesh");
+        return NULL;
+    }
+    for(t = 0; t < model->size; t++)
+    {
+        pos = (model->w[t] - lon0)/dlon;
+        cells[t].index = (int)floor(pos + 0.5);
+        if(fabs(model->e[t] - model->w[t] - dlon) > MAG_FFT_TOL*dlon ||
+           fabs(pos - cells[t].index) > MAG_FFT_TOL)
+        {
+            log_warning("tesseroid %d is not on the mesh of tesseroid 1 "
+                        "(width %g degrees), can't use the convolution in "
+                        "longitude", t + 1, dlon);
+            free(cells);
+            return NULL;
+        }
+        cells[t].s = model->s[t];
+        cells[t].n = model->n[t];
+        cells[t].r1 = model->r1[t];
+        cells[t].r2 = model->r2[t];
+        cells[t].t = t;
+    }
+    qsort(cells, model->size, sizeof(MAG_FFT_CELL), mag_fft_cell_cmp);
+
+    mesh = (MAG_FFT_MESH *)malloc(sizeof(MAG_FFT_MESH));
+    if(mesh == NULL)
+    {
+        log_error("problem allocating memory for the convolution mesh");
+        free(cells);
+        return NULL;
+    }
+    mesh->lon0 = lon0;
+    mesh->dlon = dlon;
+    around = 360/dlon;
+    mesh->periodic = 0;
+    if(fabs(around - floor(around + 0.5)) <= MAG_FFT_TOL*around)
+    {
+        mesh->periodic = (int)floor(around + 0.5);
+    }
+    mesh->ngroups = 1;
+    for(i = 1; i < model->size; i++)
+    {
+        if(!MAG_FFT_SAME_GROUP(cells[i], cells[i - 1]))
+        {
+            mesh->ngroups++;
+        }
+    }
+    mesh->groups = (MAG_FFT_GROUP *)malloc(mesh->ngroups*sizeof(MAG_FFT_GROUP));
+    probes = (TESSEROID *)malloc(mesh->ngroups*sizeof(TESSEROID));
+    mesh->data = NULL;
+    mesh->probes = NULL;
+    if(mesh->groups == NULL || probes == NULL)
+    {
+        log_error("problem allocating memory for the convolution mesh");
+        free(cells);
+        free(probes);
+        mag_fft_mesh_free(mesh);
+        return NULL;
+    }
+
+    /* Span of each group in longitude */
+    mesh->max_cells = 0;
+    ndata = 0;
+    for(i = 0, g = 0; i < model->size; g++)
+    {
+        first = i;
+        while(i < model->size && MAG_FFT_SAME_GROUP(cells[i], cells[first]))
+        {
+            i++;
+        }
+        group = &(mesh->groups[g]);
+        group->first = cells[first].index;
+        group->ncells = cells[i - 1].index - cells[first].index + 1;
+        if(group->ncells > mesh->max_cells)
+        {
+            mesh->max_cells = group->ncells;
+        }
+        ndata += 3*group->ncells;
+
+        /* The probe is the tesseroid at the first cell, with the borders
+           and the trigonometric functions of the model */
+        tess_model_get(model, cells[first].t, &probes[g]);
+        probes[g].w = lon0 + group->first*dlon;
+        probes[g].e = probes[g].w + dlon;
+        probes[g].suscept = 0;
+        probes[g].Bx = probes[g].By = probes[g].Bz = 0;
+        probes[g].cos_a1 = model->cos_a1[cells[first].t];
+        probes[g].sin_a1 = model->sin_a1[cells[first].t];
+        probes[g].cos_b1 = cos(DEG2RAD*(probes[g].w + probes[g].e)*0.5);
+        probes[g].sin_b1 = sin(DEG2RAD*(probes[g].w + probes[g].e)*0.5);
+    }
+    mesh->probes = tess_model_from_array(probes, mesh->ngroups);
+    free(probes);
+    mesh->data = (double *)calloc(ndata, sizeof(double));
+    if(mesh->probes == NULL || mesh->data == NULL)
+    {
+        log_error("problem allocating memory for the convolution mesh");
+        free(cells);
+        mag_fft_mesh_free(mesh);
+        return NULL;
+    }
+
+    /* Magnetization of each cell. Tesseroids in the same cell add up. */
+    ndata = 0;
+    for(i = 0, g = 0; i < model->size; g++)
+    {
+        group = &(mesh->groups[g]);
+        group->m = mesh->data + ndata;
+        ndata += 3*group->ncells;
+        for(first = i; i < model->size &&
+            MAG_FFT_SAME_GROUP(cells[i], cells[first]); i++)
+        {
+            t = cells[i].t;
+            k = cells[i].index - group->first;
+            group->m[3*k] += model->mx[t];
+            group->m[3*k + 1] += model->my[t];
+            group->m[3*k + 2] += model->mz[t];
+        }
+    }
+    free(cells);
+    return mesh;
+}
+
+
+/* Free the memory of a mesh */
+void mag_fft_mesh_free(MAG_FFT_MESH *mesh)
+{
+    if(mesh == NULL)
+    {
+        return;
+    }
+    if(mesh->probes != NULL)
+    {
+        tess_model_free(mesh->probes);
+    }
+    free(mesh->data);
+    free(mesh->groups);
+    free(mesh);
+}
+
+
+/* Make empty convolution buffers */
+MAG_FFT_WORK * mag_fft_work_new(void)
+{
+    MAG_FFT_WORK *work;
+
+    work = (MAG_FFT_WORK *)malloc(sizeof(MAG_FFT_WORK));
+    if(work == NULL)
+    {
+        return NULL;
+    }
+    work->size = 0;
+    work->tw = NULL;
+    work->kernel = NULL;
+    work->mag = NULL;
+    work->acc = NULL;
+    return work;
+}
+
+
+/* Free the memory of convolution buffers */
+void mag_fft_work_free(MAG_FFT_WORK *work)
+{
+    if(work == NULL)
+    {
+        return;
+    }
+    free(work->tw);
+    free(work->kernel);
+    free(work->mag);
+    free(work->acc);
+    free(work);
+}
+
+
+/* Make room for FFTs of the given size. Returns 1 if there was an error
+   with allocation. */
+static int mag_fft_work_reserve(MAG_FFT_WORK *work, int size)
+{
+    if(work->size == size)
+    {
+        return 0;
+    }
+    free(work->tw);
+    free(work->kernel);
+    free(work->mag);
+    free(work->acc);
+    work->size = size;
+    work->tw = (double *)malloc(size*sizeof(double));
+    work->kernel = (double *)malloc(9*2*size*sizeof(double));
+    work->mag = (double *)malloc(3*2*size*sizeof(double));
+    work->acc = (double *)malloc(3*2*size*sizeof(double));
+    if(work->tw == NULL || work->kernel == NULL || work->mag == NULL ||
+       work->acc == NULL)
+    {
+        free(work->tw);
+        free(work->kernel);
+        free(work->mag);
+        free(work->acc);
+        work->tw = work->kernel = work->mag = work->acc = NULL;
+        work->size = 0;
+        return 1;
+    }
+    fft_twiddles(size, work->tw);
+    return 0;
+}
+
+
+/* Calculate the magnetic field of a mesh on a row of points.
+
+   Point f of the fine row (every cell from the first point to the last) and
+   cell j of a group are d = f - j cells apart, so the field is
+   sum_j K(f - j) M(j). The kernels of all groups are placed at
+   d + max_cells - 1, which puts the field of point f at f + max_cells - 1 of
+   the convolution for every group: the products of the FFTs can be summed
+   over the groups before a single inverse FFT. */
+int calc_mag_fft_row(const MAG_FFT_MESH *mesh, const MAG_CALC *calc,
+    double lon, int step, int npoints, double lat, double height,
+    GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r, MAG_STATS *stats,
+    MAG_FFT_WORK *work, double *res)
+{
+    const MAG_FFT_GROUP *group;
+    MAG_CALC calc_row = *calc;
+    MAG_POINT point;
+    double kernel[9], *kc, *mb, *acc, kr, ki, mr, mi;
+    int nfine, shift, size, nk, nout, g, d, t, q, a, b, k, kernels = 0;
+
+    nfine = (npoints - 1)*step + 1;
+    shift = mesh->max_cells - 1;
+    size = fft_size(mesh->max_cells + nfine - 1);
+    if(mag_fft_work_reserve(work, size))
+    {
+        return 1;
+    }
+    nk = calc->vector ? 9 : 3;
+    nout = calc->vector ? 3 : 1;
+    /* The node table is indexed by the tesseroids of the model, not by the
+       probes */
+    calc_row.nodes = NULL;
+    mag_point_init(&point);
+    memset(work->acc, 0, nout*2*size*sizeof(double));
+    for(g = 0; g < mesh->ngroups; g++)
+    {
+        group = &(mesh->groups[g]);
+        memset(work->kernel, 0, nk*2*size*sizeof(double));
+        for(d = 1 - group->ncells; d < nfine; d++)
+        {
+            t = d + shift;
+            /* The kernel is the same a whole turn of the Earth away */
+            if(mesh->periodic && d - mesh->periodic >= 1 - group->ncells)
+            {
+                for(q = 0; q < nk; q++)
+                {
+                    kc = work->kernel + 2*size*q;
+                    kc[2*t] = kc[2*(t - mesh->periodic)];
+                }
+                continue;
+            }
+            mag_point_set(&point, lon + d*mesh->dlon, lat, height);
+            calc_mag_kernel(mesh->probes, g, &calc_row, &point, glq_lon,
+                            glq_lat, glq_r, stats, kernel);
+            kernels++;
+            for(q = 0; q < nk; q++)
+            {
+                work->kernel[2*size*q + 2*t] = kernel[q];
+            }
+        }
+        for(q = 0; q < nk; q++)
+        {
+            fft(work->kernel + 2*size*q, size, -1, work->tw);
+        }
+        memset(work->mag, 0, 3*2*size*sizeof(double));
+        for(b = 0; b < 3; b++)
+        {
+            mb = work->mag + 2*size*b;
+            for(k = 0; k < group->ncells; k++)
+            {
+                mb[2*k] = group->m[3*k + b];
+            }
+            fft(mb, size, -1, work->tw);
+        }
+        for(a = 0; a < nout; a++)
+        {
+            acc = work->acc + 2*size*a;
+            for(b = 0; b < 3; b++)
+            {
+                kc = work->kernel + 2*size*(3*a + b);
+                mb = work->mag + 2*size*b;
+                for(k = 0; k < size; k++)
+                {
+                    kr = kc[2*k];
+                    ki = kc[2*k + 1];
+                    mr = mb[2*k];
+                    mi = mb[2*k + 1];
+                    acc[2*k] += kr*mr - ki*mi;
+                    acc[2*k + 1] += kr*mi + ki*mr;
+                }
+            }
+        }
+    }
+    for(a = 0; a < nout; a++)
+    {
+        acc = work->acc + 2*size*a;
+        fft(acc, size, 1, work->tw);
+        for(k = 0; k < npoints; k++)
+        {
+            res[3*k + a] = acc[2*(k*step + shift)]/size;
+        }
+    }
+    if(stats != NULL)
+    {
+        stats->fft_points += npoints;
+        stats->fft_kernels += kernels;
+    }
+    return 0;
+}
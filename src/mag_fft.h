@@ -0,0 +1,131 @@
+/*
+Magnetic field of a regular tesseroid mesh on rows of a regular grid, by
+convolution in longitude.
+
+If the tesseroids of a model all have the same width in longitude and their
+borders fall on a common set of meridians, the model is a set of groups of
+tesseroids (same latitude band and radius layer) that only differ by their
+longitude and magnetization. Turning a tesseroid and a point about the axis of
+the Earth does not change the field in the local systems, so on a row of
+points with the same latitude and height, spaced by a multiple of the width of
+the tesseroids, the field of a group is the convolution of the magnetization
+with a kernel that only depends on the difference of the longitudes.
+
+The kernel is calculated once per row, group and longitude difference with
+calc_mag_kernel, so it is the same as the direct calculation (adaptative
+division, far field and GLQ orders included). The convolutions are done with
+FFTs, so the results differ from the direct ones by rounding.
+
+Example
+-------
+
+    MAG_FFT_MESH *mesh = mag_fft_mesh_new(model);
+    MAG_FFT_WORK *work = mag_fft_work_new();
+    double res[3*100];
+
+    if(mesh != NULL)
+        calc_mag_fft_row(mesh, &calc, -20, 1, 100, 45, 250000, glq_lon,
+                         glq_lat, glq_r, NULL, work, res);
+*/
+
+#ifndef _TESSEROIDS_MAG_FFT_H_
+#define _TESSEROIDS_MAG_FFT_H_
+
+
+/* Needed for definition of TESS_MODEL */
+#include "geometry.h"
+/* Needed for definition of GLQ */
+#include "glq.h"
+/* Needed for definition of MAG_CALC and MAG_STATS */
+#include "mag_tess.h"
+
+
+/* Smallest number of points of a row worth a convolution */
+#define MAG_FFT_MIN_POINTS 16
+/* Tolerance, in cells, of the positions of the tesseroids and of the points
+   of a row */
+#define MAG_FFT_TOL 1e-9
+
+
+/** Tesseroids of a mesh that only differ by their longitude */
+typedef struct mag_fft_group_struct
+{
+    int first; /* longitude index of the first cell */
+    int ncells; /* number of cells from the first to the last tesseroid */
+    double *m; /* mx, my and mz of each cell, 0 if there is no tesseroid */
+} MAG_FFT_GROUP;
+
+
+/** A model seen as a regular mesh in longitude */
+typedef struct mag_fft_mesh_struct
+{
+    double lon0; /* western border of the cell of index 0, in degrees */
+    double dlon; /* width of the cells in degrees */
+    int periodic; /* number of cells around the Earth if it is a whole
+                     number, 0 otherwise */
+    int ngroups; /* number of groups */
+    int max_cells; /* largest ncells of the groups */
+    MAG_FFT_GROUP *groups;
+    TESS_MODEL *probes; /* one tesseroid of each group, at its first cell */
+    double *data; /* memory block of the magnetizations of the groups */
+} MAG_FFT_MESH;
+
+
+/** Buffers of the convolutions. Each thread needs its own. */
+typedef struct mag_fft_work_struct
+{
+    int size; /* size of the FFTs the buffers have room for */
+    double *tw; /* twiddle factors */
+    double *kernel; /* kernels: values, then their FFTs */
+    double *mag; /* FFTs of the magnetization of a group */
+    double *acc; /* sums of the products of the FFTs */
+} MAG_FFT_WORK;
+
+
+/** Check that a model is a regular mesh in longitude and group it.
+
+@return the mesh or NULL if the model is not regular (the reason is logged)
+        or there was an error with allocation
+*/
+MAG_FFT_MESH * mag_fft_mesh_new(const TESS_MODEL *model);
+
+
+/** Free the memory of a mesh */
+void mag_fft_mesh_free(MAG_FFT_MESH *mesh);
+
+
+/** Make empty convolution buffers. Returns NULL if there was an error with
+allocation. */
+MAG_FFT_WORK * mag_fft_work_new(void);
+
+
+/** Free the memory of convolution buffers */
+void mag_fft_work_free(MAG_FFT_WORK *work);
+
+
+/** Calculate the magnetic field of a mesh on a row of points.
+
+@param mesh the mesh
+@param calc settings of the calculation, as for calc_mag_model. The node
+            table is not used.
+@param lon longitude of the first point in degrees
+@param step distance between the points, in number of cells of the mesh
+@param npoints number of points
+@param lat latitude of the points in degrees
+@param height height of the points in SI units
+@param glq_lon pointer to GLQ structure used for the longitudinal integration
+@param glq_lat pointer to GLQ structure used for the latitudinal integration
+@param glq_r pointer to GLQ structure used for the radial integration
+@param stats counters increased by the calculation. Can be NULL.
+@param work convolution buffers. Grown as needed.
+@param res receives 3 values per point: Bx, By and Bz in vector mode,
+           otherwise only the first of the 3 is set
+
+@return 0 if all went well, 1 if there was an error with allocation
+*/
+int calc_mag_fft_row(const MAG_FFT_MESH *mesh, const MAG_CALC *calc,
+    double lon, int step, int npoints, double lat, double height,
+    GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r, MAG_STATS *stats,
+    MAG_FFT_WORK *work, double *res);
+
+#endif
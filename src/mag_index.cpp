@@ -0,0 +1,352 @@
+/*
+Spatial index of the tesseroids of a model, to classify them for each
+computation point without visiting them one by one.
+*/
+
+
+#include <stdlib.h>
+#include <math.h>
+#include "constants.h"
+#include "geometry.h"
+#include "glq.h"
+#include "mag_tess.h"
+#include "mag_index.h"
+
+
+/* Classes of a bucket for a computation point */
+#define MAG_INDEX_FAR 0
+#define MAG_INDEX_MID 1
+#define MAG_INDEX_NEAR 2
+
+
+/* Distance between two points in Cartesian coordinates */
+static double mag_index_dist(const double *a, const double *b)
+{
+    return sqrt((a[0] - b[0])*(a[0] - b[0]) + (a[1] - b[1])*(a[1] - b[1]) +
+                (a[2] - b[2])*(a[2] - b[2]));
+}
+
+
+/* Smallest sphere around points[0..n-1] that is centered on their mean.
+   Returns the radius. */
+static double mag_index_sphere(const double *points, int n, double *c)
+{
+    double radius = 0, d;
+    int i, k;
+
+    for(k = 0; k < 3; k++)
+    {
+        c[k] = 0;
+        for(i = 0; i < n; i++)
+            c[k] += points[3*i + k];
+        c[k] /= n;
+    }
+    for(i = 0; i < n; i++)
+    {
+        d = mag_index_dist(&points[3*i], c);
+        if(d > radius)
+            radius = d;
+    }
+    return radius;
+}
+
+
+/* Fill in the bounds and spheres of a bucket from its tesseroids. tmp has
+   room for 3 doubles per tesseroid of the bucket. */
+static void mag_index_bucket(MAG_INDEX_BUCKET *bucket,
+    const TESS_MODEL *model, double *tmp)
+{
+    double d2r = PI/180., lont, latt, size;
+    int t, i;
+
+    bucket->w = model->w[bucket->first];
+    bucket->e = model->e[bucket->first];
+    bucket->s = model->s[bucket->first];
+    bucket->n = model->n[bucket->first];
+    bucket->r1 = model->r1[bucket->first];
+    bucket->r2 = model->r2[bucket->first];
+    bucket->size = 0;
+    for(t = bucket->first; t < bucket->last; t++)
+    {
+        if(model->w[t] < bucket->w)
+            bucket->w = model->w[t];
+        if(model->e[t] > bucket->e)
+            bucket->e = model->e[t];
+        if(model->s[t] < bucket->s)
+            bucket->s = model->s[t];
+        if(model->n[t] > bucket->n)
+            bucket->n = model->n[t];
+        if(model->r1[t] < bucket->r1)
+            bucket->r1 = model->r1[t];
+        if(model->r2[t] > bucket->r2)
+            bucket->r2 = model->r2[t];
+        /* The sizes that the adaptative division compares */
+        size = MEAN_EARTH_RADIUS*d2r*(model->e[t] - model->w[t]);
+        if(MEAN_EARTH_RADIUS*d2r*(model->n[t] - model->s[t]) > size)
+            size = MEAN_EARTH_RADIUS*d2r*(model->n[t] - model->s[t]);
+        if(model->r2[t] - model->r1[t] > size)
+            size = model->r2[t] - model->r1[t];
+        if(size > bucket->size)
+            bucket->size = size;
+        /* The division measures the distance to the middle of the top */
+        i = 3*(t - bucket->first);
+        lont = d2r*0.5*(model->w[t] + model->e[t]);
+        latt = d2r*0.5*(model->s[t] + model->n[t]);
+        tmp[i] = model->r2[t]*cos(latt)*cos(lont);
+        tmp[i + 1] = model->r2[t]*cos(latt)*sin(lont);
+        tmp[i + 2] = model->r2[t]*sin(latt);
+    }
+    bucket->top_radius = mag_index_sphere(tmp, bucket->last - bucket->first,
+                                          bucket->top);
+    for(t = bucket->first; t < bucket->last; t++)
+    {
+        i = 3*(t - bucket->first);
+        tmp[i] = model->rc[t]*model->cos_latc[t]*model->cos_lonc[t];
+        tmp[i + 1] = model->rc[t]*model->cos_latc[t]*model->sin_lonc[t];
+        tmp[i + 2] = model->rc[t]*model->sin_latc[t];
+    }
+    bucket->mass_radius = mag_index_sphere(tmp, bucket->last - bucket->first,
+                                           bucket->mass);
+}
+
+
+/* Build the index of a model and reorder the tesseroids of the model */
+MAG_INDEX * mag_index_new(TESS_MODEL *model, double truncate)
+{
+    MAG_INDEX *index;
+    double lon_min, lon_max, lat_min, lat_max, lon, lat, *tmp = NULL;
+    int *cell = NULL, *count = NULL, *perm = NULL, nb, ncells, t, c, b,
+        error = 0;
+
+    if(model->size < 1)
+    {
+        return NULL;
+    }
+    index = (MAG_INDEX *)malloc(sizeof(MAG_INDEX));
+    if(index == NULL)
+    {
+        return NULL;
+    }
+    index->truncate = truncate;
+    index->buckets = NULL;
+    /* Extent of the middles of the tesseroids */
+    lon_min = lon_max = 0.5*(model->w[0] + model->e[0]);
+    lat_min = lat_max = 0.5*(model->s[0] + model->n[0]);
+    for(t = 1; t < model->size; t++)
+    {
+        lon = 0.5*(model->w[t] + model->e[t]);
+        lat = 0.5*(model->s[t] + model->n[t]);
+        lon_min = lon < lon_min ? lon : lon_min;
+        lon_max = lon > lon_max ? lon : lon_max;
+        lat_min = lat < lat_min ? lat : lat_min;
+        lat_max = lat > lat_max ? lat : lat_max;
+    }
+    /* Cells about as wide as they are high, MAG_INDEX_BUCKET_SIZE
+       tesseroids each on average */
+    nb = (model->size + MAG_INDEX_BUCKET_SIZE - 1)/MAG_INDEX_BUCKET_SIZE;
+    if(lat_max <= lat_min)
+        index->nlat = 1;
+    else if(lon_max <= lon_min)
+        index->nlat = nb;
+    else
+        index->nlat = (int)ceil(sqrt(nb*(lat_max - lat_min)/
+                                     (lon_max - lon_min)));
+    if(index->nlat > nb)
+        index->nlat = nb;
+    index->nlon = (nb + index->nlat - 1)/index->nlat;
+    ncells = index->nlon*index->nlat;
+
+    /* Sort the tesseroids by cell */
+    cell = (int *)malloc(model->size*sizeof(int));
+    count = (int *)calloc(ncells + 1, sizeof(int));
+    perm = (int *)malloc(model->size*sizeof(int));
+    if(cell == NULL || count == NULL || perm == NULL)
+    {
+        error = 1;
+    }
+    for(t = 0; !error && t < model->size; t++)
+    {
+        lon = 0.5*(model->w[t] + model->e[t]);
+        lat = 0.5*(model->s[t] + model->n[t]);
+        c = 0;
+        if(lon_max > lon_min)
+        {
+            c = (int)(index->nlon*(lon - lon_min)/(lon_max - lon_min));
+            if(c >= index->nlon)
+                c = index->nlon - 1;
+        }
+        if(lat_max > lat_min)
+        {
+            b = (int)(index->nlat*(lat - lat_min)/(lat_max - lat_min));
+            if(b >= index->nlat)
+                b = index->nlat - 1;
+            c += index->nlon*b;
+        }
+        cell[t] = c;
+        count[c + 1]++;
+    }
+    if(!error)
+    {
+        index->nbuckets = 0;
+        for(c = 0; c < ncells; c++)
+        {
+            if(count[c + 1] > 0)
+                index->nbuckets++;
+            count[c + 1] += count[c];
+        }
+        /* The tesseroids keep their order within a cell */
+        for(t = 0; t < model->size; t++)
+        {
+            perm[count[cell[t]]++] = t;
+        }
+        index->buckets = (MAG_INDEX_BUCKET *)malloc(
+            index->nbuckets*sizeof(MAG_INDEX_BUCKET));
+        tmp = (double *)malloc(3*model->size*sizeof(double));
+        if(index->buckets == NULL || tmp == NULL ||
+           tess_model_permute(model, perm) != 0)
+        {
+            error = 1;
+        }
+    }
+    if(!error)
+    {
+        /* count[c] is now one past the last tesseroid of cell c */
+        b = 0;
+        for(c = 0; c < ncells; c++)
+        {
+            t = c > 0 ? count[c - 1] : 0;
+            if(count[c] > t)
+            {
+                index->buckets[b].first = t;
+                index->buckets[b].last = count[c];
+                mag_index_bucket(&(index->buckets[b]), model, tmp);
+                b++;
+            }
+        }
+    }
+    free(cell);
+    free(count);
+    free(perm);
+    free(tmp);
+    if(error)
+    {
+        mag_index_free(index);
+        return NULL;
+    }
+    return index;
+}
+
+
+/* Free the memory of an index */
+void mag_index_free(MAG_INDEX *index)
+{
+    if(index == NULL)
+    {
+        return;
+    }
+    free(index->buckets);
+    free(index);
+}
+
+
+/* Class of a bucket for a point at x in Cartesian coordinates. Sets
+   *straddle if some of its tesseroids are beyond the truncation radius and
+   some are not. */
+static int mag_index_class(const MAG_INDEX *index,
+    const MAG_INDEX_BUCKET *bucket, const MAG_CALC *calc,
+    const MAG_POINT *point, const double *x, int *straddle)
+{
+    double dist;
+
+    *straddle = 0;
+    if(index->truncate > 0)
+    {
+        dist = mag_index_dist(x, bucket->mass);
+        if(dist - bucket->mass_radius > index->truncate)
+        {
+            return MAG_INDEX_FAR;
+        }
+        *straddle = dist + bucket->mass_radius > index->truncate;
+    }
+    if(point->lon >= bucket->w && point->lon <= bucket->e &&
+       point->lat >= bucket->s && point->lat <= bucket->n &&
+       point->r >= bucket->r1 && point->r <= bucket->r2)
+    {
+        return MAG_INDEX_NEAR;
+    }
+    /* Well beyond the rounding of the distance in the division */
+    if(calc->adaptative &&
+       mag_index_dist(x, bucket->top) - bucket->top_radius <=
+       (1 + 1e-6)*calc->ratio_max*bucket->size + 1)
+    {
+        return MAG_INDEX_NEAR;
+    }
+    return MAG_INDEX_MID;
+}
+
+
+/* Add the magnetic field of tesseroids first to last - 1 of a model to res,
+   using the index */
+void calc_mag_index(const MAG_INDEX *index, const TESS_MODEL *model,
+    int first, int last, const MAG_CALC *calc, const MAG_POINT *point,
+    GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r, MAG_STATS *stats, double *res)
+{
+    const MAG_INDEX_BUCKET *bucket;
+    double x[3], dx, dy, dz;
+    int lo, hi, b, t, cls, straddle;
+
+    x[0] = point->r*point->sin_a2*point->cos_b2;
+    x[1] = point->r*point->sin_a2*point->sin_b2;
+    x[2] = point->r*point->cos_a2;
+    /* The last bucket that starts at or before first */
+    lo = 0;
+    hi = index->nbuckets - 1;
+    while(lo < hi)
+    {
+        b = (lo + hi + 1)/2;
+        if(index->buckets[b].first <= first)
+            lo = b;
+        else
+            hi = b - 1;
+    }
+    for(b = lo; b < index->nbuckets && index->buckets[b].first < last; b++)
+    {
+        bucket = &(index->buckets[b]);
+        lo = bucket->first > first ? bucket->first : first;
+        hi = bucket->last < last ? bucket->last : last;
+        cls = mag_index_class(index, bucket, calc, point, x, &straddle);
+        if(cls == MAG_INDEX_FAR)
+        {
+            if(stats != NULL)
+                stats->truncated += hi - lo;
+            continue;
+        }
+        if(!straddle)
+        {
+            if(cls == MAG_INDEX_MID)
+                calc_mag_model_mid(model, lo, hi, calc, point, glq_lon,
+                                   glq_lat, glq_r, stats, res);
+            else
+                calc_mag_model(model, lo, hi, calc, point, glq_lon, glq_lat,
+                               glq_r, stats, res);
+            continue;
+        }
+        for(t = lo; t < hi; t++)
+        {
+            dx = model->rc[t]*model->cos_latc[t]*model->cos_lonc[t] - x[0];
+            dy = model->rc[t]*model->cos_latc[t]*model->sin_lonc[t] - x[1];
+            dz = model->rc[t]*model->sin_latc[t] - x[2];
+            if(dx*dx + dy*dy + dz*dz > index->truncate*index->truncate)
+            {
+                if(stats != NULL)
+                    stats->truncated++;
+            }
+            else if(cls == MAG_INDEX_MID)
+                calc_mag_model_mid(model, t, t + 1, calc, point, glq_lon,
+                                   glq_lat, glq_r, stats, res);
+            else
+                calc_mag_model(model, t, t + 1, calc, point, glq_lon,
+                               glq_lat, glq_r, stats, res);
+        }
+    }
+}
@@ -0,0 +1,108 @@
+/*
+Spatial index of the tesseroids of a model, to classify them for each
+computation point without visiting them one by one.
+
+The tesseroids are put in the buckets of a regular longitude-latitude grid
+by the position of their center, and the model is reordered so that every
+bucket holds a range of consecutive tesseroids. For a computation point,
+each bucket is:
+
+  * far, if all the centers of mass of its tesseroids are beyond the
+    truncation radius. Its tesseroids are skipped.
+  * mid, if the point is outside the bounds of the bucket and, with the
+    adaptative division, far enough from all its tesseroids that none would
+    be divided. Its tesseroids are calculated with the GLQ directly, without
+    the division or the check for points inside a tesseroid.
+  * near, otherwise. Its tesseroids are calculated with calc_mag_model.
+
+A bucket that straddles the truncation radius is sorted out tesseroid by
+tesseroid. Without truncation, the reordered model gives the same results
+with or without the index.
+
+Example
+-------
+
+    MAG_INDEX *index = mag_index_new(model, 0);
+    double res[3] = {0, 0, 0};
+
+    calc_mag_index(index, model, 0, model->size, &calc, &point, glq_lon,
+                   glq_lat, glq_r, NULL, res);
+    mag_index_free(index);
+*/
+
+#ifndef _TESSEROIDS_MAG_INDEX_H_
+#define _TESSEROIDS_MAG_INDEX_H_
+
+
+/* Needed for definition of TESS_MODEL */
+#include "geometry.h"
+/* Needed for definition of GLQ */
+#include "glq.h"
+/* Needed for definition of MAG_CALC, MAG_POINT and MAG_STATS */
+#include "mag_tess.h"
+
+
+/* Average number of tesseroids in a bucket */
+#define MAG_INDEX_BUCKET_SIZE 32
+
+
+/** A bucket of the index */
+typedef struct mag_index_bucket_struct
+{
+    int first; /* first tesseroid of the bucket in the reordered model */
+    int last; /* one past the last tesseroid */
+    double w, e, s, n, r1, r2; /* bounds of all its tesseroids */
+    double top[3]; /* center of the sphere around the middle of the tops of
+                      its tesseroids, from which the adaptative division
+                      measures the distance, in Cartesian coordinates */
+    double top_radius; /* radius of that sphere */
+    double size; /* largest dimension of its tesseroids, measured as in the
+                    adaptative division */
+    double mass[3]; /* center of the sphere around the centers of mass of
+                       its tesseroids */
+    double mass_radius; /* radius of that sphere */
+} MAG_INDEX_BUCKET;
+
+
+/** Index over the tesseroids of a model */
+typedef struct mag_index_struct
+{
+    int nlon, nlat; /* number of buckets in longitude and latitude */
+    int nbuckets; /* number of buckets that hold tesseroids */
+    MAG_INDEX_BUCKET *buckets; /* in the order of the model */
+    double truncate; /* distance in SI units beyond which tesseroids are
+                        skipped, 0 to never skip them */
+} MAG_INDEX;
+
+
+/** Build the index of a model and reorder the tesseroids of the model.
+
+@param model the tesseroid model. Reordered to the order of the buckets.
+@param truncate distance from the computation point, in SI units, beyond
+                which the tesseroids are skipped. 0 to calculate all.
+
+@return the index or NULL if there was an error with allocation. The model
+        is not changed in that case.
+*/
+MAG_INDEX * mag_index_new(TESS_MODEL *model, double truncate);
+
+
+/** Free the memory of an index */
+void mag_index_free(MAG_INDEX *index);
+
+
+/** Add the magnetic field of tesseroids first to last - 1 of a model to res,
+using the index to skip or calculate them without checks.
+
+The tesseroids are summed in the same order as calc_mag_model.
+
+@param index the index made by mag_index_new for model
+@param model the tesseroid model, in the order of the index
+Other parameters are as for calc_mag_model. The stats also count the
+tesseroids that are skipped and those calculated without checks.
+*/
+void calc_mag_index(const MAG_INDEX *index, const TESS_MODEL *model,
+    int first, int last, const MAG_CALC *calc, const MAG_POINT *point,
+    GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r, MAG_STATS *stats, double *res);
+
+#endif
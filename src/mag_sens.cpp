@@ -0,0 +1,266 @@
+/*
+Sensitivity matrix of a tesseroid model, stored in a file.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "logger.h"
+#include "geometry.h"
+#include "glq.h"
+#include "mag_tess.h"
+#include "mag_sens.h"
+
+#ifdef __linux__
+    #include <cblas.h>
+#elif defined(__APPLE__) && defined(__MACH__)
+    #include <Accelerate/Accelerate.h>
+#endif
+
+
+/* Size of a sensitivity file in bytes */
+static size_t mag_sens_size(int ncomps, long long npoints, long long ntess)
+{
+    return MAG_SENS_HEADER_SIZE +
+           (size_t)(3*npoints + 6*ntess + ncomps*npoints*3*ntess)*
+           sizeof(double);
+}
+
+
+/* Point the tables of a sensitivity file into its mapping */
+static void mag_sens_set_tables(MAG_SENS *sens)
+{
+    sens->ncomps = sens->component == MAG_SENS_VECTOR ? 3 : 1;
+    sens->points = (double *)((char *)sens->map + MAG_SENS_HEADER_SIZE);
+    sens->borders = sens->points + 3*sens->npoints;
+    sens->matrix = sens->borders + 6*sens->ntess;
+}
+
+
+/* Create a sensitivity file and map it for writing */
+MAG_SENS * mag_sens_create(const char *fname, int component,
+    long long npoints, const TESS_MODEL *model)
+{
+    MAG_SENS *sens;
+    char *header;
+    int32_t comp = component, reserved = 0;
+    int64_t points = npoints, ntess = model->size;
+    int fd, t;
+
+    sens = (MAG_SENS *)calloc(1, sizeof(MAG_SENS));
+    if(sens == NULL)
+    {
+        log_error("problem allocating memory for a sensitivity file");
+        return NULL;
+    }
+    sens->component = component;
+    sens->npoints = npoints;
+    sens->ntess = model->size;
+    sens->writable = 1;
+    sens->size = mag_sens_size(component == MAG_SENS_VECTOR ? 3 : 1, npoints,
+                               model->size);
+    fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        log_error("unable to create sensitivity file %s", fname);
+        free(sens);
+        return NULL;
+    }
+    if(ftruncate(fd, sens->size) != 0)
+    {
+        log_error("unable to make room for %.3g MB in %s",
+                  sens->size/(1024.*1024.), fname);
+        close(fd);
+        free(sens);
+        return NULL;
+    }
+    sens->map = mmap(NULL, sens->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fd, 0);
+    /* The mapping keeps the file open */
+    close(fd);
+    if(sens->map == MAP_FAILED)
+    {
+        log_error("unable to map sensitivity file %s", fname);
+        free(sens);
+        return NULL;
+    }
+    header = (char *)sens->map;
+    memcpy(header, MAG_SENS_MAGIC, 8);
+    memcpy(header + 8, &comp, 4);
+    memcpy(header + 12, &reserved, 4);
+    memcpy(header + 16, &points, 8);
+    memcpy(header + 24, &ntess, 8);
+    mag_sens_set_tables(sens);
+    for(t = 0; t < model->size; t++)
+    {
+        sens->borders[6*t] = model->w[t];
+        sens->borders[6*t + 1] = model->e[t];
+        sens->borders[6*t + 2] = model->s[t];
+        sens->borders[6*t + 3] = model->n[t];
+        sens->borders[6*t + 4] = model->r1[t];
+        sens->borders[6*t + 5] = model->r2[t];
+    }
+    return sens;
+}
+
+
+/* Map an existing sensitivity file */
+MAG_SENS * mag_sens_open(const char *fname, int writable)
+{
+    MAG_SENS *sens;
+    struct stat st;
+    const char *header;
+    int32_t comp;
+    int64_t points, ntess;
+    int fd;
+
+    sens = (MAG_SENS *)calloc(1, sizeof(MAG_SENS));
+    if(sens == NULL)
+    {
+        log_error("problem allocating memory for a sensitivity file");
+        return NULL;
+    }
+    fd = open(fname, writable ? O_RDWR : O_RDONLY);
+    if(fd < 0)
+    {
+        log_error("unable to open sensitivity file %s", fname);
+        free(sens);
+        return NULL;
+    }
+    if(fstat(fd, &st) != 0 || st.st_size < MAG_SENS_HEADER_SIZE)
+    {
+        log_error("sensitivity file %s is too short for its header", fname);
+        close(fd);
+        free(sens);
+        return NULL;
+    }
+    sens->size = st.st_size;
+    sens->writable = writable;
+    sens->map = mmap(NULL, sens->size,
+                     writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                     writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(sens->map == MAP_FAILED)
+    {
+        log_error("unable to map sensitivity file %s", fname);
+        free(sens);
+        return NULL;
+    }
+    header = (const char *)sens->map;
+    memcpy(&comp, header + 8, 4);
+    memcpy(&points, header + 16, 8);
+    memcpy(&ntess, header + 24, 8);
+    if(memcmp(header, MAG_SENS_MAGIC, 8) != 0)
+    {
+        log_error("%s is not a sensitivity file (bad magic)", fname);
+        mag_sens_close(sens);
+        return NULL;
+    }
+    if(comp < MAG_SENS_VECTOR || comp > 2 || points < 0 || ntess < 1)
+    {
+        log_error("bad header of sensitivity file %s: component %d, %lld point(s), %lld tesseroid(s)",
+                  fname, (int)comp, (long long)points, (long long)ntess);
+        mag_sens_close(sens);
+        return NULL;
+    }
+    sens->component = comp;
+    sens->npoints = points;
+    sens->ntess = ntess;
+    if(sens->size < mag_sens_size(comp == MAG_SENS_VECTOR ? 3 : 1, points,
+                                  ntess))
+    {
+        log_error("sensitivity file %s is truncated", fname);
+        mag_sens_close(sens);
+        return NULL;
+    }
+    mag_sens_set_tables(sens);
+    madvise(sens->map, sens->size, MADV_SEQUENTIAL);
+    return sens;
+}
+
+
+/* Unmap a sensitivity file and free its memory */
+void mag_sens_close(MAG_SENS *sens)
+{
+    if(sens == NULL)
+    {
+        return;
+    }
+    if(sens->map != NULL)
+    {
+        if(sens->writable)
+        {
+            msync(sens->map, sens->size, MS_SYNC);
+        }
+        munmap(sens->map, sens->size);
+    }
+    free(sens);
+}
+
+
+/* Tell if a model has the tesseroids of a sensitivity file */
+long long mag_sens_check_model(const MAG_SENS *sens, const TESS_MODEL *model)
+{
+    const double *b;
+    long long t;
+
+    for(t = 0; t < sens->ntess && t < model->size; t++)
+    {
+        b = &(sens->borders[6*t]);
+        if(b[0] != model->w[t] || b[1] != model->e[t] ||
+           b[2] != model->s[t] || b[3] != model->n[t] ||
+           b[4] != model->r1[t] || b[5] != model->r2[t])
+        {
+            return t;
+        }
+    }
+    return sens->ntess == model->size ? -1 : t;
+}
+
+
+/* Calculate the rows of the sensitivity matrix of a computation point */
+void calc_mag_sens_rows(const TESS_MODEL *model, const MAG_CALC *calc,
+    const MAG_POINT *point, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r,
+    MAG_STATS *stats, double *rows)
+{
+    calc_mag_kernels(model, 0, model->size, calc, point, glq_lon, glq_lat,
+                     glq_r, stats, 3*(long long)model->size, rows);
+}
+
+
+/* Calculate the field of magnetizations of the model of a sensitivity file
+   on all its points */
+int mag_sens_apply(const MAG_SENS *sens, const double *magnetization,
+    int ncases, double *res)
+{
+    long long nrows = sens->npoints*sens->ncomps, ncols = 3*sens->ntess;
+
+    /* The BLAS takes the sizes as int */
+    if(nrows > INT_MAX || ncols > INT_MAX)
+    {
+        return 1;
+    }
+    if(nrows == 0)
+    {
+        return 0;
+    }
+    if(ncases == 1)
+    {
+        cblas_dgemv(CblasRowMajor, CblasNoTrans, (int)nrows, (int)ncols, 1.0,
+                    sens->matrix, (int)ncols, magnetization, 1, 0.0, res, 1);
+    }
+    else
+    {
+        cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, (int)nrows,
+                    ncases, (int)ncols, 1.0, sens->matrix, (int)ncols,
+                    magnetization, ncases, 0.0, res, ncases);
+    }
+    return 0;
+}
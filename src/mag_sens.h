@@ -0,0 +1,155 @@
+/*
+Sensitivity matrix of a tesseroid model: the kernels that give the magnetic
+field on a set of computation points from the magnetization of every
+tesseroid, stored in a file.
+
+The kernels only depend on the geometry of the model, so the field of any
+other magnetization of the same tesseroids is a product of the matrix with
+the magnetization vector, without the GLQ.
+
+A sensitivity file is a header of 32 bytes followed by three tables:
+
+    offset  size  content
+    0       8     magic "TESSSEN1"
+    8       4     component: 0, 1 or 2 for bx, by or bz alone, -1 for all
+                  three, int32
+    12      4     reserved, 0
+    16      8     number of computation points, int64
+    24      8     number of tesseroids, int64
+    32            the points: lon, lat and height, 3 float64 each
+    ...           the tesseroids: w, e, s, n, r1 and r2, 6 float64 each
+    ...           the matrix: for each point and component, a row of
+                  3 float64 per tesseroid (mx, my, mz)
+
+All numbers are in the byte order of the machine that wrote the file. The
+rows of the matrix are in the order of the points, with the components of a
+point one after the other (bx, by, bz), and the columns in the order of the
+model. The magnetization is that of TESS_MODEL (mx, my, mz), so the matrix
+times the magnetization is the field the tessb* programs calculate.
+
+Files are read and written through mmap.
+
+Example
+-------
+
+    MAG_SENS *sens = mag_sens_open("model.sens", 0);
+    double *m = (double *)malloc(3*model->size*sizeof(double));
+    double *res = (double *)malloc(sens->npoints*sens->ncomps*sizeof(double));
+
+    for(t = 0; t < model->size; t++)
+    {
+        m[3*t] = model->mx[t];
+        m[3*t + 1] = model->my[t];
+        m[3*t + 2] = model->mz[t];
+    }
+    if(mag_sens_check_model(sens, model) == -1)
+        mag_sens_apply(sens, m, 1, res);
+    mag_sens_close(sens);
+*/
+
+#ifndef _TESSEROIDS_MAG_SENS_H_
+#define _TESSEROIDS_MAG_SENS_H_
+
+
+/* Needed for definition of TESS_MODEL */
+#include "geometry.h"
+/* Needed for definition of GLQ */
+#include "glq.h"
+/* Needed for definition of MAG_CALC, MAG_POINT and MAG_STATS */
+#include "mag_tess.h"
+
+
+/* Magic of the sensitivity files */
+#define MAG_SENS_MAGIC "TESSSEN1"
+/* Size of the header in bytes */
+#define MAG_SENS_HEADER_SIZE 32
+/* Component of a file with all three components */
+#define MAG_SENS_VECTOR -1
+
+
+/** A sensitivity file mapped in memory */
+typedef struct mag_sens_struct
+{
+    int component; /* 0, 1 or 2 for bx, by or bz, MAG_SENS_VECTOR for all */
+    int ncomps; /* number of rows of each point, 1 or 3 */
+    long long npoints; /* number of computation points */
+    long long ntess; /* number of tesseroids */
+    double *points; /* lon, lat and height of each point */
+    double *borders; /* w, e, s, n, r1 and r2 of each tesseroid */
+    double *matrix; /* npoints*ncomps rows of 3*ntess columns */
+    void *map; /* the mapped file */
+    size_t size; /* size of the mapped file in bytes */
+    int writable; /* flag: mapped for writing */
+} MAG_SENS;
+
+
+/** Create a sensitivity file and map it for writing.
+
+The points, borders and matrix are left to be filled in. The file is written
+by mag_sens_close.
+
+@param fname name of the file
+@param component 0, 1 or 2 for bx, by or bz, MAG_SENS_VECTOR for all three
+@param npoints number of computation points
+@param model the tesseroid model. Its borders are copied to the file.
+
+@return the file or NULL if it can't be created (the reason is logged)
+*/
+MAG_SENS * mag_sens_create(const char *fname, int component,
+    long long npoints, const TESS_MODEL *model);
+
+
+/** Map an existing sensitivity file.
+
+@param fname name of the file
+@param writable 1 to map it for writing, as another MPI rank does to fill in
+                its rows of a file made by mag_sens_create, 0 to read it
+
+@return the file or NULL if it is bad or can't be read (the reason is logged)
+*/
+MAG_SENS * mag_sens_open(const char *fname, int writable);
+
+
+/** Unmap a sensitivity file and free its memory. The changes of a writable
+file reach the file before it returns. */
+void mag_sens_close(MAG_SENS *sens);
+
+
+/** Tell if a model has the tesseroids of a sensitivity file.
+
+@return -1 if all borders are the same, otherwise the index of the first
+        tesseroid that differs (the size of the smaller of the two if the
+        numbers differ)
+*/
+long long mag_sens_check_model(const MAG_SENS *sens, const TESS_MODEL *model);
+
+
+/** Calculate the rows of the sensitivity matrix of a computation point.
+
+@param model the tesseroid model
+@param calc settings of the calculation. In vector mode the point has 3
+            rows, otherwise the row of its component.
+@param rows the rows of the point, 3*model->size values each
+Other parameters are as for calc_mag_model.
+*/
+void calc_mag_sens_rows(const TESS_MODEL *model, const MAG_CALC *calc,
+    const MAG_POINT *point, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r,
+    MAG_STATS *stats, double *rows);
+
+
+/** Calculate the field of one or more magnetizations of the model of a
+sensitivity file on all its points, with a BLAS matrix-vector product for
+one magnetization and a matrix-matrix product for several.
+
+@param sens the sensitivity file
+@param magnetization the magnetization of each tesseroid (mx, my, mz) for
+                     each case: 3*ntess rows of ncases values
+@param ncases number of magnetizations
+@param res the field: npoints*ncomps rows of ncases values
+
+@return 0 if all went well, 1 if the sizes are too large for the BLAS
+*/
+int mag_sens_apply(const MAG_SENS *sens, const double *magnetization,
+    int ncases, double *res);
+
+#endif
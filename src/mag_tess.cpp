@@ -0,0 +1,350 @@
+/*
+Functions that calculate the magnetic field of a tesseroid model stored as a
+structure of arrays (TESS_MODEL).
+*/
+
+
+#include <math.h>
+#include "logger.h"
+#include "constants.h"
+#include "geometry.h"
+#include "glq.h"
+#include "grav_tess.h"
+#include "linalg.h"
+#include "mag_tess.h"
+
+
+/* Set a point to lon = lat = 0 on the mean Earth radius */
+void mag_point_init(MAG_POINT *point)
+{
+    point->lon = 0;
+    point->lat = 0;
+    point->r = MEAN_EARTH_RADIUS;
+    point->cos_b2 = cos(0.0);
+    point->sin_b2 = sin(0.0);
+    point->cos_a2 = cos(PI/2.0);
+    point->sin_a2 = sin(PI/2.0);
+}
+
+
+/* Move a point to a new position */
+void mag_point_set(MAG_POINT *point, double lon, double lat, double height)
+{
+    if(lon != point->lon)
+    {
+        point->cos_b2 = cos(DEG2RAD*lon);
+        point->sin_b2 = sin(DEG2RAD*lon);
+        point->lon = lon;
+    }
+    if(lat != point->lat)
+    {
+        point->cos_a2 = cos(PI/2.0-DEG2RAD*lat);
+        point->sin_a2 = sin(PI/2.0-DEG2RAD*lat);
+        point->lat = lat;
+    }
+    point->r = height + MEAN_EARTH_RADIUS;
+}
+
+
+/* Move a point to a new position whose trigonometric functions are known */
+void mag_point_set_trig(MAG_POINT *point, double lon, double lat,
+    double height, const double *trig_lon, const double *trig_lat)
+{
+    point->lon = lon;
+    point->cos_b2 = trig_lon[0];
+    point->sin_b2 = trig_lon[1];
+    point->lat = lat;
+    point->cos_a2 = trig_lat[0];
+    point->sin_a2 = trig_lat[1];
+    point->r = height + MEAN_EARTH_RADIUS;
+}
+
+
+/* Number of tesseroids whose gradients are calculated before their field is
+   added to the result */
+#define MAG_RANGE_CHUNK (4*TESS_BLOCK_SIZE)
+
+
+/* Tell if the point is on tesseroid t of a model */
+static int mag_point_inside(const TESS_MODEL *model, int t,
+    const MAG_POINT *point)
+{
+    return point->lon >= model->w[t] && point->lon <= model->e[t] &&
+           point->lat >= model->s[t] && point->lat <= model->n[t] &&
+           point->r >= model->r1[t] && point->r <= model->r2[t];
+}
+
+
+/* Calculate the tesseroids waiting in a block with the block kernel and put
+   the tensor of each in its place of g */
+static void calc_mag_block(TESS_BLOCK *block, const int *slot,
+    const MAG_CALC *calc, const MAG_POINT *point, const GLQ *glq_lon,
+    const GLQ *glq_lat, const GLQ *glq_r, double (*g)[6])
+{
+    double gb[6*TESS_BLOCK_SIZE];
+    int l, c;
+
+    if(block->size == 0)
+    {
+        return;
+    }
+    calc->field_block(block, point->lon, point->lat, point->r, glq_lon,
+                      glq_lat, glq_r, gb);
+    for(l = 0; l < block->size; l++)
+    {
+        for(c = 0; c < 6; c++)
+        {
+            g[slot[l]][c] = gb[c*TESS_BLOCK_SIZE + l];
+        }
+    }
+    block->size = 0;
+}
+
+
+/* Calculate the gravity gradient tensor of the unit density tesseroids first
+   to last - 1 of a model, at most MAG_RANGE_CHUNK of them, into g. Not in
+   vector mode, only the components in far_comps are needed. If mid, the
+   point is known to be outside the tesseroids and too far from them to
+   divide them.
+
+   The tesseroids that are not far, not in the node table and not divided
+   are gathered from the columns of the model into blocks for the block
+   kernel. */
+static void calc_mag_tensors(const TESS_MODEL *model, int first, int last,
+    const MAG_CALC *calc, const MAG_POINT *point, GLQ *glq_lon, GLQ *glq_lat,
+    GLQ *glq_r, int mid, MAG_STATS *stats, double (*g)[6])
+{
+    TESS_BLOCK block;
+    TESS_ADAPT *adapt = stats != NULL ? &(stats->adapt) : NULL;
+    double d2r = PI/180., sinlatp = 0, coslatp = 0, gn[3];
+    int slot[TESS_BLOCK_SIZE], t, c;
+
+    if(calc->adaptative && !mid)
+    {
+        sinlatp = sin(d2r*point->lat);
+        coslatp = cos(d2r*point->lat);
+    }
+    block.size = 0;
+    for(t = first; t < last; t++)
+    {
+        if(calc->far_ratio > 0 &&
+           tess_model_ggt_far(model, t, calc->far_ratio, point->r,
+                              point->cos_a2, point->sin_a2, point->sin_b2,
+                              point->cos_b2, g[t - first]))
+        {
+            if(stats != NULL)
+                stats->far_evals++;
+        }
+        else if(!calc->adaptative && calc->nodes != NULL &&
+                t < calc->nodes->size)
+        {
+            if(!mid && mag_point_inside(model, t, point))
+            {
+                log_warning("Point (%g %g %g) is on tesseroid %d: %g %g %g %g %g %g. Can't guarantee accuracy.",
+                            point->lon, point->lat,
+                            point->r - MEAN_EARTH_RADIUS, t, model->w[t],
+                            model->e[t], model->s[t], model->n[t],
+                            model->r2[t] - MEAN_EARTH_RADIUS,
+                            model->r1[t] - MEAN_EARTH_RADIUS);
+            }
+            if(calc->vector)
+            {
+                calc->field_nodes(calc->nodes, t, point->lon, point->lat,
+                                  point->r, g[t - first]);
+            }
+            else
+            {
+                calc->field_nodes(calc->nodes, t, point->lon, point->lat,
+                                  point->r, gn);
+                for(c = 0; c < 3; c++)
+                    g[t - first][calc->far_comps[c]] = gn[c];
+            }
+        }
+        else if(calc->adaptative && !mid &&
+                (mag_point_inside(model, t, point) ||
+                 tess_adapt_split(model->w[t], model->e[t], model->s[t],
+                                  model->n[t], model->r1[t], model->r2[t],
+                                  point->lon, point->lat, point->r, sinlatp,
+                                  coslatp, calc->ratio_max)))
+        {
+            /* Divided, or warned about, leaf by leaf */
+            calc_tess_adapt_block(model->w[t], model->e[t], model->s[t],
+                model->n[t], model->r1[t], model->r2[t], t, point->lon,
+                point->lat, point->r, glq_lon, glq_lat, glq_r,
+                calc->field_block, calc->ratio_max, adapt, g[t - first]);
+        }
+        else
+        {
+            if(!calc->adaptative && !mid && mag_point_inside(model, t, point))
+            {
+                log_warning("Point (%g %g %g) is on tesseroid %d: %g %g %g %g %g %g. Can't guarantee accuracy.",
+                            point->lon, point->lat,
+                            point->r - MEAN_EARTH_RADIUS, t, model->w[t],
+                            model->e[t], model->s[t], model->n[t],
+                            model->r2[t] - MEAN_EARTH_RADIUS,
+                            model->r1[t] - MEAN_EARTH_RADIUS);
+            }
+            /* The single leaf of the division */
+            if(calc->adaptative && adapt != NULL)
+                adapt->leaves++;
+            block.w[block.size] = model->w[t];
+            block.e[block.size] = model->e[t];
+            block.s[block.size] = model->s[t];
+            block.n[block.size] = model->n[t];
+            block.r1[block.size] = model->r1[t];
+            block.r2[block.size] = model->r2[t];
+            slot[block.size] = t - first;
+            block.size++;
+            if(block.size == TESS_BLOCK_SIZE)
+            {
+                calc_mag_block(&block, slot, calc, point, glq_lon, glq_lat,
+                               glq_r, g);
+            }
+        }
+        if(stats != NULL)
+        {
+            stats->evals++;
+            if(mid)
+                stats->mid_evals++;
+        }
+    }
+    calc_mag_block(&block, slot, calc, point, glq_lon, glq_lat, glq_r, g);
+}
+
+
+/* Calculate the magnetic field of tesseroids first to last - 1 of a model,
+   without checks if mid. The tensors are calculated MAG_RANGE_CHUNK
+   tesseroids at a time and their fields added in the order of the model. */
+static void calc_mag_range(const TESS_MODEL *model, int first, int last,
+    const MAG_CALC *calc, const MAG_POINT *point, GLQ *glq_lon, GLQ *glq_lat,
+    GLQ *glq_r, int mid, MAG_STATS *stats, double *res)
+{
+    double M_vect[3], M_vect_p[3], g[MAG_RANGE_CHUNK][6], *gt;
+    const int *comps = calc->far_comps;
+    int chunk, end, t;
+
+    for(chunk = first; chunk < last; chunk += MAG_RANGE_CHUNK)
+    {
+        end = last - chunk < MAG_RANGE_CHUNK ? last : chunk + MAG_RANGE_CHUNK;
+        calc_mag_tensors(model, chunk, end, calc, point, glq_lon, glq_lat,
+                         glq_r, mid, stats, g);
+        for(t = chunk; t < end; t++)
+        {
+            M_vect[0] = model->mx[t];
+            M_vect[1] = model->my[t];
+            M_vect[2] = model->mz[t];
+            /* Rotate the magnetization into the system of the point */
+            conv_vect_fast(M_vect, model->cos_a1[t], model->sin_a1[t],
+                           model->cos_b1[t], model->sin_b1[t], point->cos_a2,
+                           point->sin_a2, point->cos_b2, point->sin_b2,
+                           M_vect_p);
+            gt = g[t - chunk];
+            if(calc->vector)
+            {
+                res[0] += gt[0]*M_vect_p[0] + gt[1]*M_vect_p[1] +
+                          gt[2]*M_vect_p[2];
+                res[1] += gt[1]*M_vect_p[0] + gt[3]*M_vect_p[1] +
+                          gt[4]*M_vect_p[2];
+                res[2] += gt[2]*M_vect_p[0] + gt[4]*M_vect_p[1] +
+                          gt[5]*M_vect_p[2];
+            }
+            else
+            {
+                res[0] += gt[comps[0]]*M_vect_p[0] +
+                          gt[comps[1]]*M_vect_p[1] +
+                          gt[comps[2]]*M_vect_p[2];
+            }
+        }
+    }
+}
+
+
+/* Calculate the magnetic field of tesseroids first to last - 1 of a model */
+void calc_mag_model(const TESS_MODEL *model, int first, int last,
+    const MAG_CALC *calc, const MAG_POINT *point, GLQ *glq_lon, GLQ *glq_lat,
+    GLQ *glq_r, MAG_STATS *stats, double *res)
+{
+    calc_mag_range(model, first, last, calc, point, glq_lon, glq_lat, glq_r,
+                   0, stats, res);
+}
+
+
+/* Calculate the magnetic field of tesseroids first to last - 1 of a model
+   that are neither divided nor hold the point */
+void calc_mag_model_mid(const TESS_MODEL *model, int first, int last,
+    const MAG_CALC *calc, const MAG_POINT *point, GLQ *glq_lon, GLQ *glq_lat,
+    GLQ *glq_r, MAG_STATS *stats, double *res)
+{
+    calc_mag_range(model, first, last, calc, point, glq_lon, glq_lat, glq_r,
+                   1, stats, res);
+}
+
+
+/* Calculate the matrices that give the magnetic field of tesseroids first to
+   last - 1 of a model from their magnetization */
+void calc_mag_kernels(const TESS_MODEL *model, int first, int last,
+    const MAG_CALC *calc, const MAG_POINT *point, GLQ *glq_lon, GLQ *glq_lat,
+    GLQ *glq_r, MAG_STATS *stats, long long ncols, double *rows)
+{
+    double unit[3], rot[9], g[MAG_RANGE_CHUNK][6], gt[6], *col;
+    int chunk, end, t, b, c;
+
+    for(chunk = first; chunk < last; chunk += MAG_RANGE_CHUNK)
+    {
+        end = last - chunk < MAG_RANGE_CHUNK ? last : chunk + MAG_RANGE_CHUNK;
+        calc_mag_tensors(model, chunk, end, calc, point, glq_lon, glq_lat,
+                         glq_r, 0, stats, g);
+        for(t = chunk; t < end; t++)
+        {
+            /* Columns of the rotation into the system of the point */
+            for(b = 0; b < 3; b++)
+            {
+                unit[0] = unit[1] = unit[2] = 0;
+                unit[b] = 1;
+                conv_vect_fast(unit, model->cos_a1[t], model->sin_a1[t],
+                               model->cos_b1[t], model->sin_b1[t],
+                               point->cos_a2, point->sin_a2, point->cos_b2,
+                               point->sin_b2, &rot[3*b]);
+            }
+            if(calc->vector)
+            {
+                for(c = 0; c < 6; c++)
+                    gt[c] = g[t - chunk][c];
+            }
+            else
+            {
+                for(c = 0; c < 3; c++)
+                    gt[c] = g[t - chunk][calc->far_comps[c]];
+            }
+            col = rows + 3*(long long)(t - first);
+            for(b = 0; b < 3; b++)
+            {
+                if(calc->vector)
+                {
+                    col[b] = gt[0]*rot[3*b] + gt[1]*rot[3*b + 1] +
+                             gt[2]*rot[3*b + 2];
+                    col[ncols + b] = gt[1]*rot[3*b] + gt[3]*rot[3*b + 1] +
+                                     gt[4]*rot[3*b + 2];
+                    col[2*ncols + b] = gt[2]*rot[3*b] + gt[4]*rot[3*b + 1] +
+                                       gt[5]*rot[3*b + 2];
+                }
+                else
+                {
+                    col[b] = gt[0]*rot[3*b] + gt[1]*rot[3*b + 1] +
+                             gt[2]*rot[3*b + 2];
+                }
+            }
+        }
+    }
+}
+
+
+/* Calculate the matrix that gives the magnetic field of tesseroid t of a
+   model from its magnetization */
+void calc_mag_kernel(const TESS_MODEL *model, int t, const MAG_CALC *calc,
+    const MAG_POINT *point, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r,
+    MAG_STATS *stats, double *kernel)
+{
+    calc_mag_kernels(model, t, t + 1, calc, point, glq_lon, glq_lat, glq_r,
+                     stats, 3, kernel);
+}
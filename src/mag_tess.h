@@ -0,0 +1,194 @@
+/*
+Functions that calculate the magnetic field of a tesseroid model stored as a
+structure of arrays (TESS_MODEL).
+
+The magnetic field of a uniformly magnetized tesseroid is obtained from its
+gravity gradient tensor (Poisson's relation). The gradients are calculated
+with the kernels of grav_tess.h for a tesseroid of unit density, and
+multiplied by the magnetization rotated into the local system of the
+computation point. Tesseroids are read from the columns of the model and
+calculated TESS_BLOCK_SIZE at a time with a block kernel.
+
+Example
+-------
+
+    TESS_MODEL *model = tess_model_from_array(tessarray, size);
+    MAG_CALC calc = {0};
+    MAG_POINT point;
+    double res[3] = {0, 0, 0};
+
+    calc.field_block = &tess_ggt_block;
+    calc.far_comps[0] = 2;
+    calc.far_comps[1] = 4;
+    calc.far_comps[2] = 5;
+    mag_point_init(&point);
+    mag_point_set(&point, 10, 45, 250000);
+    calc_mag_model(model, 0, model->size, &calc, &point, glq_lon, glq_lat,
+                   glq_r, NULL, res);
+*/
+
+#ifndef _TESSEROIDS_MAG_TESS_H_
+#define _TESSEROIDS_MAG_TESS_H_
+
+
+/* Needed for definition of TESSEROID and TESS_MODEL */
+#include "geometry.h"
+/* Needed for definition of GLQ */
+#include "glq.h"
+/* Needed for definition of TESS_NODES and TESS_BLOCK_KERNEL */
+#include "grav_tess.h"
+
+
+/** Settings of a magnetic field calculation */
+typedef struct mag_calc_struct
+{
+    int adaptative; /* flag to divide tesseroids that are too close */
+    int vector; /* flag to calculate Bx, By and Bz together */
+    double ratio_max; /* distance-size ratio of the division, the largest
+                         of the ratios of the components */
+    TESS_BLOCK_KERNEL field_block; /* tess_ggt_block or a SIMD version */
+    const TESS_NODES *nodes; /* precomputed nodes of the first tesseroids,
+                                used if not adaptative. Can be NULL. */
+    TESS_NODES_KERNEL field_nodes; /* version of the kernel of the 3
+                                      components of far_comps, or of
+                                      tess_ggt in vector mode, that uses
+                                      the node table */
+    double far_ratio; /* distance-size ratio beyond which a tesseroid is
+                         taken as a point mass, 0 to never do it */
+    int far_comps[3]; /* components of the tensor, in the order of tess_ggt,
+                         that give the field if not in vector mode */
+    int component; /* component of the field if not in vector mode: 0, 1
+                      or 2 for Bx, By or Bz */
+} MAG_CALC;
+
+
+/** Relative error of the point mass approximation of a tesseroid at a
+distance of ratio times its size is below MAG_FAR_ERROR/ratio^2. The error
+is relative to the largest component of the gravity gradient tensor of the
+tesseroid. */
+#define MAG_FAR_ERROR 1.0
+
+
+/** Statistics of a calculation. Each thread needs its own. */
+typedef struct mag_stats_struct
+{
+    TESS_ADAPT adapt; /* limit and statistics of the adaptative division */
+    long evals; /* number of tesseroid-point pairs calculated */
+    long far_evals; /* of which calculated as a point mass */
+    long tree_nodes; /* nodes of a tree calculated from their moments */
+    long fft_points; /* points calculated by convolution in longitude */
+    long fft_kernels; /* kernels calculated for these convolutions */
+    long truncated; /* tesseroid-point pairs skipped by an index beyond its
+                       truncation radius */
+    long mid_evals; /* evaluations an index let go without division and
+                       checks */
+} MAG_STATS;
+
+
+/** A computation point and the trigonometric functions of its position */
+typedef struct mag_point_struct
+{
+    double lon; /* longitude in degrees */
+    double lat; /* latitude in degrees */
+    double r; /* radius in SI units */
+    double cos_a2, sin_a2; /* of the colatitude */
+    double cos_b2, sin_b2; /* of the longitude */
+} MAG_POINT;
+
+
+/** Set a point to lon = lat = 0 on the mean Earth radius */
+void mag_point_init(MAG_POINT *point);
+
+
+/** Move a point to a new position.
+
+The trigonometric functions are only recalculated for the coordinates that
+changed, so it pays to reuse a point along the lines of a regular grid.
+
+@param point the point to move
+@param lon longitude in degrees
+@param lat latitude in degrees
+@param height height above the mean Earth radius in SI units
+*/
+void mag_point_set(MAG_POINT *point, double lon, double lat, double height);
+
+
+/** Move a point to a new position whose trigonometric functions are known,
+as on the rows and columns of a regular grid.
+
+@param trig_lon cosine and sine of the longitude
+@param trig_lat cosine and sine of the colatitude
+Other parameters are as for mag_point_set.
+*/
+void mag_point_set_trig(MAG_POINT *point, double lon, double lat,
+    double height, const double *trig_lon, const double *trig_lat);
+
+
+/** Add the magnetic field of tesseroids first to last - 1 of a model to res.
+
+Calculating a model in ranges of tesseroids gives the same result as all at
+once, as long as the ranges are done in order.
+
+@param model the tesseroid model
+@param first index of the first tesseroid
+@param last one past the index of the last tesseroid
+@param calc settings of the calculation. Uses field_block.
+            If not adaptative, the tesseroids in the node table nodes use
+            tess_ggt_nodes instead. Tesseroids farther than far_ratio times
+            their size are taken as point masses.
+@param point the computation point
+@param glq_lon pointer to GLQ structure used for the longitudinal integration
+@param glq_lat pointer to GLQ structure used for the latitudinal integration
+@param glq_r pointer to GLQ structure used for the radial integration
+@param stats limit of the adaptative division and counters that are
+             increased by the calculation. Can be NULL.
+@param res the field in nT is added to it. Only res[0] is used unless in
+           vector mode, where res[0], res[1] and res[2] are Bx, By and Bz.
+*/
+void calc_mag_model(const TESS_MODEL *model, int first, int last,
+    const MAG_CALC *calc, const MAG_POINT *point, GLQ *glq_lon, GLQ *glq_lat,
+    GLQ *glq_r, MAG_STATS *stats, double *res);
+
+
+/** Add the magnetic field of tesseroids first to last - 1 of a model to res,
+knowing that the point is outside all of them and, if calc is adaptative,
+far enough from them that none would be divided.
+
+Gives the same result as calc_mag_model without dividing the tesseroids or
+checking if the point is inside one. Parameters are as for calc_mag_model.
+*/
+void calc_mag_model_mid(const TESS_MODEL *model, int first, int last,
+    const MAG_CALC *calc, const MAG_POINT *point, GLQ *glq_lon, GLQ *glq_lat,
+    GLQ *glq_r, MAG_STATS *stats, double *res);
+
+
+/** Calculate the matrix that gives the magnetic field of tesseroid t of a
+model from its magnetization (mx, my, mz).
+
+The field is the kernel times the magnetization, whatever the magnetization
+of tesseroid t in the model. Used to calculate the field of tesseroids that
+only differ by their magnetization at once.
+
+@param kernel in vector mode, the 3x3 matrix row by row (Bx, By, Bz);
+              otherwise the row of the component
+Other parameters are as for calc_mag_model.
+*/
+void calc_mag_kernel(const TESS_MODEL *model, int t, const MAG_CALC *calc,
+    const MAG_POINT *point, GLQ *glq_lon, GLQ *glq_lat, GLQ *glq_r,
+    MAG_STATS *stats, double *kernel);
+
+
+/** Calculate the matrices of calc_mag_kernel for tesseroids first to
+last - 1 of a model at once, as the columns of 3 rows (Bx, By and Bz) in
+vector mode, or of the row of the component otherwise.
+
+@param ncols distance between the rows in rows
+@param rows the columns of tesseroid t are 3*(t - first) to
+            3*(t - first) + 2 of each row
+Other parameters are as for calc_mag_model.
+*/
+void calc_mag_kernels(const TESS_MODEL *model, int first, int last,
+    const MAG_CALC *calc, const MAG_POINT *point, GLQ *glq_lon, GLQ *glq_lat,
+    GLQ *glq_r, MAG_STATS *stats, long long ncols, double *rows);
+
+#endif
@@ -0,0 +1,432 @@
+/*
+Hierarchical evaluation of the magnetic field of large tesseroid models.
+*/
+
+
+#include <stdlib.h>
+#include <math.h>
+#include "logger.h"
+#include "constants.h"
+#include "geometry.h"
+#include "glq.h"
+#include "mag_tess.h"
+#include "mag_tree.h"
+
+
+/* Temporary arrays used while building a tree */
+typedef struct mag_tree_build_struct
+{
+    MAG_TREE *tree;
+    int capacity; /* number of nodes allocated */
+    int *perm; /* old index of each tesseroid in the tree order */
+    int *tmp; /* buffer for sorting the tesseroids of a node */
+    double *x, *y, *z; /* centers of mass, in the old order */
+} MAG_TREE_BUILD;
+
+
+/* Add count nodes to the tree. Returns the index of the first one or -1 if
+   there was an error with allocation. */
+static int mag_tree_add_nodes(MAG_TREE_BUILD *build, int count)
+{
+    MAG_TREE *tree = build->tree;
+    MAG_TREE_NODE *nodes;
+    int first, capacity;
+
+    if(tree->nnodes + count > build->capacity)
+    {
+        capacity = 2*build->capacity + count;
+        nodes = (MAG_TREE_NODE *)realloc(tree->nodes,
+                                         capacity*sizeof(MAG_TREE_NODE));
+        if(nodes == NULL)
+        {
+            return -1;
+        }
+        tree->nodes = nodes;
+        build->capacity = capacity;
+    }
+    first = tree->nnodes;
+    tree->nnodes += count;
+    return first;
+}
+
+
+/* Octant of tesseroid t around the point mid */
+#define MAG_TREE_OCTANT(build, t, mid) \
+    (((build)->x[t] > (mid)[0]) | ((build)->y[t] > (mid)[1]) << 1 | \
+     ((build)->z[t] > (mid)[2]) << 2)
+
+
+/* Divide node into octants around the middle of the box of the centers of
+   mass of its tesseroids, and so on for its children. Returns 1 if there was
+   an error with allocation. */
+static int mag_tree_split(MAG_TREE_BUILD *build, int node, int depth)
+{
+    MAG_TREE_NODE *nd = &(build->tree->nodes[node]);
+    double min[3], max[3], mid[3], pos[3];
+    int first = nd->first, last = nd->last, count[8], start[8], i, t, o,
+        child, nchild;
+
+    min[0] = max[0] = build->x[build->perm[first]];
+    min[1] = max[1] = build->y[build->perm[first]];
+    min[2] = max[2] = build->z[build->perm[first]];
+    for(i = first + 1; i < last; i++)
+    {
+        t = build->perm[i];
+        pos[0] = build->x[t];
+        pos[1] = build->y[t];
+        pos[2] = build->z[t];
+        for(o = 0; o < 3; o++)
+        {
+            if(pos[o] < min[o])
+                min[o] = pos[o];
+            if(pos[o] > max[o])
+                max[o] = pos[o];
+        }
+    }
+    for(o = 0; o < 3; o++)
+    {
+        mid[o] = 0.5*(min[o] + max[o]);
+        nd->c[o] = mid[o];
+    }
+    nd->child = -1;
+    nd->nchild = 0;
+    if(last - first <= MAG_TREE_LEAF_SIZE || depth >= MAG_TREE_MAX_DEPTH ||
+       (min[0] == max[0] && min[1] == max[1] && min[2] == max[2]))
+    {
+        if(depth > build->tree->depth)
+            build->tree->depth = depth;
+        return 0;
+    }
+
+    /* Sort the tesseroids of the node by octant (counting sort) */
+    for(o = 0; o < 8; o++)
+    {
+        count[o] = 0;
+    }
+    for(i = first; i < last; i++)
+    {
+        t = build->perm[i];
+        build->tmp[i] = t;
+        count[MAG_TREE_OCTANT(build, t, mid)]++;
+    }
+    nchild = 0;
+    for(o = 0; o < 8; o++)
+    {
+        start[o] = o == 0 ? first : start[o - 1] + count[o - 1];
+        if(count[o] > 0)
+            nchild++;
+    }
+    for(o = 0; o < 8; o++)
+    {
+        count[o] = start[o];
+    }
+    for(i = first; i < last; i++)
+    {
+        t = build->tmp[i];
+        build->perm[count[MAG_TREE_OCTANT(build, t, mid)]++] = t;
+    }
+
+    child = mag_tree_add_nodes(build, nchild);
+    if(child < 0)
+    {
+        return 1;
+    }
+    nd = &(build->tree->nodes[node]);
+    nd->child = child;
+    nd->nchild = nchild;
+    for(o = 0; o < 8; o++)
+    {
+        if(count[o] - start[o] > 0)
+        {
+            build->tree->nodes[child].first = start[o];
+            build->tree->nodes[child].last = count[o];
+            if(mag_tree_split(build, child, depth + 1) != 0)
+            {
+                return 1;
+            }
+            child++;
+        }
+    }
+    return 0;
+}
+
+
+/* Calculate the dipole moments and the radius of every node from the
+   tesseroids of the reordered model */
+static void mag_tree_moments(MAG_TREE *tree, const TESS_MODEL *model)
+{
+    MAG_TREE_NODE *nd;
+    double pos[3], en[3], ee[3], eu[3], dip[3], s[3], j[9], lsqr[3], scale,
+           dist, radius;
+    int n, t, a, b, d;
+
+    for(n = 0; n < tree->nnodes; n++)
+    {
+        nd = &(tree->nodes[n]);
+        radius = 0;
+        for(a = 0; a < 3; a++)
+        {
+            nd->m[a] = 0;
+        }
+        for(a = 0; a < 9; a++)
+        {
+            nd->q[a] = 0;
+        }
+        for(a = 0; a < 27; a++)
+        {
+            nd->o[a] = 0;
+        }
+        for(t = nd->first; t < nd->last; t++)
+        {
+            pos[0] = model->rc[t]*model->cos_latc[t]*model->cos_lonc[t];
+            pos[1] = model->rc[t]*model->cos_latc[t]*model->sin_lonc[t];
+            pos[2] = model->rc[t]*model->sin_latc[t];
+            /* North, east and up at the center of the tesseroid, where the
+               magnetization is given. a1 is the colatitude. */
+            en[0] = -model->cos_a1[t]*model->cos_b1[t];
+            en[1] = -model->cos_a1[t]*model->sin_b1[t];
+            en[2] = model->sin_a1[t];
+            ee[0] = -model->sin_b1[t];
+            ee[1] = model->cos_b1[t];
+            ee[2] = 0;
+            eu[0] = model->sin_a1[t]*model->cos_b1[t];
+            eu[1] = model->sin_a1[t]*model->sin_b1[t];
+            eu[2] = model->cos_a1[t];
+            /* Same factors as tess_model_ggt_far times the magnetization */
+            scale = SI2EOTVOS*G*model->mass[t];
+            dist = 0;
+            for(a = 0; a < 3; a++)
+            {
+                dip[a] = scale*(model->mx[t]*en[a] + model->my[t]*ee[a] +
+                                model->mz[t]*eu[a]);
+                s[a] = pos[a] - nd->c[a];
+                dist += s[a]*s[a];
+            }
+            /* Half the diagonal of a box of the size of the tesseroid */
+            dist = sqrt(dist) + 0.5*sqrt(3.)*model->dim[t];
+            if(dist > radius)
+                radius = dist;
+            /* Second moments of the tesseroid taken as a box with sides
+               along north, east and up: L^2/12 along each side */
+            lsqr[0] = model->rc[t]*DEG2RAD*(model->n[t] - model->s[t]);
+            lsqr[1] = model->rc[t]*model->cos_latc[t]*DEG2RAD*
+                      (model->e[t] - model->w[t]);
+            lsqr[2] = model->r2[t] - model->r1[t];
+            for(a = 0; a < 3; a++)
+            {
+                lsqr[a] = lsqr[a]*lsqr[a]/12.;
+            }
+            for(a = 0; a < 3; a++)
+            {
+                for(d = 0; d < 3; d++)
+                {
+                    j[3*a + d] = lsqr[0]*en[a]*en[d] + lsqr[1]*ee[a]*ee[d] +
+                                 lsqr[2]*eu[a]*eu[d];
+                }
+            }
+            for(b = 0; b < 3; b++)
+            {
+                nd->m[b] += dip[b];
+                for(a = 0; a < 3; a++)
+                {
+                    nd->q[3*b + a] += dip[b]*s[a];
+                    for(d = 0; d < 3; d++)
+                    {
+                        nd->o[9*b + 3*a + d] += dip[b]*(s[a]*s[d] +
+                                                        j[3*a + d]);
+                    }
+                }
+            }
+        }
+        nd->radius = radius;
+    }
+}
+
+
+/* Build the tree of a model and reorder the model */
+MAG_TREE * mag_tree_new(TESS_MODEL *model, double theta)
+{
+    MAG_TREE_BUILD build;
+    MAG_TREE *tree;
+    int i, error = 0;
+
+    tree = (MAG_TREE *)malloc(sizeof(MAG_TREE));
+    if(tree == NULL)
+    {
+        return NULL;
+    }
+    tree->theta = theta;
+    tree->nnodes = 0;
+    tree->depth = 0;
+    tree->nodes = NULL;
+    build.tree = tree;
+    build.capacity = 0;
+    build.perm = (int *)malloc(model->size*sizeof(int));
+    build.tmp = (int *)malloc(model->size*sizeof(int));
+    build.x = (double *)malloc(model->size*sizeof(double));
+    build.y = (double *)malloc(model->size*sizeof(double));
+    build.z = (double *)malloc(model->size*sizeof(double));
+    if(build.perm == NULL || build.tmp == NULL || build.x == NULL ||
+       build.y == NULL || build.z == NULL || model->size < 1 ||
+       mag_tree_add_nodes(&build, 1) < 0)
+    {
+        error = 1;
+    }
+    else
+    {
+        for(i = 0; i < model->size; i++)
+        {
+            build.perm[i] = i;
+            build.x[i] = model->rc[i]*model->cos_latc[i]*model->cos_lonc[i];
+            build.y[i] = model->rc[i]*model->cos_latc[i]*model->sin_lonc[i];
+            build.z[i] = model->rc[i]*model->sin_latc[i];
+        }
+        tree->nodes[0].first = 0;
+        tree->nodes[0].last = model->size;
+        error = mag_tree_split(&build, 0, 0) != 0 ||
+                tess_model_permute(model, build.perm) != 0;
+    }
+    free(build.perm);
+    free(build.tmp);
+    free(build.x);
+    free(build.y);
+    free(build.z);
+    if(error)
+    {
+        free(tree->nodes);
+        free(tree);
+        return NULL;
+    }
+    mag_tree_moments(tree, model);
+    return tree;
+}
+
+
+/* Free the memory of a tree */
+void mag_tree_free(MAG_TREE *tree)
+{
+    free(tree->nodes);
+    free(tree);
+}
+
+
+/* Add the magnetic field of a whole model to res, using a tree */
+void calc_mag_tree(const MAG_TREE *tree, const TESS_MODEL *model,
+    const MAG_CALC *calc, const MAG_POINT *point, GLQ *glq_lon, GLQ *glq_lat,
+    GLQ *glq_r, MAG_STATS *stats, double *res)
+{
+    const MAG_TREE_NODE *nd;
+    double pos[3], D[3], B[3] = {0, 0, 0}, Bp[3], r_sqr, inv_r5, inv_r7,
+           inv_r9, dm, dqd, trq, qd, ot[3], ow[3], ov[3], oy[3], dddo, dot,
+           dow, theta_sqr = tree->theta*tree->theta;
+    int stack[7*MAG_TREE_MAX_DEPTH + 8], top, n, a, b, d;
+
+    /* a2 is the colatitude of the point */
+    pos[0] = point->r*point->sin_a2*point->cos_b2;
+    pos[1] = point->r*point->sin_a2*point->sin_b2;
+    pos[2] = point->r*point->cos_a2;
+    stack[0] = 0;
+    top = 1;
+    while(top > 0)
+    {
+        nd = &(tree->nodes[stack[--top]]);
+        for(a = 0; a < 3; a++)
+        {
+            D[a] = nd->c[a] - pos[a];
+        }
+        r_sqr = D[0]*D[0] + D[1]*D[1] + D[2]*D[2];
+        if(nd->radius*nd->radius < theta_sqr*r_sqr)
+        {
+            /* Taylor series of the field of the dipoles about the center
+               of the node, up to the second moments. The derivatives of
+               1/R are written out for the contractions with the moments. */
+            inv_r5 = 1./(r_sqr*r_sqr*sqrt(r_sqr));
+            inv_r7 = inv_r5/r_sqr;
+            inv_r9 = inv_r7/r_sqr;
+            dm = D[0]*nd->m[0] + D[1]*nd->m[1] + D[2]*nd->m[2];
+            dqd = 0;
+            for(b = 0; b < 3; b++)
+            {
+                for(a = 0; a < 3; a++)
+                {
+                    dqd += D[b]*nd->q[3*b + a]*D[a];
+                }
+            }
+            trq = nd->q[0] + nd->q[4] + nd->q[8];
+            /* ot[b] = o[b][a][a], ow[d] = o[b][b][d], ov[d] = sum of
+               D[b]*D[a]*o[b][a][d], oy[b] = sum of D[a]*D[d]*o[b][a][d] */
+            dddo = 0;
+            for(b = 0; b < 3; b++)
+            {
+                ot[b] = nd->o[9*b] + nd->o[9*b + 4] + nd->o[9*b + 8];
+                ow[b] = nd->o[b] + nd->o[12 + b] + nd->o[24 + b];
+                ov[b] = 0;
+                oy[b] = 0;
+            }
+            for(b = 0; b < 3; b++)
+            {
+                for(a = 0; a < 3; a++)
+                {
+                    for(d = 0; d < 3; d++)
+                    {
+                        ov[d] += D[b]*D[a]*nd->o[9*b + 3*a + d];
+                        oy[b] += D[a]*D[d]*nd->o[9*b + 3*a + d];
+                    }
+                }
+            }
+            dot = 0;
+            dow = 0;
+            for(b = 0; b < 3; b++)
+            {
+                dddo += D[b]*oy[b];
+                dot += D[b]*ot[b];
+                dow += D[b]*ow[b];
+            }
+            for(a = 0; a < 3; a++)
+            {
+                qd = 0;
+                for(b = 0; b < 3; b++)
+                {
+                    qd += D[b]*nd->q[3*b + a] + nd->q[3*a + b]*D[b];
+                }
+                B[a] += (3*D[a]*dm - r_sqr*nd->m[a])*inv_r5 -
+                        15*D[a]*dqd*inv_r7 + 3*(D[a]*trq + qd)*inv_r5 +
+                        0.5*(105*D[a]*dddo*inv_r9 -
+                             15*(D[a]*(dot + 2*dow) + 2*ov[a] + oy[a])*inv_r7 +
+                             3*(ot[a] + 2*ow[a])*inv_r5);
+            }
+            if(stats != NULL)
+                stats->tree_nodes++;
+        }
+        else if(nd->child < 0)
+        {
+            calc_mag_model(model, nd->first, nd->last, calc, point, glq_lon,
+                           glq_lat, glq_r, stats, res);
+        }
+        else
+        {
+            /* Push the children last to first so they are done in order */
+            for(n = nd->child + nd->nchild - 1; n >= nd->child; n--)
+            {
+                stack[top++] = n;
+            }
+        }
+    }
+
+    /* Project the field on north, east and up at the point */
+    Bp[0] = -point->cos_a2*point->cos_b2*B[0] -
+            point->cos_a2*point->sin_b2*B[1] + point->sin_a2*B[2];
+    Bp[1] = -point->sin_b2*B[0] + point->cos_b2*B[1];
+    Bp[2] = point->sin_a2*point->cos_b2*B[0] +
+            point->sin_a2*point->sin_b2*B[1] + point->cos_a2*B[2];
+    if(calc->vector)
+    {
+        res[0] += Bp[0];
+        res[1] += Bp[1];
+        res[2] += Bp[2];
+    }
+    else
+    {
+        res[0] += Bp[calc->component];
+    }
+}
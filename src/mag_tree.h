@@ -0,0 +1,109 @@
+/*
+Hierarchical evaluation of the magnetic field of large tesseroid models.
+
+An octree is built over the centers of mass of the tesseroids, in Cartesian
+coordinates. Every node keeps the sum of the dipole moments of its tesseroids
+and the first and second moments of these dipoles about the center of the
+node, the second ones including the extent of each tesseroid. A node
+that is seen from the computation point under an angle smaller than the
+opening angle is calculated from its moments. The tesseroids of the leaves
+that are too close are calculated with calc_mag_model, so the near field uses
+the same kernels, adaptative division and node table as without the tree.
+
+Building the tree reorders the tesseroids of the model, so that every node
+holds a range of consecutive tesseroids. The reordered model gives the same
+results without the tree, up to rounding.
+
+Example
+-------
+
+    MAG_TREE *tree = mag_tree_new(model, 0.3);
+    double res[3] = {0, 0, 0};
+
+    calc_mag_tree(tree, model, &calc, &point, glq_lon, glq_lat, glq_r, NULL,
+                  res);
+    mag_tree_free(tree);
+*/
+
+#ifndef _TESSEROIDS_MAG_TREE_H_
+#define _TESSEROIDS_MAG_TREE_H_
+
+
+/* Needed for definition of TESS_MODEL */
+#include "geometry.h"
+/* Needed for definition of GLQ */
+#include "glq.h"
+/* Needed for definition of MAG_CALC, MAG_POINT and MAG_STATS */
+#include "mag_tess.h"
+
+
+/* Largest number of tesseroids in a leaf, unless the depth limit is hit */
+#define MAG_TREE_LEAF_SIZE 16
+/* Largest number of levels below the root */
+#define MAG_TREE_MAX_DEPTH 32
+
+
+/** A node of the tree */
+typedef struct mag_tree_node_struct
+{
+    double c[3]; /* center of the node in Cartesian coordinates, SI units */
+    double radius; /* distance from c to the farthest corner of a tesseroid */
+    double m[3]; /* sum of the dipole moments of the tesseroids */
+    double q[9]; /* q[3*b + a] = sum of m[b]*(x[a] - c[a]) over the
+                    tesseroids, x being their centers of mass */
+    double o[27]; /* o[9*b + 3*a + d] = sum of m[b]*((x[a] - c[a])*(x[d] -
+                     c[d]) + j[a][d]) over the tesseroids, j being the
+                     second moments of the volume of a tesseroid about its
+                     center of mass divided by its volume */
+    int first; /* first tesseroid of the node in the reordered model */
+    int last; /* one past the last tesseroid */
+    int child; /* index of the first child, -1 if the node is a leaf */
+    int nchild; /* number of children, stored one after the other */
+} MAG_TREE_NODE;
+
+
+/** Octree over the tesseroids of a model */
+typedef struct mag_tree_struct
+{
+    double theta; /* opening angle, as the ratio radius/distance */
+    int nnodes; /* number of nodes */
+    int depth; /* number of levels below the root */
+    MAG_TREE_NODE *nodes; /* the root is nodes[0] */
+} MAG_TREE;
+
+
+/** Build the tree of a model and reorder the tesseroids of the model.
+
+@param model the tesseroid model. Reordered to the order of the leaves.
+@param theta opening angle: a node is calculated from its moments if its
+             radius is smaller than theta times its distance to the point
+
+@return the tree or NULL if there was an error with allocation. The model is
+        not changed in that case.
+*/
+MAG_TREE * mag_tree_new(TESS_MODEL *model, double theta);
+
+
+/** Free the memory of a tree */
+void mag_tree_free(MAG_TREE *tree);
+
+
+/** Add the magnetic field of a whole model to res, using a tree.
+
+@param tree the tree made by mag_tree_new for model
+@param model the tesseroid model, in the order of the tree
+@param calc settings of the calculation, as for calc_mag_model.
+            Uses component to pick the field of the single component
+            programs.
+@param point the computation point
+@param glq_lon pointer to GLQ structure used for the longitudinal integration
+@param glq_lat pointer to GLQ structure used for the latitudinal integration
+@param glq_r pointer to GLQ structure used for the radial integration
+@param stats counters increased by the calculation. Can be NULL.
+@param res the field in nT is added to it, as for calc_mag_model
+*/
+void calc_mag_tree(const MAG_TREE *tree, const TESS_MODEL *model,
+    const MAG_CALC *calc, const MAG_POINT *point, GLQ *glq_lon, GLQ *glq_lat,
+    GLQ *glq_r, MAG_STATS *stats, double *res);
+
+#endif
@@ -0,0 +1,241 @@
+/*
+Choice of the GLQ orders and distance-size ratio of a calculation for a
+target accuracy.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "geometry.h"
+#include "glq.h"
+#include "mag_tess.h"
+#include "mag_tune.h"
+
+
+/* Distance-size ratios tried in the adaptative division */
+static const double mag_tune_ratios[] = {1, 1.5, 2, 3, 4, 6};
+#define MAG_TUNE_NRATIOS (int)(sizeof(mag_tune_ratios)/sizeof(double))
+
+/* Largest number of tesseroids in the sample of a point */
+#define MAG_TUNE_SAMPLE (MAG_TUNE_NEAR + MAG_TUNE_SPREAD)
+
+
+/* Pick the tesseroids of the sample of a point: the MAG_TUNE_NEAR ones with
+   the smallest ratio of distance to size, then up to MAG_TUNE_SPREAD others
+   evenly spaced in the model. Each of the others stands for weight
+   tesseroids of the rest of the model. Returns the size of the sample. */
+static int mag_tune_sample(const TESS_MODEL *model, const MAG_POINT *point,
+    int *sample, double *weight)
+{
+    double near[MAG_TUNE_NEAR], x, y, z, dx, dy, dz, ratio;
+    int nnear = 0, n, t, k, step;
+
+    x = point->r*point->sin_a2*point->cos_b2;
+    y = point->r*point->sin_a2*point->sin_b2;
+    z = point->r*point->cos_a2;
+    for(t = 0; t < model->size; t++)
+    {
+        dx = model->rc[t]*model->cos_latc[t]*model->cos_lonc[t] - x;
+        dy = model->rc[t]*model->cos_latc[t]*model->sin_lonc[t] - y;
+        dz = model->rc[t]*model->sin_latc[t] - z;
+        ratio = sqrt(dx*dx + dy*dy + dz*dz)/model->dim[t];
+        if(nnear < MAG_TUNE_NEAR || ratio < near[nnear - 1])
+        {
+            /* Insert it in order, dropping the farthest if full */
+            k = nnear < MAG_TUNE_NEAR ? nnear++ : nnear - 1;
+            for(; k > 0 && near[k - 1] > ratio; k--)
+            {
+                near[k] = near[k - 1];
+                sample[k] = sample[k - 1];
+            }
+            near[k] = ratio;
+            sample[k] = t;
+        }
+    }
+    n = nnear;
+    step = model->size/MAG_TUNE_SPREAD;
+    if(step < 1)
+        step = 1;
+    for(t = step/2; t < model->size && n < MAG_TUNE_SAMPLE; t += step)
+    {
+        for(k = 0; k < nnear && sample[k] != t; k++);
+        if(k == nnear)
+            sample[n++] = t;
+    }
+    *weight = n > nnear ? (double)(model->size - nnear)/(n - nnear) : 0;
+    return n;
+}
+
+
+/* Estimate the field of the whole model on each point from its sample,
+   with the given GLQ orders. res gets 3 values per point. Returns the number
+   of GLQ nodes evaluated or -1 if there was an error with allocation. */
+static double mag_tune_field(const TESS_MODEL *model, const MAG_CALC *calc,
+    const MAG_POINT *points, int npoints, const int *sample,
+    const int *nsample, const double *weight, int lon_order, int lat_order,
+    int r_order, int max_depth, double *res)
+{
+    GLQ *glq_lon, *glq_lat, *glq_r;
+    MAG_STATS stats;
+    double nodes = -1, rest[3];
+    int p, k, t;
+
+    glq_lon = glq_new(lon_order, -1, 1);
+    glq_lat = glq_new(lat_order, -1, 1);
+    glq_r = glq_new(r_order, -1, 1);
+    memset(&stats, 0, sizeof(MAG_STATS));
+    stats.adapt.max_depth = max_depth;
+    if(glq_lon != NULL && glq_lat != NULL && glq_r != NULL)
+    {
+        for(p = 0; p < npoints; p++)
+        {
+            res[3*p] = res[3*p + 1] = res[3*p + 2] = 0;
+            rest[0] = rest[1] = rest[2] = 0;
+            for(k = 0; k < nsample[p]; k++)
+            {
+                t = sample[p*MAG_TUNE_SAMPLE + k];
+                calc_mag_model(model, t, t + 1, calc, &points[p], glq_lon,
+                               glq_lat, glq_r, &stats,
+                               k < MAG_TUNE_NEAR ? &res[3*p] : rest);
+            }
+            for(k = 0; k < 3; k++)
+            {
+                res[3*p + k] += weight[p]*rest[k];
+            }
+        }
+        /* Without division every tesseroid that is not a point mass is a
+           single piece */
+        nodes = (double)(calc->adaptative ? stats.adapt.leaves :
+                         stats.evals - stats.far_evals)*
+                lon_order*lat_order*r_order;
+    }
+    if(glq_lon != NULL)
+        glq_free(glq_lon);
+    if(glq_lat != NULL)
+        glq_free(glq_lat);
+    if(glq_r != NULL)
+        glq_free(glq_r);
+    return nodes;
+}
+
+
+/* Largest difference between res and ref relative to the largest value of
+   ref */
+static double mag_tune_error(const double *res, const double *ref, int n)
+{
+    double diff = 0, scale = 0;
+    int i;
+
+    for(i = 0; i < n; i++)
+    {
+        if(fabs(res[i] - ref[i]) > diff)
+            diff = fabs(res[i] - ref[i]);
+        if(fabs(ref[i]) > scale)
+            scale = fabs(ref[i]);
+    }
+    return scale > 0 ? diff/scale : diff;
+}
+
+
+/* Find the cheapest GLQ orders and distance-size ratio within a relative
+   error */
+int mag_tune(const TESS_MODEL *model, const MAG_CALC *calc,
+    const double *points, int npoints, double target, int max_depth,
+    MAG_TUNE *tune)
+{
+    MAG_POINT pts[MAG_TUNE_POINTS];
+    MAG_CALC cand;
+    int sample[MAG_TUNE_POINTS*MAG_TUNE_SAMPLE], nsample[MAG_TUNE_POINTS];
+    double ref[3*MAG_TUNE_POINTS], res[3*MAG_TUNE_POINTS],
+           weight[MAG_TUNE_POINTS], nodes, error;
+    int p, pairs = 0, o, o_r, r, nratios, found = 0;
+
+    if(npoints > MAG_TUNE_POINTS)
+        npoints = MAG_TUNE_POINTS;
+    for(p = 0; p < npoints; p++)
+    {
+        mag_point_init(&pts[p]);
+        mag_point_set(&pts[p], points[3*p], points[3*p + 1],
+                      points[3*p + 2]);
+        nsample[p] = mag_tune_sample(model, &pts[p],
+                                     &sample[p*MAG_TUNE_SAMPLE], &weight[p]);
+        pairs += nsample[p];
+    }
+    if(pairs == 0)
+    {
+        return 1;
+    }
+
+    /* The reference divides finely and takes no point masses */
+    cand = *calc;
+    cand.nodes = NULL;
+    cand.adaptative = 1;
+    cand.ratio_max = MAG_TUNE_REF_RATIO;
+    cand.far_ratio = 0;
+    nodes = mag_tune_field(model, &cand, pts, npoints, sample, nsample,
+                           weight, MAG_TUNE_REF_ORDER, MAG_TUNE_REF_ORDER,
+                           MAG_TUNE_REF_ORDER, max_depth, ref);
+    if(nodes < 0)
+    {
+        return -1;
+    }
+    tune->ref_nodes = nodes/pairs;
+
+    /* The cost grows with the orders and the ratio, so the candidates are
+       tried from the cheapest and dropped once they cost more than the best
+       one within the target */
+    cand = *calc;
+    cand.nodes = NULL;
+    nratios = calc->adaptative ? MAG_TUNE_NRATIOS : 1;
+    tune->nodes = -1;
+    for(o = MAG_TUNE_MIN_ORDER; o <= MAG_TUNE_MAX_ORDER; o++)
+    {
+        for(o_r = MAG_TUNE_MIN_ORDER; o_r <= MAG_TUNE_MAX_ORDER; o_r++)
+        {
+            for(r = 0; r < nratios; r++)
+            {
+                cand.ratio_max = calc->adaptative ? mag_tune_ratios[r] :
+                                 calc->ratio_max;
+                nodes = mag_tune_field(model, &cand, pts, npoints, sample,
+                                       nsample, weight, o, o, o_r, max_depth,
+                                       res);
+                if(nodes < 0)
+                {
+                    return -1;
+                }
+                nodes /= pairs;
+                error = mag_tune_error(res, ref, 3*npoints);
+                if(found && nodes >= tune->nodes)
+                {
+                    break;
+                }
+                /* Until one is within the target, the most accurate */
+                if(error*MAG_TUNE_MARGIN <= target ||
+                   (!found && (tune->nodes < 0 || error < tune->error)))
+                {
+                    tune->lon_order = o;
+                    tune->lat_order = o;
+                    tune->r_order = o_r;
+                    tune->ratio = cand.ratio_max;
+                    tune->error = error;
+                    tune->nodes = nodes;
+                    found = error*MAG_TUNE_MARGIN <= target;
+                }
+                if(error*MAG_TUNE_MARGIN <= target)
+                {
+                    break;
+                }
+            }
+            if(found && r == 0)
+            {
+                break;
+            }
+        }
+        if(found && o_r == MAG_TUNE_MIN_ORDER)
+        {
+            break;
+        }
+    }
+    return found ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+/*
+Choice of the GLQ orders and distance-size ratio of a calculation for a
+target accuracy.
+
+The field of a sample of the model is calculated on a few computation points
+with every candidate setting and compared with a reference of high order and
+fine division. The sample of each point is made of the tesseroids closest to
+it, relative to their size, where the GLQ is least accurate, and of
+tesseroids spread over the rest of the model. The candidate that evaluates
+the fewest GLQ nodes among those within the target error is chosen.
+
+Example
+-------
+
+    MAG_TUNE tune;
+    double points[3] = {10, 45, 250000};
+
+    if(mag_tune(model, &calc, points, 1, 1e-4, 30, &tune) == 0)
+        printf("%d/%d/%d %g\n", tune.lon_order, tune.lat_order,
+               tune.r_order, tune.ratio);
+*/
+
+#ifndef _TESSEROIDS_MAG_TUNE_H_
+#define _TESSEROIDS_MAG_TUNE_H_
+
+
+/* Needed for definition of TESS_MODEL */
+#include "geometry.h"
+/* Needed for definition of MAG_CALC */
+#include "mag_tess.h"
+
+
+/* Largest number of computation points worth giving to mag_tune */
+#define MAG_TUNE_POINTS 16
+/* Tesseroids closest to each point in its sample */
+#define MAG_TUNE_NEAR 16
+/* Tesseroids spread over the model in the sample of each point */
+#define MAG_TUNE_SPREAD 16
+/* Range of the GLQ orders tried */
+#define MAG_TUNE_MIN_ORDER 2
+#define MAG_TUNE_MAX_ORDER 6
+/* Margin for the points and tesseroids left out of the sample: the error
+   on the sample must be this many times smaller than the target */
+#define MAG_TUNE_MARGIN 2
+/* GLQ order and distance-size ratio of the reference */
+#define MAG_TUNE_REF_ORDER 8
+#define MAG_TUNE_REF_RATIO 8
+
+
+/** Setting chosen by mag_tune */
+typedef struct mag_tune_struct
+{
+    int lon_order, lat_order, r_order; /* orders of the GLQ */
+    double ratio; /* distance-size ratio of the division */
+    double error; /* largest difference with the reference on the sample,
+                     relative to the largest value of the reference */
+    double nodes; /* GLQ nodes evaluated per tesseroid-point pair */
+    double ref_nodes; /* same for the reference */
+} MAG_TUNE;
+
+
+/** Find the cheapest GLQ orders and distance-size ratio that calculate the
+field of a model within a relative error.
+
+The error on the sample must be MAG_TUNE_MARGIN times smaller than target.
+The longitude and latitude orders are the same. The ratio is only tuned if
+calc is adaptative, otherwise it is calc->ratio_max.
+
+@param model the tesseroid model
+@param calc settings of the calculation. Its field_block must take any GLQ
+            order. Its far field is kept, its node table is not used.
+@param points longitude, latitude and height of each computation point, one
+              after the other
+@param npoints number of computation points, at most MAG_TUNE_POINTS
+@param target largest relative error allowed
+@param max_depth number of times a tesseroid can be divided
+@param tune the chosen setting
+
+@return 0 if all went well, 1 if no candidate is within the target (the most
+        accurate one is given), -1 if there was an error with allocation
+*/
+int mag_tune(const TESS_MODEL *model, const MAG_CALC *calc,
+    const double *points, int npoints, double target, int max_depth,
+    MAG_TUNE *tune);
+
+#endif
@@ -6,12 +6,15 @@ Input and output parsing tools.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <time.h>
 #include "logger.h"
 #include "version.h"
 #include "parsers.h"
 #include "constants.h"
 #include "geometry.h"
+#include "grav_tess.h"
+#include "grav_tess_simd.h"
 
 #include <math.h>
 
@@ -139,7 +142,8 @@ int parse_tessb_args(int argc, char **argv, const char *progname,
                      TESSB_ARGS *args, void (*print_help)(const char *))
 {
     int bad_args = 0, parsed_args = 0, total_args = 1,  parsed_order = 0,
-        parsed_ratio1 = 0, parsed_ratio2 = 0, parsed_ratio3 = 0, i, nchar, nread;
+        parsed_ratio1 = 0, parsed_ratio2 = 0, parsed_ratio3 = 0,
+        parsed_threads = 0, i, nchar, nread;
     char *params;
 
     /* Default values for options */
@@ -152,6 +156,26 @@ int parse_tessb_args(int argc, char **argv, const char *progname,
     args->ratio1 = 0; /* zero means use the default for the program */
 	args->ratio2 = 0;
 	args->ratio3 = 0;
+    args->threads = 1;
+    args->isa = -1;
+    args->nodes_mem = 256;
+    args->tile_points = 0; /* zero means fit them to the caches */
+    args->tile_tess = 0;
+    args->max_depth = TESS_ADAPT_DEFAULT_DEPTH;
+    args->far_error = 0;
+    args->tree_theta = 0;
+    args->fft = 0;
+    args->grid = 0;
+    args->binary = 0;
+    args->compat_format = 0;
+    args->checkpoint = NULL;
+    args->checkpoint_every = 60;
+    args->resume = 0;
+    args->statsfname = NULL;
+    args->tune = 0;
+    args->index = 0;
+    args->truncate = 0;
+    args->kernel = NULL;
     /* Parse arguments */
     for(i = 1; i < argc; i++)
     {
@@ -207,7 +231,223 @@ int parse_tessb_args(int argc, char **argv, const char *progname,
                 case '-':
                 {
                     params = &argv[i][2];
-                    if(strcmp(params, "version"))
+                    if(!strncmp(params, "isa=", 4))
+                    {
+                        args->isa = tess_isa_parse(params + 4);
+                        if(args->isa < 0)
+                        {
+                            log_error("bad input argument '%s'. Should be one of --isa=scalar, --isa=avx2 or --isa=avx512.",
+                                      argv[i]);
+                            bad_args++;
+                        }
+                    }
+                    else if(!strncmp(params, "tile=", 5))
+                    {
+                        nread = sscanf(params + 5, "%d/%d%n",
+                                       &(args->tile_points),
+                                       &(args->tile_tess), &nchar);
+                        if(nread != 2 || *(params + 5 + nchar) != '\0' ||
+                           args->tile_points < 1 || args->tile_tess < 1)
+                        {
+                            log_error("bad input argument '%s'. Should be --tile=POINTS/TESSEROIDS with both >= 1.",
+                                      argv[i]);
+                            bad_args++;
+                        }
+                    }
+                    else if(!strncmp(params, "max-depth=", 10))
+                    {
+                        nread = sscanf(params + 10, "%d%n",
+                                       &(args->max_depth), &nchar);
+                        if(nread != 1 || *(params + 10 + nchar) != '\0' ||
+                           args->max_depth < 0 ||
+                           args->max_depth > TESS_ADAPT_MAX_DEPTH)
+                        {
+                            log_error("bad input argument '%s'. Maximum depth of the division should be from 0 to %d.",
+                                      argv[i], TESS_ADAPT_MAX_DEPTH);
+                            bad_args++;
+                        }
+                    }
+                    else if(!strncmp(params, "far-field=", 10))
+                    {
+                        nread = sscanf(params + 10, "%lf%n",
+                                       &(args->far_error), &nchar);
+                        if(nread != 1 || *(params + 10 + nchar) != '\0' ||
+                           args->far_error < 0 || args->far_error >= 1)
+                        {
+                            log_error("bad input argument '%s'. Relative error of the far field should be >= 0 and < 1.",
+                                      argv[i]);
+                            bad_args++;
+                        }
+                    }
+                    else if(!strncmp(params, "tune=", 5))
+                    {
+                        nread = sscanf(params + 5, "%lf%n", &(args->tune),
+                                       &nchar);
+                        if(nread != 1 || *(params + 5 + nchar) != '\0' ||
+                           args->tune <= 0 || args->tune >= 1)
+                        {
+                            log_error("bad input argument '%s'. Relative error of the tuning should be > 0 and < 1.",
+                                      argv[i]);
+                            bad_args++;
+                        }
+                    }
+                    else if(!strcmp(params, "index"))
+                    {
+                        if(args->index)
+                        {
+                            log_error("repeated option --index");
+                            bad_args++;
+                        }
+                        args->index = 1;
+                    }
+                    else if(!strncmp(params, "truncate=", 9))
+                    {
+                        nread = sscanf(params + 9, "%lf%n",
+                                       &(args->truncate), &nchar);
+                        if(nread != 1 || *(params + 9 + nchar) != '\0' ||
+                           args->truncate <= 0)
+                        {
+                            log_error("bad input argument '%s'. Truncation distance should be > 0.",
+                                      argv[i]);
+                            bad_args++;
+                        }
+                    }
+                    else if(!strncmp(params, "tree=", 5))
+                    {
+                        nread = sscanf(params + 5, "%lf%n",
+                                       &(args->tree_theta), &nchar);
+                        if(nread != 1 || *(params + 5 + nchar) != '\0' ||
+                           args->tree_theta < 0 || args->tree_theta >= 1)
+                        {
+                            log_error("bad input argument '%s'. Opening angle of the tree should be >= 0 and < 1.",
+                                      argv[i]);
+                            bad_args++;
+                        }
+                    }
+                    else if(!strcmp(params, "fft"))
+                    {
+                        if(args->fft)
+                        {
+                            log_error("repeated option --fft");
+                            bad_args++;
+                        }
+                        args->fft = 1;
+                    }
+                    else if(!strncmp(params, "grid=", 5))
+                    {
+                        double *area = args->grid_area;
+
+                        nread = sscanf(params + 5,
+                                       "%lf/%lf/%lf/%lf/%lf/%lf/%lf%n",
+                                       &area[0], &area[1], &area[2],
+                                       &area[3], &area[4], &area[5],
+                                       &area[6], &nchar);
+                        if(nread != 7 || *(params + 5 + nchar) != '\0' ||
+                           area[1] < area[0] || area[3] < area[2] ||
+                           area[4] <= 0 || area[5] <= 0 ||
+                           (area[1] - area[0])/area[4] >= INT_MAX ||
+                           (area[3] - area[2])/area[5] >= INT_MAX)
+                        {
+                            log_error("bad input argument '%s'. Should be --grid=W/E/S/N/DLON/DLAT/HEIGHT with E >= W, N >= S and the spacings > 0.",
+                                      argv[i]);
+                            bad_args++;
+                        }
+                        args->grid = 1;
+                    }
+                    else if(!strcmp(params, "compat-format"))
+                    {
+                        if(args->compat_format)
+                        {
+                            log_error("repeated option --compat-format");
+                            bad_args++;
+                        }
+                        args->compat_format = 1;
+                    }
+                    else if(!strcmp(params, "binary"))
+                    {
+                        if(args->binary)
+                        {
+                            log_error("repeated option --binary");
+                            bad_args++;
+                        }
+                        args->binary = 1;
+                    }
+                    else if(!strncmp(params, "checkpoint=", 11))
+                    {
+                        if(args->checkpoint != NULL)
+                        {
+                            log_error("repeated option --checkpoint");
+                            bad_args++;
+                        }
+                        args->checkpoint = params + 11;
+                        if(strlen(args->checkpoint) == 0)
+                        {
+                            log_error("bad input argument --checkpoint. Missing filename.");
+                            bad_args++;
+                        }
+                    }
+                    else if(!strncmp(params, "checkpoint-every=", 17))
+                    {
+                        nread = sscanf(params + 17, "%lf%n",
+                                       &(args->checkpoint_every), &nchar);
+                        if(nread != 1 || *(params + 17 + nchar) != '\0' ||
+                           args->checkpoint_every < 0)
+                        {
+                            log_error("bad input argument '%s'. Seconds between checkpoints should be >= 0.",
+                                      argv[i]);
+                            bad_args++;
+                        }
+                    }
+                    else if(!strncmp(params, "kernel=", 7))
+                    {
+                        if(args->kernel != NULL)
+                        {
+                            log_error("repeated option --kernel");
+                            bad_args++;
+                        }
+                        args->kernel = params + 7;
+                        if(strlen(args->kernel) == 0)
+                        {
+                            log_error("bad input argument --kernel. Missing filename.");
+                            bad_args++;
+                        }
+                    }
+                    else if(!strncmp(params, "stats=", 6))
+                    {
+                        if(args->statsfname != NULL)
+                        {
+                            log_error("repeated option --stats");
+                            bad_args++;
+                        }
+                        args->statsfname = params + 6;
+                        if(strlen(args->statsfname) == 0)
+                        {
+                            log_error("bad input argument --stats. Missing filename.");
+                            bad_args++;
+                        }
+                    }
+                    else if(!strcmp(params, "resume"))
+                    {
+                        if(args->resume)
+                        {
+                            log_error("repeated option --resume");
+                            bad_args++;
+                        }
+                        args->resume = 1;
+                    }
+                    else if(!strncmp(params, "nodes-mem=", 10))
+                    {
+                        nread = sscanf(params + 10, "%lf%n",
+                                       &(args->nodes_mem), &nchar);
+                        if(nread != 1 || *(params + 10 + nchar) != '\0' ||
+                           args->nodes_mem < 0)
+                        {
+                            log_error("bad input argument '%s'. Memory for the quadrature nodes should be >= 0 MB.",
+                                      argv[i]);
+                            bad_args++;
+                        }
+                    }
+                    else if(strcmp(params, "version"))
                     {
                         log_error("invalid argument '%s'", argv[i]);
                         bad_args++;
@@ -254,6 +494,27 @@ int parse_tessb_args(int argc, char **argv, const char *progname,
                     parsed_order = 1;
                     break;
                 }
+                case 'j':
+                {
+                    if(parsed_threads)
+                    {
+                        log_error("repeated option -j");
+                        bad_args++;
+                        break;
+                    }
+                    params = &argv[i][2];
+                    nchar = 0;
+                    nread = sscanf(params, "%d%n", &(args->threads), &nchar);
+                    if(nread != 1 || *(params + nchar) != '\0' ||
+                       args->threads < 1)
+                    {
+                        log_error("bad input argument '%s'. Number of threads should be >= 1.",
+                                  argv[i]);
+                        bad_args++;
+                    }
+                    parsed_threads = 1;
+                    break;
+                }
                 case 't':
                 {
 					//ELDAR BAYKIEV///////////////////////////////////////////////////////////////////
@@ -342,6 +603,21 @@ int parse_tessb_args(int argc, char **argv, const char *progname,
             }
         }
     }
+    if(args->resume && args->checkpoint == NULL)
+    {
+        log_error("option --resume needs the file of --checkpoint=FILE");
+        bad_args++;
+    }
+    /* The sensitivity matrix is in the order of the model and has no
+       results to print */
+    if(args->kernel != NULL &&
+       (args->tree_theta > 0 || args->index || args->truncate > 0 ||
+        args->fft || args->binary || args->checkpoint != NULL ||
+        args->statsfname != NULL))
+    {
+        log_error("option --kernel can't be used with --tree, --index, --truncate, --fft, --binary, --checkpoint or --stats");
+        bad_args++;
+    }
     /* Check if parsing went well */
     if(bad_args > 0 || parsed_args != total_args)
     {
@@ -381,6 +657,7 @@ int parse_gradcalc_args(int argc, char **argv, const char *progname, GRADCALC_AR
 
 	args->bz_NEU_NED = -1;
 	args->bz_NEU_NED_set = FALSE;
+	args->binary = FALSE;
 
 
 	/* Parse arguments */
@@ -403,7 +680,11 @@ int parse_gradcalc_args(int argc, char **argv, const char *progname, GRADCALC_AR
 				case '-':
                				{
 					params = &argv[i][2];
-					if(strcmp(params, "version"))
+					if(!strcmp(params, "binary"))
+					{
+						args->binary = 1;
+					}
+					else if(strcmp(params, "version"))
 					{
 						printf("invalid argument '%s'\n", argv[i]);
 						bad_args++;
@@ -587,10 +868,10 @@ int gets_mag_tess(const char *str, TESSEROID *tess)
 	tess->By = By;
 	tess->Bz = Bz;
 
-  tess->cos_a1 = cos(PI/2.0-DEG2RAD*(w+e)*0.5);
-  tess->sin_a1 = sin(PI/2.0-DEG2RAD*(w+e)*0.5);
-  tess->cos_b1 = cos(DEG2RAD*(s+n)*0.5);
-  tess->sin_b1 = sin(DEG2RAD*(s+n)*0.5);
+  tess->cos_a1 = cos(PI/2.0-DEG2RAD*(s+n)*0.5);
+  tess->sin_a1 = sin(PI/2.0-DEG2RAD*(s+n)*0.5);
+  tess->cos_b1 = cos(DEG2RAD*(w+e)*0.5);
+  tess->sin_b1 = sin(DEG2RAD*(w+e)*0.5);
     return 0;
 }
 
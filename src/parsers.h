@@ -34,6 +34,40 @@ typedef struct tessh_args
 	double ratio1; /**< distance-size ratio used for recusive division */
 	double ratio2; /**< distance-size ratio used for recusive division */
 	double ratio3; /**< distance-size ratio used for recusive division */
+	int threads; /**< number of threads used to evaluate computation points */
+	int isa; /**< instruction set of the kernels, -1 to detect the best one */
+	double nodes_mem; /**< memory in MB for the precomputed quadrature nodes,
+                           0 to scale the nodes for every point */
+	int tile_points; /**< number of points in a tile, 0 to fit the tile
+                          to the caches */
+	int tile_tess; /**< number of tesseroids in a tile, 0 to fit the tile
+                        to the caches */
+	int max_depth; /**< number of times the adaptative algorithm can divide
+                        a tesseroid */
+	double far_error; /**< relative error allowed to take far tesseroids as
+                           point masses, 0 to never do it */
+	double tree_theta; /**< opening angle of the tree evaluation, 0 to sum
+                            all tesseroids directly */
+	int fft; /**< flag to calculate rows of regular grids by convolution in
+                  longitude */
+	int grid; /**< flag to generate the computation points instead of
+                   reading them from stdin */
+	double grid_area[7]; /**< W, E, S, N, dlon, dlat and height of the
+                              generated grid */
+	int binary; /**< flag to write the results as a binary grid */
+	int compat_format; /**< flag to write the numbers as printf("%.15g") */
+	char *checkpoint; /**< name of the checkpoint file, NULL to not write
+                           checkpoints */
+	double checkpoint_every; /**< seconds between two checkpoints */
+	int resume; /**< flag to continue the run of the checkpoint file */
+	char *statsfname; /**< file of the report of --stats, NULL for none */
+	double tune; /**< relative error the GLQ orders and ratios are chosen
+                      for, 0 to use the ones given */
+	int index; /**< flag to sort the tesseroids out with a spatial index */
+	double truncate; /**< distance beyond which tesseroids are skipped, 0 to
+                          calculate all */
+	char *kernel; /**< file of the sensitivity matrix to write instead of
+                       the results, NULL to calculate the results */
 } TESSB_ARGS;
 
 
@@ -53,6 +87,8 @@ typedef struct gradcalc_args
 	int bz_NEU_NED;
 	int bz_NEU_NED_set;
 
+	int binary; /**< flag to write the output as a binary grid */
+
 	int verbose; /**< flag to indicate if verbose printing is enabled */
 	int logtofile; /**< flag to indicate if logging to a file is enabled */
 
@@ -0,0 +1,231 @@
+/*
+Checkpoints of the tessb* programs.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "logger.h"
+#include "grav_tess_simd.h"
+#include "text_io.h"
+#include "parsers.h"
+#include "tessb_pipe.h"
+#include "tessb_checkpoint.h"
+
+
+/* Make the name of a file of the checkpoint: the checkpoint itself with
+   suffix "", the copy of the output with ".out" or a temporary file.
+   Returns NULL if there was an error with allocation. */
+static char * tessb_checkpoint_name(const TESSB_JOB *job, const char *suffix)
+{
+    char *name;
+
+    name = (char *)malloc(strlen(job->checkpoint) + strlen(suffix) + 1);
+    if(name != NULL)
+    {
+        sprintf(name, "%s%s", job->checkpoint, suffix);
+    }
+    return name;
+}
+
+
+/* Write the committed prefix of the output to the checkpoint file. The copy
+   of the output goes to the disk first and the file is replaced at once, so
+   a crash at any moment leaves the last checkpoint valid. Returns 1 if there
+   was an error. */
+static int write_tessb_checkpoint(TESSB_JOB *job, long long lines)
+{
+    FILE *file;
+    char *tmpname;
+    int error;
+
+    job->checkpoint_time = tessb_clock();
+    if(text_out_flush(job->out) || fflush(job->out->copy) ||
+       fsync(fileno(job->out->copy)))
+    {
+        return 1;
+    }
+    fflush(job->out->file);
+    tmpname = tessb_checkpoint_name(job, ".tmp");
+    if(tmpname == NULL)
+    {
+        return 1;
+    }
+    file = fopen(tmpname, "w");
+    if(file == NULL)
+    {
+        free(tmpname);
+        return 1;
+    }
+    fprintf(file, "# Checkpoint of %s: continue the run with --resume\n",
+            job->progname);
+    fprintf(file, "program %s\n", job->progname);
+    fprintf(file, "model %s\n", job->modelfname);
+    fprintf(file, "input %s\n", job->input);
+    fprintf(file, "output %s\n", job->binary ? "binary" : "text");
+    fprintf(file, "settings %s\n", job->settings);
+    fprintf(file, "lines %lld\n", lines);
+    fprintf(file, "points %d\n", job->points);
+    fprintf(file, "bytes %lld\n", job->out->count);
+    error = fflush(file) || fsync(fileno(file));
+    error = fclose(file) || error;
+    error = error || rename(tmpname, job->checkpoint);
+    free(tmpname);
+    return error;
+}
+
+
+/* Write the options of a run that change its results, as the settings of
+   its checkpoints. The number of threads, the tiles and the checkpoints
+   themselves don't change the results. */
+void tessb_settings(const TESSB_ARGS *args, int isa, char *settings)
+{
+    const double *area = args->grid_area;
+    int n;
+
+    n = snprintf(settings, TESSB_SETTINGS_SIZE,
+                 "-o%d/%d/%d adaptative=%d ratios=%.17g/%.17g/%.17g depth=%d far-field=%.17g tune=%.17g tree=%.17g index=%d truncate=%.17g fft=%d isa=%s nodes-mem=%.17g compat-format=%d",
+                 args->lon_order, args->lat_order, args->r_order,
+                 args->adaptative, args->ratio1, args->ratio2, args->ratio3,
+                 args->max_depth, args->far_error, args->tune,
+                 args->tree_theta, args->index, args->truncate, args->fft,
+                 tess_isa_name(isa), args->nodes_mem, args->compat_format);
+    if(args->grid && n > 0 && n < TESSB_SETTINGS_SIZE)
+    {
+        snprintf(settings + n, TESSB_SETTINGS_SIZE - n,
+                 " grid=%.17g/%.17g/%.17g/%.17g/%.17g/%.17g/%.17g", area[0],
+                 area[1], area[2], area[3], area[4], area[5], area[6]);
+    }
+}
+
+
+/* Read the checkpoint file of a run to resume it. A missing file is a run
+   that has not committed anything yet. Returns 1 if the file can't be read
+   or belongs to another run. */
+int read_tessb_checkpoint(const TESSB_JOB *job, TESSB_CHECKPOINT *ckpt)
+{
+    FILE *file;
+    char buff[TESSB_LINE_SIZE], key[32], *value;
+    const char *expect;
+    int nchar, nread = 0, settings = 0;
+
+    ckpt->lines = 0;
+    ckpt->points = 0;
+    ckpt->bytes = 0;
+    file = fopen(job->checkpoint, "r");
+    if(file == NULL)
+    {
+        log_info("No checkpoint in %s yet. Starting from the beginning.",
+                 job->checkpoint);
+        return 0;
+    }
+    while(fgets(buff, TESSB_LINE_SIZE, file) != NULL)
+    {
+        if(buff[0] == '#' || sscanf(buff, "%31s %n", key, &nchar) != 1)
+        {
+            continue;
+        }
+        value = buff + nchar;
+        strstrip(value);
+        expect = NULL;
+        if(!strcmp(key, "program"))
+            expect = job->progname;
+        else if(!strcmp(key, "model"))
+            expect = job->modelfname;
+        else if(!strcmp(key, "input"))
+            expect = job->input;
+        else if(!strcmp(key, "output"))
+            expect = job->binary ? "binary" : "text";
+        else if(!strcmp(key, "settings"))
+        {
+            expect = job->settings;
+            settings = 1;
+        }
+        else if(!strcmp(key, "lines"))
+            nread += sscanf(value, "%lld", &(ckpt->lines));
+        else if(!strcmp(key, "points"))
+            nread += sscanf(value, "%lld", &(ckpt->points));
+        else if(!strcmp(key, "bytes"))
+            nread += sscanf(value, "%lld", &(ckpt->bytes));
+        if(expect != NULL && strcmp(value, expect))
+        {
+            log_error("checkpoint %s is of a run with %s %s, not %s",
+                      job->checkpoint, key, value, expect);
+            fclose(file);
+            return 1;
+        }
+    }
+    fclose(file);
+    if(nread != 3 || !settings || ckpt->lines < 0 || ckpt->points < 0 ||
+       ckpt->bytes < 0)
+    {
+        log_error("checkpoint %s is incomplete", job->checkpoint);
+        return 1;
+    }
+    return 0;
+}
+
+
+/* Open the copy of the output kept with the checkpoints. The copy of a
+   resumed run is cut back to the checkpoint and printed again, so stdout
+   gets the whole output. Returns NULL if there was an error. */
+FILE * open_tessb_copy(const TESSB_JOB *job,
+    const TESSB_CHECKPOINT *ckpt)
+{
+    FILE *copy;
+    char *name, buff[TESSB_LINE_SIZE];
+    long long left;
+    size_t n;
+
+    name = tessb_checkpoint_name(job, ".out");
+    if(name == NULL)
+    {
+        log_error("problem allocating memory for the checkpoint");
+        return NULL;
+    }
+    copy = fopen(name, ckpt->bytes > 0 ? "r+b" : "wb");
+    if(copy == NULL)
+    {
+        log_error("failed to open the copy of the output %s", name);
+        free(name);
+        return NULL;
+    }
+    for(left = ckpt->bytes; left > 0; left -= n)
+    {
+        n = left < TESSB_LINE_SIZE ? (size_t)left : TESSB_LINE_SIZE;
+        if(fread(buff, 1, n, copy) != n || fwrite(buff, 1, n, stdout) != n)
+        {
+            log_error("copy of the output %s is shorter than checkpoint %s",
+                      name, job->checkpoint);
+            fclose(copy);
+            free(name);
+            return NULL;
+        }
+    }
+    /* What was written after the checkpoint is written again */
+    if(ftruncate(fileno(copy), ckpt->bytes) ||
+       fseeko(copy, ckpt->bytes, SEEK_SET))
+    {
+        log_error("problem cutting %s back to the checkpoint", name);
+        fclose(copy);
+        free(name);
+        return NULL;
+    }
+    free(name);
+    return copy;
+}
+
+
+/* Write a checkpoint of the lines of the input printed so far. A run whose
+   checkpoints fail goes on without them. */
+void checkpoint_tessb(TESSB_JOB *job)
+{
+    if(write_tessb_checkpoint(job, job->committed))
+    {
+        log_warning("problem writing checkpoint %s. Continuing without checkpoints.",
+                    job->checkpoint);
+        job->checkpoint = NULL;
+    }
+}
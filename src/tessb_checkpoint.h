@@ -0,0 +1,83 @@
+/*
+Checkpoints of the tessb* programs, to continue a long run after a crash.
+
+With --checkpoint=FILE the writer keeps a copy of the output in FILE.out
+and, every --checkpoint-every seconds, writes to FILE how many lines of the
+input have their results in the copy. The checkpoint also has the program,
+model file, kinds of input and output and the options that change the
+results, so that --resume only continues the same run:
+
+    # Checkpoint of tessbz: continue the run with --resume
+    program tessbz
+    model model.txt
+    input text
+    output text
+    settings -o2/2/2 adaptative=1 ...
+    lines 4096
+    points 4090
+    bytes 204500
+
+A checkpoint is written to a temporary file after the copy is on the disk,
+then renamed, so a crash at any moment leaves the last one valid.
+*/
+
+#ifndef _TESSEROIDS_TESSB_CHECKPOINT_H_
+#define _TESSEROIDS_TESSB_CHECKPOINT_H_
+
+
+#include <stdio.h>
+/* Needed for definition of TESSB_ARGS */
+#include "parsers.h"
+/* Needed for definition of TESSB_JOB */
+#include "tessb_pipe.h"
+
+
+/* Prefix of the output that is committed: the results of the first lines
+   of the input are printed and their copy is on the disk */
+typedef struct tessb_checkpoint_struct
+{
+    long long lines; /* lines of the input, rows of a binary grid or points
+                        of --grid done */
+    long long points; /* computation points printed */
+    long long bytes; /* size of the results in the copy of the output */
+} TESSB_CHECKPOINT;
+
+
+/** Write the options of a run that change its results, as the settings of
+its checkpoints.
+
+@param args the options of the run
+@param isa instruction set of the kernels
+@param settings buffer of TESSB_SETTINGS_SIZE characters
+*/
+void tessb_settings(const TESSB_ARGS *args, int isa, char *settings);
+
+
+/** Read the checkpoint file of a run to resume it. A missing file is a run
+that has not committed anything yet, and gives an empty checkpoint.
+
+@param job the pipeline, with the checkpoint file and the run it belongs to
+@param ckpt the checkpoint read
+
+@return 0 if all went well, 1 if the file can't be read or belongs to
+        another run (the reason is logged)
+*/
+int read_tessb_checkpoint(const TESSB_JOB *job, TESSB_CHECKPOINT *ckpt);
+
+
+/** Open the copy of the output kept with the checkpoints. The copy of a
+resumed run is cut back to the checkpoint and printed again on stdout.
+
+@param job the pipeline, with the checkpoint file
+@param ckpt the checkpoint the run resumes from
+
+@return the copy or NULL if there was an error (the reason is logged)
+*/
+FILE * open_tessb_copy(const TESSB_JOB *job, const TESSB_CHECKPOINT *ckpt);
+
+
+/** Write a checkpoint of the lines of the input printed so far
+(job->committed). A run whose checkpoints fail goes on without them. */
+void checkpoint_tessb(TESSB_JOB *job);
+
+#endif
@@ -9,24 +9,111 @@ Generic main function for the tessb* programs.
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
 #include "logger.h"
 #include "version.h"
 #include "grav_tess.h"
+#include "grav_tess_simd.h"
+#include "grav_tess_fixed.h"
+#include "mag_tess.h"
+#include "mag_tree.h"
+#include "mag_index.h"
+#include "mag_fft.h"
+#include "mag_tune.h"
+#include "grid_bin.h"
+#include "text_io.h"
 #include "glq.h"
 #include "constants.h"
 #include "geometry.h"
 #include "parsers.h"
 #include "tessb_main.h"
+#include "tessb_pipe.h"
+#include "tessb_stats.h"
+#include "tessb_checkpoint.h"
+#include "tessb_mpi.h"
+#include "tessb_sens.h"
 #include "linalg.h"
+#ifdef TESSB_MPI
+#include <mpi.h>
+#endif
 
 #include <math.h>
 
+
+/* Regular grid of computation points generated with --grid, in
+   longitude-fastest order from the south-west corner */
+typedef struct tessb_grid_struct
+{
+    int nlon; /* number of columns */
+    int nlat; /* number of rows */
+    double *lon; /* longitude of each column */
+    double *lat; /* latitude of each row */
+    double *trig_lon; /* cosine and sine of the longitude of each column */
+    double *trig_lat; /* cosine and sine of the colatitude of each row */
+    char *text_lon; /* longitude of each column as text */
+    char *text_lat; /* latitude and height of each row as text */
+    double height;
+} TESSB_GRID;
+
+
+/* Room for a coordinate printed with %.15g */
+#define TESSB_GRID_TEXT 32
+
+
+/* Lines or rows of a stream read ahead to sample the computation points of
+   --tune. The reader takes them before the rest of the stream. */
+typedef struct tessb_peek_struct
+{
+    char **lines; /* lines of text */
+    double *rows; /* rows of a binary grid */
+    int n; /* number of lines or rows read ahead */
+    int next; /* index of the next one for the reader */
+    double *coords; /* longitude, latitude and height of the points among
+                       them */
+    int npoints; /* number of points */
+} TESSB_PEEK;
+
+
+/* Everything a run makes, from the options to the results. It starts
+   zeroed and free_tessb_run frees what was made of it, so a run can stop at
+   any point. */
+typedef struct tessb_run_struct
+{
+    const char *progname;
+    TESSB_ARGS args;
+    TESSB_JOB job;
+    TESSB_WORKER *workers; /* one per compute thread */
+    pthread_t *threads; /* the compute threads, the writer and the thread
+                           that talks to the other MPI ranks */
+    TESSB_GRID grid; /* the points of --grid */
+    GRID_BIN *input; /* binary grid on stdin, NULL for text or --grid */
+    double *row; /* a row of the binary grid */
+    TESSB_PEEK peek; /* points read ahead for --tune */
+    TESSB_CHECKPOINT ckpt; /* the lines a resumed run skips */
+    MAG_TUNE tune; /* the orders of --tune */
+    int tuned; /* 0: not tuned, 1: tuned, 2: tuned short of the target */
+    int nsamples; /* number of points --tune sampled */
+    int isa; /* instruction set of the kernels */
+    int modelsize; /* number of tesseroids */
+    FILE *logfile; /* the log file of --log, NULL if none */
+    time_t start_time; /* local time of the start, for the header */
+    double run_start; /* clock of the start */
+    double run_cpu; /* CPU time of the process at the start */
+    TESSB_REPORT report; /* measures for --stats */
+} TESSB_RUN;
+
 /* Print the help message for tessh* programs */
 void print_tessb_help(const char *progname)
 {
 		printf("MAGNETIC TESSEROIDS\n");
 	  printf("Usage: %s MODELFILE [OPTIONS]\n\n", progname);
-	  if(strcmp(progname + 4, "pot") == 0)
+	  if(strcmp(progname, "tessb") == 0)
+	  {
+	  		printf("Calculate the bx, by and bz components due to a tesseroid model on\n");
+	  }
+	  else if(strcmp(progname + 4, "pot") == 0)
 	  {
 	  		printf("Calculate the potential due to a tesseroid model on\n");
 	  }
@@ -39,151 +126,542 @@ void print_tessb_help(const char *progname)
 }
 
 
-/* Run the main for a generic tessh* program */
-int run_tessb_main(int argc, char **argv, const char *progname,
-    double (*field)(TESSEROID, double, double, double, GLQ, GLQ, GLQ),
-    double ratio1, double ratio2, double ratio3)
+/* Free the memory of a grid */
+static void free_tessb_grid(TESSB_GRID *grid)
 {
-    TESSB_ARGS args;
-    GLQ *glq_lon, *glq_lat, *glq_r;
-    TESSEROID *model;
+    free(grid->lon);
+    free(grid->lat);
+    free(grid->text_lon);
+    free(grid->text_lat);
+    grid->lon = NULL;
+    grid->lat = NULL;
+    grid->text_lon = NULL;
+    grid->text_lat = NULL;
+}
 
-    int modelsize, rc, line, points = 0, error_exit = 0, bad_input = 0;
-    char buff[10000];
 
-    double lon, lat, height, res;
+/* Make the columns and rows of the grid of --grid=W/E/S/N/DLON/DLAT/HEIGHT
+   and their trigonometric functions. Returns 1 if there was an error with
+   allocation. */
+static int make_tessb_grid(TESSB_GRID *grid, const double *area)
+{
+    int i;
+
+    /* The east and north borders are included if they fall on the grid */
+    grid->nlon = (int)floor((area[1] - area[0])/area[4] + 1e-9) + 1;
+    grid->nlat = (int)floor((area[3] - area[2])/area[5] + 1e-9) + 1;
+    grid->height = area[6];
+    grid->lon = (double *)malloc(3*grid->nlon*sizeof(double));
+    grid->lat = (double *)malloc(3*grid->nlat*sizeof(double));
+    grid->text_lon = (char *)malloc(grid->nlon*TESSB_GRID_TEXT);
+    grid->text_lat = (char *)malloc(grid->nlat*2*TESSB_GRID_TEXT);
+    if(grid->lon == NULL || grid->lat == NULL || grid->text_lon == NULL ||
+       grid->text_lat == NULL)
+    {
+        free_tessb_grid(grid);
+        return 1;
+    }
+    grid->trig_lon = grid->lon + grid->nlon;
+    grid->trig_lat = grid->lat + grid->nlat;
+    for(i = 0; i < grid->nlon; i++)
+    {
+        grid->lon[i] = area[0] + i*area[4];
+        grid->trig_lon[2*i] = cos(DEG2RAD*grid->lon[i]);
+        grid->trig_lon[2*i + 1] = sin(DEG2RAD*grid->lon[i]);
+        sprintf(&(grid->text_lon[i*TESSB_GRID_TEXT]), "%.15g", grid->lon[i]);
+    }
+    for(i = 0; i < grid->nlat; i++)
+    {
+        grid->lat[i] = area[2] + i*area[5];
+        grid->trig_lat[2*i] = cos(PI/2.0 - DEG2RAD*grid->lat[i]);
+        grid->trig_lat[2*i + 1] = sin(PI/2.0 - DEG2RAD*grid->lat[i]);
+        sprintf(&(grid->text_lat[i*2*TESSB_GRID_TEXT]), "%.15g %.15g",
+                grid->lat[i], grid->height);
+    }
+    return 0;
+}
 
-		/*variables for precalculation of trigonometrical functions for tesseroid centers*/
-		double cos_a2, sin_a2, cos_b2, sin_b2;
 
-		/*variables for precalculation of trigonometrical functions for grid points*/
-		double lon_prev, lat_prev;
-		double cos_a2_prev, sin_a2_prev, cos_b2_prev, sin_b2_prev;
 
-    FILE *logfile = NULL, *modelfile = NULL;
-    time_t rawtime;
-    clock_t tstart;
-    struct tm * timeinfo;
+/* Free what was read ahead and not taken by the reader */
+static void free_tessb_peek(TESSB_PEEK *peek)
+{
+    int i;
 
-		double (*field1)(TESSEROID, double, double, double, GLQ, GLQ, GLQ);
-		double (*field2)(TESSEROID, double, double, double, GLQ, GLQ, GLQ);
-		double (*field3)(TESSEROID, double, double, double, GLQ, GLQ, GLQ);
-		void (*field_triple)(TESSEROID, double, double, double, GLQ, GLQ, GLQ, double*);
-		double ggt_1, ggt_2, ggt_3;
-		double gtt_v[3];
-		int n_tesseroid;
+    for(i = peek->next; peek->lines != NULL && i < peek->n; i++)
+    {
+        free(peek->lines[i]);
+    }
+    free(peek->lines);
+    free(peek->rows);
+    free(peek->coords);
+}
 
 
-    log_init(LOG_INFO);
+/* Read up to a block of lines of stdin, or of rows of the binary grid
+   input if not NULL, ahead of the reader. Returns 1 if there was an error
+   with allocation. */
+static int peek_tessb_stream(TESSB_PEEK *peek, GRID_BIN *input)
+{
+    char buff[TESSB_LINE_SIZE];
+    double *row;
 
-    rc = parse_tessb_args(argc, argv, progname, &args, &print_tessb_help);
-    if(rc == 2)
+    peek->coords = (double *)malloc(3*TESSB_BLOCK_SIZE*sizeof(double));
+    if(input != NULL)
     {
-        return 0;
+        peek->rows = (double *)malloc(TESSB_BLOCK_SIZE*input->ncols*
+                                      sizeof(double));
     }
-    if(rc == 1)
+    else
     {
-        log_warning("Terminating due to bad input");
-        log_warning("Try '%s -h' for instructions", progname);
+        peek->lines = (char **)malloc(TESSB_BLOCK_SIZE*sizeof(char *));
+    }
+    if(peek->coords == NULL || (peek->rows == NULL && peek->lines == NULL))
+    {
+        return 1;
+    }
+    while(peek->n < TESSB_BLOCK_SIZE)
+    {
+        if(input != NULL)
+        {
+            row = &(peek->rows[peek->n*input->ncols]);
+            if(!grid_bin_read(input, row))
+            {
+                break;
+            }
+            memcpy(&(peek->coords[3*peek->npoints]), row, 3*sizeof(double));
+            peek->npoints++;
+        }
+        else
+        {
+            if(fgets(buff, TESSB_LINE_SIZE, stdin) == NULL)
+            {
+                break;
+            }
+            peek->lines[peek->n] = strdup(buff);
+            if(peek->lines[peek->n] == NULL)
+            {
+                return 1;
+            }
+            if(buff[0] != '#' && buff[0] != '\r' && buff[0] != '\n' &&
+               text_parse_doubles(buff, 3,
+                                  &(peek->coords[3*peek->npoints])) == 3)
+            {
+                peek->npoints++;
+            }
+        }
+        peek->n++;
+    }
+    return 0;
+}
+
 
+/* Read the next line of stdin, the ones read ahead first. Returns NULL at
+   the end of stdin or on error, as fgets. */
+static char * read_tessb_line(TESSB_PEEK *peek, char *buff)
+{
+    if(peek->next < peek->n)
+    {
+        strcpy(buff, peek->lines[peek->next]);
+        free(peek->lines[peek->next]);
+        peek->next++;
+        return buff;
+    }
+    return fgets(buff, TESSB_LINE_SIZE, stdin);
+}
+
+
+/* Read the next row of a binary grid, the ones read ahead first. Returns 1
+   if a row was read, as grid_bin_read. */
+static int read_tessb_row(TESSB_PEEK *peek, GRID_BIN *input, double *row)
+{
+    if(peek->next < peek->n)
+    {
+        memcpy(row, &(peek->rows[peek->next*input->ncols]),
+               input->ncols*sizeof(double));
+        peek->next++;
         return 1;
     }
+    return grid_bin_read(input, row);
+}
 
-    /* Set the appropriate logging level and log to file if necessary */
-    if(!args.verbose)
+
+/* Take up to MAG_TUNE_POINTS computation points evenly spread over those of
+   the grid, of the mapped binary grid input or read ahead. Returns the
+   number of points. */
+static int sample_tessb_points(const TESSB_GRID *grid, const GRID_BIN *input,
+    const TESSB_PEEK *peek, double *points)
+{
+    long long n, k;
+    int i, count;
+
+    if(grid != NULL)
+        n = (long long)grid->nlon*grid->nlat;
+    else if(input != NULL && input->data != NULL)
+        n = input->nrows;
+    else
+        n = peek->npoints;
+    count = n < MAG_TUNE_POINTS ? (int)n : MAG_TUNE_POINTS;
+    for(i = 0; i < count; i++)
     {
-        log_init(LOG_WARNING);
+        /* The middle of each of count equal parts */
+        k = (2*i + 1)*n/(2*count);
+        if(grid != NULL)
+        {
+            points[3*i] = grid->lon[k % grid->nlon];
+            points[3*i + 1] = grid->lat[k/grid->nlon];
+            points[3*i + 2] = grid->height;
+        }
+        else if(input != NULL && input->data != NULL)
+        {
+            memcpy(&points[3*i], &(input->data[k*input->ncols]),
+                   3*sizeof(double));
+        }
+        else
+        {
+            memcpy(&points[3*i], &(peek->coords[3*k]), 3*sizeof(double));
+        }
     }
-    if(args.logtofile)
+    return count;
+}
+
+
+/* Read all computation points of the grid, of the binary grid input or of
+   stdin, for the sensitivity matrix. Returns the number of points, 3 values
+   each in *points, or -1 if there was an error. */
+static long long read_tessb_points(const TESSB_GRID *grid, GRID_BIN *input,
+    TESSB_PEEK *peek, double *row, double **points, int *bad_input)
+{
+    char buff[TESSB_LINE_SIZE];
+    double coords[3], *tmp;
+    long long npoints = 0, capacity = 0;
+    int i, j, line;
+
+    *points = NULL;
+    for(line = 1; ; line++)
     {
-        logfile = fopen(args.logfname, "w");
-        if(logfile == NULL)
+        if(grid != NULL)
         {
-            log_error("unable to create log file %s", args.logfname);
-            log_warning("Terminating due to bad input");
-            log_warning("Try '%s -h' for instructions", progname);
-            return 1;
+            if(npoints == (long long)grid->nlon*grid->nlat)
+                break;
+            i = (int)(npoints % grid->nlon);
+            j = (int)(npoints/grid->nlon);
+            coords[0] = grid->lon[i];
+            coords[1] = grid->lat[j];
+            coords[2] = grid->height;
+        }
+        else if(input != NULL)
+        {
+            if(!read_tessb_row(peek, input, row))
+                break;
+            memcpy(coords, row, 3*sizeof(double));
         }
-        log_tofile(logfile, LOG_DEBUG);
+        else
+        {
+            if(read_tessb_line(peek, buff) == NULL)
+            {
+                if(ferror(stdin))
+                {
+                    log_error("problem encountered reading line %d", line);
+                    free(*points);
+                    *points = NULL;
+                    return -1;
+                }
+                break;
+            }
+            /* Comments and blank lines have no point */
+            if(buff[0] == '#' || buff[0] == '\r' || buff[0] == '\n')
+                continue;
+            if(text_parse_doubles(buff, 3, coords) != 3)
+            {
+                log_warning("bad/invalid computation point at line %d", line);
+                log_warning("skipping this line and continuing");
+                (*bad_input)++;
+                continue;
+            }
+        }
+        if(npoints == capacity)
+        {
+            capacity = 2*capacity + TESSB_BLOCK_SIZE;
+            tmp = (double *)realloc(*points, 3*capacity*sizeof(double));
+            if(tmp == NULL)
+            {
+                log_error("problem allocating memory for %lld point(s)",
+                          capacity);
+                free(*points);
+                *points = NULL;
+                return -1;
+            }
+            *points = tmp;
+        }
+        memcpy(&((*points)[3*npoints]), coords, 3*sizeof(double));
+        npoints++;
     }
+    return npoints;
+}
 
-    /* Check if a custom distance-size ratio is given */
-    if(args.ratio1 != 0)
+
+/* Free what a run made and close the log file. done tells that the run got
+   to calculate. */
+static void free_tessb_run(TESSB_RUN *run, int done)
+{
+    TESSB_JOB *job = &(run->job);
+    FILE *copy;
+    int i;
+
+    grid_bin_close(run->input);
+    free(run->row);
+    free_tessb_grid(&(run->grid));
+    free_tessb_peek(&(run->peek));
+    if(job->tree != NULL)
+        mag_tree_free(job->tree);
+    mag_index_free(job->index);
+    mag_fft_mesh_free(job->mesh);
+    if(job->model != NULL)
+        tess_model_free(job->model);
+    if(job->calc.nodes != NULL)
+        tess_nodes_free((TESS_NODES *)job->calc.nodes);
+    for(i = 0; run->workers != NULL && i < run->args.threads; i++)
     {
-        ratio1 = args.ratio1;
+        free_tessb_worker(&(run->workers[i]));
     }
-	  if(args.ratio2 != 0)
+    free(run->workers);
+    free(run->threads);
+    free_tessb_pipe(job);
+    if(job->out != NULL)
     {
-        ratio2 = args.ratio2;
+        copy = job->out->copy;
+        if(text_out_free(job->out))
+        {
+            log_error("problem writing the results to stdout");
+        }
+        if(copy != NULL)
+            fclose(copy);
     }
-	  if(args.ratio3 != 0)
+    if(done)
     {
-        ratio3 = args.ratio3;
+        log_info("Done");
     }
+    if(run->logfile != NULL)
+        fclose(run->logfile);
+}
 
-    /* Print standard verbose */
-    log_info("%s (Tesseroids project) %s", progname, tesseroids_version);
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
-    log_info("(local time) %s", asctime(timeinfo));
-    log_info("Use recursive division of tesseroids: %s",
-             args.adaptative ? "True" : "False");
-    log_info("Distance-size ratio1 for recusive division: %g", ratio1);
-	  log_info("Distance-size ratio2 for recusive division: %g", ratio2);
-	  log_info("Distance-size ratio3 for recusive division: %g", ratio3);
-
-    /* Make the necessary GLQ structures */
-    log_info("Using GLQ orders: %d lon / %d lat / %d r", args.lon_order,
-             args.lat_order, args.r_order);
-    glq_lon = glq_new(args.lon_order, -1, 1);
-    glq_lat = glq_new(args.lat_order, -1, 1);
-    glq_r = glq_new(args.r_order, -1, 1);
-    if(glq_lon == NULL || glq_lat == NULL || glq_r == NULL)
-    {
-        log_error("failed to create required GLQ structures");
-        log_warning("Terminating due to bad input");
-        log_warning("Try '%s -h' for instructions", progname);
-        if(args.logtofile)
-            fclose(logfile);
+
+/* Read the model file on rank 0 and send the model to the others. Returns 1
+   if there was an error. */
+static int read_tessb_model(TESSB_RUN *run)
+{
+    TESSB_JOB *job = &(run->job);
+    TESSEROID *model = NULL;
+    FILE *modelfile;
+
+    if(job->rank == 0)
+    {
+        log_info("Reading magnetic tesseroid model from file %s",
+                 run->args.modelfname);
+        modelfile = fopen(run->args.modelfname, "r");
+        if(modelfile == NULL)
+        {
+            log_error("failed to open model file %s", run->args.modelfname);
+            return 1;
+        }
+        model = read_mag_tess_model(modelfile, &(run->modelsize));
+        fclose(modelfile);
+        if(run->modelsize == 0)
+        {
+            log_error("tesseroid file %s is empty", run->args.modelfname);
+            free(model);
+            return 1;
+        }
+        if(model == NULL)
+        {
+            log_error("failed to read model from file %s",
+                      run->args.modelfname);
+            return 1;
+        }
+    }
+#ifdef TESSB_MPI
+    model = bcast_tessb_model(model, &(run->modelsize), job->rank);
+#endif
+    log_info("Total of %d tesseroid(s) read", run->modelsize);
+    /* The calculation only needs the columns of the model */
+    job->model = tess_model_from_array(model, run->modelsize);
+    free(model);
+    if(job->model == NULL)
+    {
+        log_error("problem allocating memory for %d tesseroid(s)",
+                  run->modelsize);
         return 1;
     }
+    return 0;
+}
 
-    /* Read the tesseroid model file */
-    log_info("Reading magnetic tesseroid model from file %s", args.modelfname);
-    modelfile = fopen(args.modelfname, "r");
-    if(modelfile == NULL)
+
+/* Make the grid of --grid or open the binary grid on stdin. Returns 1 if
+   there was an error. */
+static int open_tessb_input(TESSB_RUN *run)
+{
+    /* Make the grid before the output starts, so that the output is empty if
+       there is no memory for it */
+    if(run->args.grid)
     {
-        log_error("failed to open model file %s", args.modelfname);
-        log_warning("Terminating due to bad input");
-        log_warning("Try '%s -h' for instructions", progname);
-        if(args.logtofile)
-            fclose(logfile);
-        return 1;
+        if(make_tessb_grid(&(run->grid), run->args.grid_area))
+        {
+            log_error("problem allocating memory for the grid");
+            return 1;
+        }
+        log_info("Generating a grid of %d x %d point(s) at height %g",
+                 run->grid.nlon, run->grid.nlat, run->grid.height);
     }
-    model = read_mag_tess_model(modelfile, &modelsize);
-    fclose(modelfile);
-    if(modelsize == 0)
+
+    /* Computation points can also come as a binary grid on stdin */
+    if(run->job.rank == 0 && !run->args.grid && grid_bin_detect(stdin))
     {
-        log_error("tesseroid file %s is empty", args.modelfname);
-        log_warning("Terminating due to bad input");
-        log_warning("Try '%s -h' for instructions", progname);
-        if(args.logtofile)
-            fclose(logfile);
-        return 1;
+        run->input = grid_bin_open(stdin);
+        if(run->input != NULL && run->input->ncols < 3)
+        {
+            log_error("binary grid on stdin has %d column(s), needs LON LAT ALT",
+                      run->input->ncols);
+            grid_bin_close(run->input);
+            run->input = NULL;
+        }
+        if(run->input != NULL)
+        {
+            run->row = (double *)malloc(run->input->ncols*sizeof(double));
+        }
+        if(run->input == NULL || run->row == NULL)
+        {
+            log_error("failed to read the binary grid of computation points");
+            return 1;
+        }
+        log_info("Reading computation points from a binary grid (%s)",
+                 run->input->data != NULL ? "mapped" : "stream");
     }
-    if(model == NULL)
+    return 0;
+}
+
+
+/* Choose the GLQ orders and ratio for the accuracy asked for, on a sample of
+   the computation points and of the model. Only rank 0 has the points.
+   Returns 1 if there was an error. */
+static int tune_tessb(TESSB_RUN *run)
+{
+    TESSB_ARGS *args = &(run->args);
+    TESSB_JOB *job = &(run->job);
+    double samples[3*MAG_TUNE_POINTS], tuned[5] = {0};
+    int rc;
+
+    /* 0: not tuned, 1: tuned, 2: tuned short of the target, -1: error.
+       Then the orders and the ratio. */
+    if(job->rank == 0)
+    {
+        if(!args->grid && (run->input == NULL || run->input->data == NULL) &&
+           peek_tessb_stream(&(run->peek), run->input))
+        {
+            log_error("problem allocating memory to read the computation points ahead");
+            tuned[0] = -1;
+        }
+        else
+        {
+            run->nsamples = sample_tessb_points(
+                args->grid ? &(run->grid) : NULL, run->input, &(run->peek),
+                samples);
+            log_info("Tuning the GLQ orders for relative error %g on %d point(s)",
+                     args->tune, run->nsamples);
+            if(run->nsamples == 0)
+            {
+                log_warning("no computation points to tune the GLQ orders on");
+            }
+            else
+            {
+                rc = mag_tune(job->model, &(job->calc), samples,
+                              run->nsamples, args->tune, args->max_depth,
+                              &(run->tune));
+                if(rc < 0)
+                {
+                    log_error("problem allocating memory for the tuning");
+                    tuned[0] = -1;
+                }
+                else
+                {
+                    tuned[0] = 1 + rc;
+                }
+            }
+        }
+        if(tuned[0] > 0)
+        {
+            tuned[1] = run->tune.lon_order;
+            tuned[2] = run->tune.lat_order;
+            tuned[3] = run->tune.r_order;
+            tuned[4] = run->tune.ratio;
+        }
+    }
+#ifdef TESSB_MPI
+    MPI_Bcast(tuned, 5, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+#endif
+    if(tuned[0] < 0)
     {
-        log_error("failed to read model from file %s", args.modelfname);
-        log_warning("Terminating due to bad input");
-        log_warning("Try '%s -h' for instructions", progname);
-        if(args.logtofile)
-            fclose(logfile);
         return 1;
     }
-    log_info("Total of %d tesseroid(s) read", modelsize);
+    run->tuned = (int)tuned[0];
+    if(run->tuned > 0)
+    {
+        args->lon_order = (int)tuned[1];
+        args->lat_order = (int)tuned[2];
+        args->r_order = (int)tuned[3];
+        if(args->adaptative)
+        {
+            job->calc.ratio_max = tuned[4];
+        }
+    }
+    if(job->rank == 0 && run->tuned == 2)
+    {
+        log_warning("no GLQ orders up to %d reach relative error %g. Using the most accurate ones.",
+                    MAG_TUNE_MAX_ORDER, args->tune);
+    }
+    if(job->rank == 0 && run->tuned > 0)
+    {
+        log_info("Tuned GLQ orders: %d lon / %d lat / %d r, distance-size ratio %g",
+                 args->lon_order, args->lat_order, args->r_order,
+                 job->calc.ratio_max);
+        log_info("Relative error on the sample: %g with %.3g GLQ nodes per tesseroid-point pair (%.3g for the reference)",
+                 run->tune.error, run->tune.nodes, run->tune.ref_nodes);
+    }
+    return 0;
+}
+
+
+/* Print the header of the output on rank 0 */
+static void print_tessb_header(const TESSB_RUN *run)
+{
+    const TESSB_ARGS *args = &(run->args);
+    const TESSB_JOB *job = &(run->job);
+    const char *progname = run->progname;
 
+    /* A binary grid has no room for the provenance information */
+    if(job->rank > 0 || args->kernel != NULL)
+    {
+        /* The other ranks write nothing, nor does the sensitivity matrix */
+        return;
+    }
+    if(job->binary)
+    {
+        if(grid_bin_write_header(stdout, !strcmp("tessb", progname) ? 6 : 4,
+               args->grid ? (long long)run->grid.nlon*run->grid.nlat :
+               (run->input != NULL && run->input->nrows > 0 ?
+                run->input->nrows : 0)))
+        {
+            log_error("problem writing the binary grid to stdout");
+        }
+        return;
+    }
     /* Print a header on the output with provenance information */
-    if(strcmp(progname + 4, "pot") == 0)
+    if(!strcmp("tessb", progname))
+    {
+        printf("# bx, by, bz components calculated with %s %s:\n", progname,
+               tesseroids_version);
+    }
+    else if(strcmp(progname + 4, "pot") == 0)
     {
         printf("# Potential calculated with %s %s:\n", progname,
                tesseroids_version);
@@ -193,57 +671,535 @@ int run_tessb_main(int argc, char **argv, const char *progname,
         printf("# %s component calculated with %s %s:\n", progname+4, progname,
                tesseroids_version);
     }
-    printf("#   local time: %s", asctime(timeinfo));
-    printf("#   model file: %s (%d tesseroids)\n", args.modelfname, modelsize);
-    printf("#   GLQ order: %d lon / %d lat / %d r\n", args.lon_order,
-           args.lat_order, args.r_order);
+    printf("#   local time: %s", asctime(localtime(&(run->start_time))));
+    printf("#   model file: %s (%d tesseroids)\n", args->modelfname,
+           run->modelsize);
+    printf("#   GLQ order: %d lon / %d lat / %d r\n", args->lon_order,
+           args->lat_order, args->r_order);
     printf("#   Use recursive division of tesseroids: %s\n",
-           args.adaptative ? "True" : "False");
-    printf("#   Distance-size ratio1 for recusive division: %g\n", ratio1);
-		printf("#   Distance-size ratio2 for recusive division: %g\n", ratio2);
-		printf("#   Distance-size ratio3 for recusive division: %g\n", ratio3);
+           args->adaptative ? "True" : "False");
+    printf("#   Distance-size ratio for recursive division: %g\n",
+           job->calc.ratio_max);
+    if(args->tune > 0 && run->tuned > 0)
+    {
+        printf("#   Tuned for relative error %g (%.3g on a sample of %d point(s))\n",
+               args->tune, run->tune.error, run->nsamples);
+    }
+    if(args->truncate > 0 && args->tree_theta <= 0)
+    {
+        printf("#   Tesseroids farther than %g m skipped\n", args->truncate);
+    }
+}
+
+
+/* Build the tree, index, mesh and node table of the model and size the
+   tiles. Whatever does not fit in memory is done without. */
+static void prepare_tessb_model(TESSB_RUN *run,
+    void (*field_triple)(TESSEROID, double, double, double, GLQ, GLQ, GLQ,
+                         double*))
+{
+    TESSB_ARGS *args = &(run->args);
+    TESSB_JOB *job = &(run->job);
+    int nodes_size;
+
+    /* Build the tree before the node table, because it reorders the model */
+    job->tree = NULL;
+    if(args->tree_theta > 0)
+    {
+        job->tree = mag_tree_new(job->model, args->tree_theta);
+        if(job->tree == NULL)
+        {
+            log_warning("problem allocating memory for the tree. Summing all tesseroids directly.");
+        }
+        else
+        {
+            log_info("Tree of %d node(s) and %d level(s) with opening angle %g",
+                     job->tree->nnodes, job->tree->depth, args->tree_theta);
+        }
+    }
+    /* The index too reorders the model. It does nothing for the tree. */
+    job->index = NULL;
+    if((args->index || args->truncate > 0) && job->tree != NULL)
+    {
+        log_warning("the spatial index is not used with --tree");
+    }
+    else if(args->index || args->truncate > 0)
+    {
+        job->index = mag_index_new(job->model, args->truncate);
+        if(job->index == NULL)
+        {
+            log_warning("problem allocating memory for the spatial index. Visiting all tesseroids.");
+        }
+        else if(args->truncate > 0)
+        {
+            log_info("Spatial index of %d bucket(s) on a %d by %d grid, truncated at %g m",
+                     job->index->nbuckets, job->index->nlon,
+                     job->index->nlat, args->truncate);
+        }
+        else
+        {
+            log_info("Spatial index of %d bucket(s) on a %d by %d grid",
+                     job->index->nbuckets, job->index->nlon,
+                     job->index->nlat);
+        }
+    }
+
+    /* Rows of regular grids over a regular mesh can be calculated by
+       convolution in longitude */
+    job->mesh = NULL;
+    if(args->fft)
+    {
+        job->mesh = mag_fft_mesh_new(job->model);
+        if(job->mesh == NULL)
+        {
+            log_warning("Calculating all points directly.");
+        }
+        else
+        {
+            log_info("Convolution in longitude: %d group(s) of up to %d cell(s) of %g degrees",
+                     job->mesh->ngroups, job->mesh->max_cells,
+                     job->mesh->dlon);
+        }
+    }
+
+    /* The non-adaptative calculation can reuse the nodes of the tesseroids
+       for every point. Precompute as many as fit in the memory given. The
+       kernels that use them are scalar, so they are not worth it against the
+       SIMD kernels. */
+    job->calc.nodes = NULL;
+    job->calc.field_nodes = tess_fixed_nodes(
+        job->calc.vector ? &tess_ggt : field_triple, args->lon_order,
+        args->lat_order, args->r_order);
+    if(!args->adaptative && args->nodes_mem > 0 &&
+       (run->isa == TESS_ISA_SCALAR ||
+        (args->isa < 0 &&
+         tess_fixed_supported(args->lon_order, args->lat_order,
+                              args->r_order))))
+    {
+        nodes_size = (int)(args->nodes_mem*1024*1024/
+                           tess_nodes_bytes(1, args->lon_order,
+                                            args->lat_order, args->r_order));
+        if(nodes_size > run->modelsize)
+            nodes_size = run->modelsize;
+        if(nodes_size > 0)
+        {
+            job->calc.nodes = tess_nodes_new(job->model, nodes_size,
+                args->lon_order, args->lat_order, args->r_order);
+            if(job->calc.nodes == NULL)
+            {
+                log_warning("problem allocating memory for the quadrature nodes. Scaling them for every point.");
+            }
+        }
+    }
+    log_info("Precomputed quadrature nodes of %d of %d tesseroid(s) (%.3g MB)",
+             job->calc.nodes == NULL ? 0 : job->calc.nodes->size,
+             run->modelsize, job->calc.nodes == NULL ? 0 :
+             tess_nodes_bytes(job->calc.nodes->size, args->lon_order,
+                              args->lat_order, args->r_order)/(1024*1024));
+    if(args->tile_tess == 0)
+    {
+        args->tile_tess = tessb_tile_tess(args, &(job->calc));
+    }
+    job->tile_points = args->tile_points;
+    job->tile_tess = args->tile_tess;
+    log_info("Tile size: %d point(s) / %d tesseroid(s) (L1 data cache %ld kB, L2 %ld kB)",
+             args->tile_points, args->tile_tess,
+             tessb_cache_size(1, TESSB_L1_DEFAULT)/1024,
+             tessb_cache_size(2, TESSB_L2_DEFAULT)/1024);
+}
+
+
+/* Parse the options, read the model and make everything the calculation
+   needs, up to the header of the output. Returns 0 if the run can go on, 1
+   if there was an error and 2 if the run is over (-h or --version). */
+static int setup_tessb(TESSB_RUN *run, int argc, char **argv,
+    const char *progname, double ratio1, double ratio2, double ratio3)
+{
+    TESSB_ARGS *args = &(run->args);
+    TESSB_JOB *job = &(run->job);
+    int rc, i;
+
+		void (*field_triple)(TESSEROID, double, double, double, GLQ, GLQ, GLQ, double*) = NULL;
+
+
+    memset(run, 0, sizeof(TESSB_RUN));
+    run->progname = progname;
+    log_init(LOG_INFO);
+    run->run_start = tessb_clock();
+    run->run_cpu = tessb_clock_of(CLOCK_PROCESS_CPUTIME_ID);
+
+    job->rank = 0;
+    job->nranks = 1;
+#ifdef TESSB_MPI
+    MPI_Comm_rank(MPI_COMM_WORLD, &(job->rank));
+    MPI_Comm_size(MPI_COMM_WORLD, &(job->nranks));
+#endif
+
+    rc = parse_tessb_args(argc, argv, progname, args, &print_tessb_help);
+    if(rc != 0)
+    {
+        return rc;
+    }
+
+    /* Only rank 0 reads the points, writes the results and tells what it
+       does. The other ranks get the points from it. */
+    if(job->rank > 0)
+    {
+        args->verbose = 0;
+        args->logtofile = 0;
+        args->grid = 0;
+        args->checkpoint = NULL;
+        args->resume = 0;
+        args->statsfname = NULL;
+    }
+
+    /* Set the appropriate logging level and log to file if necessary */
+    if(!args->verbose)
+    {
+        log_init(LOG_WARNING);
+    }
+    if(args->logtofile)
+    {
+        run->logfile = fopen(args->logfname, "w");
+        if(run->logfile == NULL)
+        {
+            log_error("unable to create log file %s", args->logfname);
+            return 1;
+        }
+        log_tofile(run->logfile, LOG_DEBUG);
+    }
+
+    /* Check if a custom distance-size ratio is given */
+    if(args->ratio1 != 0)
+    {
+        ratio1 = args->ratio1;
+    }
+	  if(args->ratio2 != 0)
+    {
+        ratio2 = args->ratio2;
+    }
+	  if(args->ratio3 != 0)
+    {
+        ratio3 = args->ratio3;
+    }
+    /* All components share the division of the strictest ratio */
+    job->calc.ratio_max = ratio1;
+    if(ratio2 > job->calc.ratio_max)
+        job->calc.ratio_max = ratio2;
+    if(ratio3 > job->calc.ratio_max)
+        job->calc.ratio_max = ratio3;
+
+    /* Print standard verbose */
+    log_info("%s (Tesseroids project) %s", progname, tesseroids_version);
+    time(&(run->start_time));
+    log_info("(local time) %s", asctime(localtime(&(run->start_time))));
+    log_info("Use recursive division of tesseroids: %s",
+             args->adaptative ? "True" : "False");
+    log_info("Distance-size ratio for recursive division: %g",
+             job->calc.ratio_max);
+    if(args->adaptative)
+    {
+        log_info("Maximum depth of the recursive division: %d",
+                 args->max_depth);
+    }
+    log_info("Number of threads: %d", args->threads);
+    if(job->nranks > 1)
+    {
+        log_info("Number of MPI ranks: %d", job->nranks);
+    }
+    /* Without --tile, fit the tiles to the caches. The tesseroids wait for
+       the node table and the far field to be set. */
+    if(args->tile_points == 0)
+    {
+        args->tile_points = tessb_tile_points(args->threads);
+    }
+
+    /* Use the best instruction set for the kernels unless told otherwise */
+    run->isa = tess_isa_detect();
+    if(args->isa >= 0)
+    {
+        if(args->isa > run->isa)
+        {
+            log_error("instruction set %s is not supported by this processor",
+                      tess_isa_name(args->isa));
+            return 1;
+        }
+        run->isa = args->isa;
+    }
+
+    /* Make the necessary GLQ structures. Every thread needs its own because
+       glq_set_limits changes them in place. */
+    log_info("Using GLQ orders: %d lon / %d lat / %d r", args->lon_order,
+             args->lat_order, args->r_order);
+    run->workers = (TESSB_WORKER *)calloc(args->threads, sizeof(TESSB_WORKER));
+    /* One more thread writes the results and another talks to the other
+       MPI ranks */
+    run->threads = (pthread_t *)malloc((args->threads + 2)*sizeof(pthread_t));
+    job->out = text_out_new(stdout, TEXT_OUT_SIZE);
+    if(run->workers == NULL || run->threads == NULL || job->out == NULL ||
+       init_tessb_pipe(job))
+    {
+        log_error("problem allocating memory for %d thread(s)", args->threads);
+        return 1;
+    }
+
+    if(read_tessb_model(run) || open_tessb_input(run))
+    {
+        return 1;
+    }
+
+    job->binary = args->binary;
+    job->format = args->compat_format ? TEXT_FORMAT_COMPAT :
+                  TEXT_FORMAT_SHORTEST;
+
+    /* Checkpoints tell how far the output got. A resumed run skips the
+       lines of the input that are done. */
+    job->checkpoint = args->checkpoint;
+    job->checkpoint_every = args->checkpoint_every;
+    job->checkpoint_time = tessb_clock();
+    job->progname = progname;
+    job->modelfname = args->modelfname;
+    job->input = args->grid ? "grid" :
+                 (run->input != NULL ? "binary" : "text");
+    tessb_settings(args, run->isa, job->settings);
+    if(args->resume && read_tessb_checkpoint(job, &(run->ckpt)))
+    {
+        return 1;
+    }
+    if(run->ckpt.lines > 0)
+    {
+        log_info("Resuming after %lld line(s) of input and %lld point(s) from checkpoint %s",
+                 run->ckpt.lines, run->ckpt.points, job->checkpoint);
+    }
+    job->points = (int)run->ckpt.points;
+    job->committed = run->ckpt.lines;
 
 		/////////////ELDAR BAYKIEV//////////////
 		/* Assign pointers to functions that calculate gravity gradient tensor components */
 		if (!strcmp("tessbx", progname))
 		{
-				field1 = &tess_gxx;
-				field2 = &tess_gxy;
-				field3 = &tess_gxz;
-
+				job->calc.component = 0;
 				field_triple = &tess_gxx_gxy_gxz;
+				job->calc.far_comps[0] = 0;
+				job->calc.far_comps[1] = 1;
+				job->calc.far_comps[2] = 2;
 		}
 
 		if (!strcmp("tessby", progname))
 		{
-				field1 = &tess_gxy;
-				field2 = &tess_gyy;
-				field3 = &tess_gyz;
-
+				job->calc.component = 1;
 				field_triple = &tess_gxy_gyy_gyz;
+				job->calc.far_comps[0] = 1;
+				job->calc.far_comps[1] = 3;
+				job->calc.far_comps[2] = 4;
 		}
 
 		if (!strcmp("tessbz", progname))
 		{
-				field1 = &tess_gxz;
-				field2 = &tess_gyz;
-				field3 = &tess_gzz;
-
+				job->calc.component = 2;
 				field_triple = &tess_gxz_gyz_gzz;
+				job->calc.far_comps[0] = 2;
+				job->calc.far_comps[1] = 4;
+				job->calc.far_comps[2] = 5;
 		}
 		/////////////ELDAR BAYKIEV//////////////
 
-	  /* Read each computation point from stdin and calculate */
-	  log_info("Calculating (this may take a while)...");
-	  tstart = clock();
+    /* tessb calculates all three components with the full tensor */
+    job->calc.vector = !strcmp("tessb", progname);
+    if(job->calc.vector)
+    {
+        field_triple = NULL;
+    }
+
+    job->calc.adaptative = args->adaptative;
+    /* The tesseroids are calculated a block at a time, one in each lane of
+       the SIMD registers */
+    job->calc.field_block = tess_simd_block_kernel(run->isa);
+    /* Take the tesseroids as point masses where the error bound allows */
+    job->calc.far_ratio = 0;
+    if(args->far_error > 0)
+    {
+        job->calc.far_ratio = sqrt(MAG_FAR_ERROR/args->far_error);
+        log_info("Far field: point masses beyond distance-size ratio %g (relative error < %g)",
+                 job->calc.far_ratio, args->far_error);
+    }
+
+    if(args->tune > 0 && tune_tessb(run))
+    {
+        return 1;
+    }
+
+    /* The GLQ structures of the threads only have their orders now */
+    for(i = 0; i < args->threads; i++)
+    {
+        if(init_tessb_worker(&(run->workers[i]), job, args) != 0)
+        {
+            log_error("failed to create required GLQ structures");
+            return 1;
+        }
+    }
+
+    print_tessb_header(run);
+    /* The results of a resumed run start with those of the checkpoint */
+    if(job->checkpoint != NULL)
+    {
+        job->out->copy = open_tessb_copy(job, &(run->ckpt));
+        if(job->out->copy == NULL)
+        {
+            return 1;
+        }
+        job->out->count = run->ckpt.bytes;
+    }
+
+    log_info("Instruction set of the kernels: %s", tess_isa_name(run->isa));
+    prepare_tessb_model(run, field_triple);
+    return 0;
+}
+
+
+/* Calculate the sensitivity matrix of --kernel. It takes all points at once
+   instead of streaming them through the pipeline. Returns 1 if there was an
+   error. */
+static int calc_tessb_matrix(TESSB_RUN *run)
+{
+    TESSB_ARGS *args = &(run->args);
+    TESSB_JOB *job = &(run->job);
+    TESSB_REPORT *report = &(run->report);
+    long *stats = report->stats;
+    double *points = NULL, pipe_start;
+    long long npoints = 0;
+    int i, error_exit, bad_input = 0;
+
+    log_info("Calculating the sensitivity matrix (this may take a while)...");
+    if(job->rank == 0)
+    {
+        npoints = read_tessb_points(args->grid ? &(run->grid) : NULL,
+                                    run->input, &(run->peek), run->row,
+                                    &points, &bad_input);
+    }
+    pipe_start = tessb_clock();
+    error_exit = run_tessb_kernel(job, run->workers, run->threads,
+                                  args->threads, args->kernel, points,
+                                  npoints);
+    report->compute.wall = tessb_clock() - pipe_start;
+    free(points);
+    stats[TESSB_STAT_DEPTH_HITS] = 0;
+    for(i = 0; i < args->threads; i++)
+    {
+        stats[TESSB_STAT_DEPTH_HITS] +=
+            run->workers[i].stats.adapt.depth_hits;
+    }
+#ifdef TESSB_MPI
+    MPI_Reduce(job->rank == 0 ? MPI_IN_PLACE : stats, stats, 1, MPI_LONG,
+               MPI_SUM, 0, MPI_COMM_WORLD);
+#endif
+    if(bad_input)
+    {
+        log_warning("Encountered %d bad computation points which were skipped",
+                    bad_input);
+    }
+    if(error_exit)
+    {
+        log_warning("Terminating due to error in input");
+        log_warning("Try '%s -h' for instructions", run->progname);
+    }
+    else
+    {
+        log_info("Sensitivity matrix of %lld point(s) calculated in %.5g seconds",
+                 npoints, report->compute.wall);
+    }
+    if(job->rank == 0 && stats[TESSB_STAT_DEPTH_HITS] > 0)
+    {
+        log_warning("Maximum depth of the recursive division reached %ld time(s). Increase it with --max-depth if the results are not accurate enough.",
+                    stats[TESSB_STAT_DEPTH_HITS]);
+    }
+    return error_exit;
+}
 
-		///////////////
-		lon_prev = 0;
-		lat_prev = 0;
 
-    for(line = 1; !feof(stdin); line++)
+/* Read the computation points of the grid, of the binary grid input or of
+   stdin into the pipeline. Lines done before the checkpoint are skipped.
+   Returns 1 if the input stopped with an error. */
+static int read_tessb_input(TESSB_RUN *run, int *bad_input)
+{
+    TESSB_JOB *job = &(run->job);
+    const TESSB_GRID *grid = &(run->grid);
+    TESSB_PEEK *peek = &(run->peek);
+    TESSB_POINT *point, next;
+    pthread_t flusher;
+    double coords[3], *row = run->row;
+    long long lines, skip = run->ckpt.lines;
+    char buff[TESSB_LINE_SIZE];
+    int i, j, line, flushing, error_exit = 0;
+
+    /* The points of a generated grid go in blocks of whole rows, unless a
+       row is longer than a block, so that the rows can be calculated by
+       convolution */
+    for(j = 0; run->args.grid && j < grid->nlat; j++)
+    {
+        if(grid->nlon <= TESSB_BLOCK_SIZE &&
+           job->fill->npoints + grid->nlon > TESSB_BLOCK_SIZE)
+        {
+            push_tessb_block(job);
+        }
+        for(i = 0; i < grid->nlon; i++)
+        {
+            if(job->lines++ < skip)
+            {
+                continue;
+            }
+            point = &(job->fill->points[job->fill->npoints]);
+            point->type = TESSB_LINE_POINT;
+            point->line = NULL;
+            point->row = 0;
+            point->lon = grid->lon[i];
+            point->lat = grid->lat[j];
+            point->height = grid->height;
+            point->trig_lon = &(grid->trig_lon[2*i]);
+            point->trig_lat = &(grid->trig_lat[2*j]);
+            point->text_lon = &(grid->text_lon[i*TESSB_GRID_TEXT]);
+            point->text_lat = &(grid->text_lat[j*2*TESSB_GRID_TEXT]);
+            job->fill->npoints++;
+            if(job->fill->npoints == TESSB_BLOCK_SIZE)
+            {
+                push_tessb_block(job);
+            }
+        }
+    }
+    /* Blocks of streams are also handed over when they take too long to
+       fill, by a thread that does not wait for the input. The lines are
+       counted here and only given to the job with the points, so that a
+       block the flusher hands over counts no line after its last point. */
+    lines = job->lines;
+    flushing = job->rank == 0 && !run->args.grid;
+    if(flushing && pthread_create(&flusher, NULL, run_tessb_flusher, job))
+    {
+        log_warning("failed to start the thread that hands over slow blocks. Blocks will wait to be full.");
+        flushing = 0;
+    }
+    while(run->input != NULL && read_tessb_row(peek, run->input, row))
+    {
+        if(lines++ < skip)
+        {
+            continue;
+        }
+        point = &next;
+        point->type = TESSB_LINE_POINT;
+        point->line = NULL;
+        point->row = 0;
+        point->lon = row[0];
+        point->lat = row[1];
+        point->height = row[2];
+        point->trig_lon = NULL;
+        point->trig_lat = NULL;
+        point->text_lon = NULL;
+        point->text_lat = NULL;
+        add_tessb_point(job, point, lines);
+    }
+    for(line = 1; job->rank == 0 && !run->args.grid && run->input == NULL &&
+        (peek->next < peek->n || !feof(stdin)); line++)
     {
-        if(fgets(buff, 10000, stdin) == NULL)
+        if(read_tessb_line(peek, buff) == NULL)
         {
             if(ferror(stdin))
             {
@@ -252,111 +1208,201 @@ int run_tessb_main(int argc, char **argv, const char *progname,
                 break;
             }
         }
+        else if(lines++ < skip)
+        {
+            /* Done before the checkpoint */
+        }
         else
         {
+            point = &next;
             /* Check for comments and blank lines */
             if(buff[0] == '#' || buff[0] == '\r' || buff[0] == '\n')
             {
-                printf("%s", buff);
-                continue;
+                point->type = TESSB_LINE_COMMENT;
             }
-            if(sscanf(buff, "%lf %lf %lf", &lon, &lat, &height) != 3)
+            else if(text_parse_doubles(buff, 3, coords) != 3)
             {
                 log_warning("bad/invalid computation point at line %d", line);
                 log_warning("skipping this line and continuing");
-                bad_input++;
+                (*bad_input)++;
                 continue;
             }
-            /* Need to remove \n and \r from end of buff first to print the
-               result in the end */
-            strstrip(buff);
-
+            else
+            {
+                point->type = TESSB_LINE_POINT;
+                point->lon = coords[0];
+                point->lat = coords[1];
+                point->height = coords[2];
+                /* Need to remove \n and \r from end of buff first to print the
+                   result in the end */
+                strstrip(buff);
+            }
+            point->row = 0;
+            point->trig_lon = NULL;
+            point->trig_lat = NULL;
+            point->text_lon = NULL;
+            point->text_lat = NULL;
+            point->line = strdup(buff);
+            if(point->line == NULL)
+            {
+                log_error("problem allocating memory for line %d", line);
+                error_exit = 1;
+                break;
+            }
+            add_tessb_point(job, point, lines);
+        }
+    }
+    pthread_mutex_lock(&(job->fill_lock));
+    job->lines = lines;
+    pthread_mutex_unlock(&(job->fill_lock));
+    if(flushing)
+    {
+        pthread_mutex_lock(&(job->fill_lock));
+        job->read_done = 1;
+        pthread_cond_signal(&(job->fill_cond));
+        pthread_mutex_unlock(&(job->fill_lock));
+        pthread_join(flusher, NULL);
+    }
+    if(job->lines < skip)
+    {
+        log_warning("the input has %lld line(s), fewer than the %lld of checkpoint %s",
+                    job->lines, skip, job->checkpoint);
+    }
+    return error_exit;
+}
 
 
-			/////////////ELDAR BAYKIEV//////////////
-		        res = 0;
-            if(args.adaptative)
-            {
-								for(n_tesseroid = 0; n_tesseroid < modelsize; n_tesseroid++)
-								{
-										gtt_v[0] = 0;
-										gtt_v[1] = 0;
-										gtt_v[2] = 0;
-										double B_to_H = model[n_tesseroid].suscept/(M_0);//IMPORTANT
-										double M_vect[3] = {model[n_tesseroid].Bx * B_to_H, model[n_tesseroid].By * B_to_H, model[n_tesseroid].Bz * B_to_H};
-										double M_vect_p[3] = {0, 0, 0};
+/* Log the statistics of all threads and ranks and write the report of
+   --stats */
+static void report_tessb(TESSB_RUN *run)
+{
+    TESSB_ARGS *args = &(run->args);
+    TESSB_JOB *job = &(run->job);
+    TESSB_REPORT *report = &(run->report);
+    long *stats = report->stats;
+    struct rusage usage;
+    double sums[2];
 
-										conv_vect_cblas(M_vect, (model[n_tesseroid].w + model[n_tesseroid].e)*0.5, (model[n_tesseroid].s + model[n_tesseroid].n)*0.5, lon, lat, M_vect_p);
+    /* Statistics of all threads, and of all ranks on rank 0 */
+    sum_tessb_stats(run->workers, args->threads, stats);
+    report->total.wall = tessb_clock() - run->run_start;
+    sums[0] = tessb_clock_of(CLOCK_PROCESS_CPUTIME_ID) - run->run_cpu;
+    sums[1] = report->compute.cpu;
+    getrusage(RUSAGE_SELF, &usage);
+    /* ru_maxrss is in kB on Linux */
+    report->peak_mb = usage.ru_maxrss/1024.0;
+#ifdef TESSB_MPI
+    MPI_Reduce(job->rank == 0 ? MPI_IN_PLACE : stats, stats, TESSB_NSTATS,
+               MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(job->rank == 0 ? MPI_IN_PLACE : sums, sums, 2, MPI_DOUBLE,
+               MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(job->rank == 0 ? MPI_IN_PLACE : &(report->peak_mb),
+               &(report->peak_mb), 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+#endif
+    report->total.cpu = sums[0];
+    report->compute.cpu = sums[1];
+    if(job->rank == 0 && args->adaptative)
+    {
+        if(stats[TESSB_STAT_DEPTH_HITS] > 0)
+        {
+            log_warning("Maximum depth of the recursive division reached %ld time(s). Increase it with --max-depth if the results are not accurate enough.",
+                        stats[TESSB_STAT_DEPTH_HITS]);
+        }
+        else
+        {
+            log_info("Maximum depth of the recursive division never reached");
+        }
+    }
+    if(job->calc.far_ratio > 0)
+    {
+        log_info("Far field: %ld of %ld tesseroid-point evaluation(s) used a point mass",
+                 stats[TESSB_STAT_FAR], stats[TESSB_STAT_EVALS]);
+    }
+    if(job->tree != NULL)
+    {
+        log_info("Tree: %ld node(s) calculated from their moments and %ld tesseroid-point evaluation(s) summed directly",
+                 stats[TESSB_STAT_TREE], stats[TESSB_STAT_EVALS]);
+    }
+    if(job->index != NULL)
+    {
+        log_info("Spatial index: %ld tesseroid-point pair(s) truncated and %ld evaluation(s) without checks",
+                 stats[TESSB_STAT_TRUNCATED], stats[TESSB_STAT_MID]);
+    }
+    if(job->mesh != NULL)
+    {
+        log_info("Convolution in longitude: %ld of %d point(s) with %ld kernel(s)",
+                 stats[TESSB_STAT_FFT_POINTS], job->points,
+                 stats[TESSB_STAT_FFT_KERNELS]);
+    }
+    if(args->statsfname != NULL &&
+       write_tessb_stats(args->statsfname, run->progname, args, job,
+                         run->modelsize, report))
+    {
+        log_error("problem writing the statistics to %s", args->statsfname);
+    }
+}
 
-										ggt_1 = calc_tess_model_adapt(&model[n_tesseroid], 1, lon, lat, height + MEAN_EARTH_RADIUS, glq_lon, glq_lat, glq_r, field1, ratio1);
-										ggt_2 = calc_tess_model_adapt(&model[n_tesseroid], 1, lon, lat, height + MEAN_EARTH_RADIUS, glq_lon, glq_lat, glq_r, field2, ratio2);
-										ggt_3 = calc_tess_model_adapt(&model[n_tesseroid], 1, lon, lat, height + MEAN_EARTH_RADIUS, glq_lon, glq_lat, glq_r, field3, ratio3);
 
-										res = res + M_0*EOTVOS2SI*(ggt_1 * M_vect_p[0]  + ggt_2 * M_vect_p[1] + ggt_3 * M_vect_p[2]) /(G*model[n_tesseroid].density*4*PI);
+/* Stream the computation points through the pipeline: this thread reads
+   them while the others calculate and print them */
+static void calc_tessb_stream(TESSB_RUN *run)
+{
+    TESSB_JOB *job = &(run->job);
+    TESSB_REPORT *report = &(run->report);
+    double pipe_start, read_cpu;
+    int i, started, error_exit = 0, bad_input = 0;
 
-										//printf("res %g\n", res);
-								}
+	  /* Read blocks of computation points from stdin and calculate */
+	  log_info("Calculating (this may take a while)...");
+    report->load.wall = tessb_clock() - run->run_start;
+    report->load.cpu = tessb_clock_of(CLOCK_PROCESS_CPUTIME_ID) - run->run_cpu;
+    pipe_start = tessb_clock();
+    read_cpu = tessb_clock_of(CLOCK_THREAD_CPUTIME_ID);
 
-						/////////////////////////////////////////////////////////////////////////////////////////////////////////
-            }
-            else
-            {
-								//precalculate trigonometrical functions
-
-								if(lon == lon_prev)
-								{
-										cos_b2 = cos_b2_prev;
-										sin_b2 = sin_b2_prev;
-								}
-								else
-								{
-										cos_b2 = cos(DEG2RAD*lon);
-										sin_b2 = sin(DEG2RAD*lon);
-								}
-
-								if(lat == lat_prev)
-								{
-										cos_a2 = cos_a2_prev;
-										sin_a2 = sin_a2_prev;
-								}
-								else
-								{
-										cos_a2 = cos(PI/2.0-DEG2RAD*lat);
-										sin_a2 = sin(PI/2.0-DEG2RAD*lat);
-								}
-				/////////////////////////////////////////////////////////////////////////////////////////////////////////
-								for(n_tesseroid = 0; n_tesseroid < modelsize; n_tesseroid++)
-								{
-										gtt_v[0] = 0;
-										gtt_v[1] = 0;
-										gtt_v[2] = 0;
-										//ELDAR: TODO: PRECALCULATE SIC COSINE TABLES
-										double B_to_H = model[n_tesseroid].suscept/(M_0);//IMPORTANT
-										double M_vect[3] = {model[n_tesseroid].Bx * B_to_H, model[n_tesseroid].By * B_to_H, model[n_tesseroid].Bz * B_to_H};
-										double M_vect_p[3] = {0, 0, 0};
-
-										//conv_vect_cblas(M_vect, (model[n_tesseroid].w + model[n_tesseroid].e)*0.5, (model[n_tesseroid].s + model[n_tesseroid].n)*0.5, lon, lat, M_vect_p);
-									  conv_vect_cblas_precalc(M_vect, model[n_tesseroid].cos_a1, model[n_tesseroid].sin_a1, model[n_tesseroid].cos_b1, model[n_tesseroid].sin_b1, cos_a2, sin_a2, cos_b2, sin_b2, M_vect_p);
-
-										calc_tess_model_triple(&model[n_tesseroid], 1, lon, lat, height + MEAN_EARTH_RADIUS, glq_lon, glq_lat, glq_r, field_triple, gtt_v);
-
-										res = res + M_0*EOTVOS2SI*(gtt_v[0] * M_vect_p[0]  + gtt_v[1] * M_vect_p[1] + gtt_v[2] * M_vect_p[2]) /(G*model[n_tesseroid].density*4*PI);
-
-								}
-
-								lon_prev = lon;
-								lat_prev = lat;
-
-								cos_a2_prev = cos_a2;
-								sin_a2_prev = sin_a2;
-
-								cos_b2_prev = cos_b2;
-								sin_b2_prev = sin_b2;
-				/////////////////////////////////////////////////////////////////////////////////////////////////////////
-            }
-            printf("%s %.15g\n", buff, res);
-            points++;
+    log_info("Pipeline of %d block(s) of %d line(s): reader, %d compute thread(s) and writer",
+             job->nblocks, TESSB_BLOCK_SIZE, run->args.threads);
+    if(start_tessb_pipe(job, run->workers, run->threads, run->args.threads,
+                        &started))
+    {
+#ifdef TESSB_MPI
+        /* The other ranks would wait for rank 0 forever */
+        if(job->nranks > 1)
+        {
+            MPI_Abort(MPI_COMM_WORLD, 1);
         }
+#endif
+        error_exit = 1;
+    }
+#ifdef TESSB_MPI
+    if(job->rank > 0 && !error_exit)
+    {
+        serve_tessb_mpi(job);
+    }
+#endif
+    if(!error_exit)
+    {
+        error_exit = read_tessb_input(run, &bad_input);
+    }
+    report->read.wall = tessb_clock() - pipe_start - job->read_wait;
+    report->read.cpu = tessb_clock_of(CLOCK_THREAD_CPUTIME_ID) - read_cpu;
+    /* Calculate what is left, even if the input stopped with an error */
+    stop_tessb_pipe(job, run->threads, started, error_exit);
+    report->compute.wall = tessb_clock() - pipe_start;
+    report->output.cpu = job->write_cpu;
+    report->output.wall = job->rank == 0 ?
+                          report->compute.wall - job->write_wait : 0;
+    report->points = job->points - (long)run->ckpt.points;
+    report->compute.cpu = 0;
+    for(i = 0; i < run->args.threads; i++)
+    {
+        report->compute.cpu += run->workers[i].cpu;
+    }
+    /* The number of points read from stdin is only known now. Pipes keep
+       the 0 of the header. */
+    if(job->rank == 0 && job->binary && !run->args.grid)
+    {
+        text_out_flush(job->out);
+        grid_bin_set_rows(stdout, job->points);
     }
     if(bad_input)
     {
@@ -366,20 +1412,73 @@ int run_tessb_main(int argc, char **argv, const char *progname,
     if(error_exit)
     {
         log_warning("Terminating due to error in input");
-        log_warning("Try '%s -h' for instructions", progname);
+        log_warning("Try '%s -h' for instructions", run->progname);
     }
     else
     {
-        log_info("Calculated on %d points in %.5g seconds", points,
-                 (double)(clock() - tstart)/CLOCKS_PER_SEC);
+        log_info("Calculated on %ld points in %.5g seconds (%.5g seconds of CPU in the compute threads)",
+                 report->points, report->compute.wall, report->compute.cpu);
     }
-    /* Clean up */
-    free(model);
-    glq_free(glq_lon);
-    glq_free(glq_lat);
-    glq_free(glq_r);
-    log_info("Done");
-    if(args.logtofile)
-        fclose(logfile);
-    return 0;
+    report_tessb(run);
+}
+
+
+/* Run a generic tessh* program in one process or MPI rank */
+static int run_tessb(int argc, char **argv, const char *progname,
+    double (*field)(TESSEROID, double, double, double, GLQ, GLQ, GLQ),
+    double ratio1, double ratio2, double ratio3)
+{
+    TESSB_RUN run;
+    int rc, done = 0;
+
+    rc = setup_tessb(&run, argc, argv, progname, ratio1, ratio2, ratio3);
+    if(rc == 1)
+    {
+        log_warning("Terminating due to bad input");
+        log_warning("Try '%s -h' for instructions", progname);
+    }
+    else if(rc == 0)
+    {
+        done = 1;
+        if(run.args.kernel != NULL)
+        {
+            rc = calc_tessb_matrix(&run);
+        }
+        else
+        {
+            calc_tessb_stream(&run);
+        }
+    }
+    free_tessb_run(&run, done);
+    return rc == 2 ? 0 : rc;
+}
+
+
+/* Run the main for a generic tessh* program. Built with TESSB_MPI, every
+   rank runs it and rank 0 shares the points with the others. */
+int run_tessb_main(int argc, char **argv, const char *progname,
+    double (*field)(TESSEROID, double, double, double, GLQ, GLQ, GLQ),
+    double ratio1, double ratio2, double ratio3)
+{
+#ifdef TESSB_MPI
+    int provided, rc;
+
+    /* Only one thread of a rank calls MPI at a time */
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_SERIALIZED, &provided);
+    if(provided < MPI_THREAD_SERIALIZED)
+    {
+        log_error("the MPI library does not support calls from several threads");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    rc = run_tessb(argc, argv, progname, field, ratio1, ratio2, ratio3);
+    /* A rank that stops early leaves the others waiting for it */
+    if(rc != 0)
+    {
+        MPI_Abort(MPI_COMM_WORLD, rc);
+    }
+    MPI_Finalize();
+    return rc;
+#else
+    return run_tessb(argc, argv, progname, field, ratio1, ratio2, ratio3);
+#endif
 }
@@ -0,0 +1,300 @@
+/*
+Distribution of the computation points of the tessb* programs over MPI
+ranks.
+*/
+
+#ifdef TESSB_MPI
+
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <mpi.h>
+#include "logger.h"
+#include "geometry.h"
+#include "tessb_pipe.h"
+#include "tessb_mpi.h"
+
+
+/* Make the slots of the blocks at the other ranks. Returns 1 if there was
+   an error with allocation. */
+int init_tessb_slots(TESSB_JOB *job)
+{
+    int i;
+
+    job->nslots = 0;
+    if(job->rank == 0)
+    {
+        job->nslots = TESSB_MPI_INFLIGHT*(job->nranks - 1);
+    }
+    job->slot_blocks = (TESSB_BLOCK **)calloc(job->nslots + 1,
+                                              sizeof(TESSB_BLOCK *));
+    job->slot_posted = (int *)calloc(job->nslots + 1, sizeof(int));
+    job->slot_send = (double *)malloc((job->nslots + 1)*4*TESSB_BLOCK_SIZE*
+                                      sizeof(double));
+    job->slot_recv = (double *)malloc((job->nslots + 1)*3*TESSB_BLOCK_SIZE*
+                                      sizeof(double));
+    job->slot_reqs = (MPI_Request *)malloc((2*job->nslots + 1)*
+                                           sizeof(MPI_Request));
+    if(job->slot_blocks == NULL || job->slot_posted == NULL ||
+       job->slot_send == NULL || job->slot_recv == NULL ||
+       job->slot_reqs == NULL)
+    {
+        return 1;
+    }
+    for(i = 0; i < 2*job->nslots; i++)
+    {
+        job->slot_reqs[i] = MPI_REQUEST_NULL;
+    }
+    return 0;
+}
+
+
+/* Free the slots of the blocks at the other ranks */
+void free_tessb_slots(TESSB_JOB *job)
+{
+    free(job->slot_blocks);
+    free(job->slot_posted);
+    free(job->slot_send);
+    free(job->slot_recv);
+    free(job->slot_reqs);
+}
+
+
+/* Take the first block that no thread has started, to send it to another
+   rank. Needs the lock. Returns NULL if there is none. */
+static TESSB_BLOCK * claim_tessb_block(TESSB_JOB *job)
+{
+    TESSB_BLOCK *block;
+    long i;
+
+    for(i = job->computing; i < job->filled; i++)
+    {
+        block = &(job->blocks[i % job->nblocks]);
+        if(block->busy == 0 && block->next == 0 && block->next_row == 0)
+        {
+            /* The threads see it as taken */
+            block->next = block->npoints;
+            block->next_row = block->nrows;
+            block->busy = 1;
+            return block;
+        }
+    }
+    return NULL;
+}
+
+
+/* Send the lines of the block of a slot to its rank and start receiving the
+   results */
+static void post_tessb_slot(TESSB_JOB *job, int s)
+{
+    TESSB_BLOCK *block = job->slot_blocks[s];
+    TESSB_POINT *point;
+    double *send = &(job->slot_send[s*4*TESSB_BLOCK_SIZE]);
+    int i, rank = 1 + s/TESSB_MPI_INFLIGHT;
+
+    for(i = 0; i < block->npoints; i++)
+    {
+        point = &(block->points[i]);
+        send[4*i] = point->type;
+        send[4*i + 1] = point->lon;
+        send[4*i + 2] = point->lat;
+        send[4*i + 3] = point->height;
+    }
+    MPI_Irecv(&(job->slot_recv[s*3*TESSB_BLOCK_SIZE]), 3*block->npoints,
+              MPI_DOUBLE, rank, TESSB_MPI_TAG_RESULT, MPI_COMM_WORLD,
+              &(job->slot_reqs[s]));
+    MPI_Isend(send, 4*block->npoints, MPI_DOUBLE, rank, TESSB_MPI_TAG_BLOCK,
+              MPI_COMM_WORLD, &(job->slot_reqs[job->nslots + s]));
+    job->slot_posted[s] = 1;
+}
+
+
+/* Copy the results of a slot into its block and hand the block to the
+   writer */
+static void finish_tessb_slot(TESSB_JOB *job, int s)
+{
+    TESSB_BLOCK *block = job->slot_blocks[s];
+    double *recv = &(job->slot_recv[s*3*TESSB_BLOCK_SIZE]);
+    int i;
+
+    MPI_Wait(&(job->slot_reqs[job->nslots + s]), MPI_STATUS_IGNORE);
+    for(i = 0; i < block->npoints; i++)
+    {
+        block->points[i].res[0] = recv[3*i];
+        block->points[i].res[1] = recv[3*i + 1];
+        block->points[i].res[2] = recv[3*i + 2];
+    }
+    job->slot_blocks[s] = NULL;
+    job->slot_posted[s] = 0;
+    pthread_mutex_lock(&(job->lock));
+    block->busy = 0;
+    block->done = 1;
+    skip_tessb_blocks(job);
+    pthread_cond_signal(&(job->done));
+    pthread_mutex_unlock(&(job->lock));
+}
+
+
+/* Send the blocks that no thread has started to the other ranks, as long as
+   they have room, until the input ends. Used as the start routine of the
+   thread of rank 0 that talks to the other ranks, so it is the only thread
+   calling MPI while the pipeline runs. */
+void * run_tessb_mpi(void *arg)
+{
+    TESSB_JOB *job = (TESSB_JOB *)arg;
+    struct timespec until;
+    int s, busy, index, flag, rank;
+
+    pthread_mutex_lock(&(job->lock));
+    while(1)
+    {
+        busy = 0;
+        for(s = 0; s < job->nslots; s++)
+        {
+            if(job->slot_blocks[s] == NULL)
+            {
+                job->slot_blocks[s] = claim_tessb_block(job);
+            }
+            if(job->slot_blocks[s] != NULL)
+            {
+                busy++;
+            }
+        }
+        if(busy == 0)
+        {
+            if(job->eof)
+            {
+                break;
+            }
+            pthread_cond_wait(&(job->work), &(job->lock));
+            continue;
+        }
+        pthread_mutex_unlock(&(job->lock));
+        for(s = 0; s < job->nslots; s++)
+        {
+            if(job->slot_blocks[s] != NULL && !job->slot_posted[s])
+            {
+                post_tessb_slot(job, s);
+            }
+        }
+        /* With all ranks full, wait for one of them. Otherwise look for
+           new blocks every millisecond in between. */
+        if(busy == job->nslots)
+        {
+            MPI_Waitany(job->nslots, job->slot_reqs, &index,
+                        MPI_STATUS_IGNORE);
+        }
+        else
+        {
+            MPI_Testany(job->nslots, job->slot_reqs, &index, &flag,
+                        MPI_STATUS_IGNORE);
+        }
+        if(index != MPI_UNDEFINED)
+        {
+            finish_tessb_slot(job, index);
+            pthread_mutex_lock(&(job->lock));
+        }
+        else
+        {
+            pthread_mutex_lock(&(job->lock));
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += 1000000;
+            if(until.tv_nsec >= 1000000000)
+            {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&(job->work), &(job->lock), &until);
+        }
+    }
+    pthread_mutex_unlock(&(job->lock));
+    for(rank = 1; rank < job->nranks; rank++)
+    {
+        MPI_Send(NULL, 0, MPI_DOUBLE, rank, TESSB_MPI_TAG_STOP,
+                 MPI_COMM_WORLD);
+    }
+    return NULL;
+}
+
+
+/* Calculate the blocks sent by rank 0 and send back the results until rank
+   0 says stop. The other ranks do this instead of reading stdin. */
+void serve_tessb_mpi(TESSB_JOB *job)
+{
+    TESSB_BLOCK *block;
+    TESSB_POINT *point;
+    MPI_Status status;
+    double *recv = job->slot_send, *send = job->slot_recv;
+    int i, count;
+
+    while(1)
+    {
+        MPI_Probe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        if(status.MPI_TAG == TESSB_MPI_TAG_STOP)
+        {
+            MPI_Recv(NULL, 0, MPI_DOUBLE, 0, TESSB_MPI_TAG_STOP,
+                     MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            break;
+        }
+        MPI_Get_count(&status, MPI_DOUBLE, &count);
+        MPI_Recv(recv, count, MPI_DOUBLE, 0, TESSB_MPI_TAG_BLOCK,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        block = job->fill;
+        block->npoints = count/4;
+        for(i = 0; i < block->npoints; i++)
+        {
+            point = &(block->points[i]);
+            point->type = (int)recv[4*i];
+            point->lon = recv[4*i + 1];
+            point->lat = recv[4*i + 2];
+            point->height = recv[4*i + 3];
+            point->line = NULL;
+            point->row = 0;
+            point->trig_lon = NULL;
+            point->trig_lat = NULL;
+            point->text_lon = NULL;
+            point->text_lat = NULL;
+        }
+        /* The same lines make the same rows as on rank 0 */
+        push_tessb_block(job);
+        pthread_mutex_lock(&(job->lock));
+        while(!tessb_block_ready(job))
+        {
+            pthread_cond_wait(&(job->done), &(job->lock));
+        }
+        pthread_mutex_unlock(&(job->lock));
+        for(i = 0; i < block->npoints; i++)
+        {
+            send[3*i] = block->points[i].res[0];
+            send[3*i + 1] = block->points[i].res[1];
+            send[3*i + 2] = block->points[i].res[2];
+        }
+        MPI_Send(send, 3*block->npoints, MPI_DOUBLE, 0, TESSB_MPI_TAG_RESULT,
+                 MPI_COMM_WORLD);
+        pthread_mutex_lock(&(job->lock));
+        job->written++;
+        pthread_mutex_unlock(&(job->lock));
+    }
+}
+
+
+/* Send the model read by rank 0 to the other ranks. Returns the model of
+   each rank. */
+TESSEROID * bcast_tessb_model(TESSEROID *model, int *size, int rank)
+{
+    MPI_Bcast(size, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if(rank > 0)
+    {
+        model = (TESSEROID *)malloc(*size*sizeof(TESSEROID));
+        if(model == NULL)
+        {
+            log_error("rank %d: problem allocating memory for %d tesseroid(s)",
+                      rank, *size);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    MPI_Bcast(model, *size*sizeof(TESSEROID), MPI_BYTE, 0, MPI_COMM_WORLD);
+    return model;
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+Distribution of the computation points of the tessb* programs over MPI
+ranks. Only built with TESSB_MPI.
+
+Rank 0 reads the points and writes the results. A thread of rank 0 sends
+the blocks of the pipeline that no compute thread has started to the other
+ranks, TESSB_MPI_INFLIGHT at a time per rank, and hands their results back
+to the writer. The other ranks calculate the blocks they get with their own
+compute threads, so the output is the same as with one rank.
+*/
+
+#ifndef _TESSEROIDS_TESSB_MPI_H_
+#define _TESSEROIDS_TESSB_MPI_H_
+
+#ifdef TESSB_MPI
+
+
+/* Needed for definition of TESSEROID */
+#include "geometry.h"
+/* Needed for definition of TESSB_JOB */
+#include "tessb_pipe.h"
+
+
+/** Number of blocks each of the other ranks has at a time: one being
+    calculated and the next one waiting */
+#define TESSB_MPI_INFLIGHT 2
+
+/* Tags of the messages between the ranks */
+#define TESSB_MPI_TAG_BLOCK 1 /* lines of a block for another rank */
+#define TESSB_MPI_TAG_RESULT 2 /* results of the block sent back */
+#define TESSB_MPI_TAG_STOP 3 /* no more blocks will come */
+
+
+/** Make the slots of the blocks at the other ranks. Rank 0 has
+TESSB_MPI_INFLIGHT slots per other rank, and the ring of blocks needs room
+for job->nslots more blocks. The other ranks only use the buffers.
+
+@return 0 if all went well, 1 if there was an error with allocation
+*/
+int init_tessb_slots(TESSB_JOB *job);
+
+
+/** Free what init_tessb_slots made */
+void free_tessb_slots(TESSB_JOB *job);
+
+
+/** Start routine of the thread of rank 0 that talks to the other ranks.
+Sends them the blocks no compute thread has started until the input ends,
+then tells them to stop. It is the only thread calling MPI while the
+pipeline runs.
+
+@param arg the TESSB_JOB
+*/
+void * run_tessb_mpi(void *arg);
+
+
+/** Calculate the blocks sent by rank 0 and send back the results until rank
+0 says stop. The other ranks do this instead of reading stdin, with the
+compute threads of the pipeline started. */
+void serve_tessb_mpi(TESSB_JOB *job);
+
+
+/** Send the model read by rank 0 to the other ranks.
+
+@param model the model on rank 0, ignored on the others
+@param size number of tesseroids, set on the other ranks
+@param rank MPI rank of the process
+
+@return the model of each rank. The other ranks allocate it, and abort if
+        there is no memory.
+*/
+TESSEROID * bcast_tessb_model(TESSEROID *model, int *size, int rank);
+
+#endif
+
+#endif
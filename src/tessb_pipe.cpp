@@ -0,0 +1,842 @@
+/*
+Pipeline of the tessb* programs: the compute threads and the blocks between
+the reader and the writer.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#if defined(__APPLE__) && defined(__MACH__)
+    #include <stdint.h>
+    #include <sys/sysctl.h>
+#endif
+#include "logger.h"
+#include "grav_tess.h"
+#include "mag_tess.h"
+#include "mag_tree.h"
+#include "mag_index.h"
+#include "mag_fft.h"
+#include "parsers.h"
+#include "text_io.h"
+#include "tessb_pipe.h"
+#include "tessb_checkpoint.h"
+#include "tessb_mpi.h"
+
+
+/** Smallest tile of tesseroids worth keeping in the L1 data cache. If fewer
+    fit, the tiles are sized for the L2 cache instead. */
+#define TESSB_TILE_MIN_TESS 64
+
+/** Number of blocks in the pipeline: one being read, the others being
+    calculated or written. Bounds the memory whatever the length of the
+    input. */
+#define TESSB_PIPE_BLOCKS 4
+
+/** Seconds after which a block read from stdin is calculated even if it is
+    not full, so that the results of slow streams come out */
+#define TESSB_STREAM_LATENCY 0.1
+
+
+/* Calculate the field of the whole model on a tile of computation points.
+   The model is done in tiles of job->tile_tess tesseroids, so each tile of
+   tesseroids is reused from the cache for all points. The tesseroids are
+   summed in the same order as one point at a time. */
+static void calc_tessb_tile(TESSB_WORKER *worker, int npoints)
+{
+    TESSB_JOB *job = worker->job;
+    int first, last, p;
+
+    for(p = 0; p < npoints; p++)
+    {
+        worker->tile_res[p]->res[0] = 0;
+        worker->tile_res[p]->res[1] = 0;
+        worker->tile_res[p]->res[2] = 0;
+    }
+    /* The tree decides for each point which tesseroids to sum directly */
+    if(job->tree != NULL)
+    {
+        for(p = 0; p < npoints; p++)
+        {
+            calc_mag_tree(job->tree, job->model, &(job->calc),
+                          &(worker->tile[p]), worker->glq_lon,
+                          worker->glq_lat, worker->glq_r, &(worker->stats),
+                          worker->tile_res[p]->res);
+        }
+        return;
+    }
+    for(first = 0; first < job->model->size; first += job->tile_tess)
+    {
+        last = first + job->tile_tess;
+        if(last > job->model->size)
+        {
+            last = job->model->size;
+        }
+        if(job->index != NULL)
+        {
+            for(p = 0; p < npoints; p++)
+            {
+                calc_mag_index(job->index, job->model, first, last,
+                               &(job->calc), &(worker->tile[p]),
+                               worker->glq_lon, worker->glq_lat,
+                               worker->glq_r, &(worker->stats),
+                               worker->tile_res[p]->res);
+            }
+            continue;
+        }
+        for(p = 0; p < npoints; p++)
+        {
+            calc_mag_model(job->model, first, last, &(job->calc),
+                           &(worker->tile[p]), worker->glq_lon,
+                           worker->glq_lat, worker->glq_r, &(worker->stats),
+                           worker->tile_res[p]->res);
+        }
+    }
+}
+
+
+/* Make the GLQ structures and the trigonometric cache of a thread */
+int init_tessb_worker(TESSB_WORKER *worker, TESSB_JOB *job,
+    TESSB_ARGS *args)
+{
+    int i;
+
+    worker->job = job;
+    worker->stats.adapt.max_depth = args->max_depth;
+    worker->stats.adapt.depth_hits = 0;
+    memset(worker->stats.adapt.splits, 0, sizeof(worker->stats.adapt.splits));
+    worker->stats.adapt.leaves = 0;
+    worker->cpu = 0;
+    worker->stats.evals = 0;
+    worker->stats.far_evals = 0;
+    worker->stats.tree_nodes = 0;
+    worker->stats.fft_points = 0;
+    worker->stats.fft_kernels = 0;
+    worker->stats.truncated = 0;
+    worker->stats.mid_evals = 0;
+    worker->glq_lon = glq_new(args->lon_order, -1, 1);
+    worker->glq_lat = glq_new(args->lat_order, -1, 1);
+    worker->glq_r = glq_new(args->r_order, -1, 1);
+    worker->tile = (MAG_POINT *)malloc(args->tile_points*sizeof(MAG_POINT));
+    worker->tile_res = (TESSB_POINT **)malloc(args->tile_points*
+                                              sizeof(TESSB_POINT *));
+    worker->fft = NULL;
+    worker->row_res = NULL;
+    if(args->fft)
+    {
+        worker->fft = mag_fft_work_new();
+        worker->row_res = (double *)malloc(3*TESSB_BLOCK_SIZE*sizeof(double));
+    }
+    if(worker->glq_lon == NULL || worker->glq_lat == NULL ||
+       worker->glq_r == NULL || worker->tile == NULL ||
+       worker->tile_res == NULL ||
+       (args->fft && (worker->fft == NULL || worker->row_res == NULL)))
+    {
+        return 1;
+    }
+    for(i = 0; i < args->tile_points; i++)
+    {
+        mag_point_init(&(worker->tile[i]));
+    }
+    return 0;
+}
+
+
+/* Free the GLQ structures of a thread */
+void free_tessb_worker(TESSB_WORKER *worker)
+{
+    if(worker->glq_lon != NULL)
+        glq_free(worker->glq_lon);
+    if(worker->glq_lat != NULL)
+        glq_free(worker->glq_lat);
+    if(worker->glq_r != NULL)
+        glq_free(worker->glq_r);
+    free(worker->tile);
+    free(worker->tile_res);
+    mag_fft_work_free(worker->fft);
+    free(worker->row_res);
+}
+
+
+/* Calculate the computation points of lines first to last - 1 of a block
+   in tiles. Points of rows are skipped unless rows is set. */
+static void calc_tessb_lines(TESSB_WORKER *worker, TESSB_BLOCK *block,
+    int first, int last, int rows)
+{
+    TESSB_JOB *job = worker->job;
+    TESSB_POINT *point;
+    int i, npoints = 0;
+
+    for(i = first; i < last; i++)
+    {
+        point = &(block->points[i]);
+        if(point->type != TESSB_LINE_POINT || (point->row && !rows))
+        {
+            continue;
+        }
+        if(point->trig_lon != NULL)
+        {
+            mag_point_set_trig(&(worker->tile[npoints]), point->lon,
+                               point->lat, point->height, point->trig_lon,
+                               point->trig_lat);
+        }
+        else
+        {
+            mag_point_set(&(worker->tile[npoints]), point->lon, point->lat,
+                          point->height);
+        }
+        worker->tile_res[npoints] = point;
+        npoints++;
+        if(npoints == job->tile_points)
+        {
+            calc_tessb_tile(worker, npoints);
+            npoints = 0;
+        }
+    }
+    if(npoints > 0)
+    {
+        calc_tessb_tile(worker, npoints);
+    }
+}
+
+
+/* Calculate a row of a block by convolution */
+static void calc_tessb_row(TESSB_WORKER *worker, TESSB_BLOCK *block,
+    const TESSB_ROW *row)
+{
+    TESSB_JOB *job = worker->job;
+    TESSB_POINT *points = &(block->points[row->first]);
+    int p, c, ncomps = job->calc.vector ? 3 : 1;
+
+    if(calc_mag_fft_row(job->mesh, &(job->calc), points[0].lon, row->step,
+                        row->npoints, points[0].lat, points[0].height,
+                        worker->glq_lon, worker->glq_lat, worker->glq_r,
+                        &(worker->stats), worker->fft, worker->row_res))
+    {
+        log_warning("problem allocating memory for the convolution of %d point(s). Calculating them directly.",
+                    row->npoints);
+        calc_tessb_lines(worker, block, row->first, row->first + row->npoints,
+                         1);
+        return;
+    }
+    for(p = 0; p < row->npoints; p++)
+    {
+        for(c = 0; c < ncomps; c++)
+        {
+            points[p].res[c] = worker->row_res[3*p + c];
+        }
+    }
+}
+
+
+/* Size in bytes of the L1 data cache (level 1) or of the L2 cache (level 2),
+   or def if the system does not tell */
+long tessb_cache_size(int level, long def)
+{
+    long size = -1;
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+    size = sysconf(level == 1 ? _SC_LEVEL1_DCACHE_SIZE :
+                                _SC_LEVEL2_CACHE_SIZE);
+#elif defined(__APPLE__) && defined(__MACH__)
+    int64_t value;
+    size_t len = sizeof(value);
+
+    if(sysctlbyname(level == 1 ? "hw.l1dcachesize" : "hw.l2cachesize",
+                    &value, &len, NULL, 0) == 0)
+        size = (long)value;
+#endif
+    return size > 0 ? size : def;
+}
+
+
+/* Number of points of a tile if --tile does not give it: the points of a
+   tile and their results take a quarter of the L1 data cache. Every thread
+   still gets several tiles of a block. */
+int tessb_tile_points(int threads)
+{
+    long l1 = tessb_cache_size(1, TESSB_L1_DEFAULT), npoints;
+
+    npoints = l1/4/(long)(sizeof(MAG_POINT) + sizeof(TESSB_POINT));
+    if(npoints > TESSB_BLOCK_SIZE/(4*threads))
+        npoints = TESSB_BLOCK_SIZE/(4*threads);
+    return npoints > 1 ? (int)npoints : 1;
+}
+
+
+/* Number of tesseroids of a tile if --tile does not give it: the columns of
+   the model that calc_mag_model reads for them take half of the L1 data
+   cache, or of the L2 cache if fewer than TESSB_TILE_MIN_TESS fit in L1. A
+   multiple of the size of the blocks of the kernels. */
+int tessb_tile_tess(const TESSB_ARGS *args, const MAG_CALC *calc)
+{
+    long l1 = tessb_cache_size(1, TESSB_L1_DEFAULT),
+         l2 = tessb_cache_size(2, TESSB_L2_DEFAULT), bytes, ntess;
+
+    /* Borders, magnetization and trigonometric functions of the center */
+    bytes = 13*sizeof(double);
+    /* Mass, center and size of the point mass */
+    if(calc->far_ratio > 0)
+        bytes += 7*sizeof(double);
+    /* Scaled nodes of the tesseroids in the node table */
+    if(calc->nodes != NULL)
+        bytes += (long)tess_nodes_bytes(1, args->lon_order, args->lat_order,
+                                        args->r_order);
+    ntess = l1/2/bytes;
+    if(ntess < TESSB_TILE_MIN_TESS)
+        ntess = l2/2/bytes;
+    ntess -= ntess % TESS_BLOCK_SIZE;
+    return ntess > TESS_BLOCK_SIZE ? (int)ntess : TESS_BLOCK_SIZE;
+}
+
+
+/* Seconds on one of the clocks of clock_gettime */
+double tessb_clock_of(clockid_t id)
+{
+    struct timespec now;
+
+    clock_gettime(id, &now);
+    return now.tv_sec + 1e-9*now.tv_nsec;
+}
+
+
+/* Seconds on a clock that only goes forward */
+double tessb_clock(void)
+{
+    return tessb_clock_of(CLOCK_MONOTONIC);
+}
+
+
+/* Tell if all rows and lines of a block have been taken by threads */
+static int tessb_block_taken(const TESSB_BLOCK *block)
+{
+    /* The threads move the counters forward without the lock */
+    return __atomic_load_n(&(block->next_row), __ATOMIC_ACQUIRE) >=
+               block->nrows &&
+           __atomic_load_n(&(block->next), __ATOMIC_ACQUIRE) >=
+               block->npoints;
+}
+
+
+/* Move past the blocks that have been handed out entirely. Blocks are
+   handed out in the order of the input. Needs the lock. */
+void skip_tessb_blocks(TESSB_JOB *job)
+{
+    while(job->computing < job->filled &&
+          tessb_block_taken(&(job->blocks[job->computing % job->nblocks])))
+    {
+        job->computing++;
+    }
+}
+
+
+/* Calculate the rows, then chunks of the blocks in the order of the input
+   until the input ends. Used as the start routine of the compute threads.
+   Threads take rows and chunks of a block without the lock; it is only
+   taken to go from one block to the next. */
+static void * run_tessb_worker(void *arg)
+{
+    TESSB_WORKER *worker = (TESSB_WORKER *)arg;
+    TESSB_JOB *job = worker->job;
+    TESSB_BLOCK *block;
+    int first, last;
+    double cpu = tessb_clock_of(CLOCK_THREAD_CPUTIME_ID);
+
+    pthread_mutex_lock(&(job->lock));
+    while(1)
+    {
+        skip_tessb_blocks(job);
+        if(job->computing == job->filled)
+        {
+            if(job->eof)
+            {
+                break;
+            }
+            pthread_cond_wait(&(job->work), &(job->lock));
+            continue;
+        }
+        block = &(job->blocks[job->computing % job->nblocks]);
+        block->busy++;
+        pthread_mutex_unlock(&(job->lock));
+        while(1)
+        {
+            first = __sync_fetch_and_add(&(block->next_row), 1);
+            if(first >= block->nrows)
+            {
+                break;
+            }
+            calc_tessb_row(worker, block, &(block->rows[first]));
+        }
+        while(1)
+        {
+            first = __sync_fetch_and_add(&(block->next), job->tile_points);
+            if(first >= block->npoints)
+            {
+                break;
+            }
+            last = first + job->tile_points;
+            if(last > block->npoints)
+            {
+                last = block->npoints;
+            }
+            calc_tessb_lines(worker, block, first, last, 0);
+        }
+        /* Nothing is left to take, so the last thread out finished the
+           block */
+        pthread_mutex_lock(&(job->lock));
+        block->busy--;
+        if(block->busy == 0)
+        {
+            block->done = 1;
+            pthread_cond_signal(&(job->done));
+        }
+    }
+    pthread_mutex_unlock(&(job->lock));
+    worker->cpu += tessb_clock_of(CLOCK_THREAD_CPUTIME_ID) - cpu;
+    return NULL;
+}
+
+
+/* Find the rows of a block that are worth a convolution. A row is made of
+   consecutive computation points, so rows are cut at the ends of the
+   blocks. */
+static void find_tessb_rows(TESSB_JOB *job, TESSB_BLOCK *block)
+{
+    TESSB_POINT *points = block->points;
+    double dlon = job->mesh->dlon, cells;
+    int i, j, step;
+
+    for(i = 0; i + 1 < block->npoints; i = j)
+    {
+        j = i + 1;
+        if(points[i].type != TESSB_LINE_POINT ||
+           points[j].type != TESSB_LINE_POINT)
+        {
+            continue;
+        }
+        cells = (points[j].lon - points[i].lon)/dlon;
+        step = (int)floor(cells + 0.5);
+        if(step < 1 || fabs(cells - step) > MAG_FFT_TOL)
+        {
+            continue;
+        }
+        while(j < block->npoints && points[j].type == TESSB_LINE_POINT &&
+              points[j].lat == points[i].lat &&
+              points[j].height == points[i].height &&
+              fabs((points[j].lon - points[i].lon)/dlon - (j - i)*step) <=
+              MAG_FFT_TOL)
+        {
+            j++;
+        }
+        if(j - i >= MAG_FFT_MIN_POINTS)
+        {
+            block->rows[block->nrows].first = i;
+            block->rows[block->nrows].npoints = j - i;
+            block->rows[block->nrows].step = step;
+            block->nrows++;
+            for(; i < j; i++)
+            {
+                points[i].row = 1;
+            }
+        }
+        else if(j > i + 1)
+        {
+            /* The last point can start the next row */
+            j--;
+        }
+    }
+}
+
+
+/* Tell if the next block to be printed is calculated. Needs the lock. */
+int tessb_block_ready(const TESSB_JOB *job)
+{
+    return job->written < job->filled &&
+           job->blocks[job->written % job->nblocks].done;
+}
+
+
+/* Hand the block being read over to the threads and wait until the next
+   block of the ring is printed, so that the reader never gets more than
+   the size of the ring ahead of the writer */
+void push_tessb_block(TESSB_JOB *job)
+{
+    TESSB_BLOCK *block = job->fill;
+    double wait;
+
+    block->next = 0;
+    block->next_row = 0;
+    block->nrows = 0;
+    block->busy = 0;
+    block->done = 0;
+    block->lines = job->lines;
+    if(job->mesh != NULL)
+    {
+        find_tessb_rows(job, block);
+    }
+    pthread_mutex_lock(&(job->lock));
+    job->filled++;
+    pthread_cond_broadcast(&(job->work));
+    if(job->filled - job->written >= job->nblocks)
+    {
+        wait = tessb_clock();
+        while(job->filled - job->written >= job->nblocks)
+        {
+            pthread_cond_wait(&(job->free), &(job->lock));
+        }
+        job->read_wait += tessb_clock() - wait;
+    }
+    pthread_mutex_unlock(&(job->lock));
+    job->fill = &(job->blocks[job->filled % job->nblocks]);
+    job->fill->npoints = 0;
+}
+
+
+/* Add a point read from a stream to the block being read and hand the
+   block over when it is full. lines is the number of lines of the input
+   read up to and including the point. */
+void add_tessb_point(TESSB_JOB *job, const TESSB_POINT *point,
+    long long lines)
+{
+    pthread_mutex_lock(&(job->fill_lock));
+    job->fill->points[job->fill->npoints] = *point;
+    job->fill->npoints++;
+    job->lines = lines;
+    if(job->fill->npoints == 1)
+    {
+        job->fill_time = tessb_clock();
+        pthread_cond_signal(&(job->fill_cond));
+    }
+    if(job->fill->npoints == TESSB_BLOCK_SIZE)
+    {
+        push_tessb_block(job);
+    }
+    pthread_mutex_unlock(&(job->fill_lock));
+}
+
+
+/* Hand the block being read over to the threads once its first line is
+   TESSB_STREAM_LATENCY seconds old, even while the reader waits for the
+   next line of a slow stream. Runs until the reader is done. */
+void * run_tessb_flusher(void *arg)
+{
+    TESSB_JOB *job = (TESSB_JOB *)arg;
+    struct timespec deadline;
+    double left;
+
+    pthread_mutex_lock(&(job->fill_lock));
+    while(!job->read_done)
+    {
+        if(job->fill->npoints == 0)
+        {
+            pthread_cond_wait(&(job->fill_cond), &(job->fill_lock));
+            continue;
+        }
+        left = job->fill_time + TESSB_STREAM_LATENCY - tessb_clock();
+        if(left <= 0)
+        {
+            push_tessb_block(job);
+            continue;
+        }
+        /* The timed wait takes the real time clock */
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += (time_t)left;
+        deadline.tv_nsec += (long)(1e9*(left - (time_t)left));
+        if(deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&(job->fill_cond), &(job->fill_lock),
+                               &deadline);
+    }
+    pthread_mutex_unlock(&(job->fill_lock));
+    return NULL;
+}
+
+
+/* Print the result of a computation point, as a line of text or as a row of
+   a binary grid */
+static void print_tessb_point(const TESSB_JOB *job, const TESSB_POINT *point)
+{
+    double row[6];
+    int c, ncomps = job->calc.vector ? 3 : 1;
+
+    if(job->binary)
+    {
+        row[0] = point->lon;
+        row[1] = point->lat;
+        row[2] = point->height;
+        row[3] = point->res[0];
+        row[4] = point->res[1];
+        row[5] = point->res[2];
+        text_out_write(job->out, (const char *)row,
+                       (3 + ncomps)*sizeof(double));
+        return;
+    }
+    if(point->line != NULL)
+    {
+        text_out_string(job->out, point->line);
+    }
+    else if(point->text_lon != NULL)
+    {
+        /* The coordinates of a grid are formatted once per row and column */
+        text_out_string(job->out, point->text_lon);
+        text_out_char(job->out, ' ');
+        text_out_string(job->out, point->text_lat);
+    }
+    else
+    {
+        text_out_double(job->out, point->lon, job->format);
+        text_out_char(job->out, ' ');
+        text_out_double(job->out, point->lat, job->format);
+        text_out_char(job->out, ' ');
+        text_out_double(job->out, point->height, job->format);
+    }
+    for(c = 0; c < ncomps; c++)
+    {
+        text_out_char(job->out, ' ');
+        text_out_double(job->out, point->res[c], job->format);
+    }
+    text_out_char(job->out, '\n');
+}
+
+
+/* Print the lines of a block in the order of the input and free them */
+static void print_tessb_block(TESSB_JOB *job, TESSB_BLOCK *block)
+{
+    TESSB_POINT *point;
+    int i;
+
+    for(i = 0; i < block->npoints; i++)
+    {
+        point = &(block->points[i]);
+        if(point->type == TESSB_LINE_COMMENT)
+        {
+            if(!job->binary)
+            {
+                text_out_string(job->out, point->line);
+            }
+        }
+        else if(point->type == TESSB_LINE_POINT)
+        {
+            print_tessb_point(job, point);
+            job->points++;
+        }
+        free(point->line);
+    }
+}
+
+
+/* Print the blocks in the order of the input as they are calculated. Used
+   as the start routine of the writer thread. */
+static void * run_tessb_writer(void *arg)
+{
+    TESSB_JOB *job = (TESSB_JOB *)arg;
+    TESSB_BLOCK *block;
+    double cpu = tessb_clock_of(CLOCK_THREAD_CPUTIME_ID), wait;
+
+    pthread_mutex_lock(&(job->lock));
+    while(1)
+    {
+        if(!tessb_block_ready(job) &&
+           !(job->eof && job->written == job->filled))
+        {
+            /* Send out what is printed before waiting, so that the results
+               of a stream don't wait for the next ones */
+            pthread_mutex_unlock(&(job->lock));
+            text_out_flush(job->out);
+            fflush(job->out->file);
+            pthread_mutex_lock(&(job->lock));
+            wait = tessb_clock();
+            while(!tessb_block_ready(job) &&
+                  !(job->eof && job->written == job->filled))
+            {
+                pthread_cond_wait(&(job->done), &(job->lock));
+            }
+            job->write_wait += tessb_clock() - wait;
+        }
+        if(!tessb_block_ready(job))
+        {
+            break;
+        }
+        block = &(job->blocks[job->written % job->nblocks]);
+        pthread_mutex_unlock(&(job->lock));
+        print_tessb_block(job, block);
+        job->committed = block->lines;
+        if(job->checkpoint != NULL &&
+           tessb_clock() - job->checkpoint_time >= job->checkpoint_every)
+        {
+            checkpoint_tessb(job);
+        }
+        pthread_mutex_lock(&(job->lock));
+        job->written++;
+        pthread_cond_signal(&(job->free));
+    }
+    pthread_mutex_unlock(&(job->lock));
+    /* The last checkpoint has the whole output */
+    if(job->checkpoint != NULL)
+    {
+        checkpoint_tessb(job);
+    }
+    job->write_cpu = tessb_clock_of(CLOCK_THREAD_CPUTIME_ID) - cpu;
+    return NULL;
+}
+
+
+/* Free the blocks of the pipeline */
+void free_tessb_pipe(TESSB_JOB *job)
+{
+    int i;
+
+    for(i = 0; job->blocks != NULL && i < job->nblocks; i++)
+    {
+        free(job->blocks[i].points);
+        free(job->blocks[i].rows);
+    }
+    free(job->blocks);
+    job->blocks = NULL;
+#ifdef TESSB_MPI
+    free_tessb_slots(job);
+#endif
+}
+
+
+/* Make the blocks of the pipeline. The ring has room for the blocks at the
+   other ranks. Returns 1 if there was an error with allocation. */
+int init_tessb_pipe(TESSB_JOB *job)
+{
+    int i, error = 0;
+
+    job->nblocks = TESSB_PIPE_BLOCKS;
+#ifdef TESSB_MPI
+    error = init_tessb_slots(job);
+    job->nblocks += job->nslots;
+#endif
+    job->blocks = (TESSB_BLOCK *)calloc(job->nblocks, sizeof(TESSB_BLOCK));
+    if(job->blocks == NULL)
+    {
+        free_tessb_pipe(job);
+        return 1;
+    }
+    for(i = 0; i < job->nblocks; i++)
+    {
+        job->blocks[i].points = (TESSB_POINT *)malloc(TESSB_BLOCK_SIZE*
+                                                      sizeof(TESSB_POINT));
+        job->blocks[i].rows = (TESSB_ROW *)malloc(
+            (TESSB_BLOCK_SIZE/MAG_FFT_MIN_POINTS)*sizeof(TESSB_ROW));
+        if(job->blocks[i].points == NULL || job->blocks[i].rows == NULL)
+        {
+            error = 1;
+        }
+    }
+    if(error)
+    {
+        free_tessb_pipe(job);
+        return 1;
+    }
+    job->fill = &(job->blocks[0]);
+    job->fill->npoints = 0;
+    job->filled = 0;
+    job->computing = 0;
+    job->written = 0;
+    job->eof = 0;
+    job->points = 0;
+    job->lines = 0;
+    job->committed = 0;
+    job->read_wait = 0;
+    job->write_wait = 0;
+    job->write_cpu = 0;
+    pthread_mutex_init(&(job->lock), NULL);
+    pthread_cond_init(&(job->work), NULL);
+    pthread_cond_init(&(job->done), NULL);
+    pthread_cond_init(&(job->free), NULL);
+    job->fill_time = 0;
+    job->read_done = 0;
+    pthread_mutex_init(&(job->fill_lock), NULL);
+    pthread_cond_init(&(job->fill_cond), NULL);
+    return 0;
+}
+
+
+/* Start the compute threads and, on rank 0, the writer and the thread that
+   talks to the other ranks. started is set to the number of threads
+   started. Returns 1 if the pipeline can't run. */
+int start_tessb_pipe(TESSB_JOB *job, TESSB_WORKER *workers,
+    pthread_t *threads, int nthreads, int *started)
+{
+    int i;
+
+    for(i = 0; i < nthreads; i++)
+    {
+        if(pthread_create(&threads[i], NULL, run_tessb_worker,
+                          &workers[i]) != 0)
+        {
+            if(i == 0)
+            {
+                log_error("failed to start the compute threads");
+                *started = 0;
+                return 1;
+            }
+            log_warning("failed to start thread %d. Continuing with %d thread(s)",
+                        i + 1, i);
+            break;
+        }
+    }
+    *started = i;
+    if(job->rank > 0)
+    {
+        return 0;
+    }
+    if(pthread_create(&threads[*started], NULL, run_tessb_writer, job) != 0)
+    {
+        log_error("failed to start the writer thread");
+        return 1;
+    }
+    (*started)++;
+#ifdef TESSB_MPI
+    if(job->nranks > 1)
+    {
+        if(pthread_create(&threads[*started], NULL, run_tessb_mpi, job) != 0)
+        {
+            log_error("failed to start the thread of the other ranks");
+            return 1;
+        }
+        (*started)++;
+    }
+#endif
+    return 0;
+}
+
+
+/* Hand over the last block, tell the threads that the input ended and wait
+   for them to calculate and print everything. Nothing is handed over if the
+   pipeline could not start. */
+void stop_tessb_pipe(TESSB_JOB *job, pthread_t *threads, int started,
+    int error)
+{
+    int i;
+
+    if(!error && job->fill->npoints > 0)
+    {
+        push_tessb_block(job);
+    }
+    pthread_mutex_lock(&(job->lock));
+    job->eof = 1;
+    pthread_cond_broadcast(&(job->work));
+    pthread_cond_signal(&(job->done));
+    pthread_mutex_unlock(&(job->lock));
+    for(i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&(job->lock));
+    pthread_cond_destroy(&(job->work));
+    pthread_cond_destroy(&(job->done));
+    pthread_cond_destroy(&(job->free));
+    pthread_mutex_destroy(&(job->fill_lock));
+    pthread_cond_destroy(&(job->fill_cond));
+}
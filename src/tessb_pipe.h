@@ -0,0 +1,312 @@
+/*
+Pipeline of the tessb* programs. The computation points go through a ring of
+blocks: the reader fills a block, the compute threads calculate it and the
+writer prints it in the order of the input, while the reader fills the next
+ones.
+
+The threads take rows and tiles of lines of a block without the lock. The
+lock is only taken to go from one block to the next. A block of a stream
+that takes too long to fill is handed over by the flusher thread, so that
+the results of slow streams come out.
+*/
+
+#ifndef _TESSEROIDS_TESSB_PIPE_H_
+#define _TESSEROIDS_TESSB_PIPE_H_
+
+
+#include <pthread.h>
+#include <time.h>
+#ifdef TESSB_MPI
+#include <mpi.h>
+#endif
+/* Needed for definition of TESS_MODEL */
+#include "geometry.h"
+/* Needed for definition of GLQ */
+#include "glq.h"
+/* Needed for definition of MAG_CALC, MAG_POINT and MAG_STATS */
+#include "mag_tess.h"
+/* Needed for definition of MAG_TREE */
+#include "mag_tree.h"
+/* Needed for definition of MAG_INDEX */
+#include "mag_index.h"
+/* Needed for definition of MAG_FFT_MESH and MAG_FFT_WORK */
+#include "mag_fft.h"
+/* Needed for definition of TEXT_OUT */
+#include "text_io.h"
+/* Needed for definition of TESSB_ARGS */
+#include "parsers.h"
+
+
+/** Number of input lines read from stdin before they are calculated */
+#define TESSB_BLOCK_SIZE 4096
+
+/** Sizes of the L1 data and L2 caches used if the system does not tell */
+#define TESSB_L1_DEFAULT (32*1024)
+#define TESSB_L2_DEFAULT (1024*1024)
+
+/** Size of the buffer used to read a line from stdin */
+#define TESSB_LINE_SIZE 10000
+
+/** Size of the settings of a run kept in its checkpoints */
+#define TESSB_SETTINGS_SIZE 512
+
+/* Types of lines read from stdin */
+#define TESSB_LINE_POINT 0
+#define TESSB_LINE_COMMENT 1
+#define TESSB_LINE_BAD 2
+
+
+/* Store one line read from stdin and the result calculated for it */
+typedef struct tessb_point_struct
+{
+    char *line; /* the input line, stripped if it is a computation point.
+                   NULL for the points of a generated grid. */
+    int type; /* one of TESSB_LINE_POINT, TESSB_LINE_COMMENT, TESSB_LINE_BAD */
+    double lon;
+    double lat;
+    double height;
+    double res[3]; /* only res[0] is used unless in vector mode */
+    int row; /* flag: calculated with its row by convolution */
+    const double *trig_lon; /* cosine and sine of the longitude and */
+    const double *trig_lat; /* colatitude, NULL to calculate them */
+    const char *text_lon; /* longitude, and latitude and height, as text */
+    const char *text_lat; /* for the points of a generated grid */
+} TESSB_POINT;
+
+
+/* Consecutive lines of a block with the same latitude and height and
+   longitudes spaced by a whole number of cells of the mesh */
+typedef struct tessb_row_struct
+{
+    int first; /* index of the first line in the block */
+    int npoints; /* number of lines */
+    int step; /* spacing of the longitudes in cells */
+} TESSB_ROW;
+
+
+/* Block of lines on its way through the pipeline: filled by the reader,
+   calculated by the workers and printed by the writer */
+typedef struct tessb_block_struct
+{
+    TESSB_POINT *points; /* lines of the block */
+    int npoints; /* number of lines in the block */
+    int next; /* index of the next line to be taken by a thread */
+    TESSB_ROW *rows; /* rows of the block calculated by convolution */
+    int nrows; /* number of rows */
+    int next_row; /* index of the next row to be taken by a thread */
+    int busy; /* number of threads calculating the block */
+    int done; /* flag: all lines of the block are calculated */
+    long long lines; /* number of lines of the input read up to the end of
+                        the block */
+} TESSB_BLOCK;
+
+
+/* Settings shared by all threads, and the queue of blocks between them */
+typedef struct tessb_job_struct
+{
+    TESS_MODEL *model;
+    MAG_TREE *tree; /* tree over the model, NULL to sum directly */
+    MAG_INDEX *index; /* index over the model, NULL to visit every
+                         tesseroid */
+    MAG_FFT_MESH *mesh; /* the model as a regular mesh, NULL if rows of
+                           points are not calculated by convolution */
+    MAG_CALC calc;
+    int tile_points; /* number of lines a thread takes from a block at a
+                        time */
+    int tile_tess; /* number of tesseroids calculated on these lines before
+                      going to the next tesseroids */
+    TESSB_BLOCK *blocks; /* ring of blocks. Block i of the input is
+                            blocks[i % nblocks]. */
+    int nblocks; /* number of blocks in the ring */
+    TESSB_BLOCK *fill; /* block being read */
+    long filled; /* number of blocks read */
+    long computing; /* first block that still has lines to be taken */
+    long written; /* number of blocks printed */
+    int eof; /* flag: the input ended, no more blocks will come */
+    int points; /* number of computation points printed */
+    long long lines; /* number of lines of the input read up to the last
+                        point added to the blocks. Guarded by fill_lock
+                        while the flusher runs. */
+    long long committed; /* number of lines of the input whose results are
+                            printed */
+    pthread_mutex_t lock; /* guards the counters of the queue */
+    pthread_cond_t work; /* a block was read */
+    pthread_cond_t done; /* a block was calculated */
+    pthread_cond_t free; /* a block was printed */
+    pthread_mutex_t fill_lock; /* guards the block being read, which the
+                                  flusher can hand over */
+    pthread_cond_t fill_cond; /* a block got its first line, or the input
+                                 ended */
+    double fill_time; /* clock when the first line of the block being read
+                         arrived */
+    int read_done; /* flag: the reader is done, the flusher can stop */
+    int binary; /* flag to write the results as a binary grid */
+    int format; /* format of the numbers of text output, one of
+                   TEXT_FORMAT_SHORTEST or TEXT_FORMAT_COMPAT */
+    TEXT_OUT *out; /* buffer of stdout */
+    const char *checkpoint; /* checkpoint file, NULL to not write them */
+    double checkpoint_every; /* seconds between two checkpoints */
+    double checkpoint_time; /* clock of the last checkpoint */
+    const char *progname; /* the run a checkpoint belongs to: the program, */
+    const char *modelfname; /* the model file, */
+    const char *input; /* the kind of input: "text", "binary" or "grid", */
+    char settings[TESSB_SETTINGS_SIZE]; /* and the options that change the
+                                           results */
+    double read_wait; /* seconds the reader waited for a free block */
+    double write_wait; /* seconds the writer waited for a calculated block */
+    double write_cpu; /* CPU time of the writer in seconds */
+    int rank; /* MPI rank of the process, 0 without MPI */
+    int nranks; /* number of MPI ranks, 1 without MPI */
+#ifdef TESSB_MPI
+    int nslots; /* number of blocks that can be at the other ranks */
+    TESSB_BLOCK **slot_blocks; /* block at the other ranks, NULL if the
+                                  slot is free */
+    int *slot_posted; /* flag: the block of the slot was sent */
+    double *slot_send; /* lines of the block of each slot, 4 per line */
+    double *slot_recv; /* results of the block of each slot, 3 per line */
+    MPI_Request *slot_reqs; /* receive of the results of each slot, then
+                               send of its lines */
+#endif
+} TESSB_JOB;
+
+
+/* Data owned by a single thread. glq_set_limits changes the GLQ structures in
+   place and the trigonometric functions of the last point are cached, so they
+   can't be shared between threads. */
+typedef struct tessb_worker_struct
+{
+    TESSB_JOB *job;
+    GLQ *glq_lon, *glq_lat, *glq_r;
+    MAG_POINT *tile; /* computation points of the current tile */
+    TESSB_POINT **tile_res; /* where the results of the tile go */
+    MAG_STATS stats; /* depth limit of the division and statistics */
+    MAG_FFT_WORK *fft; /* buffers of the convolutions */
+    double *row_res; /* results of a row */
+    double cpu; /* CPU time of the thread in seconds */
+} TESSB_WORKER;
+
+
+/** Make the GLQ structures and the buffers of a compute thread.
+
+@param worker the thread
+@param job the settings shared by all threads
+@param args the options of the run, for the GLQ orders, the depth limit, the
+            tile size and --fft
+
+@return 0 if all went well, 1 if there was an error with allocation
+*/
+int init_tessb_worker(TESSB_WORKER *worker, TESSB_JOB *job,
+    TESSB_ARGS *args);
+
+
+/** Free what init_tessb_worker made */
+void free_tessb_worker(TESSB_WORKER *worker);
+
+
+/** Size of a cache of the processor.
+
+@param level 1 for the L1 data cache, 2 for the L2 cache
+@param def size to use if the system does not tell
+
+@return the size in bytes
+*/
+long tessb_cache_size(int level, long def);
+
+
+/** Number of points of a tile if --tile does not give it: the points and
+their results take a quarter of the L1 data cache. */
+int tessb_tile_points(int threads);
+
+
+/** Number of tesseroids of a tile if --tile does not give it: the columns of
+the model read for them take half of the L1 data cache, or of the L2 cache if
+too few fit in L1. */
+int tessb_tile_tess(const TESSB_ARGS *args, const MAG_CALC *calc);
+
+
+/** Seconds on one of the clocks of clock_gettime, such as
+CLOCK_THREAD_CPUTIME_ID */
+double tessb_clock_of(clockid_t id);
+
+
+/** Seconds on a clock that only goes forward */
+double tessb_clock(void);
+
+
+/** Move job->computing past the blocks whose lines have all been taken by
+threads. Needs job->lock. */
+void skip_tessb_blocks(TESSB_JOB *job);
+
+
+/** Tell if the next block to be printed is calculated. Needs job->lock. */
+int tessb_block_ready(const TESSB_JOB *job);
+
+
+/** Hand the block being read over to the threads and start the next one.
+Waits while the ring is full, so that the reader never gets more than the
+size of the ring ahead of the writer. */
+void push_tessb_block(TESSB_JOB *job);
+
+
+/** Add a point read from a stream to the block being read and hand the block
+over when it is full. Takes job->fill_lock, so it can run with the flusher.
+
+@param job the pipeline
+@param point the point, copied into the block
+@param lines number of lines of the input read up to and including the point
+*/
+void add_tessb_point(TESSB_JOB *job, const TESSB_POINT *point,
+    long long lines);
+
+
+/** Start routine of the flusher thread. Hands the block being read over once
+its first line is TESSB_STREAM_LATENCY seconds old, until job->read_done is
+set.
+
+@param arg the TESSB_JOB
+*/
+void * run_tessb_flusher(void *arg);
+
+
+/** Make the ring of blocks of the pipeline, with room for the blocks at the
+other MPI ranks, and its locks.
+
+@return 0 if all went well, 1 if there was an error with allocation
+*/
+int init_tessb_pipe(TESSB_JOB *job);
+
+
+/** Free the blocks of the pipeline */
+void free_tessb_pipe(TESSB_JOB *job);
+
+
+/** Start the compute threads and, on rank 0, the writer and the thread that
+talks to the other MPI ranks.
+
+@param job the pipeline, made by init_tessb_pipe
+@param workers the compute threads, made by init_tessb_worker
+@param threads room for nthreads + 2 threads
+@param nthreads number of compute threads
+@param started set to the number of threads started, to give to
+               stop_tessb_pipe
+
+@return 0 if the pipeline runs, with fewer compute threads if some failed to
+        start, 1 if it can't run
+*/
+int start_tessb_pipe(TESSB_JOB *job, TESSB_WORKER *workers,
+    pthread_t *threads, int nthreads, int *started);
+
+
+/** Hand over the last block, tell the threads that the input ended and wait
+for them to calculate and print everything.
+
+@param job the pipeline
+@param threads the threads of start_tessb_pipe
+@param started number of threads started
+@param error 1 if the pipeline could not start, so that nothing is handed
+             over
+*/
+void stop_tessb_pipe(TESSB_JOB *job, pthread_t *threads, int started,
+    int error);
+
+#endif
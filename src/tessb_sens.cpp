@@ -0,0 +1,141 @@
+/*
+Sensitivity matrix of option --kernel of the tessb* programs.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "logger.h"
+#include "mag_tess.h"
+#include "mag_sens.h"
+#include "tessb_pipe.h"
+#include "tessb_sens.h"
+#ifdef TESSB_MPI
+#include <mpi.h>
+#endif
+
+
+/* Points of the sensitivity matrix that a compute thread fills in */
+typedef struct tessb_sens_struct
+{
+    TESSB_WORKER *worker;
+    MAG_SENS *sens;
+    long long first; /* first point of the thread */
+    long long step; /* distance to its next point */
+} TESSB_SENS;
+
+
+/* Fill in the rows of the sensitivity matrix of the points of a compute
+   thread */
+static void * run_tessb_sens(void *arg)
+{
+    TESSB_SENS *part = (TESSB_SENS *)arg;
+    TESSB_WORKER *worker = part->worker;
+    TESSB_JOB *job = worker->job;
+    MAG_SENS *sens = part->sens;
+    const double *coords;
+    long long p, size = sens->ncomps*3*sens->ntess;
+    double cpu = tessb_clock_of(CLOCK_THREAD_CPUTIME_ID);
+
+    for(p = part->first; p < sens->npoints; p += part->step)
+    {
+        coords = &(sens->points[3*p]);
+        mag_point_set(&(worker->tile[0]), coords[0], coords[1], coords[2]);
+        calc_mag_sens_rows(job->model, &(job->calc), &(worker->tile[0]),
+                           worker->glq_lon, worker->glq_lat, worker->glq_r,
+                           &(worker->stats), &(sens->matrix[p*size]));
+    }
+    worker->cpu += tessb_clock_of(CLOCK_THREAD_CPUTIME_ID) - cpu;
+    return NULL;
+}
+
+
+/* Calculate the sensitivity matrix of the points into a file, with the
+   threads of all ranks. Only rank 0 has the points and makes the file; the
+   other ranks map it and fill in their rows. Returns 1 if there was an
+   error. */
+int run_tessb_kernel(TESSB_JOB *job, TESSB_WORKER *workers,
+    pthread_t *threads, int nthreads, const char *fname,
+    const double *points, long long npoints)
+{
+    MAG_SENS *sens = NULL;
+    TESSB_SENS *parts;
+    int i, started, ok = 1;
+
+    if(job->rank == 0 && npoints >= 0)
+    {
+        sens = mag_sens_create(fname, job->calc.vector ? MAG_SENS_VECTOR :
+                               job->calc.component, npoints, job->model);
+        if(sens != NULL)
+        {
+            memcpy(sens->points, points, 3*npoints*sizeof(double));
+            log_info("Sensitivity matrix of %lld point(s) and %d tesseroid(s) in %s (%.3g MB)",
+                     npoints, job->model->size, fname,
+                     sens->size/(1024.*1024.));
+        }
+    }
+    if(job->rank == 0)
+    {
+        ok = sens != NULL;
+    }
+#ifdef TESSB_MPI
+    /* The file must be there before the other ranks map it */
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if(ok && job->rank > 0)
+    {
+        sens = mag_sens_open(fname, 1);
+        if(sens == NULL)
+        {
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+#endif
+    if(!ok)
+    {
+        return 1;
+    }
+    parts = (TESSB_SENS *)malloc(nthreads*sizeof(TESSB_SENS));
+    if(parts == NULL)
+    {
+        log_error("problem allocating memory for %d thread(s)", nthreads);
+#ifdef TESSB_MPI
+        MPI_Abort(MPI_COMM_WORLD, 1);
+#endif
+        mag_sens_close(sens);
+        return 1;
+    }
+    /* The points are dealt out in turn, so that all threads get near and
+       far ones */
+    for(started = 0; started < nthreads; started++)
+    {
+        parts[started].worker = &workers[started];
+        parts[started].sens = sens;
+        parts[started].first = (long long)job->rank*nthreads + started;
+        parts[started].step = (long long)job->nranks*nthreads;
+        if(pthread_create(&threads[started], NULL, run_tessb_sens,
+                          &parts[started]) != 0)
+        {
+            log_warning("failed to start thread %d. Calculating its points and those of the next ones in this thread",
+                        started + 1);
+            break;
+        }
+    }
+    for(i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    /* The points of the threads that did not start */
+    for(i = started; i < nthreads; i++)
+    {
+        run_tessb_sens(&parts[i]);
+    }
+    free(parts);
+    mag_sens_close(sens);
+#ifdef TESSB_MPI
+    /* Rank 0 tells it is done once all rows are in the file */
+    MPI_Barrier(MPI_COMM_WORLD);
+#endif
+    return 0;
+}
@@ -0,0 +1,35 @@
+/*
+Sensitivity matrix of option --kernel of the tessb* programs: the compute
+threads of all MPI ranks fill in the rows of the points of a sensitivity
+file (see mag_sens.h) instead of calculating the field.
+*/
+
+#ifndef _TESSEROIDS_TESSB_SENS_H_
+#define _TESSEROIDS_TESSB_SENS_H_
+
+
+#include <pthread.h>
+/* Needed for definition of TESSB_JOB and TESSB_WORKER */
+#include "tessb_pipe.h"
+
+
+/** Calculate the sensitivity matrix of the points into a file, with the
+threads of all ranks. Only rank 0 has the points and makes the file; the
+other ranks map it and fill in their rows, so it must be on a file system
+they share.
+
+@param job the model and the settings of the calculation
+@param workers the compute threads, made by init_tessb_worker
+@param threads room for nthreads threads
+@param nthreads number of compute threads
+@param fname name of the sensitivity file
+@param points lon, lat and height of the points, on rank 0
+@param npoints number of points on rank 0, -1 if they could not be read
+
+@return 0 if all went well, 1 if there was an error (the reason is logged)
+*/
+int run_tessb_kernel(TESSB_JOB *job, TESSB_WORKER *workers,
+    pthread_t *threads, int nthreads, const char *fname,
+    const double *points, long long npoints);
+
+#endif
@@ -0,0 +1,136 @@
+/*
+Statistics of the runs of the tessb* programs and the report of --stats.
+*/
+
+
+#include <stdio.h>
+#include "version.h"
+#include "grav_tess.h"
+#include "parsers.h"
+#include "tessb_pipe.h"
+#include "tessb_stats.h"
+
+
+/* Sum the statistics of the compute threads */
+void sum_tessb_stats(const TESSB_WORKER *workers, int nthreads, long *stats)
+{
+    int i, j;
+
+    for(i = 0; i < TESSB_NSTATS; i++)
+    {
+        stats[i] = 0;
+    }
+    for(i = 0; i < nthreads; i++)
+    {
+        stats[TESSB_STAT_DEPTH_HITS] += workers[i].stats.adapt.depth_hits;
+        stats[TESSB_STAT_EVALS] += workers[i].stats.evals;
+        stats[TESSB_STAT_FAR] += workers[i].stats.far_evals;
+        stats[TESSB_STAT_TREE] += workers[i].stats.tree_nodes;
+        stats[TESSB_STAT_FFT_POINTS] += workers[i].stats.fft_points;
+        stats[TESSB_STAT_FFT_KERNELS] += workers[i].stats.fft_kernels;
+        stats[TESSB_STAT_LEAVES] += workers[i].stats.adapt.leaves;
+        stats[TESSB_STAT_TRUNCATED] += workers[i].stats.truncated;
+        stats[TESSB_STAT_MID] += workers[i].stats.mid_evals;
+        for(j = 0; j < TESS_ADAPT_MAX_DEPTH; j++)
+        {
+            stats[TESSB_STAT_SPLITS + j] += workers[i].stats.adapt.splits[j];
+        }
+    }
+}
+
+
+/* Print a string as a JSON string */
+static void print_tessb_json_string(FILE *file, const char *str)
+{
+    fputc('"', file);
+    for(; *str != '\0'; str++)
+    {
+        if(*str == '"' || *str == '\\')
+            fprintf(file, "\\%c", *str);
+        else if((unsigned char)*str < 0x20)
+            fprintf(file, "\\u%04x", *str);
+        else
+            fputc(*str, file);
+    }
+    fputc('"', file);
+}
+
+
+/* Print the wall and CPU time of a stage as a JSON object */
+static void print_tessb_json_times(FILE *file, const char *name,
+    const TESSB_TIMES *times, const char *end)
+{
+    fprintf(file, "    \"%s\": {\"wall_seconds\": %.6g, \"cpu_seconds\": %.6g}%s\n",
+            name, times->wall, times->cpu, end);
+}
+
+
+/* Write the report of --stats as JSON. Returns 1 if there was an error. */
+int write_tessb_stats(const char *fname, const char *progname,
+    const TESSB_ARGS *args, const TESSB_JOB *job, int modelsize,
+    const TESSB_REPORT *report)
+{
+    FILE *file;
+    const long *stats = report->stats;
+    long kernels;
+    int d;
+
+    file = fopen(fname, "w");
+    if(file == NULL)
+    {
+        return 1;
+    }
+    /* Pieces of the division, or the tesseroids calculated with the GLQ */
+    kernels = stats[TESSB_STAT_EVALS] - stats[TESSB_STAT_FAR];
+    if(args->adaptative)
+    {
+        kernels = stats[TESSB_STAT_LEAVES];
+    }
+    fprintf(file, "{\n");
+    fprintf(file, "  \"program\": \"%s\",\n", progname);
+    fprintf(file, "  \"version\": ");
+    print_tessb_json_string(file, tesseroids_version);
+    fprintf(file, ",\n  \"model\": ");
+    print_tessb_json_string(file, args->modelfname);
+    fprintf(file, ",\n  \"tesseroids\": %d,\n", modelsize);
+    fprintf(file, "  \"threads\": %d,\n", args->threads);
+    fprintf(file, "  \"ranks\": %d,\n", job->nranks);
+    fprintf(file, "  \"points\": %ld,\n", report->points);
+    fprintf(file, "  \"points_per_second\": %.6g,\n",
+            report->compute.wall > 0 ?
+            report->points/report->compute.wall : 0);
+    fprintf(file, "  \"wall_seconds\": %.6g,\n", report->total.wall);
+    fprintf(file, "  \"cpu_seconds\": %.6g,\n", report->total.cpu);
+    fprintf(file, "  \"stages\": {\n");
+    print_tessb_json_times(file, "load", &(report->load), ",");
+    print_tessb_json_times(file, "read", &(report->read), ",");
+    print_tessb_json_times(file, "compute", &(report->compute), ",");
+    print_tessb_json_times(file, "output", &(report->output), "");
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"evaluations\": {\n");
+    fprintf(file, "    \"tesseroid_point\": %ld,\n", stats[TESSB_STAT_EVALS]);
+    fprintf(file, "    \"glq_kernels\": %ld,\n", kernels);
+    fprintf(file, "    \"point_mass\": %ld,\n", stats[TESSB_STAT_FAR]);
+    fprintf(file, "    \"tree_nodes\": %ld,\n", stats[TESSB_STAT_TREE]);
+    fprintf(file, "    \"fft_points\": %ld,\n", stats[TESSB_STAT_FFT_POINTS]);
+    fprintf(file, "    \"fft_kernels\": %ld,\n", stats[TESSB_STAT_FFT_KERNELS]);
+    fprintf(file, "    \"truncated\": %ld,\n", stats[TESSB_STAT_TRUNCATED]);
+    fprintf(file, "    \"index_unchecked\": %ld\n", stats[TESSB_STAT_MID]);
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"adaptive\": {\n");
+    fprintf(file, "    \"enabled\": %s,\n", args->adaptative ? "true" : "false");
+    fprintf(file, "    \"max_depth\": %d,\n", args->max_depth);
+    fprintf(file, "    \"depth_limit_hits\": %ld,\n",
+            stats[TESSB_STAT_DEPTH_HITS]);
+    fprintf(file, "    \"splits_per_depth\": [");
+    for(d = 0; args->adaptative && d < args->max_depth; d++)
+    {
+        fprintf(file, "%s%ld", d > 0 ? ", " : "",
+                stats[TESSB_STAT_SPLITS + d]);
+    }
+    fprintf(file, "]\n");
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"peak_memory_mb\": %.6g\n", report->peak_mb);
+    fprintf(file, "}\n");
+    return fclose(file) != 0;
+}
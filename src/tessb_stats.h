@@ -0,0 +1,79 @@
+/*
+Statistics of the runs of the tessb* programs and the report of option
+--stats: the times of the stages of a run, the counters of the compute
+threads and the JSON file they are written to.
+*/
+
+#ifndef _TESSEROIDS_TESSB_STATS_H_
+#define _TESSEROIDS_TESSB_STATS_H_
+
+
+/* Needed for definition of TESS_ADAPT_MAX_DEPTH */
+#include "grav_tess.h"
+/* Needed for definition of TESSB_ARGS */
+#include "parsers.h"
+/* Needed for definition of TESSB_JOB and TESSB_WORKER */
+#include "tessb_pipe.h"
+
+
+/* Counters of the statistics of the threads, summed over the ranks */
+#define TESSB_STAT_DEPTH_HITS 0 /* depth limit of the division reached */
+#define TESSB_STAT_EVALS 1 /* tesseroid-point evaluations */
+#define TESSB_STAT_FAR 2 /* of which with a point mass */
+#define TESSB_STAT_TREE 3 /* nodes of the tree from their moments */
+#define TESSB_STAT_FFT_POINTS 4 /* points of the convolutions */
+#define TESSB_STAT_FFT_KERNELS 5 /* kernels of the convolutions */
+#define TESSB_STAT_LEAVES 6 /* pieces of the division calculated */
+#define TESSB_STAT_TRUNCATED 7 /* pairs skipped beyond the truncation */
+#define TESSB_STAT_MID 8 /* evaluations the index let go without checks */
+#define TESSB_STAT_SPLITS 9 /* first of the divisions at each depth */
+#define TESSB_NSTATS (TESSB_STAT_SPLITS + TESS_ADAPT_MAX_DEPTH)
+
+
+/* Wall and CPU time of a stage of a run, in seconds */
+typedef struct tessb_times_struct
+{
+    double wall;
+    double cpu;
+} TESSB_TIMES;
+
+
+/* Measures of a run for the report of --stats */
+typedef struct tessb_report_struct
+{
+    TESSB_TIMES total; /* the whole run */
+    TESSB_TIMES load; /* reading the model and preparing the calculation */
+    TESSB_TIMES read; /* reading the computation points */
+    TESSB_TIMES compute; /* calculating them, CPU of all threads and ranks */
+    TESSB_TIMES output; /* writing the results */
+    long points; /* computation points calculated in this run */
+    double peak_mb; /* largest resident memory of a rank in MB */
+    long stats[TESSB_NSTATS]; /* counters of all threads and ranks */
+} TESSB_REPORT;
+
+
+/** Sum the statistics of the compute threads.
+
+@param workers the threads
+@param nthreads number of threads
+@param stats the TESSB_NSTATS counters, set to the sums
+*/
+void sum_tessb_stats(const TESSB_WORKER *workers, int nthreads, long *stats);
+
+
+/** Write the report of --stats as JSON.
+
+@param fname name of the file
+@param progname name of the program
+@param args the options of the run
+@param job the pipeline, for the number of ranks
+@param modelsize number of tesseroids
+@param report the measures of the run
+
+@return 0 if all went well, 1 if there was an error
+*/
+int write_tessb_stats(const char *fname, const char *progname,
+    const TESSB_ARGS *args, const TESSB_JOB *job, int modelsize,
+    const TESSB_REPORT *report);
+
+#endif
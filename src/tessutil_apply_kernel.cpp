@@ -0,0 +1,181 @@
+/*
+Calculate the magnetic field of new magnetizations of a tesseroid model from
+its sensitivity matrix, written by the tessb* programs with --kernel=FILE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "logger.h"
+#include "version.h"
+#include "geometry.h"
+#include "parsers.h"
+#include "mag_sens.h"
+#include "text_io.h"
+
+
+void print_apply_help(const char *progname)
+{
+    printf("MAGNETIC TESSEROIDS: Sensitivity Matrix\n");
+    printf("Usage: %s KERNELFILE MODELFILE [MODELFILE...]\n\n", progname);
+    printf("Calculate the magnetic field on the computation points of the\n");
+    printf("sensitivity matrix KERNELFILE, written by tessb, tessbx, tessby or\n");
+    printf("tessbz with --kernel=KERNELFILE, for the magnetization of each\n");
+    printf("MODELFILE. The models must have the same tesseroids, in the same\n");
+    printf("order, as the model of the matrix; only their susceptibility and\n");
+    printf("inducing field may differ. Each line of the output has the\n");
+    printf("longitude, latitude and height of a point, then the components of\n");
+    printf("the matrix for each model in turn.\n");
+}
+
+
+/* Read a model file with the tesseroids of a sensitivity matrix and put its
+   magnetization in column k of m. Returns 1 if there was an error. */
+static int read_apply_model(const char *fname, const MAG_SENS *sens, int k,
+    int ncases, double *m)
+{
+    TESSEROID *array;
+    TESS_MODEL *model;
+    FILE *file;
+    long long t;
+    int size;
+
+    file = fopen(fname, "r");
+    if(file == NULL)
+    {
+        log_error("failed to open model file %s", fname);
+        return 1;
+    }
+    array = read_mag_tess_model(file, &size);
+    fclose(file);
+    if(array == NULL || size == 0)
+    {
+        log_error("failed to read model from file %s", fname);
+        free(array);
+        return 1;
+    }
+    model = tess_model_from_array(array, size);
+    free(array);
+    if(model == NULL)
+    {
+        log_error("problem allocating memory for %d tesseroid(s)", size);
+        return 1;
+    }
+    t = mag_sens_check_model(sens, model);
+    if(t >= 0)
+    {
+        log_error("model file %s does not have the tesseroids of the sensitivity matrix (%d tesseroid(s) for %lld, first difference at tesseroid %lld)",
+                  fname, size, sens->ntess, t + 1);
+        tess_model_free(model);
+        return 1;
+    }
+    for(t = 0; t < sens->ntess; t++)
+    {
+        m[(3*t)*ncases + k] = model->mx[t];
+        m[(3*t + 1)*ncases + k] = model->my[t];
+        m[(3*t + 2)*ncases + k] = model->mz[t];
+    }
+    tess_model_free(model);
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    const char *progname = "tessutil_apply_kernel";
+    const char *names[] = {"bx", "by", "bz"};
+    MAG_SENS *sens;
+    TEXT_OUT *out;
+    double *m, *res;
+    long long p, size;
+    int ncases, k, c, rc = 0;
+
+    log_init(LOG_WARNING);
+    if(argc == 2 && !strcmp(argv[1], "-h"))
+    {
+        print_apply_help(progname);
+        return 0;
+    }
+    if(argc == 2 && !strcmp(argv[1], "--version"))
+    {
+        print_version(progname);
+        return 0;
+    }
+    if(argc < 3)
+    {
+        log_error("needs a sensitivity matrix and at least one model file");
+        log_warning("Try '%s -h' for instructions", progname);
+        return 1;
+    }
+    sens = mag_sens_open(argv[1], 0);
+    if(sens == NULL)
+    {
+        return 1;
+    }
+    ncases = argc - 2;
+    size = sens->npoints*sens->ncomps;
+    m = (double *)malloc(3*sens->ntess*ncases*sizeof(double));
+    res = (double *)malloc((size > 0 ? size : 1)*ncases*sizeof(double));
+    out = text_out_new(stdout, TEXT_OUT_SIZE);
+    if(m == NULL || res == NULL || out == NULL)
+    {
+        log_error("problem allocating memory for %d model(s)", ncases);
+        rc = 1;
+    }
+    for(k = 0; rc == 0 && k < ncases; k++)
+    {
+        rc = read_apply_model(argv[2 + k], sens, k, ncases, m);
+    }
+    if(rc == 0 && mag_sens_apply(sens, m, ncases, res))
+    {
+        log_error("sensitivity matrix %s is too large for the BLAS",
+                  argv[1]);
+        rc = 1;
+    }
+    if(rc == 0)
+    {
+        /* A header with provenance information, as the tessb* programs */
+        if(sens->component == MAG_SENS_VECTOR)
+            printf("# bx, by, bz components calculated with %s %s:\n",
+                   progname, tesseroids_version);
+        else
+            printf("# %s component calculated with %s %s:\n",
+                   names[sens->component], progname, tesseroids_version);
+        printf("#   sensitivity matrix: %s (%lld points, %lld tesseroids)\n",
+               argv[1], sens->npoints, sens->ntess);
+        for(k = 0; k < ncases; k++)
+        {
+            printf("#   model file: %s\n", argv[2 + k]);
+        }
+        fflush(stdout);
+        for(p = 0; p < sens->npoints; p++)
+        {
+            text_out_double(out, sens->points[3*p], TEXT_FORMAT_SHORTEST);
+            text_out_char(out, ' ');
+            text_out_double(out, sens->points[3*p + 1], TEXT_FORMAT_SHORTEST);
+            text_out_char(out, ' ');
+            text_out_double(out, sens->points[3*p + 2], TEXT_FORMAT_SHORTEST);
+            for(k = 0; k < ncases; k++)
+            {
+                for(c = 0; c < sens->ncomps; c++)
+                {
+                    text_out_char(out, ' ');
+                    text_out_double(out,
+                        res[(p*sens->ncomps + c)*ncases + k],
+                        TEXT_FORMAT_SHORTEST);
+                }
+            }
+            text_out_char(out, '\n');
+        }
+    }
+    if(out != NULL && text_out_free(out))
+    {
+        log_error("problem writing the results to stdout");
+        rc = 1;
+    }
+    free(m);
+    free(res);
+    mag_sens_close(sens);
+    return rc;
+}
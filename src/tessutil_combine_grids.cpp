@@ -2,27 +2,75 @@
 #include <stdlib.h>            
 #include <string.h>
 #include <math.h> 
+#include "grid_bin.h"
+#include "text_io.h"
 
 #define MAX_GRID_POINTS 16000
 
-#define GRID_FORMAT "%lf %lf %f %lf"
 
+void printresult_binary(double* longitudes, double* latitudes, float* altitudes, double* values, int n_values)
+{
+	double row[4];
+
+	grid_bin_write_header(stdout, 4, n_values);
+	for (int h = 0; h < n_values; h++)
+	{
+		row[0] = longitudes[h];
+		row[1] = latitudes[h];
+		row[2] = altitudes[h];
+		row[3] = values[h];
+		fwrite(row, sizeof(double), 4, stdout);
+	}
+
+	return;
+}
+
+/* Same characters as printf("%lf %lf %f %lf\n") */
 void printresult_withalt(double* longitudes, double* latitudes, float* altitudes, double* values, int n_values)
 {
+	TEXT_OUT *out = text_out_new(stdout, TEXT_OUT_SIZE);
 
-  
+	if (out == NULL)
+	{
+		printf("ERROR: Can not allocate the output buffer.\n");
+		exit(EXIT_FAILURE);
+	}
 	for (int h = 0; h < n_values; h++)
-        printf( "%lf %lf %f %lf\n", longitudes[h], latitudes[h], altitudes[h], values[h]);
+	{
+		text_out_double(out, longitudes[h], TEXT_FORMAT_FIXED);
+		text_out_char(out, ' ');
+		text_out_double(out, latitudes[h], TEXT_FORMAT_FIXED);
+		text_out_char(out, ' ');
+		text_out_double(out, altitudes[h], TEXT_FORMAT_FIXED);
+		text_out_char(out, ' ');
+		text_out_double(out, values[h], TEXT_FORMAT_FIXED);
+		text_out_char(out, '\n');
+	}
+	text_out_free(out);
 
 	return;
 }
 
+/* Same characters as printf("%lf %lf %lf\n") */
 void printresult(double* longitudes, double* latitudes, double* values, int n_values)
 {
+	TEXT_OUT *out = text_out_new(stdout, TEXT_OUT_SIZE);
 
-  
+	if (out == NULL)
+	{
+		printf("ERROR: Can not allocate the output buffer.\n");
+		exit(EXIT_FAILURE);
+	}
 	for (int h = 0; h < n_values; h++)
-        printf( "%lf %lf %lf\n", longitudes[h], latitudes[h], values[h]);
+	{
+		text_out_double(out, longitudes[h], TEXT_FORMAT_FIXED);
+		text_out_char(out, ' ');
+		text_out_double(out, latitudes[h], TEXT_FORMAT_FIXED);
+		text_out_char(out, ' ');
+		text_out_double(out, values[h], TEXT_FORMAT_FIXED);
+		text_out_char(out, '\n');
+	}
+	text_out_free(out);
 
 	return;
 }
@@ -30,6 +78,13 @@ void printresult(double* longitudes, double* latitudes, double* values, int n_va
 
 int main(int argc, char**argv)
 {
+	/* --binary as the first argument writes a binary grid */
+	int binary = (argc > 1) && !strcmp(argv[1], "--binary");
+	if (binary)
+	{
+		argc--;
+		argv++;
+	}
 	int n_files = (argc-1)/2;
 	
 	double lons[MAX_GRID_POINTS];
@@ -58,6 +113,34 @@ int main(int argc, char**argv)
 		}
 		
 		n_lines = 0;
+		/* Binary grids are read through mmap, the value is the 4th column */
+		if (grid_bin_detect(fp))
+		{
+			GRID_BIN *grid = grid_bin_open(fp);
+			double row[64];
+
+			if ((grid == NULL) || (grid->ncols < 4) || (grid->ncols > 64))
+			{
+				printf("ERROR: Bad binary grid %s.\n", argv[1+2*i]);
+				exit(EXIT_FAILURE);
+			}
+			while (grid_bin_read(grid, row))
+			{
+				n_lines++;
+				if (n_lines>MAX_GRID_POINTS)
+				{
+					printf("ERROR: Too many grid points (> %d) in the input. Recompile program with a bigger value of MAX_GRID_POINTS.\n", n_lines);
+					exit(EXIT_FAILURE);
+				}
+				lons[n_lines-1] = row[0];
+				lats[n_lines-1] = row[1];
+				alts[n_lines-1] = row[2];
+				vals[n_lines-1] = vals[n_lines-1] + row[3]*factor;
+			}
+			grid_bin_close(grid);
+			fclose(fp);
+			continue;
+		}
 		while ((read = getline(&line, &len, fp )) != -1)
 		{
 
@@ -69,10 +152,13 @@ int main(int argc, char**argv)
 					printf("ERROR: Too many grid points (> %d) in the input. Recompile program with a bigger value of MAX_GRID_POINTS.\n", n_lines);
 					exit(EXIT_FAILURE);
 				}
-				double value;
-			
-				sscanf(line, GRID_FORMAT, &lons[n_lines-1], &lats[n_lines-1], &alts[n_lines-1], &value);
-				vals[n_lines-1] = vals[n_lines-1] + value*factor;
+				double v[4] = {0, 0, 0, 0};
+
+				text_parse_doubles(line, 4, v);
+				lons[n_lines-1] = v[0];
+				lats[n_lines-1] = v[1];
+				alts[n_lines-1] = (float)v[2];
+				vals[n_lines-1] = vals[n_lines-1] + v[3]*factor;
 
 			}
 		}
@@ -81,7 +167,9 @@ int main(int argc, char**argv)
 	
 	int no_alt = 0;
 	
-	if (no_alt)
+	if (binary)
+		printresult_binary(lons, lats, alts, vals, n_lines);
+	else if (no_alt)
 		printresult(lons, lats, vals,  n_lines);
     else
 		printresult_withalt(lons, lats, alts, vals, n_lines);
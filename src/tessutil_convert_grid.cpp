@@ -0,0 +1,235 @@
+/*
+Convert grids between the text format and the binary format of grid_bin.h.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "logger.h"
+#include "version.h"
+#include "grid_bin.h"
+#include "text_io.h"
+
+
+/* Size of the buffer used to read a line of a text grid */
+#define CONVERT_LINE_SIZE 10000
+/* Largest number of columns of a text grid */
+#define CONVERT_MAX_COLS 64
+
+
+void print_convert_help(const char *progname)
+{
+    printf("MAGNETIC TESSEROIDS: Grid Converter\n");
+    printf("Usage: %s [--compat-format] INPUT OUTPUT\n\n", progname);
+    printf("Convert a text grid into a binary grid, or a binary grid into a\n");
+    printf("text grid. The direction is taken from the format of INPUT.\n");
+    printf("INPUT can be - for stdin. A text OUTPUT can be - for stdout; a\n");
+    printf("binary OUTPUT must be a file, written through mmap.\n");
+    printf("The numbers of a text OUTPUT are written with the fewest digits\n");
+    printf("that read back to the same double. With --compat-format they are\n");
+    printf("written as printf(\"%%.15g\").\n");
+}
+
+
+/* Parse the numbers of a line of a text grid. Returns the number of
+   columns. */
+static int parse_convert_line(const char *line, double *values)
+{
+    const char *pos = line, *end;
+    int ncols = 0;
+
+    while(ncols < CONVERT_MAX_COLS)
+    {
+        end = text_parse_double(pos, &values[ncols]);
+        if(end == NULL)
+        {
+            break;
+        }
+        ncols++;
+        pos = end;
+    }
+    /* Anything but blanks after the numbers is an error */
+    while(*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n')
+    {
+        pos++;
+    }
+    return *pos == '\0' ? ncols : -1;
+}
+
+
+/* Read a text grid and write it as a binary grid */
+static int text_to_binary(FILE *in, const char *outname)
+{
+    GRID_BIN *out;
+    double values[CONVERT_MAX_COLS], *data = NULL, *tmp;
+    long long nrows = 0, capacity = 0;
+    char buff[CONVERT_LINE_SIZE];
+    int ncols = 0, n, line;
+
+    for(line = 1; fgets(buff, CONVERT_LINE_SIZE, in) != NULL; line++)
+    {
+        if(buff[0] == '#' || buff[0] == '\r' || buff[0] == '\n')
+        {
+            continue;
+        }
+        n = parse_convert_line(buff, values);
+        if(n < 1 || (ncols != 0 && n != ncols))
+        {
+            log_error("bad/invalid grid line %d", line);
+            free(data);
+            return 1;
+        }
+        ncols = n;
+        if(nrows == capacity)
+        {
+            capacity = 2*capacity + 4096;
+            tmp = (double *)realloc(data, capacity*ncols*sizeof(double));
+            if(tmp == NULL)
+            {
+                log_error("problem allocating memory for %lld row(s)",
+                          capacity);
+                free(data);
+                return 1;
+            }
+            data = tmp;
+        }
+        memcpy(&data[nrows*ncols], values, ncols*sizeof(double));
+        nrows++;
+    }
+    if(ncols == 0)
+    {
+        log_error("no grid points in the input");
+        return 1;
+    }
+    out = grid_bin_create(outname, ncols, nrows);
+    if(out == NULL)
+    {
+        free(data);
+        return 1;
+    }
+    memcpy(out->data, data, nrows*ncols*sizeof(double));
+    grid_bin_close(out);
+    free(data);
+    return 0;
+}
+
+
+/* Read a binary grid and write it as text, with the numbers in format, one
+   of TEXT_FORMAT_SHORTEST or TEXT_FORMAT_COMPAT */
+static int binary_to_text(FILE *in, FILE *out, int format)
+{
+    GRID_BIN *grid;
+    TEXT_OUT *text;
+    double *row;
+    int c, rc = 0;
+
+    grid = grid_bin_open(in);
+    if(grid == NULL)
+    {
+        return 1;
+    }
+    row = (double *)malloc(grid->ncols*sizeof(double));
+    text = text_out_new(out, TEXT_OUT_SIZE);
+    if(row == NULL || text == NULL)
+    {
+        log_error("problem allocating memory for a row");
+        free(row);
+        text_out_free(text);
+        grid_bin_close(grid);
+        return 1;
+    }
+    while(grid_bin_read(grid, row))
+    {
+        text_out_double(text, row[0], format);
+        for(c = 1; c < grid->ncols; c++)
+        {
+            text_out_char(text, ' ');
+            text_out_double(text, row[c], format);
+        }
+        text_out_char(text, '\n');
+    }
+    if(text_out_free(text))
+    {
+        log_error("problem writing the text grid");
+        rc = 1;
+    }
+    free(row);
+    grid_bin_close(grid);
+    return rc;
+}
+
+
+int main(int argc, char **argv)
+{
+    const char *progname = "tessutil_convert_grid";
+    const char *names[2];
+    FILE *in, *out;
+    int i, nnames = 0, format = TEXT_FORMAT_SHORTEST, rc;
+
+    log_init(LOG_WARNING);
+    if(argc == 2 && !strcmp(argv[1], "-h"))
+    {
+        print_convert_help(progname);
+        return 0;
+    }
+    if(argc == 2 && !strcmp(argv[1], "--version"))
+    {
+        print_version(progname);
+        return 0;
+    }
+    for(i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--compat-format"))
+        {
+            format = TEXT_FORMAT_COMPAT;
+        }
+        else if(nnames < 2)
+        {
+            names[nnames++] = argv[i];
+        }
+        else
+        {
+            nnames++;
+        }
+    }
+    if(nnames != 2)
+    {
+        log_error("needs an input and an output grid");
+        log_warning("Try '%s -h' for instructions", progname);
+        return 1;
+    }
+    in = strcmp(names[0], "-") ? fopen(names[0], "rb") : stdin;
+    if(in == NULL)
+    {
+        log_error("unable to open grid %s", names[0]);
+        return 1;
+    }
+    if(grid_bin_detect(in))
+    {
+        out = strcmp(names[1], "-") ? fopen(names[1], "w") : stdout;
+        if(out == NULL)
+        {
+            log_error("unable to create grid %s", names[1]);
+            rc = 1;
+        }
+        else
+        {
+            rc = binary_to_text(in, out, format);
+            if(out != stdout)
+                fclose(out);
+        }
+    }
+    else if(!strcmp(names[1], "-"))
+    {
+        log_error("binary grids are written through mmap and need a file name");
+        rc = 1;
+    }
+    else
+    {
+        rc = text_to_binary(in, names[1]);
+    }
+    if(in != stdin)
+        fclose(in);
+    return rc;
+}
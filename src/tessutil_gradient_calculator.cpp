@@ -6,31 +6,118 @@
 #include "constants.h"
 #include "parsers.h"
 #include "linalg.h"
+#include "grid_bin.h"
+#include "text_io.h"
 
 #define MAX_GRID_POINTS 50000
 
-#define GRID_FORMAT "%lf %lf %f %lf"
 
 
 // TODO conversion of input/output units nT/km pT/km nT/m pT/m
 
 
-void printcomp(double* longitudes, double* latitudes, double* values, int n_values)
+/* Read the values (4th column) of a binary grid and, if lons is not NULL, its
+   coordinates. Returns the number of grid points, -1 if the grid is bad. */
+int read_binary_grid(FILE *fp, double* lons, double* lats, float* alts, double* values)
 {
+	GRID_BIN *grid = grid_bin_open(fp);
+	double row[64];
+	int n_values = 0;
+
+	if ((grid == NULL) || (grid->ncols < 4) || (grid->ncols > 64))
+	{
+		grid_bin_close(grid);
+		return -1;
+	}
+	while (grid_bin_read(grid, row))
+	{
+		if (n_values == MAX_GRID_POINTS)
+		{
+			printf("ERROR: Too many grid points (> %d) in the input. Recompile program with a bigger value of MAX_GRID_POINTS.\n", n_values);
+			exit(EXIT_FAILURE);
+		}
+		if (lons != NULL)
+		{
+			lons[n_values] = row[0];
+			lats[n_values] = row[1];
+			alts[n_values] = row[2];
+		}
+		values[n_values] = row[3];
+		n_values++;
+	}
+	grid_bin_close(grid);
+	return n_values;
+}
 
+/* Write LON LAT and the components as a binary grid */
+void printbinary(double* longitudes, double* latitudes, int n_values, int n_comps, double** values)
+{
+	double row[9];
 
+	grid_bin_write_header(stdout, 2 + n_comps, n_values);
 	for (int h = 0; h < n_values; h++)
-        printf("%lf %lf %lf\n", longitudes[h], latitudes[h], values[h]);
+	{
+		row[0] = longitudes[h];
+		row[1] = latitudes[h];
+		for (int c = 0; c < n_comps; c++)
+			row[2 + c] = values[c][h];
+		fwrite(row, sizeof(double), 2 + n_comps, stdout);
+	}
 
 	return;
 }
 
-void printall(double* longitudes, double* latitudes, int n_values,  double* values1,  double* values2,  double* values3,  double* values4,  double* values5,  double* values6,  double* values7)
+/* Read LON LAT ALT VALUE from a line of a text grid */
+void read_text_line(const char* line, double* lon, double* lat, float* alt, double* value)
 {
+	double v[4] = {0, 0, 0, 0};
+
+	text_parse_doubles(line, 4, v);
+	*lon = v[0];
+	*lat = v[1];
+	*alt = (float)v[2];
+	*value = v[3];
+}
 
+/* Write rows with the same characters as printf("%lf %lf ...\n") */
+void printtext(double* longitudes, double* latitudes, int n_values, int n_comps, double** values)
+{
+	TEXT_OUT *out = text_out_new(stdout, TEXT_OUT_SIZE);
 
+	if (out == NULL)
+	{
+		printf("ERROR: Can not allocate the output buffer.\n");
+		exit(EXIT_FAILURE);
+	}
 	for (int h = 0; h < n_values; h++)
-		printf("%lf %lf %lf %lf %lf %lf %lf %lf %lf\n", longitudes[h], latitudes[h], values1[h], values2[h], values3[h], values4[h], values5[h], values6[h], values7[h]);
+	{
+		text_out_double(out, longitudes[h], TEXT_FORMAT_FIXED);
+		text_out_char(out, ' ');
+		text_out_double(out, latitudes[h], TEXT_FORMAT_FIXED);
+		for (int c = 0; c < n_comps; c++)
+		{
+			text_out_char(out, ' ');
+			text_out_double(out, values[c][h], TEXT_FORMAT_FIXED);
+		}
+		text_out_char(out, '\n');
+	}
+	text_out_free(out);
+
+	return;
+}
+
+void printcomp(double* longitudes, double* latitudes, double* values, int n_values)
+{
+	printtext(longitudes, latitudes, n_values, 1, &values);
+
+	return;
+}
+
+void printall(double* longitudes, double* latitudes, int n_values,  double* values1,  double* values2,  double* values3,  double* values4,  double* values5,  double* values6,  double* values7)
+{
+	double* values[7] = {values1, values2, values3, values4, values5, values6, values7};
+
+	printtext(longitudes, latitudes, n_values, 7, values);
 
 	return;
 }
@@ -52,6 +139,8 @@ void print_gradcalc_help(const char *progname)
 	printf("\t-o[COMPONENT]\t\t If 0, then output format is LON LAT BXX BYX BZX BXY BYY BZY BZZ, if 1-7, then \n");
 	printf("\tonly corresponding component would be printed with format LON LAT B**.\n");
 	printf("\tNOTE: output is always in North-East-Down coordinate system.\n\t\tLON, LAT in [deg], B** in [nT/km].\n");
+	printf("\t--binary\t\t Write the output as a binary grid with the same columns.\n");
+	printf("\tNOTE: input grids can be text or binary grids (see tessutil_convert_grid).\n");
 
 
 
@@ -90,11 +179,15 @@ int main(int argc, char**argv)
 		exit(EXIT_FAILURE);
 	}
 
-	if (args.bz_NEU_NED == 1)
-		printf("#Coordinate system in input grids: North-East-Down\n");
-	else
-		printf("#Coordinate system in input grids: North-East-Up\n");
-	printf("#Coordinate system in output grid: North-East-Down\n");
+	/* Binary grids have no comments */
+	if (!args.binary)
+	{
+		if (args.bz_NEU_NED == 1)
+			printf("#Coordinate system in input grids: North-East-Down\n");
+		else
+			printf("#Coordinate system in input grids: North-East-Up\n");
+		printf("#Coordinate system in output grid: North-East-Down\n");
+	}
 
 
 	double lons[MAX_GRID_POINTS];
@@ -122,8 +215,16 @@ int main(int argc, char**argv)
 	int n_lines = 0;
 
 
-
-	while ((read = getline(&line, &len, bxfp )) != -1)
+	if (grid_bin_detect(bxfp))
+	{
+		n_lines = read_binary_grid(bxfp, lons, lats, alts, bx);
+		if (n_lines < 0)
+		{
+			printf("ERROR: Bad binary grid with Bx values.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	else while ((read = getline(&line, &len, bxfp )) != -1)
 	{
 
 		if ((line[0] != '#') && (strlen(line) > 2))
@@ -135,7 +236,7 @@ int main(int argc, char**argv)
 				exit(EXIT_FAILURE);
 			}
 
-			sscanf(line, GRID_FORMAT, &lons[n_lines-1], &lats[n_lines-1], &alts[n_lines-1], &bx[n_lines-1]);
+			read_text_line(line, &lons[n_lines-1], &lats[n_lines-1], &alts[n_lines-1], &bx[n_lines-1]);
 
 		}
 	}
@@ -143,7 +244,8 @@ int main(int argc, char**argv)
 
 
 	/*number of grid points*/
-	printf("#Number of grid points: %d\n", n_lines);
+	if (!args.binary)
+		printf("#Number of grid points: %d\n", n_lines);
 
 	/*grid spacing*/
 
@@ -177,9 +279,12 @@ int main(int argc, char**argv)
 		exit(EXIT_FAILURE);
 	}
 
-	printf("#Longitudinal step: %lf, latitudinal step: %lf \n", lon_step, lat_step);
-	printf("#Longitudinal points: %d, latitudinal points: %d \n", lon_n, lat_n);
-	printf("#Edges: W %lf, E %lf, S %lf, N %lf \n", lon_min, lon_max, lat_min, lat_max);
+	if (!args.binary)
+	{
+		printf("#Longitudinal step: %lf, latitudinal step: %lf \n", lon_step, lat_step);
+		printf("#Longitudinal points: %d, latitudinal points: %d \n", lon_n, lat_n);
+		printf("#Edges: W %lf, E %lf, S %lf, N %lf \n", lon_min, lon_max, lat_min, lat_max);
+	}
 
 	/* read other grids */
 	// By
@@ -191,7 +296,11 @@ int main(int argc, char**argv)
 	}
 
 	int n_lines2 = 0;
-	while ((read = getline(&line, &len, byfp )) != -1)
+	if (grid_bin_detect(byfp))
+	{
+		n_lines2 = read_binary_grid(byfp, NULL, NULL, NULL, by);
+	}
+	else while ((read = getline(&line, &len, byfp )) != -1)
 	{
 
 		if ((line[0] != '#') && (strlen(line) > 2))
@@ -200,7 +309,7 @@ int main(int argc, char**argv)
 			//printf("%s", line);
         		double dummy1, dummy2;
 			float dummy3;
-			sscanf(line, GRID_FORMAT , &dummy1, &dummy2, &dummy3, &by[n_lines2-1]);
+			read_text_line(line, &dummy1, &dummy2, &dummy3, &by[n_lines2-1]);
         	}
 	}
 	fclose(byfp);
@@ -220,7 +329,13 @@ int main(int argc, char**argv)
 	}
 
 	n_lines2 = 0;
-	while ((read = getline(&line, &len, bzfp )) != -1)
+	if (grid_bin_detect(bzfp))
+	{
+		n_lines2 = read_binary_grid(bzfp, NULL, NULL, NULL, bz);
+		for (int h = 0; h < n_lines2; h++)
+			bz[h] = args.bz_NEU_NED*bz[h]; //COORDINATE SYSTEM NEU or NED
+	}
+	else while ((read = getline(&line, &len, bzfp )) != -1)
 	{
 		if ((line[0] != '#') && (strlen(line) > 2))
 		{
@@ -229,7 +344,7 @@ int main(int argc, char**argv)
 			double dummy1, dummy2;
 			float dummy3;
 			double bz_curr;
-			sscanf(line, GRID_FORMAT, &dummy1, &dummy2, &dummy3,&bz_curr);
+			read_text_line(line, &dummy1, &dummy2, &dummy3, &bz_curr);
 
 			bz[n_lines2-1] = args.bz_NEU_NED* bz_curr; //COORDINATE SYSTEM NEU or NED
 		}
@@ -303,6 +418,17 @@ int main(int argc, char**argv)
 	}
 
 
+	double* all[7] = {bxx, byx, bzx, bxy, byy, bzy, bzz};
+
+	if (args.binary)
+	{
+		if ((args.out_set >= 1) && (args.out_set <= 7))
+			printbinary(lons, lats, n_lines, 1, &all[args.out_set - 1]);
+		else
+			printbinary(lons, lats, n_lines, 7, all);
+		return 0;
+	}
+
 	switch(args.out_set)
 	{
 		case 1:
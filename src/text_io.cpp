@@ -0,0 +1,200 @@
+/*
+Fast parsing and formatting of the numbers of text grids, and buffered
+output.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <charconv>
+#include "text_io.h"
+
+
+/* Parse a number after blanks, returning the end of the number */
+const char * text_parse_double(const char *str, double *value)
+{
+    const char *pos = str;
+
+    /* Same blanks as scanf, and the sign that from_chars rejects */
+    while(*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r' ||
+          *pos == '\v' || *pos == '\f')
+    {
+        pos++;
+    }
+    if(*pos == '+')
+    {
+        pos++;
+    }
+    std::from_chars_result res = std::from_chars(pos, pos + strlen(pos),
+                                                 *value);
+    if(res.ec != std::errc())
+    {
+        /* Out of range numbers are still numbers for scanf */
+        if(res.ec != std::errc::result_out_of_range)
+        {
+            return NULL;
+        }
+        *value = strtod(pos, NULL);
+    }
+    return res.ptr;
+}
+
+
+/* Parse up to n numbers separated by blanks at the beginning of a string */
+int text_parse_doubles(const char *str, int n, double *values)
+{
+    const char *pos = str;
+    int i;
+
+    for(i = 0; i < n; i++)
+    {
+        pos = text_parse_double(pos, &values[i]);
+        if(pos == NULL)
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+
+/* Format a double into buf */
+int text_format_double(char *buf, double value, int format)
+{
+    std::to_chars_result res;
+
+    switch(format)
+    {
+        case TEXT_FORMAT_COMPAT:
+            res = std::to_chars(buf, buf + TEXT_DOUBLE_SIZE, value,
+                                std::chars_format::general, 15);
+            break;
+        case TEXT_FORMAT_FIXED:
+            res = std::to_chars(buf, buf + TEXT_DOUBLE_SIZE, value,
+                                std::chars_format::fixed, 6);
+            if(res.ec != std::errc())
+            {
+                snprintf(buf, TEXT_DOUBLE_SIZE, "%f", value);
+                return (int)strlen(buf);
+            }
+            break;
+        default:
+            res = std::to_chars(buf, buf + TEXT_DOUBLE_SIZE, value);
+            break;
+    }
+    return (int)(res.ptr - buf);
+}
+
+
+/* Make an output of the given buffer size on a stream */
+TEXT_OUT * text_out_new(FILE *file, size_t size)
+{
+    TEXT_OUT *out;
+
+    out = (TEXT_OUT *)malloc(sizeof(TEXT_OUT));
+    if(out == NULL)
+    {
+        return NULL;
+    }
+    out->buf = (char *)malloc(size);
+    if(out->buf == NULL)
+    {
+        free(out);
+        return NULL;
+    }
+    out->file = file;
+    out->copy = NULL;
+    out->count = 0;
+    out->len = 0;
+    out->size = size;
+    out->error = 0;
+    return out;
+}
+
+
+/* Write characters to the streams of an output */
+static void text_out_put(TEXT_OUT *out, const char *str, size_t len)
+{
+    if(fwrite(str, 1, len, out->file) != len ||
+       (out->copy != NULL && fwrite(str, 1, len, out->copy) != len))
+    {
+        out->error = 1;
+    }
+    out->count += len;
+}
+
+
+/* Write the buffer of an output to its streams */
+int text_out_flush(TEXT_OUT *out)
+{
+    if(out->len > 0)
+    {
+        text_out_put(out, out->buf, out->len);
+    }
+    out->len = 0;
+    return out->error;
+}
+
+
+/* Add characters to an output */
+void text_out_write(TEXT_OUT *out, const char *str, size_t len)
+{
+    if(out->len + len > out->size)
+    {
+        text_out_flush(out);
+        /* Too large for the buffer, write it as it is */
+        if(len > out->size)
+        {
+            text_out_put(out, str, len);
+            return;
+        }
+    }
+    memcpy(out->buf + out->len, str, len);
+    out->len += len;
+}
+
+
+/* Add a '\0' terminated string to an output */
+void text_out_string(TEXT_OUT *out, const char *str)
+{
+    text_out_write(out, str, strlen(str));
+}
+
+
+/* Add a character to an output */
+void text_out_char(TEXT_OUT *out, char c)
+{
+    if(out->len == out->size)
+    {
+        text_out_flush(out);
+    }
+    out->buf[out->len++] = c;
+}
+
+
+/* Add a formatted double to an output */
+void text_out_double(TEXT_OUT *out, double value, int format)
+{
+    if(out->len + TEXT_DOUBLE_SIZE > out->size)
+    {
+        text_out_flush(out);
+    }
+    out->len += text_format_double(out->buf + out->len, value, format);
+}
+
+
+/* Flush an output and free its memory */
+int text_out_free(TEXT_OUT *out)
+{
+    int error;
+
+    if(out == NULL)
+    {
+        return 0;
+    }
+    error = text_out_flush(out);
+    free(out->buf);
+    free(out);
+    return error;
+}
@@ -0,0 +1,117 @@
+/*
+Fast parsing and formatting of the numbers of text grids, and buffered
+output.
+
+Numbers are parsed with std::from_chars and formatted with std::to_chars, so
+they don't depend on the locale and need no format string. The default
+format of the results is the shortest one that reads back to the same double.
+The compatible format gives the same characters as printf("%.15g").
+
+Example
+-------
+
+    TEXT_OUT *out = text_out_new(stdout, TEXT_OUT_SIZE);
+    double values[3];
+
+    if(text_parse_doubles(line, 3, values) == 3)
+    {
+        text_out_double(out, values[0], TEXT_FORMAT_SHORTEST);
+        text_out_char(out, '\n');
+    }
+    text_out_free(out);
+*/
+
+#ifndef _TESSEROIDS_TEXT_IO_H_
+#define _TESSEROIDS_TEXT_IO_H_
+
+
+#include <stdio.h>
+
+
+/* Formats of the doubles */
+#define TEXT_FORMAT_SHORTEST 0 /* shortest that reads back the same */
+#define TEXT_FORMAT_COMPAT 1 /* as printf("%.15g") */
+#define TEXT_FORMAT_FIXED 2 /* as printf("%f") */
+
+/* Room for a double in any of the formats, but large fixed numbers */
+#define TEXT_DOUBLE_SIZE 32
+
+/* Default size of the buffer of the output */
+#define TEXT_OUT_SIZE (1 << 20)
+
+
+/** Output written in large blocks */
+typedef struct text_out_struct
+{
+    FILE *file;
+    FILE *copy; /* second stream that gets the same characters, NULL for
+                   none */
+    long long count; /* number of characters written to the streams */
+    char *buf;
+    size_t len; /* number of characters in the buffer */
+    size_t size; /* size of the buffer */
+    int error; /* flag: a write failed */
+} TEXT_OUT;
+
+
+/** Parse a number after blanks at the beginning of a string, as sscanf with
+"%lf" would.
+
+@return the end of the number, NULL if there is no number
+*/
+const char * text_parse_double(const char *str, double *value);
+
+
+/** Parse up to n numbers separated by blanks at the beginning of a string,
+as sscanf with n times "%lf" would.
+
+@return the number of numbers parsed
+*/
+int text_parse_doubles(const char *str, int n, double *values);
+
+
+/** Format a double into buf, which must have room for TEXT_DOUBLE_SIZE
+characters. Large numbers in TEXT_FORMAT_FIXED fall back to snprintf and are
+cut to the size of the buffer.
+
+@return the number of characters written. No '\0' is added.
+*/
+int text_format_double(char *buf, double value, int format);
+
+
+/** Make an output of the given buffer size on a stream. Returns NULL if
+there was an error with allocation. Set the copy of the output to write the
+same characters to a second stream. */
+TEXT_OUT * text_out_new(FILE *file, size_t size);
+
+
+/** Add characters to an output */
+void text_out_write(TEXT_OUT *out, const char *str, size_t len);
+
+
+/** Add a '\0' terminated string to an output */
+void text_out_string(TEXT_OUT *out, const char *str);
+
+
+/** Add a character to an output */
+void text_out_char(TEXT_OUT *out, char c);
+
+
+/** Add a formatted double to an output */
+void text_out_double(TEXT_OUT *out, double value, int format);
+
+
+/** Write the buffer of an output to its streams.
+
+@return 0 if all went well, 1 if a write failed since the output was made
+*/
+int text_out_flush(TEXT_OUT *out);
+
+
+/** Flush an output and free its memory. Does not close the stream.
+
+@return 0 if all went well, 1 if a write failed since the output was made
+*/
+int text_out_free(TEXT_OUT *out);
+
+#endif